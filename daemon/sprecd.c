@@ -0,0 +1,100 @@
+/*
+ * sprecd.c
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ *
+ * Recognition daemon: lets the processes of a machine share one set of
+ * connections to the API, one cache and one pool of encoders (see
+ * client.h for the client side).
+ *
+ * Usage: sprecd [-s <socket>] [-n <max clients>] [-c <cache entries>]
+ *               [-d <disk cache>] [-e <encoders>] [-m <max connections>]
+ *               [-r <retries>] [-1]
+ *
+ * -1 disables HTTP/2, so that the connections use HTTP/1.1.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sprec/sprec.h>
+
+static sprec_server *server;
+
+static void on_signal(int sig)
+{
+	sprec_server_stop(server);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-s <socket>] [-n <max clients>] [-c <cache entries>]\n"
+		"       %*s [-d <disk cache>] [-e <encoders>] [-m <max connections>]\n"
+		"       %*s [-r <retries>] [-1]\n",
+		prog, (int)strlen(prog), "", (int)strlen(prog), "");
+}
+
+int main(int argc, char *argv[])
+{
+	sprec_server_options opts;
+	struct sigaction sa;
+	char path[256];
+	int opt, err;
+
+	sprec_server_options_init(&opts);
+
+	while ((opt = getopt(argc, argv, "s:n:c:d:e:m:r:1h")) != -1) {
+		switch (opt) {
+		case 's': opts.path = optarg; break;
+		case 'n': opts.max_clients = strtoul(optarg, NULL, 10); break;
+		case 'c': opts.cache_entries = strtoul(optarg, NULL, 10); break;
+		case 'd': opts.cache_path = optarg; break;
+		case 'e': opts.encoders = strtoul(optarg, NULL, 10); break;
+		case 'm': opts.http.max_connections = strtol(optarg, NULL, 10); break;
+		case 'r': opts.send.max_retries = strtoul(optarg, NULL, 10); break;
+		case '1': opts.http.http2 = 0; break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (sprec_init() != 0) {
+		fprintf(stderr, "%s: can't initialize libcurl\n", argv[0]);
+		return 1;
+	}
+
+	server = sprec_server_new(&opts);
+	if (server == NULL) {
+		err = errno;
+		if (opts.path != NULL) {
+			snprintf(path, sizeof path, "%s", opts.path);
+		} else if (sprec_client_socket_path(path, sizeof path) != 0) {
+			snprintf(path, sizeof path, "/tmp/sprecd-%lu/%s", (unsigned long)geteuid(), SPREC_DAEMON_SOCKET);
+		}
+		fprintf(stderr, "%s: can't listen on %s: %s\n", argv[0], path, strerror(err));
+		sprec_shutdown();
+		return 1;
+	}
+
+	memset(&sa, 0, sizeof sa);
+	sa.sa_handler = on_signal;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	/* a client going away mid-response mustn't take the daemon with it */
+	sa.sa_handler = SIG_IGN;
+	sigaction(SIGPIPE, &sa, NULL);
+
+	err = sprec_server_run(server);
+	sprec_server_free(server);
+	sprec_shutdown();
+
+	return err != 0;
+}
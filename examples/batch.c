@@ -0,0 +1,482 @@
+/*
+ * batch.c
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ *
+ * Transcribes a set of WAV files, several at a time, writing one JSON
+ * object per file (JSON Lines) and a throughput report at the end.
+ * With a journal, files finished by an earlier (interrupted) run are
+ * skipped, so a backfill can simply be restarted.
+ *
+ * Usage: batch -k <API key> [-l <language>] [-j <jobs>] [-r <journal>]
+ *              [-o <output>] <directory | file.wav | list file>...
+ *
+ * A directory is scanned for *.wav files; any other argument not
+ * ending in .wav is read as a list of files, one per line ("-" is
+ * the standard input).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sprec/sprec.h>
+
+/*
+ * Most workers (-j) allowed; the requests are bound by the network,
+ * and each worker holds a whole file and its encoded form in memory
+ */
+#define MAX_JOBS 256
+
+typedef struct string_list {
+	char **items;
+	size_t count;
+	size_t size;
+} string_list;
+
+static const char *error_names[] = {
+	"ok",
+	"record",
+	"encode",
+	"transport",
+	"http",
+	"cancelled",
+	"nomem"
+};
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static int compare_strings(const void *a, const void *b)
+{
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static int has_suffix(const char *s, const char *suffix)
+{
+	size_t n = strlen(s), m = strlen(suffix);
+
+	return n >= m && strcasecmp(s + n - m, suffix) == 0;
+}
+
+static int list_add(string_list *list, const char *s)
+{
+	char **tmp;
+
+	if (list->count == list->size) {
+		list->size = list->size ? list->size * 2 : 64;
+		tmp = realloc(list->items, list->size * sizeof list->items[0]);
+		if (tmp == NULL) {
+			return -1;
+		}
+		list->items = tmp;
+	}
+
+	list->items[list->count] = strdup(s);
+	if (list->items[list->count] == NULL) {
+		return -1;
+	}
+
+	list->count++;
+
+	return 0;
+}
+
+static void list_free(string_list *list)
+{
+	size_t i;
+
+	for (i = 0; i < list->count; i++) {
+		free(list->items[i]);
+	}
+
+	free(list->items);
+}
+
+/*
+ * Reads one path per line, ignoring empty lines
+ */
+static int read_lines(FILE *f, string_list *list)
+{
+	char line[4096];
+	size_t n;
+
+	while (fgets(line, sizeof line, f) != NULL) {
+		n = strlen(line);
+		while (n > 0 && (line[n - 1] == '\n' || line[n - 1] == '\r')) {
+			line[--n] = '\0';
+		}
+
+		if (n > 0 && list_add(list, line) != 0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int scan_directory(const char *path, string_list *list)
+{
+	struct dirent *ent;
+	char file[4096];
+	size_t first = list->count;
+	DIR *dir;
+
+	dir = opendir(path);
+	if (dir == NULL) {
+		return -1;
+	}
+
+	while ((ent = readdir(dir)) != NULL) {
+		if (!has_suffix(ent->d_name, ".wav")) {
+			continue;
+		}
+
+		snprintf(file, sizeof file, "%s/%s", path, ent->d_name);
+		if (list_add(list, file) != 0) {
+			closedir(dir);
+			return -1;
+		}
+	}
+
+	closedir(dir);
+
+	/* readdir() order is arbitrary */
+	qsort(list->items + first, list->count - first, sizeof list->items[0], compare_strings);
+
+	return 0;
+}
+
+static int collect_inputs(const char *arg, string_list *list)
+{
+	struct stat st;
+	FILE *f;
+	int err;
+
+	if (strcmp(arg, "-") == 0) {
+		return read_lines(stdin, list);
+	}
+
+	if (stat(arg, &st) != 0) {
+		return -1;
+	}
+
+	if (S_ISDIR(st.st_mode)) {
+		return scan_directory(arg, list);
+	}
+
+	if (has_suffix(arg, ".wav")) {
+		return list_add(list, arg);
+	}
+
+	f = fopen(arg, "r");
+	if (f == NULL) {
+		return -1;
+	}
+
+	err = read_lines(f, list);
+	fclose(f);
+
+	return err;
+}
+
+/*
+ * Length of the audio in the file in seconds, 0 if unknown
+ */
+static double audio_length(const char *path)
+{
+	sprec_wav_header *hdr;
+	uint32_t length;
+	double seconds = 0;
+	FILE *f;
+
+	f = fopen(path, "rb");
+	if (f == NULL) {
+		return 0;
+	}
+
+	if (sprec_wav_read_header(f, &hdr, &length) == 0) {
+		if (hdr->sample_rate > 0 && hdr->bytes_per_frame > 0) {
+			seconds = (double)length / hdr->sample_rate / hdr->bytes_per_frame;
+		}
+		sprec_free(hdr);
+	}
+
+	fclose(f);
+
+	return seconds;
+}
+
+static void write_json_string(FILE *f, const char *s)
+{
+	const unsigned char *p;
+
+	fputc('"', f);
+
+	for (p = (const unsigned char *)s; *p != '\0'; p++) {
+		switch (*p) {
+		case '"':	fputs("\\\"", f); break;
+		case '\\':	fputs("\\\\", f); break;
+		case '\n':	fputs("\\n", f); break;
+		case '\r':	fputs("\\r", f); break;
+		case '\t':	fputs("\\t", f); break;
+		default:
+			if (*p < 0x20) {
+				fprintf(f, "\\u%04x", *p);
+			} else {
+				fputc(*p, f);
+			}
+			break;
+		}
+	}
+
+	fputc('"', f);
+}
+
+static void write_result(FILE *out, const char *path, double seconds, const sprec_future_result *res)
+{
+	const sprec_result *result = res->resp ? &res->resp->result : NULL;
+
+	fputs("{\"file\":", out);
+	write_json_string(out, path);
+	fprintf(out, ",\"error\":\"%s\",\"status\":%ld", error_names[res->error], res->status);
+	fprintf(out, ",\"audio\":%.3f,\"queued\":%.3f,\"encoding\":%.3f,\"uploading\":%.3f",
+		seconds, res->queued, res->encoding, res->uploading);
+
+	if (result != NULL && result->count > 0) {
+		fputs(",\"transcript\":", out);
+		write_json_string(out, result->alternatives[0].transcript);
+		if (result->alternatives[0].confidence >= 0) {
+			fprintf(out, ",\"confidence\":%.4f", result->alternatives[0].confidence);
+		}
+	}
+
+	fputs("}\n", out);
+	fflush(out);
+}
+
+static double percentile(const double *sorted, size_t n, double p)
+{
+	if (n == 0) {
+		return 0;
+	}
+
+	return sorted[(size_t)(p * (n - 1) + 0.5)];
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s -k <API key> [-l <language>] [-j <jobs>] [-r <journal>]\n"
+		"       %*s [-o <output>] <directory | file.wav | list file>...\n",
+		prog, (int)strlen(prog), "");
+}
+
+int main(int argc, char *argv[])
+{
+	const char *apikey = NULL, *lang = "en-US";
+	const char *journal_path = NULL, *output_path = NULL;
+	string_list inputs = { NULL, 0, 0 }, done = { NULL, 0, 0 };
+	sprec_executor *exec;
+	sprec_future **window;
+	size_t *slots, nwindow, next, i, k, finished = 0, failed = 0, skipped = 0;
+	double *seconds, *latencies, audio_total = 0, started, elapsed;
+	FILE *out = stdout, *journal = NULL, *f;
+	long jobs;
+	char *end;
+	int opt;
+
+	jobs = sysconf(_SC_NPROCESSORS_ONLN);
+
+	while ((opt = getopt(argc, argv, "k:l:j:r:o:h")) != -1) {
+		switch (opt) {
+		case 'k': apikey = optarg; break;
+		case 'l': lang = optarg; break;
+		case 'j':
+			jobs = strtol(optarg, &end, 10);
+			if (*optarg == '\0' || *end != '\0' || jobs < 1 || jobs > MAX_JOBS) {
+				fprintf(stderr, "%s: -j must be between 1 and %d\n", argv[0], MAX_JOBS);
+				return 1;
+			}
+			break;
+		case 'r': journal_path = optarg; break;
+		case 'o': output_path = optarg; break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	/* sysconf() may fail, or report more CPUs than make sense */
+	if (jobs < 1) {
+		jobs = 1;
+	} else if (jobs > MAX_JOBS) {
+		jobs = MAX_JOBS;
+	}
+
+	if (apikey == NULL || optind >= argc) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	for (i = optind; i < (size_t)argc; i++) {
+		if (collect_inputs(argv[i], &inputs) != 0) {
+			fprintf(stderr, "%s: can't read %s\n", argv[0], argv[i]);
+			return 1;
+		}
+	}
+
+	/*
+	 * Skip what an earlier run has already done
+	 */
+	if (journal_path != NULL) {
+		f = fopen(journal_path, "r");
+		if (f != NULL) {
+			read_lines(f, &done);
+			fclose(f);
+			qsort(done.items, done.count, sizeof done.items[0], compare_strings);
+		}
+
+		journal = fopen(journal_path, "a");
+		if (journal == NULL) {
+			fprintf(stderr, "%s: can't open %s\n", argv[0], journal_path);
+			return 1;
+		}
+	}
+
+	if (output_path != NULL) {
+		/* appending, so that a resumed run adds to the earlier results */
+		out = fopen(output_path, journal ? "a" : "w");
+		if (out == NULL) {
+			fprintf(stderr, "%s: can't open %s\n", argv[0], output_path);
+			return 1;
+		}
+	}
+
+	exec = sprec_executor_new(jobs, NULL);
+	if (exec == NULL) {
+		fprintf(stderr, "%s: can't start the workers\n", argv[0]);
+		return 1;
+	}
+
+	/*
+	 * Twice as many files in flight as there are workers keeps every
+	 * worker busy without queueing up the whole input at once
+	 */
+	nwindow = 2 * jobs;
+	window = calloc(nwindow, sizeof window[0]);
+	slots = calloc(nwindow, sizeof slots[0]);
+	seconds = calloc(inputs.count + 1, sizeof seconds[0]);
+	latencies = calloc(inputs.count + 1, sizeof latencies[0]);
+	if (window == NULL || slots == NULL || seconds == NULL || latencies == NULL) {
+		fprintf(stderr, "%s: out of memory\n", argv[0]);
+		return 1;
+	}
+
+	started = now();
+	next = 0;
+	k = 0;
+
+	for (;;) {
+		while (k < nwindow && next < inputs.count) {
+			const char *path = inputs.items[next];
+
+			if (done.count > 0 && bsearch(&path, done.items, done.count, sizeof done.items[0], compare_strings)) {
+				skipped++;
+				next++;
+				continue;
+			}
+
+			seconds[next] = audio_length(path);
+			window[k] = sprec_future_recognize_file(exec, path, apikey, lang);
+			if (window[k] == NULL) {
+				fprintf(stderr, "%s: can't queue %s\n", argv[0], path);
+				next++;
+				failed++;
+				continue;
+			}
+
+			slots[k++] = next++;
+		}
+
+		if (k == 0) {
+			break;
+		}
+
+		sprec_future_wait_any(window, k, -1, &i);
+
+		{
+			const sprec_future_result *res = sprec_future_get(window[i]);
+			const char *path = inputs.items[slots[i]];
+
+			write_result(out, path, seconds[slots[i]], res);
+
+			if (res->error == SPREC_FUTURE_OK) {
+				latencies[finished++] = res->encoding + res->uploading;
+				audio_total += seconds[slots[i]];
+
+				if (journal != NULL) {
+					fprintf(journal, "%s\n", path);
+					fflush(journal);
+				}
+			} else {
+				failed++;
+			}
+		}
+
+		sprec_future_free(window[i]);
+
+		/* keep the window dense */
+		window[i] = window[--k];
+		slots[i] = slots[k];
+	}
+
+	elapsed = now() - started;
+	sprec_executor_free(exec);
+
+	qsort(latencies, finished, sizeof latencies[0], compare_doubles);
+
+	fprintf(stderr, "%zu done, %zu failed, %zu skipped in %.1f s\n", finished, failed, skipped, elapsed);
+	if (elapsed > 0) {
+		fprintf(stderr, "%.2f files/s, %.2f audio s/s\n", finished / elapsed, audio_total / elapsed);
+	}
+	fprintf(stderr, "latency p50 %.3f s, p90 %.3f s, p99 %.3f s\n",
+		percentile(latencies, finished, 0.50),
+		percentile(latencies, finished, 0.90),
+		percentile(latencies, finished, 0.99));
+
+	if (journal != NULL) {
+		fclose(journal);
+	}
+
+	if (out != stdout) {
+		fclose(out);
+	}
+
+	free(window);
+	free(slots);
+	free(seconds);
+	free(latencies);
+	list_free(&inputs);
+	list_free(&done);
+
+	return failed > 0;
+}
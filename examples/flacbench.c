@@ -0,0 +1,270 @@
+/*
+ * flacbench.c
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ *
+ * Compares the FLAC encoding of one long recording by a single encoder
+ * with the parallel encoder, on 1, 2, 4... threads up to the number of
+ * processors. Every parallel stream must be the same, byte for byte,
+ * and describe the same audio (number of samples and MD5 signature)
+ * as the serial one.
+ *
+ * Usage: flacbench [-l <level>] [-s <seconds>] [-r <rate>] [-c <channels>]
+ *                  [-n <runs>] [file.wav]
+ *
+ * Without a file, `seconds' of synthetic audio (default 600) are used.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sprec/sprec.h>
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-l <level>] [-s <seconds>] [-r <rate>] [-c <channels>]\n"
+		"       %*s [-n <runs>] [file.wav]\n",
+		prog, (int)strlen(prog), "");
+}
+
+/*
+ * A few drifting tones in a little noise, which compresses about as
+ * badly as speech does
+ */
+static int16_t *synthesize(size_t frames, uint32_t rate, uint32_t channels)
+{
+	int16_t *pcm;
+	size_t i, c;
+	double t, x;
+	uint32_t state = 1;
+
+	pcm = malloc(frames * channels * sizeof pcm[0]);
+	if (pcm == NULL) {
+		return NULL;
+	}
+
+	for (i = 0; i < frames; i++) {
+		t = (double)i / rate;
+
+		for (c = 0; c < channels; c++) {
+			state = state * 1664525 + 1013904223;
+			x = 6000 * sin(2 * M_PI * (220 + 30 * sin(t / 3) + 50 * c) * t)
+			  + 3000 * sin(2 * M_PI * 1375 * t + c)
+			  + (int32_t)(state >> 16) % 800 - 400;
+			pcm[i * channels + c] = x;
+		}
+	}
+
+	return pcm;
+}
+
+static void *read_wav(const char *path, size_t *frames, uint32_t *rate, uint32_t *channels, sprec_pcm_format *fmt)
+{
+	sprec_wav_header *hdr;
+	uint32_t length;
+	void *pcm;
+	FILE *f;
+	int err;
+
+	f = fopen(path, "rb");
+	if (f == NULL) {
+		return NULL;
+	}
+
+	if (sprec_wav_read_header(f, &hdr, &length) != 0) {
+		fclose(f);
+		return NULL;
+	}
+
+	err = hdr->bytes_per_frame == 0 || sprec_pcm_format_from_wav(hdr, fmt) != 0;
+	pcm = err ? NULL : malloc(length + 1);
+
+	if (pcm != NULL && fread(pcm, 1, length, f) != length) {
+		free(pcm);
+		pcm = NULL;
+	}
+
+	if (pcm != NULL) {
+		*frames = length / hdr->bytes_per_frame;
+		*rate = hdr->sample_rate;
+		*channels = hdr->number_of_channels;
+	}
+
+	sprec_free(hdr);
+	fclose(f);
+
+	return pcm;
+}
+
+int main(int argc, char *argv[])
+{
+	sprec_flac_parallel_options opts;
+	sprec_encoder_options enc_opts;
+	sprec_encoder *enc;
+	sprec_pcm_format fmt = SPREC_PCM_S16LE;
+	unsigned char streaminfo[SPREC_FLAC_STREAMINFO_SIZE];
+	unsigned char *first = NULL, *flac;
+	const void *serial;
+	void *pcm;
+	double seconds = 600, best, started, elapsed, serial_time;
+	uint32_t rate = 16000, channels = 1;
+	size_t frames, size, serial_size, first_size = 0;
+	long ncpu, threads, runs = 3, i;
+	int opt, failed = 0;
+
+	sprec_flac_parallel_options_init(&opts);
+
+	while ((opt = getopt(argc, argv, "l:s:r:c:n:h")) != -1) {
+		switch (opt) {
+		case 'l': opts.level = strtoul(optarg, NULL, 10); break;
+		case 's': seconds = strtod(optarg, NULL); break;
+		case 'r': rate = strtoul(optarg, NULL, 10); break;
+		case 'c': channels = strtoul(optarg, NULL, 10); break;
+		case 'n': runs = strtol(optarg, NULL, 10); break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (seconds <= 0 || rate == 0 || channels == 0 || channels > 8 || runs < 1 || optind < argc - 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (optind < argc) {
+		pcm = read_wav(argv[optind], &frames, &rate, &channels, &fmt);
+		if (pcm == NULL) {
+			fprintf(stderr, "%s: can't read %s\n", argv[0], argv[optind]);
+			return 1;
+		}
+	} else {
+		frames = seconds * rate;
+		pcm = synthesize(frames, rate, channels);
+		if (pcm == NULL) {
+			fprintf(stderr, "%s: out of memory\n", argv[0]);
+			return 1;
+		}
+	}
+
+	printf("%.1f s of audio, %u Hz, %u channel(s), level %u\n",
+		(double)frames / rate, rate, channels, opts.level);
+
+	/*
+	 * The reference: one encoder, one stream
+	 */
+	sprec_encoder_options_init(&enc_opts);
+	enc_opts.level = opts.level;
+
+	enc = sprec_encoder_new_ex(&enc_opts);
+	if (enc == NULL) {
+		fprintf(stderr, "%s: can't create an encoder\n", argv[0]);
+		return 1;
+	}
+
+	best = 0;
+	serial_size = 0;
+
+	for (i = 0; i < runs; i++) {
+		started = now();
+
+		if (sprec_encoder_stream_begin(enc, rate, channels, fmt) != 0
+		 || sprec_encoder_stream_write(enc, pcm, frames) != 0
+		 || sprec_encoder_stream_end(enc, streaminfo, &serial, &serial_size) != 0) {
+			fprintf(stderr, "%s: serial encoding failed\n", argv[0]);
+			return 1;
+		}
+
+		elapsed = now() - started;
+		if (i == 0 || elapsed < best) {
+			best = elapsed;
+		}
+	}
+
+	serial_time = best;
+	printf("%-10s %8.3f s %8.1fx realtime %10zu bytes\n",
+		"serial", serial_time, frames / (rate * serial_time), serial_size);
+
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ncpu < 1) {
+		ncpu = 1;
+	}
+
+	for (threads = 1; ; threads = threads * 2 < ncpu ? threads * 2 : ncpu) {
+		opts.threads = threads;
+		best = 0;
+
+		for (i = 0; i < runs; i++) {
+			started = now();
+			flac = sprec_flac_encode_parallel(pcm, frames, rate, channels, fmt, &opts, &size);
+			elapsed = now() - started;
+
+			if (flac == NULL) {
+				fprintf(stderr, "%s: parallel encoding failed\n", argv[0]);
+				return 1;
+			}
+
+			if (i == 0 || elapsed < best) {
+				best = elapsed;
+			}
+
+			if (first == NULL) {
+				first = flac;
+				first_size = size;
+				continue;
+			}
+
+			if (size != first_size || memcmp(flac, first, size) != 0) {
+				fprintf(stderr, "%ld thread(s): the stream differs\n", threads);
+				failed = 1;
+			}
+
+			sprec_free(flac);
+		}
+
+		printf("%-2ld threads %8.3f s %8.1fx realtime %10zu bytes, %.2fx faster\n",
+			threads, best, frames / (rate * best), first_size, serial_time / best);
+
+		if (threads == ncpu) {
+			break;
+		}
+	}
+
+	/*
+	 * Total samples (36 bits from byte 13) and MD5 signature (byte 18).
+	 * Audio converted to 16 bits is dithered differently, so only the
+	 * lengths can be compared.
+	 */
+	if ((streaminfo[13] & 0x0f) != (first[SPREC_FLAC_STREAMINFO_OFFSET + 13] & 0x0f)
+	 || memcmp(streaminfo + 14, first + SPREC_FLAC_STREAMINFO_OFFSET + 14, 4) != 0) {
+		fprintf(stderr, "the parallel stream has a different number of samples\n");
+		failed = 1;
+	} else if (sprec_pcm_sample_size(fmt) > 2) {
+		printf("STREAMINFO: same number of samples\n");
+	} else if (memcmp(streaminfo + 18, first + SPREC_FLAC_STREAMINFO_OFFSET + 18, 16) != 0) {
+		fprintf(stderr, "the parallel stream has a different MD5 signature\n");
+		failed = 1;
+	} else {
+		printf("STREAMINFO: same number of samples and MD5 signature\n");
+	}
+
+	sprec_free(first);
+	sprec_encoder_free(enc);
+	free(pcm);
+
+	return failed;
+}
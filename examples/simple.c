@@ -13,9 +13,13 @@
 
 int main(int argc, char *argv[])
 {
-	char *res = sprec_recognize_sync(argv[1], argv[2], strtod(argv[3], NULL));
+	char *res;
+
+	sprec_init();
+	res = sprec_recognize_sync(argv[1], argv[2], strtod(argv[3], NULL));
 	printf("%s\n", res);
-	free(res);
+	sprec_free(res);
+	sprec_shutdown();
 	return 0;
 }
 
@@ -32,9 +36,11 @@ int main(int argc, char *argv[])
 	pthread_t pid;
 	void *retval;
 
+	sprec_init();
 	pid = sprec_recognize_async(argv[1], argv[2], strtod(argv[3], NULL), callback, NULL);
 	printf("Thread: %lld\n", (long long)pthread_self());
 	pthread_join(pid, &retval);
+	sprec_shutdown();
 	return 0;
 }
 
@@ -0,0 +1,115 @@
+/*
+ * adaptive.h
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#ifndef __SPREC_ADAPTIVE_H__
+#define __SPREC_ADAPTIVE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <sprec/web_client.h>
+#include <sprec/pcm.h>
+
+/*
+ * Picks the format of each request so as to get the audio to the API
+ * the soonest: raw L16 when the CPU is the bottleneck (it costs nothing
+ * to produce but is about twice as large), FLAC at a low or high
+ * compression level when the uplink is. The choice is based on moving
+ * averages of the throughput of the encoder at each level, of the
+ * compression it achieves and of the upload bandwidth, all measured on
+ * the previous requests.
+ *
+ * The audio is sent as 16 bit mono, whatever its original format.
+ */
+#define SPREC_ADAPTIVE_CHOICES 4
+
+typedef struct sprec_adaptive sprec_adaptive;
+
+typedef struct sprec_adaptive_options {
+	double smoothing;	/* weight of the latest measurement in the
+				 * averages, default 0.2 */
+	unsigned explore;	/* every `explore' requests, the choice
+				 * measured the longest ago is tried again,
+				 * to follow changes of conditions;
+				 * default 32, 0 for never */
+	int allow_l16;		/* default 1 */
+	unsigned min_level;	/* FLAC levels considered among 0, 5 and 8; */
+	unsigned max_level;	/* default 0 and 8 */
+} sprec_adaptive_options;
+
+void sprec_adaptive_options_init(sprec_adaptive_options *opts);
+
+typedef struct sprec_adaptive_choice {
+	sprec_audio_encoding encoding;
+	unsigned level;		/* for FLAC */
+	int enabled;		/* by the options */
+	double encode_rate;	/* bytes of 16 bit PCM encoded per second,
+				 * 0 if not measured (or L16) */
+	double ratio;		/* size of the payload relative to the PCM */
+	double estimate;	/* seconds to encode and upload the last
+				 * request this way, 0 if unknown */
+	uint64_t chosen;
+} sprec_adaptive_choice;
+
+typedef struct sprec_adaptive_metrics {
+	double upload_rate;	/* bytes per second, 0 if not measured */
+	uint64_t requests;
+	int last;		/* index of the last choice, -1 if none */
+	sprec_adaptive_choice choices[SPREC_ADAPTIVE_CHOICES];
+} sprec_adaptive_metrics;
+
+/*
+ * If `opts' is NULL, the defaults are used. Returns NULL on error.
+ */
+sprec_adaptive *sprec_adaptive_new(const sprec_adaptive_options *opts);
+
+void sprec_adaptive_free(sprec_adaptive *ad);
+
+/*
+ * Sends `frames' frames of interleaved PCM data in the format `fmt',
+ * in whichever way is estimated to be the fastest, as
+ * sprec_send_audio_data_ex() would with `send' (NULL for the defaults;
+ * its `encoding' and `stats' are ignored). May be called from several
+ * threads at once. Returns NULL on error.
+ */
+sprec_server_response *sprec_adaptive_send_pcm(
+	sprec_adaptive *ad,
+	const void *data,
+	size_t frames,
+	uint32_t rate,
+	uint32_t channels,
+	sprec_pcm_format fmt,
+	const char *apikey,
+	const char *language,
+	const sprec_send_options *send
+);
+
+/*
+ * Same as sprec_adaptive_send_pcm(), for the WAV file at `wavfile'
+ */
+sprec_server_response *sprec_adaptive_recognize_file(
+	sprec_adaptive *ad,
+	const char *wavfile,
+	const char *apikey,
+	const char *language,
+	const sprec_send_options *send
+);
+
+/*
+ * Copies the current measurements and decisions to `metrics'
+ */
+void sprec_adaptive_get_metrics(sprec_adaptive *ad, sprec_adaptive_metrics *metrics);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !__SPREC_ADAPTIVE_H__ */
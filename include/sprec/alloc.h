@@ -0,0 +1,127 @@
+/*
+ * alloc.h
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#ifndef __SPREC_ALLOC_H__
+#define __SPREC_ALLOC_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stddef.h>
+
+/*
+ * Memory allocation hooks.
+ *
+ * Every allocation made by libsprec itself goes through an allocator.
+ * The allocator in effect for a thread is the one set for that thread
+ * with sprec_set_thread_allocator(), or else the global one set with
+ * sprec_set_allocator(), or else the C library's malloc() family.
+ *
+ * Long-lived objects (encoder contexts and pools, caches, schedulers,
+ * etc.) remember the allocator in effect when they were created and use
+ * it for their whole lifetime, regardless of the thread they are used
+ * from. Everything else (responses, headers, strings and buffers
+ * returned to the caller) is allocated with the allocator in effect for
+ * the calling thread, and must be freed with sprec_free() (or the
+ * corresponding *_free() function) while that allocator is in effect.
+ * With the default allocator, free() works too.
+ *
+ * libcurl and libFLAC do their own internal allocations, which
+ * these hooks don't cover.
+ */
+typedef struct sprec_allocator {
+	void *(*malloc)(size_t size, void *ctx);
+	void *(*realloc)(void *ptr, size_t size, void *ctx);
+	void (*free)(void *ptr, void *ctx);
+	void *ctx;
+} sprec_allocator;
+
+/*
+ * Sets the global allocator (the structure is copied).
+ * NULL restores the default. This should be done before any other
+ * libsprec function is called, as memory allocated with the previous
+ * allocator can't be freed with the new one.
+ */
+void sprec_set_allocator(const sprec_allocator *alloc);
+
+/*
+ * Sets the allocator for the calling thread only, overriding the global
+ * one. The structure is *not* copied; it must stay valid as long as it
+ * is set. NULL reverts the thread to the global allocator.
+ */
+void sprec_set_thread_allocator(const sprec_allocator *alloc);
+
+/*
+ * Copies the allocator in effect for the calling thread into `alloc'
+ */
+void sprec_get_allocator(sprec_allocator *alloc);
+
+/*
+ * Allocation functions using the allocator in effect for the calling
+ * thread. They behave like their C library counterparts.
+ */
+void *sprec_malloc(size_t size);
+void *sprec_calloc(size_t count, size_t size);
+void *sprec_realloc(void *ptr, size_t size);
+void sprec_free(void *ptr);
+char *sprec_strdup(const char *str);
+
+/*
+ * Allocation functions using a specific allocator
+ */
+void *sprec_allocator_malloc(const sprec_allocator *alloc, size_t size);
+void *sprec_allocator_calloc(const sprec_allocator *alloc, size_t count, size_t size);
+void *sprec_allocator_realloc(const sprec_allocator *alloc, void *ptr, size_t size);
+void sprec_allocator_free(const sprec_allocator *alloc, void *ptr);
+char *sprec_allocator_strdup(const sprec_allocator *alloc, const char *str);
+
+/*
+ * Arena (region) allocator. Memory is handed out from large chunks and
+ * is never freed individually; sprec_arena_reset() releases everything
+ * allocated from the arena at once. Typical use is to set an arena as
+ * the thread allocator for the duration of one recognition, copy out
+ * the result, then reset the arena.
+ *
+ * An arena must not be used by more than one thread at a time, so it
+ * shouldn't be in effect when calling functions that allocate from
+ * worker threads on behalf of the caller (sprec_recognize_long()).
+ */
+typedef struct sprec_arena sprec_arena;
+
+/*
+ * Creates an arena allocating chunks of `chunk_size' bytes (or larger,
+ * for larger requests). The arena itself and its chunks are allocated
+ * using the allocator in effect for the calling thread.
+ * Returns NULL on error.
+ */
+sprec_arena *sprec_arena_new(size_t chunk_size);
+
+/*
+ * Releases every allocation made from the arena. The first chunk
+ * is kept, so a reused arena doesn't need to allocate again.
+ */
+void sprec_arena_reset(sprec_arena *arena);
+
+void sprec_arena_free(sprec_arena *arena);
+
+/*
+ * Returns the allocator interface of the arena, for use with
+ * sprec_set_thread_allocator(). It is valid as long as the arena is.
+ */
+const sprec_allocator *sprec_arena_allocator(sprec_arena *arena);
+
+/*
+ * Number of bytes currently allocated from the arena
+ */
+size_t sprec_arena_used(const sprec_arena *arena);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !__SPREC_ALLOC_H__ */
@@ -0,0 +1,103 @@
+/*
+ * archive.h
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#ifndef __SPREC_ARCHIVE_H__
+#define __SPREC_ARCHIVE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <sprec/pcm.h>
+
+/*
+ * Archival of captured audio to a WAV or FLAC file, off the capture
+ * thread. The frames handed to sprec_archive_write() are copied into a
+ * queue, and a thread of the archive's own writes them out in large
+ * blocks (and encodes them, for FLAC), reserving disk space well ahead
+ * where the system allows. The caller never waits for the disk: if the
+ * writer falls so far behind that the queue is full, the frames which
+ * don't fit are dropped and counted. The header is written with the
+ * true length of the audio when the archive is closed.
+ *
+ * A WAV file can't be larger than 4 GiB (its sizes are 32 bits). Once
+ * an archive in this format is full, no more frames are accepted and
+ * they are counted as `truncated'; start a new archive to go on, or
+ * use FLAC for recordings this long.
+ */
+typedef struct sprec_archive sprec_archive;
+
+typedef enum sprec_archive_format {
+	SPREC_ARCHIVE_WAV,	/* the samples as they are */
+	SPREC_ARCHIVE_FLAC	/* converted as for recognition, see pcm.h */
+} sprec_archive_format;
+
+typedef struct sprec_archive_options {
+	sprec_archive_format format;	/* default SPREC_ARCHIVE_WAV */
+	double queue_length;		/* seconds of audio the queue holds,
+					 * default 10 */
+	size_t block_size;		/* bytes written at a time, default 1 MB;
+					 * whatever is queued is also written
+					 * every second */
+	double preallocate;		/* seconds of audio to reserve disk
+					 * space for at a time, default 600;
+					 * 0 for none */
+	unsigned level;			/* FLAC compression level, default 5 */
+} sprec_archive_options;
+
+typedef struct sprec_archive_stats {
+	uint64_t frames;		/* frames queued */
+	uint64_t dropped;		/* frames dropped, the queue being full */
+	uint64_t truncated;		/* frames refused, a WAV file being full */
+	uint64_t bytes;			/* bytes written to the file */
+	size_t queue_peak;		/* most bytes ever waiting in the queue */
+} sprec_archive_stats;
+
+void sprec_archive_options_init(sprec_archive_options *opts);
+
+/*
+ * Creates the file `filename' for audio in the given format, and starts
+ * the writer. If `opts' is NULL, the defaults are used.
+ * Returns NULL on error.
+ */
+sprec_archive *sprec_archive_open(
+	const char *filename,
+	uint32_t rate,
+	uint32_t channels,
+	sprec_pcm_format fmt,
+	const sprec_archive_options *opts
+);
+
+/*
+ * Queues `frames' frames of interleaved audio. Never blocks on the
+ * writer, and may be called from a capture callback. Returns the number
+ * of frames queued; the rest are dropped, or refused if the file is
+ * full (see `truncated' in sprec_archive_stats).
+ */
+size_t sprec_archive_write(sprec_archive *ar, const void *pcm, size_t frames);
+
+/*
+ * Copies the statistics of the archive so far to `stats'
+ */
+void sprec_archive_get_stats(sprec_archive *ar, sprec_archive_stats *stats);
+
+/*
+ * Writes out everything still queued, completes the header, flushes
+ * the file to the disk and frees the archive. If `stats' isn't NULL,
+ * the final statistics are stored there. Returns 0 if all the audio
+ * queued is in the file, non-0 on an error of the writer.
+ */
+int sprec_archive_close(sprec_archive *ar, sprec_archive_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !__SPREC_ARCHIVE_H__ */
@@ -0,0 +1,112 @@
+/*
+ * async.h
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#ifndef __SPREC_ASYNC_H__
+#define __SPREC_ASYNC_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <sprec/web_client.h>
+
+/*
+ * Uploads driven by the caller's event loop (epoll, libev, libuv...).
+ *
+ * Nothing here blocks or starts a thread. libsprec tells the loop which
+ * sockets to watch and when it wants a timer through two callbacks; the
+ * loop reports the activity back with sprec_async_socket_action() and
+ * sprec_async_timeout(), and the requests are completed (and their
+ * callbacks called) from within those two functions. Any number of
+ * requests can be in flight on a single thread.
+ *
+ * A sprec_async must only be used from one thread at a time.
+ */
+typedef struct sprec_async sprec_async;
+
+/*
+ * Events of a socket, as a bit mask
+ */
+#define SPREC_POLL_IN		1
+#define SPREC_POLL_OUT		2
+#define SPREC_POLL_ERR		4	/* only passed to sprec_async_socket_action() */
+#define SPREC_POLL_REMOVE	8	/* only passed to the socket callback */
+
+/*
+ * `fd' should be watched for the events in `what' from now on,
+ * or no longer at all if it is SPREC_POLL_REMOVE
+ */
+typedef void (*sprec_async_socket_callback)(int fd, int what, void *ctx);
+
+/*
+ * sprec_async_timeout() should be called `timeout_ms' milliseconds
+ * from now (0 means as soon as possible), replacing any earlier timer.
+ * -1 means the timer should be cancelled.
+ */
+typedef void (*sprec_async_timer_callback)(long timeout_ms, void *ctx);
+
+/*
+ * Receives the response of a request, or NULL if it failed.
+ * The response should be freed with sprec_free_response().
+ */
+typedef void (*sprec_async_callback)(sprec_server_response *resp, void *ctx);
+
+/*
+ * Returns NULL on error
+ */
+sprec_async *sprec_async_new(
+	sprec_async_socket_callback socket_cb,
+	sprec_async_timer_callback timer_cb,
+	void *ctx
+);
+
+/*
+ * Cancels the requests in flight (without calling their callbacks)
+ * and frees `async'. Must not be called from one of the callbacks.
+ */
+void sprec_async_free(sprec_async *async);
+
+/*
+ * Starts uploading `length' bytes of FLAC audio, which must stay valid
+ * until `cb' is called. No retries or hedging are done; see
+ * sprec_send_audio_data_ex() for those. Returns 0 on success, non-0 on
+ * error, in which case `cb' won't be called.
+ */
+int sprec_async_send(
+	sprec_async *async,
+	const void *data,
+	size_t length,
+	const char *apikey,
+	const char *language,
+	uint32_t sample_rate,
+	sprec_async_callback cb,
+	void *ctx
+);
+
+/*
+ * Reports the events in `what' (SPREC_POLL_IN, _OUT, _ERR) on `fd'
+ */
+void sprec_async_socket_action(sprec_async *async, int fd, int what);
+
+/*
+ * Reports that the timer set by the timer callback has expired
+ */
+void sprec_async_timeout(sprec_async *async);
+
+/*
+ * Number of requests in flight
+ */
+size_t sprec_async_pending(const sprec_async *async);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !__SPREC_ASYNC_H__ */
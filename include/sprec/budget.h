@@ -0,0 +1,142 @@
+/*
+ * budget.h
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#ifndef __SPREC_BUDGET_H__
+#define __SPREC_BUDGET_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Process-wide memory budget.
+ *
+ * Before it starts, every recognition reserves the memory it may need
+ * at once: the audio it records or reads, its encoded form and the
+ * response (see sprec_budget_estimate()). This covers sprec_recognize_*,
+ * futures, long recordings (for all their segments in flight), fanout,
+ * the adaptive encoder, the daemon and the spool drainer. The listener
+ * reserves its capture buffers for as long as it listens. All
+ * reservations are charged against one limit, each operation taking a
+ * single one, so that none waits for memory while holding some.
+ *
+ * The functions which only send encoded audio given by the caller
+ * (sprec_send_audio_data*(), the async client and the HTTP pool) are
+ * the transport of the above, and aren't charged themselves: the audio
+ * belongs to the caller, and the recognition using them has reserved
+ * for the response already. Buffers of libcurl and libFLAC aren't
+ * counted either. The sizes are estimates made before the work starts;
+ * this is admission control, not accounting of every allocation.
+ *
+ * A recognition which doesn't fit is handled according to the policy:
+ *
+ *  - SPREC_BUDGET_BLOCK: it waits, at most `timeout' seconds, for
+ *    memory to be released. Higher priorities are admitted first,
+ *    in order of arrival among equal ones.
+ *  - SPREC_BUDGET_REJECT: it fails at once.
+ *  - SPREC_BUDGET_SHED: reservations of lower priority are asked to
+ *    give up (see sprec_reservation_shed()), and it waits for them as
+ *    with SPREC_BUDGET_BLOCK. It fails at once if even shedding all of
+ *    them wouldn't make room.
+ *
+ * Recognitions which fail this way fail as if memory had run out:
+ * they return NULL or an error, futures report SPREC_FUTURE_ERR_NOMEM
+ * and the daemon SPREC_CLIENT_ERR_NOMEM, and the drainer keeps the entry
+ * for later. All but sprec_recognize_*_ex() use priority 0. Without a
+ * limit (the default), reservations always succeed and are only counted.
+ */
+
+/*
+ * Allowance for a response (the JSON and its parsed form), in bytes
+ */
+#define SPREC_BUDGET_RESPONSE 0x10000
+
+typedef enum sprec_budget_policy {
+	SPREC_BUDGET_BLOCK,
+	SPREC_BUDGET_REJECT,
+	SPREC_BUDGET_SHED
+} sprec_budget_policy;
+
+typedef struct sprec_budget_options {
+	size_t limit;			/* bytes, default 0: no limit */
+	sprec_budget_policy policy;	/* default SPREC_BUDGET_BLOCK */
+	double timeout;			/* seconds a reservation may wait,
+					 * default 10; negative for ever */
+} sprec_budget_options;
+
+typedef struct sprec_budget_stats {
+	size_t limit;
+	size_t used;		/* bytes reserved */
+	size_t peak;		/* most bytes ever reserved at once */
+	size_t active;		/* reservations held */
+	size_t waiting;		/* reservations waiting for memory */
+	uint64_t granted;
+	uint64_t blocked;	/* had to wait (and were granted or not) */
+	uint64_t rejected;	/* including those which timed out */
+	uint64_t shed;		/* asked to give up for a higher priority */
+} sprec_budget_stats;
+
+/*
+ * A reservation. The members are private.
+ */
+typedef struct sprec_reservation {
+	size_t bytes;
+	int priority;
+	int state;
+	int shed;
+	uint64_t ticket;
+	struct sprec_reservation *prev;
+	struct sprec_reservation *next;
+} sprec_reservation;
+
+void sprec_budget_options_init(sprec_budget_options *opts);
+
+/*
+ * Sets the budget (the structure is copied). NULL removes the limit.
+ * Reservations already held are kept, even over a lower limit.
+ * Returns 0 on success, non-0 if the options are invalid.
+ */
+int sprec_budget_configure(const sprec_budget_options *opts);
+
+/*
+ * Copies the gauges and counters of the budget to `stats'
+ */
+void sprec_budget_get_stats(sprec_budget_stats *stats);
+
+/*
+ * Memory a recognition of `pcm_bytes' bytes of audio may hold at once:
+ * the audio, its encoded form (as large as the audio, at worst) and
+ * the response
+ */
+size_t sprec_budget_estimate(size_t pcm_bytes);
+
+/*
+ * Reserves `bytes' bytes, applying the policy if they don't fit.
+ * Returns 0 once the reservation is held, non-0 if it was refused.
+ */
+int sprec_budget_reserve(sprec_reservation *res, size_t bytes, int priority);
+
+/*
+ * Returns non-0 if the holder of `res' has been asked to give up its
+ * memory to a recognition of higher priority. Recognitions check this
+ * between stages (before encoding, before uploading) and fail if so.
+ */
+int sprec_reservation_shed(sprec_reservation *res);
+
+/*
+ * Gives the reserved memory back. Does nothing if `res' isn't held.
+ */
+void sprec_budget_release(sprec_reservation *res);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !__SPREC_BUDGET_H__ */
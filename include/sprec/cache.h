@@ -0,0 +1,106 @@
+/*
+ * cache.h
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#ifndef __SPREC_CACHE_H__
+#define __SPREC_CACHE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <sprec/web_client.h>
+
+/*
+ * Content-addressed cache of recognition results.
+ *
+ * Entries are keyed by a 128-bit hash of the audio payload (PCM or FLAC,
+ * whatever the caller has at hand) and the language code. There is an
+ * in-memory LRU tier and an optional on-disk tier, which is a fixed-size
+ * file mapped into memory, so results survive restarts. The hash is fast
+ * but not cryptographic; don't share a cache file with untrusted parties.
+ *
+ * All functions are thread-safe.
+ */
+typedef struct sprec_cache sprec_cache;
+
+typedef struct sprec_cache_stats {
+	uint64_t hits;		/* served from memory */
+	uint64_t disk_hits;	/* served from the disk tier */
+	uint64_t misses;
+	uint64_t stores;
+	size_t entries;		/* currently in memory */
+} sprec_cache_stats;
+
+/*
+ * Creates a cache holding at most `max_entries' results in memory.
+ * If `disk_path' is not NULL, the file is created (or reopened) and
+ * used as a second tier with room for `disk_slots' results of at most
+ * SPREC_CACHE_DISK_VALUE_MAX bytes each.
+ * Returns NULL on error.
+ */
+sprec_cache *sprec_cache_new(size_t max_entries, const char *disk_path, size_t disk_slots);
+
+/*
+ * Flushes the disk tier and releases every resource held by `cache'.
+ */
+void sprec_cache_free(sprec_cache *cache);
+
+/*
+ * Looks up the result for `data' recognized in `language'.
+ * On a hit, returns a new response (JSON and parsed result) which
+ * should be freed with sprec_free_response(). Returns NULL on a miss.
+ */
+sprec_server_response *sprec_cache_lookup(
+	sprec_cache *cache,
+	const void *data,
+	size_t length,
+	const char *language
+);
+
+/*
+ * Remembers `resp' as the result for `data' recognized in `language'.
+ * Returns 0 on success, non-0 on error.
+ */
+int sprec_cache_store(
+	sprec_cache *cache,
+	const void *data,
+	size_t length,
+	const char *language,
+	const sprec_server_response *resp
+);
+
+/*
+ * Same as sprec_send_audio_data(), but consults `cache' first (keyed
+ * by the FLAC data) and stores successful results in it afterwards.
+ * Responses without any recognized alternative are not cached.
+ * If `cache' is NULL, this is just sprec_send_audio_data().
+ */
+sprec_server_response *
+sprec_send_audio_data_cached(
+	sprec_cache *cache,
+	const void *data,
+	size_t length,
+	const char *apikey,
+	const char *language,
+	uint32_t sample_rate
+);
+
+void sprec_cache_get_stats(sprec_cache *cache, sprec_cache_stats *stats);
+
+/*
+ * Largest JSON response that fits in a slot of the disk tier
+ */
+#define SPREC_CACHE_DISK_VALUE_MAX 2000
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !__SPREC_CACHE_H__ */
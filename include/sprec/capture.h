@@ -0,0 +1,227 @@
+/*
+ * capture.h
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#ifndef __SPREC_CAPTURE_H__
+#define __SPREC_CAPTURE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <poll.h>
+
+#include <sprec/pcm.h>
+
+/*
+ * Audio capture which keeps the device open and delivers the audio in
+ * periods, without gaps, until it is stopped. ALSA on Linux and the
+ * like, Audio Queue Services on OS X and iOS.
+ */
+typedef struct sprec_capture sprec_capture;
+
+typedef struct sprec_capture_params {
+	const char *device;		/* ALSA device name, default "default" */
+	uint32_t sample_rate;		/* default 16000 */
+	uint32_t channels;		/* default 2 */
+	sprec_pcm_format format;	/* default SPREC_PCM_S16LE */
+	double period;			/* seconds per callback, default 0.02 */
+	int realtime;			/* SCHED_FIFO priority of the capture
+					 * thread, 1 to 99; default 0, normal
+					 * scheduling */
+	int lock_memory;		/* lock the buffers of the capture thread
+					 * in memory; default 0 */
+} sprec_capture_params;
+
+/*
+ * With `realtime', the capture thread preempts every ordinary thread
+ * whenever a period is ready, so that a busy host doesn't make it miss
+ * the device's deadlines. It needs CAP_SYS_NICE or a large enough
+ * RLIMIT_RTPRIO; without them, capture silently goes on at normal
+ * priority (see `realtime' in sprec_capture_stats). With `lock_memory',
+ * the thread runs on a stack of its own, locked as a whole, and its
+ * buffers are touched and locked before capture starts, so that it
+ * never waits for a page fault; this is limited by RLIMIT_MEMLOCK.
+ * A manager's thread is set up as asked by the most demanding of its
+ * devices. Both are ignored on OS X and iOS,
+ * where the system owns the capture threads, and in an event loop.
+ */
+typedef struct sprec_capture_stats {
+	uint64_t periods;		/* callbacks made */
+	uint64_t frames;		/* frames delivered */
+	uint64_t overruns;		/* times audio was lost because the
+					 * device wasn't read in time (xruns) */
+	uint64_t suspends;		/* times the device was suspended */
+	int realtime;			/* real-time scheduling was granted */
+	int locked;			/* the buffers are locked in memory */
+	double latency;			/* seconds from the capture of the first
+					 * frame of the last period to the start
+					 * of its callback */
+	double latency_mean;
+	double latency_max;
+	double callback_max;		/* longest time spent in the callback,
+					 * in seconds */
+} sprec_capture_stats;
+
+/*
+ * Receives `frames' frames of interleaved audio. Called on the capture
+ * thread; it should return quickly, or the device will overrun.
+ */
+typedef void (*sprec_capture_callback)(const void *pcm, size_t frames, void *ctx);
+
+void sprec_capture_params_init(sprec_capture_params *params);
+
+/*
+ * Opens and configures the device. The sample rate may be changed to
+ * the nearest one the device supports; see sprec_capture_sample_rate().
+ * Returns NULL on error.
+ */
+sprec_capture *sprec_capture_open(
+	const sprec_capture_params *params,
+	sprec_capture_callback cb,
+	void *ctx
+);
+
+/*
+ * Starts capturing on a new thread.
+ * Returns 0 on success, non-0 on error (or if `cap' belongs to a manager).
+ */
+int sprec_capture_start(sprec_capture *cap);
+
+/*
+ * Stops capturing. When it returns, the callback is not running
+ * and won't be called again until the next start.
+ */
+void sprec_capture_stop(sprec_capture *cap);
+
+/*
+ * Stops capturing if needed and closes the device.
+ * A device belonging to a manager is removed from it;
+ * the manager must not be running.
+ */
+void sprec_capture_close(sprec_capture *cap);
+
+uint32_t sprec_capture_sample_rate(const sprec_capture *cap);
+
+/*
+ * Number of times audio was lost because the
+ * callback didn't keep up with the device
+ */
+uint64_t sprec_capture_overruns(sprec_capture *cap);
+
+/*
+ * Copies the statistics gathered since the device was opened to `stats'
+ */
+void sprec_capture_get_stats(sprec_capture *cap, sprec_capture_stats *stats);
+
+/*
+ * Records `duration_ms' milliseconds to the WAV file `filename' like
+ * sprec_record_wav(), but on a capture thread set up as `params' asks
+ * (NULL for the defaults). The format, sample rate and number of
+ * channels are taken from `hdr', whose sample rate is updated to the
+ * one the device supports. The whole recording is kept in memory,
+ * allocated and touched beforehand, and written to the file by the
+ * calling thread at the end, so the capture thread does nothing but
+ * copy the audio. If `stats' isn't NULL, the statistics of the capture
+ * are stored there. Returns 0 on success, non-0 on error (including
+ * the device delivering less than asked for, in which case what was
+ * captured is still written).
+ */
+int sprec_capture_record_wav(
+	const sprec_capture_params *params,
+	const char *filename,
+	sprec_wav_header *hdr,
+	uint32_t duration_ms,
+	sprec_capture_stats *stats
+);
+
+/*
+ * Driving a device from the caller's event loop instead of a thread
+ * (ALSA only; an Audio Queue always calls back on a thread of its own,
+ * and these return non-0 on OS X and iOS).
+ *
+ * After sprec_capture_begin(), the loop watches the descriptors
+ * returned by sprec_capture_poll_descriptors() and, whenever any of
+ * them is ready, calls sprec_capture_process() with the returned
+ * events. The callback is called from there, on the loop's thread.
+ */
+
+/*
+ * Number of descriptors to watch, or -1 on error
+ */
+int sprec_capture_poll_count(sprec_capture *cap);
+
+/*
+ * Fills in at most `n' descriptors to watch (with the events
+ * to watch for). Returns their number, or -1 on error.
+ */
+int sprec_capture_poll_descriptors(sprec_capture *cap, struct pollfd *fds, unsigned n);
+
+/*
+ * Starts the device without starting a thread.
+ * Returns 0 on success, non-0 on error.
+ */
+int sprec_capture_begin(sprec_capture *cap);
+
+/*
+ * Reads whatever the device has to offer, given the result of polling
+ * the descriptors (the same array as the one filled in above).
+ * Returns 0 on success, non-0 if the device has failed for good.
+ */
+int sprec_capture_process(sprec_capture *cap, struct pollfd *fds, unsigned n);
+
+/*
+ * Stops the device started by sprec_capture_begin()
+ */
+void sprec_capture_end(sprec_capture *cap);
+
+/*
+ * Capture from several devices at once. With ALSA, all of them are
+ * serviced by a single thread waiting in poll() on the descriptors of
+ * every device, instead of one thread blocked in a read per device.
+ * Each device still delivers its audio to its own callback.
+ */
+typedef struct sprec_capture_manager sprec_capture_manager;
+
+sprec_capture_manager *sprec_capture_manager_new(void);
+
+/*
+ * Stops the manager if needed and closes all of its devices
+ */
+void sprec_capture_manager_free(sprec_capture_manager *mgr);
+
+/*
+ * Opens a device like sprec_capture_open() and adds it to the manager,
+ * which must not be running. The device is started and stopped with
+ * the manager; sprec_capture_start() and sprec_capture_stop() don't
+ * work on it. Returns NULL on error.
+ */
+sprec_capture *sprec_capture_manager_open(
+	sprec_capture_manager *mgr,
+	const sprec_capture_params *params,
+	sprec_capture_callback cb,
+	void *ctx
+);
+
+/*
+ * Starts capturing from all the devices of the manager.
+ * Returns 0 on success, non-0 on error.
+ */
+int sprec_capture_manager_start(sprec_capture_manager *mgr);
+
+/*
+ * Stops capturing from all the devices. When it returns,
+ * none of the callbacks is running.
+ */
+void sprec_capture_manager_stop(sprec_capture_manager *mgr);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !__SPREC_CAPTURE_H__ */
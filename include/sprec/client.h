@@ -0,0 +1,103 @@
+/*
+ * client.h
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#ifndef __SPREC_CLIENT_H__
+#define __SPREC_CLIENT_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <sprec/web_client.h>
+
+/*
+ * Recognition through a local daemon (see server.h and sprecd), so that
+ * the processes of a machine share its connections to the API, its
+ * cache and its encoders instead of each paying for their own. The
+ * audio is handed over in shared memory (or as the descriptor of the
+ * WAV file itself), not copied through the socket.
+ *
+ * The socket is only for the user the daemon runs as: it is made
+ * readable and writable by them alone, and the daemon hangs up on
+ * processes of anyone else. By default, it is named SPREC_DAEMON_SOCKET
+ * and lives in $XDG_RUNTIME_DIR, or else in /tmp/sprecd-<uid>, a
+ * directory which only the user may enter.
+ */
+#define SPREC_DAEMON_SOCKET "sprecd.sock"
+
+typedef struct sprec_client sprec_client;
+
+typedef enum sprec_client_error {
+	SPREC_CLIENT_OK,
+	SPREC_CLIENT_ERR_REQUEST,	/* malformed request or unreadable audio */
+	SPREC_CLIENT_ERR_ENCODE,	/* the daemon couldn't encode the audio */
+	SPREC_CLIENT_ERR_TRANSPORT,	/* the daemon got no response from the API */
+	SPREC_CLIENT_ERR_NOMEM		/* out of memory, or refused by the
+					 * daemon's memory budget */
+} sprec_client_error;
+
+/*
+ * Puts the path at which the daemon listens by default in `path'
+ * (`size' bytes): the SPREC_SOCKET environment variable if it is set,
+ * or the default described above. Returns 0 on success, non-0 if the
+ * path doesn't fit, or if /tmp/sprecd-<uid> isn't the user's own.
+ */
+int sprec_client_socket_path(char *path, size_t size);
+
+/*
+ * Connects to the daemon listening at `path', or at the default path
+ * if it is NULL. Returns NULL on error.
+ */
+sprec_client *sprec_client_connect(const char *path);
+
+void sprec_client_close(sprec_client *client);
+
+/*
+ * Same as sprec_send_audio_data(), through the daemon.
+ * A connection handles one request at a time; calls from
+ * several threads are serialized.
+ */
+sprec_server_response *sprec_client_send_audio_data(
+	sprec_client *client,
+	const void *data,
+	size_t length,
+	const char *apikey,
+	const char *language,
+	uint32_t sample_rate
+);
+
+/*
+ * Has the daemon encode and recognize the WAV file at `wavfile' (in any
+ * format listed in pcm.h). The daemon reads the file in place.
+ */
+sprec_server_response *sprec_client_recognize_file(
+	sprec_client *client,
+	const char *wavfile,
+	const char *apikey,
+	const char *language
+);
+
+/*
+ * Same as sprec_recognize_sync(): records `dur_s' seconds of audio
+ * (straight to shared memory) and returns the JSON response of the
+ * API, to be freed with sprec_free(), or NULL on error.
+ */
+char *sprec_client_recognize_sync(sprec_client *client, const char *apikey, const char *lang, double dur_s);
+
+/*
+ * The error of the last request of `client'
+ */
+sprec_client_error sprec_client_last_error(sprec_client *client);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !__SPREC_CLIENT_H__ */
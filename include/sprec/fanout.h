@@ -0,0 +1,89 @@
+/*
+ * fanout.h
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#ifndef __SPREC_FANOUT_H__
+#define __SPREC_FANOUT_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <sprec/web_client.h>
+
+/*
+ * Recognition of one recording in several candidate languages at once.
+ * The audio is encoded once and the requests for all the languages are
+ * sent concurrently, so the whole takes about as long as the slowest
+ * request instead of the sum of all of them.
+ *
+ * A response is "useful" if it has a 2xx status and at least one
+ * alternative (the API answers with an empty result when it can't make
+ * sense of the audio, which is typical of a wrong language). Its
+ * confidence is that of its first alternative (0 if not reported).
+ */
+typedef enum sprec_fanout_mode {
+	SPREC_FANOUT_ALL,	/* wait for every response */
+	SPREC_FANOUT_FIRST,	/* take the first useful response */
+	SPREC_FANOUT_BEST	/* take the most confident useful response */
+} sprec_fanout_mode;
+
+typedef struct sprec_fanout_options {
+	sprec_fanout_mode mode;	/* default SPREC_FANOUT_ALL */
+	double confidence;	/* SPREC_FANOUT_BEST stops waiting for the
+				 * others once a response is at least this
+				 * confident; default 1 (never) */
+} sprec_fanout_options;
+
+void sprec_fanout_options_init(sprec_fanout_options *opts);
+
+/*
+ * Sends the FLAC-encoded audio for each of the `count' language codes
+ * at `languages'. If `opts' is NULL, the defaults are used.
+ *
+ * `resps' (an array of `count' elements) receives the responses in the
+ * order of the languages, NULL for the ones that failed. In the FIRST
+ * and BEST modes, only the chosen response is kept; the requests still
+ * in progress are cancelled and the other responses are freed.
+ *
+ * Returns the index of the chosen response (the first useful one in
+ * FIRST mode, the most confident useful one otherwise), or -1 if none
+ * of them is useful.
+ */
+int sprec_send_audio_data_fanout(
+	const void *data,
+	size_t length,
+	const char *apikey,
+	const char *const *languages,
+	size_t count,
+	uint32_t sample_rate,
+	const sprec_fanout_options *opts,
+	sprec_server_response **resps
+);
+
+/*
+ * Same as sprec_send_audio_data_fanout(), for the WAV file at `wavfile'
+ * (in any format listed in pcm.h). Returns -1 if the file can't be
+ * read or encoded, or if the memory budget (see budget.h) refuses it,
+ * too.
+ */
+int sprec_recognize_file_fanout(
+	const char *wavfile,
+	const char *apikey,
+	const char *const *languages,
+	size_t count,
+	const sprec_fanout_options *opts,
+	sprec_server_response **resps
+);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !__SPREC_FANOUT_H__ */
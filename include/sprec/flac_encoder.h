@@ -18,17 +18,259 @@ extern "C" {
 #include <stdint.h>
 #include <string.h>
 
+#include <sprec/pcm.h>
+
 /*
  * Converts a WAV PCM file at the path `wavfile'
- * to a FLAC file with the same sample rate,
- * channel number and bit depth. Writes the result
- * to the file at path `flacfile'.
+ * to a FLAC file with the same sample rate and
+ * channel number. 8 and 16 bit audio keeps its bit
+ * depth; 24 and 32 bit integer and 32 bit float audio
+ * is converted to 16 bits (see pcm.h).
  * Returns a pointer to FLAC data buffer on success,
  * NULL on error. On success, *size will be set to
  * the size of the FLAC data (in bytes).
+ * The buffer should be freed with sprec_free().
  */
 void *sprec_flac_encode(const char *wavfile, size_t *size);
 
+/*
+ * Same as sprec_flac_encode(), but takes `frames' frames of interleaved
+ * PCM data (in the format of the data section of a WAV file: 8 bit
+ * unsigned, or 16, 24 or 32 bit signed, little endian) directly
+ * from memory.
+ * Returns a pointer to FLAC data buffer (to be freed
+ * with sprec_free()) on success, NULL on error.
+ */
+void *sprec_flac_encode_pcm(
+	const void *data,
+	size_t frames,
+	uint32_t rate,
+	uint32_t channels,
+	uint32_t bps,
+	size_t *size
+);
+
+/*
+ * Encoding of one long recording on several processors. FLAC frames are
+ * independent of each other, so the audio is cut into segments of whole
+ * frames, which are encoded at the same time, and the frames are then
+ * put back together into one stream (renumbered, with their checksums
+ * recomputed) with a STREAMINFO block describing the whole of it. The
+ * audio decodes to the same samples as with sprec_flac_encode_pcm();
+ * for 24 bit, 32 bit and float audio, the dither noise is different,
+ * but it doesn't depend on the number of threads either.
+ */
+typedef struct sprec_flac_parallel_options {
+	unsigned threads;	/* default 0, one per processor */
+	unsigned level;		/* FLAC compression level, default 5 */
+	size_t segment_length;	/* frames of audio per segment, rounded up
+				 * to whole FLAC frames; default 262144 */
+} sprec_flac_parallel_options;
+
+void sprec_flac_parallel_options_init(sprec_flac_parallel_options *opts);
+
+/*
+ * Same as sprec_flac_encode_pcm(), for samples in the format `fmt',
+ * with the options in `opts' (NULL for the defaults).
+ * Returns a buffer to be freed with sprec_free(), or NULL on error.
+ */
+void *sprec_flac_encode_parallel(
+	const void *data,
+	size_t frames,
+	uint32_t rate,
+	uint32_t channels,
+	sprec_pcm_format fmt,
+	const sprec_flac_parallel_options *opts,
+	size_t *size
+);
+
+/*
+ * Same as sprec_flac_encode(), in parallel. The file is mapped into
+ * memory rather than read.
+ */
+void *sprec_flac_encode_file_parallel(
+	const char *wavfile,
+	const sprec_flac_parallel_options *opts,
+	size_t *size
+);
+
+/*
+ * A reusable encoder context. It owns a libFLAC encoder and the scratch
+ * buffers needed for the conversion of the samples and for the output,
+ * so that encoding many short recordings doesn't have to allocate and
+ * set them up again each time. A context may only be used by one thread
+ * at a time; use an encoder pool to share contexts between threads.
+ */
+typedef struct sprec_encoder sprec_encoder;
+typedef struct sprec_encoder_pool sprec_encoder_pool;
+
+typedef struct sprec_encoder_options {
+	size_t chunk_frames;	/* frames converted at a time, default 20480 */
+	size_t output_keep;	/* bytes of output kept by reset, default 4 MB */
+	int dither;		/* dither when converting to 16 bits, default 1 */
+	unsigned level;		/* FLAC compression level (0 to 8), default 5 */
+} sprec_encoder_options;
+
+/*
+ * Receives the encoded data as it is produced, instead of it being
+ * collected in memory. Returns non-0 to abort the encoding.
+ */
+typedef int (*sprec_encoder_sink)(const void *data, size_t size, void *ctx);
+
+void sprec_encoder_options_init(sprec_encoder_options *opts);
+
+/*
+ * Upper bound of the memory (in bytes) a context created with `opts'
+ * (NULL for the defaults) allocates for encoding audio with the given
+ * number of channels and bits per sample. This is independent of the
+ * length of the input, and nothing is allocated on the stack. It doesn't
+ * include the encoded output, which is collected in memory unless a sink
+ * is set, nor the internal state of libFLAC, which depends on the
+ * number of channels but not on the length of the input either.
+ */
+size_t sprec_encoder_memory_bound(const sprec_encoder_options *opts, uint32_t channels, uint32_t bps);
+
+/*
+ * Creates a new encoder context with the default options.
+ * Returns NULL on error.
+ */
+sprec_encoder *sprec_encoder_new(void);
+
+/*
+ * Same as sprec_encoder_new(), with the options in `opts'
+ * (NULL for the defaults). Smaller chunks need less memory,
+ * but make more calls into libFLAC.
+ */
+sprec_encoder *sprec_encoder_new_ex(const sprec_encoder_options *opts);
+
+void sprec_encoder_free(sprec_encoder *enc);
+
+/*
+ * Abandons the stream being encoded (if any), discards the output and
+ * removes the sink, but keeps the buffers around for the next encoding
+ * (unless the output buffer has grown larger than `output_keep').
+ */
+void sprec_encoder_reset(sprec_encoder *enc);
+
+/*
+ * Makes the context pass the encoded data to `sink' (NULL to collect it
+ * in memory again) until it is reset. With a sink, the encoding
+ * functions set `*flac' to NULL and `*size' to the number of bytes
+ * passed to the sink.
+ */
+void sprec_encoder_set_sink(sprec_encoder *enc, sprec_encoder_sink sink, void *ctx);
+
+/*
+ * Makes the context use the given compression level (0, the fastest,
+ * to 8, the smallest output) until it is reset
+ */
+void sprec_encoder_set_level(sprec_encoder *enc, unsigned level);
+
+/*
+ * Encodes `frames' frames of interleaved PCM data, like
+ * sprec_flac_encode_pcm(). On success, returns 0 and sets `*flac'
+ * to the FLAC data and `*size' to its size in bytes. The data is owned
+ * by the encoder; it stays valid until the next call to any function
+ * with the same context. Returns non-0 on error.
+ */
+int sprec_encoder_encode_pcm(
+	sprec_encoder *enc,
+	const void *data,
+	size_t frames,
+	uint32_t rate,
+	uint32_t channels,
+	uint32_t bps,
+	const void **flac,
+	size_t *size
+);
+
+/*
+ * Same as sprec_encoder_encode_pcm(), for samples in the format `fmt'
+ */
+int sprec_encoder_encode_pcm_ex(
+	sprec_encoder *enc,
+	const void *data,
+	size_t frames,
+	uint32_t rate,
+	uint32_t channels,
+	sprec_pcm_format fmt,
+	const void **flac,
+	size_t *size
+);
+
+/*
+ * Size of the body of the STREAMINFO metadata block,
+ * and its offset from the start of a FLAC stream
+ */
+#define SPREC_FLAC_STREAMINFO_SIZE 34
+#define SPREC_FLAC_STREAMINFO_OFFSET 8
+
+/*
+ * Encoding a stream whose length isn't known beforehand, a piece at a
+ * time: sprec_encoder_stream_begin() starts it, every call to
+ * sprec_encoder_stream_write() encodes `frames' more frames in the
+ * format given at the beginning, and sprec_encoder_stream_end() finishes
+ * it. All of them return 0 on success, non-0 on error, after which the
+ * stream is abandoned. Use a sink to keep the output out of memory.
+ */
+int sprec_encoder_stream_begin(sprec_encoder *enc, uint32_t rate, uint32_t channels, sprec_pcm_format fmt);
+
+int sprec_encoder_stream_write(sprec_encoder *enc, const void *data, size_t frames);
+
+/*
+ * Sets `*flac' and `*size' like sprec_encoder_encode_pcm(). The STREAMINFO
+ * block at the start of the output carries the length of the stream and
+ * the MD5 signature of the audio, which are only known at the end, when
+ * a sink has long been given that part of the stream. If `streaminfo'
+ * isn't NULL, the final block (SPREC_FLAC_STREAMINFO_SIZE bytes) is
+ * stored there, to be written over the one SPREC_FLAC_STREAMINFO_OFFSET
+ * bytes into the output; without a sink, this is already done.
+ */
+int sprec_encoder_stream_end(sprec_encoder *enc, unsigned char *streaminfo, const void **flac, size_t *size);
+
+/*
+ * Encodes the WAV file at the path `wavfile', like sprec_flac_encode().
+ * Ownership of the result is the same as for sprec_encoder_encode_pcm().
+ */
+int sprec_encoder_encode_file(
+	sprec_encoder *enc,
+	const char *wavfile,
+	const void **flac,
+	size_t *size
+);
+
+/*
+ * Creates a thread-safe pool of encoder contexts, which keeps
+ * at most `max_idle' unused contexts for reuse.
+ * Returns NULL on error.
+ */
+sprec_encoder_pool *sprec_encoder_pool_new(size_t max_idle);
+
+/*
+ * Same as sprec_encoder_pool_new(), but the contexts
+ * are created with the options in `opts'
+ */
+sprec_encoder_pool *sprec_encoder_pool_new_ex(size_t max_idle, const sprec_encoder_options *opts);
+
+/*
+ * Frees the pool and the idle contexts in it.
+ * Contexts acquired from it must be released before.
+ */
+void sprec_encoder_pool_free(sprec_encoder_pool *pool);
+
+/*
+ * Takes an idle context from the pool, or creates a new one
+ * if there is none. Never blocks on other threads' encoding.
+ * Returns NULL on error.
+ */
+sprec_encoder *sprec_encoder_pool_acquire(sprec_encoder_pool *pool);
+
+/*
+ * Resets `enc' and puts it back into the pool
+ * (or frees it if the pool is already full).
+ */
+void sprec_encoder_pool_release(sprec_encoder_pool *pool, sprec_encoder *enc);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -0,0 +1,145 @@
+/*
+ * future.h
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#ifndef __SPREC_FUTURE_H__
+#define __SPREC_FUTURE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <sprec/web_client.h>
+
+/*
+ * Recognitions running in the background on a pool of worker threads
+ * (an executor), each represented by a future: a handle which can be
+ * polled, waited for (alone or together with others) and finally
+ * queried for a result with the details of what happened.
+ */
+typedef struct sprec_executor sprec_executor;
+typedef struct sprec_future sprec_future;
+
+typedef enum sprec_future_stage {
+	SPREC_STAGE_QUEUED,	/* waiting for a worker */
+	SPREC_STAGE_RECORDING,
+	SPREC_STAGE_ENCODING,
+	SPREC_STAGE_UPLOADING,
+	SPREC_STAGE_DONE
+} sprec_future_stage;
+
+typedef enum sprec_future_error {
+	SPREC_FUTURE_OK,
+	SPREC_FUTURE_ERR_RECORD,	/* couldn't record the audio */
+	SPREC_FUTURE_ERR_ENCODE,	/* couldn't read or encode the audio */
+	SPREC_FUTURE_ERR_TRANSPORT,	/* no response was received */
+	SPREC_FUTURE_ERR_HTTP,		/* the response isn't a 2xx one */
+	SPREC_FUTURE_ERR_CANCELLED,
+	SPREC_FUTURE_ERR_NOMEM		/* out of memory, or refused by the budget */
+} sprec_future_error;
+
+typedef struct sprec_future_result {
+	sprec_future_error error;
+	long status;			/* HTTP status, 0 if none */
+	sprec_server_response *resp;	/* NULL if none; owned by the future */
+
+	/* durations of the stages, in seconds */
+	double queued;
+	double recording;
+	double encoding;
+	double uploading;
+} sprec_future_result;
+
+/*
+ * Creates an executor with `threads' workers (the number of CPUs if 0).
+ * Requests are sent as sprec_send_audio_data_ex() would with `send'
+ * (which is copied; NULL means the defaults). Returns NULL on error.
+ */
+sprec_executor *sprec_executor_new(unsigned threads, const sprec_send_options *send);
+
+/*
+ * Cancels the queued recognitions, waits for the running ones and
+ * frees the executor. The futures stay valid until they are freed.
+ */
+void sprec_executor_free(sprec_executor *exec);
+
+/*
+ * Records `dur_s' seconds of audio and recognizes it, like
+ * sprec_recognize_sync() does. Functions taking an executor use a
+ * shared one (with a worker per CPU) if it is NULL.
+ * Returns NULL on error.
+ */
+sprec_future *sprec_future_recognize(
+	sprec_executor *exec,
+	const char *apikey,
+	const char *lang,
+	double dur_s
+);
+
+/*
+ * Recognizes the WAV file at `wavfile' (in any format listed in pcm.h).
+ * Returns NULL on error.
+ */
+sprec_future *sprec_future_recognize_file(
+	sprec_executor *exec,
+	const char *wavfile,
+	const char *apikey,
+	const char *lang
+);
+
+/*
+ * Returns non-0 if the recognition is finished (or failed)
+ */
+int sprec_future_poll(sprec_future *future);
+
+sprec_future_stage sprec_future_progress(sprec_future *future);
+
+/*
+ * Waits at most `timeout' seconds (forever if negative)
+ * for the recognition to finish.
+ * Returns 0 if it is finished, non-0 on timeout.
+ */
+int sprec_future_wait(sprec_future *future, double timeout);
+
+/*
+ * Waits at most `timeout' seconds for any of the `count' futures at
+ * `futures' to finish. Returns 0 and sets `*index' to the index of
+ * the first finished one, or returns non-0 on timeout.
+ */
+int sprec_future_wait_any(sprec_future *const *futures, size_t count, double timeout, size_t *index);
+
+/*
+ * Waits at most `timeout' seconds for all of the futures to finish.
+ * Returns 0 if they are finished, non-0 on timeout.
+ */
+int sprec_future_wait_all(sprec_future *const *futures, size_t count, double timeout);
+
+/*
+ * Returns the result, or NULL if the recognition isn't finished yet.
+ * It is valid as long as the future is.
+ */
+const sprec_future_result *sprec_future_get(sprec_future *future);
+
+/*
+ * Cancels the recognition if it hasn't started yet.
+ * Returns 0 if it has been cancelled, non-0 if it is too late.
+ */
+int sprec_future_cancel(sprec_future *future);
+
+/*
+ * Frees the future. An unfinished recognition goes on,
+ * but its result is thrown away.
+ */
+void sprec_future_free(sprec_future *future);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !__SPREC_FUTURE_H__ */
@@ -0,0 +1,50 @@
+/*
+ * init.h
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#ifndef __SPREC_INIT_H__
+#define __SPREC_INIT_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Global setup. sprec_init() initializes libcurl (and through it the
+ * TLS library and its certificates) once, instead of leaving it to the
+ * first request, and creates a cache of DNS lookups, TLS sessions and
+ * open connections to the API that every request made by the blocking
+ * client shares. Without it, each request connects from scratch.
+ *
+ * It should be called at startup, before any other thread uses libcurl
+ * (whose global initialization isn't thread-safe), and may be called
+ * again; every call must be matched by one to sprec_shutdown().
+ * Returns 0 on success, non-0 on error.
+ */
+int sprec_init(void);
+
+/*
+ * Undoes sprec_init(). The last call waits for warm-ups in progress and
+ * closes the connections; no request may be in progress then.
+ */
+void sprec_shutdown(void);
+
+/*
+ * Starts connecting to the API in the background (DNS lookup, TCP and
+ * TLS handshakes), so that the connection is ready by the time there
+ * is audio to send. Returns at once. Does nothing if a connection was
+ * used recently enough to still be open, if a warm-up is already under
+ * way, or without sprec_init(). Recognition calls which capture audio
+ * (sprec_recognize_sync(), sprec_listen()) do this when capture starts.
+ * Returns 0 if a connection is or will soon be ready, non-0 if not.
+ */
+int sprec_warm_up(void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !__SPREC_INIT_H__ */
@@ -0,0 +1,126 @@
+/*
+ * levels.h
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#ifndef __SPREC_LEVELS_H__
+#define __SPREC_LEVELS_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <sprec/pcm.h>
+
+/*
+ * Signal levels of a recording, measured as the audio goes by, so that
+ * audio nobody could recognize (silence, or clipped beyond repair) can
+ * be turned down before it is encoded and uploaded.
+ *
+ * The noise floor and the speech level are estimated from the levels
+ * of 10 ms windows: the noise floor is the level exceeded by 90% of the
+ * windows, and the speech level the one exceeded by only 10% of them.
+ */
+typedef struct sprec_levels {
+	uint64_t samples;	/* samples measured */
+	uint64_t clipped;	/* samples within one step of full scale */
+	double peak;		/* dBFS */
+	double rms;		/* dBFS, of the whole recording */
+	double noise_floor;	/* dBFS */
+	double speech;		/* dBFS */
+	double snr;		/* dB, speech level over noise floor */
+	double clipping;	/* fraction of the samples clipped */
+} sprec_levels;
+
+/*
+ * Levels below which audio is not worth recognizing. Any of the tests
+ * can be turned off with the value noted.
+ */
+typedef struct sprec_level_limits {
+	double min_rms;		/* dBFS, default -60; -INFINITY for none */
+	double min_speech;	/* dBFS, default -45; -INFINITY for none */
+	double min_snr;		/* dB, default 6; -INFINITY for none */
+	double max_clipping;	/* fraction, default 0.01; 1 for none */
+} sprec_level_limits;
+
+/*
+ * Lowest level measured, in dBFS (digital silence)
+ */
+#define SPREC_LEVEL_FLOOR -120.0
+
+/*
+ * Levels of windows in 0.5 dB steps, from SPREC_LEVEL_FLOOR to 0 dBFS
+ */
+#define SPREC_LEVEL_BINS 241
+
+/*
+ * Accumulates the levels of a stream of audio. It allocates nothing,
+ * so it may be used on a capture thread. The members are private.
+ */
+typedef struct sprec_level_meter {
+	sprec_pcm_format fmt;
+	uint32_t channels;
+	size_t window;		/* samples per window */
+	size_t fill;		/* samples in the current window */
+	double window_energy;
+	double energy;
+	float peak;
+	uint64_t samples;
+	uint64_t clipped;
+	uint64_t windows;
+	uint32_t histogram[SPREC_LEVEL_BINS];
+} sprec_level_meter;
+
+void sprec_level_limits_init(sprec_level_limits *limits);
+
+/*
+ * Prepares `meter' for audio in the given format
+ */
+void sprec_level_meter_init(sprec_level_meter *meter, uint32_t rate, uint32_t channels, sprec_pcm_format fmt);
+
+/*
+ * Forgets the audio measured so far
+ */
+void sprec_level_meter_reset(sprec_level_meter *meter);
+
+/*
+ * Measures `frames' frames of interleaved audio. Returns their mean
+ * power relative to full scale, like sprec_pcm_power(), so that the
+ * caller doesn't need another pass to tell speech from silence.
+ * Uses SIMD instructions where available.
+ */
+double sprec_level_meter_update(sprec_level_meter *meter, const void *pcm, size_t frames);
+
+/*
+ * Stores the levels of the audio measured so far in `levels'.
+ * A partial window at the end is counted as a whole one.
+ */
+void sprec_level_meter_read(const sprec_level_meter *meter, sprec_levels *levels);
+
+/*
+ * Returns 1 if `levels' are within `limits', 0 if not
+ */
+int sprec_levels_acceptable(const sprec_levels *levels, const sprec_level_limits *limits);
+
+/*
+ * Measures the `frames' frames at `pcm' in one go
+ */
+void sprec_levels_measure(
+	const void *pcm,
+	size_t frames,
+	uint32_t rate,
+	uint32_t channels,
+	sprec_pcm_format fmt,
+	sprec_levels *levels
+);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !__SPREC_LEVELS_H__ */
@@ -0,0 +1,119 @@
+/*
+ * listen.h
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#ifndef __SPREC_LISTEN_H__
+#define __SPREC_LISTEN_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <sprec/capture.h>
+#include <sprec/archive.h>
+#include <sprec/levels.h>
+#include <sprec/web_client.h>
+
+/*
+ * Continuous recognition.
+ *
+ * The capture device is kept open and the audio is split into utterances
+ * on the fly: an utterance starts when the level rises above
+ * `silence_threshold' and ends after `silence_length' seconds of silence
+ * (or at `max_length' seconds, in which case the next one follows
+ * without a gap). `pre_roll' seconds of the audio preceding the onset
+ * are included, so that soft beginnings of words aren't cut off.
+ * Utterances shorter than `min_length' (clicks, coughs) are ignored.
+ *
+ * Finished utterances are queued and encoded and uploaded on a separate
+ * thread while capturing goes on. The capture thread never allocates or
+ * waits for the network: if `queue_length' utterances are already
+ * waiting, the new one is dropped (see sprec_listener_dropped()).
+ *
+ * If `archive' is set, everything captured, speech or not, is also
+ * written to that file as it comes (see archive.h), without slowing
+ * the capture thread down. The file is completed when listening stops.
+ *
+ * The levels of each utterance (see levels.h) are measured by the
+ * capture thread in the same pass that tells speech from silence, and
+ * handed to the callback with the result. If `reject' is set, utterances
+ * whose levels aren't within its limits are neither encoded nor
+ * uploaded, and the callback gets them with `rejected' set.
+ *
+ * The buffers, and the memory needed to upload one of them, are reserved
+ * from the memory budget (see budget.h) for as long as listening goes
+ * on, with the highest priority: they are never shed.
+ */
+typedef struct sprec_listen_options {
+	sprec_capture_params capture;	/* see capture.h */
+	double silence_threshold;	/* dBFS, default -40 */
+	double silence_length;		/* seconds, default 0.6 */
+	double min_length;		/* seconds, default 0.3 */
+	double max_length;		/* seconds, default 15 */
+	double pre_roll;		/* seconds, default 0.3 */
+	size_t queue_length;		/* default 4 */
+	const sprec_send_options *send;	/* default: NULL */
+	const char *archive;		/* default: NULL, no archive */
+	const sprec_archive_options *archive_options;	/* default: NULL */
+	const sprec_level_limits *reject;	/* default: NULL, upload all */
+} sprec_listen_options;
+
+typedef struct sprec_utterance {
+	double start;			/* seconds from the start of listening */
+	double end;
+	sprec_server_response *resp;	/* NULL if recognition failed
+					 * or the utterance was rejected */
+	sprec_levels levels;
+	int rejected;			/* not uploaded, see `reject' */
+} sprec_utterance;
+
+/*
+ * Called on the upload thread once for each utterance, in order.
+ * `utt' and the response are freed when the callback returns.
+ */
+typedef void (*sprec_listen_callback)(const sprec_utterance *utt, void *ctx);
+
+typedef struct sprec_listener sprec_listener;
+
+void sprec_listen_options_init(sprec_listen_options *opts);
+
+/*
+ * Starts listening. If `opts' is NULL, the defaults are used.
+ * Returns NULL on error, or if the memory budget refuses the buffers.
+ */
+sprec_listener *sprec_listen(
+	const char *apikey,
+	const char *language,
+	const sprec_listen_options *opts,
+	sprec_listen_callback cb,
+	void *ctx
+);
+
+/*
+ * Stops listening, recognizes the utterance in progress (if any) and
+ * everything still in the queue, then frees the listener.
+ * The callback is not called after this returns.
+ */
+void sprec_listener_stop(sprec_listener *l);
+
+/*
+ * Number of utterances dropped because the queue was full
+ */
+uint64_t sprec_listener_dropped(sprec_listener *l);
+
+/*
+ * Statistics of the archive so far (all zero without one)
+ */
+void sprec_listener_archive_stats(sprec_listener *l, sprec_archive_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !__SPREC_LISTEN_H__ */
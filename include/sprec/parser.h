@@ -0,0 +1,108 @@
+/*
+ * parser.h
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#ifndef __SPREC_PARSER_H__
+#define __SPREC_PARSER_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stddef.h>
+
+/*
+ * Limits of the fixed-size result structure. The parser never allocates,
+ * so alternatives beyond SPREC_MAX_ALTERNATIVES are dropped and transcripts
+ * longer than SPREC_MAX_TRANSCRIPT - 1 bytes are truncated (on a UTF-8
+ * character boundary); in both cases `truncated' is set in the result.
+ */
+#define SPREC_MAX_ALTERNATIVES 8
+#define SPREC_MAX_TRANSCRIPT 512
+#define SPREC_PARSER_MAX_DEPTH 32
+
+typedef struct sprec_alternative {
+	char transcript[SPREC_MAX_TRANSCRIPT];
+	double confidence; /* negative if the API didn't report it */
+} sprec_alternative;
+
+typedef struct sprec_result {
+	sprec_alternative alternatives[SPREC_MAX_ALTERNATIVES];
+	size_t count;
+	int final;
+	int result_index;
+	int truncated;
+} sprec_result;
+
+/*
+ * Incremental parser for the recognition response. Google sends one
+ * or more JSON objects separated by newlines, e. g.
+ *
+ *	{"result":[]}
+ *	{"result":[{"alternative":[{"transcript":"hello","confidence":0.9}],
+ *	  "final":true}],"result_index":0}
+ *
+ * The parser accepts any number of concatenated top-level values and
+ * may be fed arbitrarily split chunks of the response, so it can run
+ * directly in the HTTP write callback. The structure is opaque;
+ * it is only exposed so that it can live on the stack.
+ */
+typedef struct sprec_parser {
+	sprec_result *result;
+	sprec_alternative *alt;
+	int state;
+	int error;
+	int depth;
+	unsigned char kind[SPREC_PARSER_MAX_DEPTH];
+	unsigned char ctx[SPREC_PARSER_MAX_DEPTH];
+	int in_key;
+	char key[16];
+	size_t keylen;
+	char *str;
+	size_t strlen;
+	size_t strcap;
+	char scalar[64];
+	size_t scalarlen;
+	unsigned long codepoint;
+	unsigned long surrogate;
+	int hexdigits;
+} sprec_parser;
+
+/*
+ * Prepares `parser' for a new response and clears `result'.
+ */
+void sprec_parser_init(sprec_parser *parser, sprec_result *result);
+
+/*
+ * Feeds the next `length' bytes of the response to the parser.
+ * Returns 0 on success, non-0 if the input is malformed
+ * (after which the parser ignores any further input).
+ */
+int sprec_parser_feed(sprec_parser *parser, const char *data, size_t length);
+
+/*
+ * Signals the end of the response.
+ * Returns 0 if every top-level value was complete, non-0 otherwise.
+ */
+int sprec_parser_finish(sprec_parser *parser);
+
+/*
+ * Convenience function that parses a complete response in one go.
+ * Returns 0 on success, non-0 on error.
+ */
+int sprec_result_parse(const char *json, size_t length, sprec_result *result);
+
+/*
+ * Returns the alternative with the highest confidence (the first one
+ * if none of them has a confidence value), or NULL if there is none.
+ */
+const sprec_alternative *sprec_result_best(const sprec_result *result);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !__SPREC_PARSER_H__ */
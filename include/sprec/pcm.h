@@ -0,0 +1,98 @@
+/*
+ * pcm.h
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#ifndef __SPREC_PCM_H__
+#define __SPREC_PCM_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <sprec/wav.h>
+
+/*
+ * Sample formats accepted as input. All of them are little endian
+ * and interleaved. 8 bit audio is encoded as is; everything wider is
+ * converted to 16 bits, which is what the Speech API expects.
+ */
+typedef enum sprec_pcm_format {
+	SPREC_PCM_U8,		/* 8 bit unsigned */
+	SPREC_PCM_S16LE,	/* 16 bit signed */
+	SPREC_PCM_S24LE,	/* 24 bit signed, packed in 3 bytes */
+	SPREC_PCM_S32LE,	/* 32 bit signed */
+	SPREC_PCM_F32LE		/* 32 bit float, full scale is [-1, 1] */
+} sprec_pcm_format;
+
+/*
+ * State of the dither noise generator
+ */
+typedef struct sprec_dither {
+	uint32_t state[4];
+} sprec_dither;
+
+/*
+ * Size of one sample in bytes
+ */
+size_t sprec_pcm_sample_size(sprec_pcm_format fmt);
+
+/*
+ * Bits per sample of the converted samples (8 or 16)
+ */
+uint32_t sprec_pcm_output_bps(sprec_pcm_format fmt);
+
+/*
+ * Integer format with `bps' bits per sample.
+ * Returns 0 on success, non-0 if there is none.
+ */
+int sprec_pcm_format_from_bps(uint32_t bps, sprec_pcm_format *fmt);
+
+/*
+ * Format of the data section of a WAV file with the header `hdr'.
+ * Returns 0 on success, non-0 if the format is not supported.
+ */
+int sprec_pcm_format_from_wav(const sprec_wav_header *hdr, sprec_pcm_format *fmt);
+
+/*
+ * Seeds the generator. The same seed gives the same noise,
+ * so that converting the same audio twice gives the same result.
+ */
+void sprec_dither_init(sprec_dither *dither, uint32_t seed);
+
+/*
+ * Converts `nsamples' samples at `src' to `sprec_pcm_output_bps(fmt)'
+ * bits, stored in 32 bit integers (as libFLAC takes them).
+ * Down-converted samples are rounded, with triangular dither noise of
+ * +/- 1 LSB added if `dither' is not NULL, and clamped to the 16 bit
+ * range; NaN is converted to 0. Uses SIMD instructions where available.
+ */
+void sprec_pcm_convert(
+	const void *src,
+	sprec_pcm_format fmt,
+	size_t nsamples,
+	int32_t *dst,
+	sprec_dither *dither
+);
+
+/*
+ * Value of the sample at `index', relative to full scale (0 for NaN)
+ */
+float sprec_pcm_sample(const void *src, sprec_pcm_format fmt, size_t index);
+
+/*
+ * Mean power of `nsamples' samples, relative to full scale
+ * (10 * log10() of it is the level in dBFS)
+ */
+double sprec_pcm_power(const void *src, sprec_pcm_format fmt, size_t nsamples);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !__SPREC_PCM_H__ */
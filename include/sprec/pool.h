@@ -0,0 +1,75 @@
+/*
+ * pool.h
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#ifndef __SPREC_POOL_H__
+#define __SPREC_POOL_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <sprec/web_client.h>
+
+/*
+ * A pool of connections to the API shared by any number of threads.
+ * Over HTTP/2 the concurrent requests are multiplexed as streams of a
+ * few connections instead of each opening (and handshaking) its own;
+ * if libcurl or the server lacks HTTP/2, the requests fall back to
+ * HTTP/1.1 and are spread over at most `max_connections' connections.
+ * Either way the connections are kept alive between requests.
+ */
+typedef struct sprec_http_pool sprec_http_pool;
+
+typedef struct sprec_http_options {
+	int http2;		/* non-0 to try HTTP/2; default 1 */
+	long max_streams;	/* concurrent requests per HTTP/2
+				 * connection; default 100 */
+	long max_connections;	/* to the API; default 4 */
+} sprec_http_options;
+
+void sprec_http_options_init(sprec_http_options *opts);
+
+/*
+ * Creates a pool and the thread driving its transfers.
+ * If `opts' is NULL, the defaults are used. Returns NULL on error.
+ */
+sprec_http_pool *sprec_http_pool_new(const sprec_http_options *opts);
+
+/*
+ * Stops the thread and closes the connections.
+ * No request may be in progress.
+ */
+void sprec_http_pool_free(sprec_http_pool *pool);
+
+/*
+ * Same as sprec_send_audio_data(), over the connections of the pool.
+ * Blocks until the response has been received; may be called
+ * from several threads at once.
+ */
+sprec_server_response *sprec_http_pool_send(
+	sprec_http_pool *pool,
+	const void *data,
+	size_t length,
+	const char *apikey,
+	const char *language,
+	uint32_t sample_rate
+);
+
+/*
+ * Returns non-0 if the requests of the pool are multiplexed over HTTP/2
+ * (as far as libcurl goes; the server may still answer in HTTP/1.1)
+ */
+int sprec_http_pool_multiplexing(const sprec_http_pool *pool);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !__SPREC_POOL_H__ */
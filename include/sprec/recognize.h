@@ -21,11 +21,18 @@ typedef void (*sprec_callback)(const char *, void *);
  * Performs a synchronous text recognition session in the given language,
  * listening for the duration specified by `dur_s' (in seconds),
  * then returns the recognized text and the recognition confidence.
- * The return value must be freed using sprec_result_free().
+ * The return value must be freed using sprec_free().
  * Returns NULL on error.
  */
 char *sprec_recognize_sync(const char *apikey, const char *lang, double dur_s);
 
+/*
+ * Same as sprec_recognize_sync(), with the priority the recognition is
+ * given under the memory budget (see budget.h); the former uses 0.
+ * Returns NULL as well if the budget refuses it, or sheds it.
+ */
+char *sprec_recognize_sync_ex(const char *apikey, const char *lang, double dur_s, int priority);
+
 
 /*
  * Performs an asynchronous text recognition session in the given language,
@@ -33,7 +40,7 @@ char *sprec_recognize_sync(const char *apikey, const char *lang, double dur_s);
  * Returns immediately. When the recognition finishes or an eror occurs,
  * it calls the `cb' callback function with a valid sprec_result structure
  * and the `userdata' specified here. The callback function *must not*
- * sprec_result_free() its first parameter!
+ * sprec_free() its first parameter!
  */
 pthread_t sprec_recognize_async(
 	const char *apikey,
@@ -43,6 +50,19 @@ pthread_t sprec_recognize_async(
 	void *userdata
 );
 
+/*
+ * Same as sprec_recognize_async(), with a priority
+ * as for sprec_recognize_sync_ex()
+ */
+pthread_t sprec_recognize_async_ex(
+	const char *apikey,
+	const char *lang,
+	double dur_s,
+	int priority,
+	sprec_callback cb,
+	void *userdata
+);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
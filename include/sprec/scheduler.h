@@ -0,0 +1,101 @@
+/*
+ * scheduler.h
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#ifndef __SPREC_SCHEDULER_H__
+#define __SPREC_SCHEDULER_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <sprec/web_client.h>
+
+/*
+ * Quota-aware request scheduler.
+ *
+ * The scheduler owns a pool of API keys, each with its own token bucket.
+ * A request consumes one token of the key it is sent with; when no key
+ * has a token left, requests wait in a priority queue (higher priority
+ * first, FIFO among equal priorities) until one is refilled. A key that
+ * gets a 403 or 429 response is put in exponential back-off and the
+ * request is transparently re-sent with another key.
+ *
+ * All functions are thread-safe; sprec_scheduler_send() blocks
+ * the calling thread while the request is queued.
+ */
+typedef struct sprec_scheduler sprec_scheduler;
+
+typedef struct sprec_key_config {
+	const char *apikey;
+	double rate;	/* tokens per second, e. g. 50.0 / 86400 for 50/day */
+	double burst;	/* bucket capacity (and initial number of tokens) */
+} sprec_key_config;
+
+typedef struct sprec_key_stats {
+	double tokens;		/* currently available */
+	double backoff;		/* seconds left until the key is usable again */
+	unsigned failures;	/* consecutive 403/429 responses */
+	uint64_t requests;
+	uint64_t rejected;	/* 403/429 responses */
+} sprec_key_stats;
+
+/*
+ * Back-off applied after the first rejection of a key;
+ * doubled on each consecutive one, up to SPREC_SCHEDULER_MAX_BACKOFF.
+ */
+#define SPREC_SCHEDULER_MIN_BACKOFF 1.0
+#define SPREC_SCHEDULER_MAX_BACKOFF 3600.0
+
+/*
+ * Creates a scheduler for the `nkeys' keys in `keys'.
+ * The key strings are copied.
+ * Returns NULL on error.
+ */
+sprec_scheduler *sprec_scheduler_new(const sprec_key_config *keys, size_t nkeys);
+
+/*
+ * Frees the scheduler. There must be no request in progress.
+ */
+void sprec_scheduler_free(sprec_scheduler *sched);
+
+/*
+ * Same as sprec_send_audio_data(), but picks the API key from the pool,
+ * waiting at most `timeout' seconds (forever if negative) for one to be
+ * available. Requests with a higher `priority' are served first.
+ * Returns NULL on error or timeout. If every key was rejected, the
+ * last 403/429 response is returned.
+ */
+sprec_server_response *
+sprec_scheduler_send(
+	sprec_scheduler *sched,
+	const void *data,
+	size_t length,
+	const char *language,
+	uint32_t sample_rate,
+	int priority,
+	double timeout
+);
+
+/*
+ * Returns the number of requests waiting for a key.
+ */
+size_t sprec_scheduler_queued(sprec_scheduler *sched);
+
+/*
+ * Fills `stats' with the current state of the key at `index'.
+ * Returns 0 on success, non-0 if `index' is out of range.
+ */
+int sprec_scheduler_get_key_stats(sprec_scheduler *sched, size_t index, sprec_key_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !__SPREC_SCHEDULER_H__ */
@@ -0,0 +1,93 @@
+/*
+ * segment.h
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#ifndef __SPREC_SEGMENT_H__
+#define __SPREC_SEGMENT_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <sprec/wav.h>
+#include <sprec/web_client.h>
+
+/*
+ * Recognition of long recordings.
+ *
+ * The audio is split into segments, preferably in the middle of pauses
+ * (runs of windows quieter than `silence_threshold'). If no pause is
+ * found, a segment is cut at `max_length' seconds and the next one
+ * starts `overlap' seconds earlier, so that a word on the boundary is
+ * heard in full at least once. Segments containing nothing but silence
+ * are skipped. The segments are then encoded and uploaded concurrently
+ * by `workers' threads.
+ */
+typedef struct sprec_segment_options {
+	double max_length;		/* seconds, default 15 */
+	double min_length;		/* seconds, default 2 */
+	double overlap;			/* seconds, default 0.5 */
+	double silence_threshold;	/* dBFS, default -40 */
+	double silence_length;		/* seconds, default 0.3 */
+	unsigned workers;		/* default: number of CPUs, at least 4 */
+	const sprec_send_options *send;	/* default: NULL */
+} sprec_segment_options;
+
+typedef struct sprec_segment_result {
+	double start;			/* seconds from the beginning */
+	double end;
+	sprec_server_response *resp;	/* NULL if recognition failed */
+} sprec_segment_result;
+
+void sprec_segment_options_init(sprec_segment_options *opts);
+
+/*
+ * Recognizes the WAV file at `wavfile' (in any format listed in pcm.h).
+ * If `opts' is NULL, the defaults are used.
+ * On success, returns 0 and sets `*results' to an array of `*count'
+ * results in chronological order, which should be freed using
+ * sprec_segment_results_free(). Failure of a single segment is not an
+ * error; its `resp' is NULL. Returns non-0 on error.
+ * The file and the segments in flight are reserved for under the memory
+ * budget (see budget.h): a refusal is an error, and once shed, the
+ * segments not yet uploaded fail.
+ */
+int sprec_recognize_long(
+	const char *wavfile,
+	const char *apikey,
+	const char *language,
+	const sprec_segment_options *opts,
+	sprec_segment_result **results,
+	size_t *count
+);
+
+/*
+ * Same as sprec_recognize_long(), but takes the interleaved PCM data
+ * (in the format of the data section of a WAV file) from memory.
+ * Only the sample rate, the format type, the bit depth and the number
+ * of channels are used from `hdr'.
+ */
+int sprec_recognize_long_pcm(
+	const void *pcm,
+	size_t length,
+	const sprec_wav_header *hdr,
+	const char *apikey,
+	const char *language,
+	const sprec_segment_options *opts,
+	sprec_segment_result **results,
+	size_t *count
+);
+
+void sprec_segment_results_free(sprec_segment_result *results, size_t count);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !__SPREC_SEGMENT_H__ */
@@ -0,0 +1,74 @@
+/*
+ * server.h
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#ifndef __SPREC_SERVER_H__
+#define __SPREC_SERVER_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stddef.h>
+
+#include <sprec/web_client.h>
+#include <sprec/pool.h>
+
+/*
+ * The daemon side of client.h: serves recognition requests from local
+ * processes over a Unix-domain socket, with one connection pool, one
+ * cache and one pool of encoders for all of them.
+ */
+typedef struct sprec_server sprec_server;
+
+typedef struct sprec_server_options {
+	const char *path;	/* of the socket; default as for
+				 * sprec_client_connect(), see
+				 * sprec_client_socket_path() */
+	size_t max_clients;	/* connected at once; default 64 */
+	size_t cache_entries;	/* in memory; default 1024, 0 for no cache */
+	const char *cache_path;	/* disk tier of the cache; default NULL (none) */
+	size_t cache_slots;	/* of the disk tier; default 4096 */
+	size_t encoders;	/* idle encoders kept; default 4 */
+	sprec_http_options http;
+	sprec_send_options send;	/* `pool' is set by the server */
+} sprec_server_options;
+
+void sprec_server_options_init(sprec_server_options *opts);
+
+/*
+ * Creates the server and its socket. A socket left at the path by a
+ * daemon which is gone is replaced; if another daemon is listening
+ * there, or the path names anything but a socket, this fails with
+ * errno set to EADDRINUSE or EEXIST; if the default directory in /tmp
+ * isn't the user's own, with EPERM. The socket is given mode 0600, and
+ * only processes of the same user are served. If `opts' is NULL, the
+ * defaults are used. Returns NULL on error.
+ */
+sprec_server *sprec_server_new(const sprec_server_options *opts);
+
+/*
+ * Serves clients, each on its own thread, until sprec_server_stop()
+ * is called. Returns 0 once stopped, non-0 on error.
+ */
+int sprec_server_run(sprec_server *srv);
+
+/*
+ * Makes sprec_server_run() disconnect the clients and return.
+ * May be called from a signal handler.
+ */
+void sprec_server_stop(sprec_server *srv);
+
+/*
+ * Removes the socket and frees the server, which mustn't be running
+ */
+void sprec_server_free(sprec_server *srv);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !__SPREC_SERVER_H__ */
@@ -0,0 +1,151 @@
+/*
+ * spool.h
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#ifndef __SPREC_SPOOL_H__
+#define __SPREC_SPOOL_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <sprec/web_client.h>
+
+/*
+ * An on-disk queue of encoded audio waiting to be uploaded, so that
+ * the work survives an outage of the API, an exhausted quota or a
+ * restart of the program. Entries are appended to a journal file
+ * (and synced to disk) before they are sent, and marked as removed
+ * once they have been answered. When no entry is left, the file is
+ * truncated.
+ *
+ * Every entry is checksummed: after a crash, a partially written
+ * entry at the end of the file is detected and discarded when the
+ * spool is opened again. Removals aren't synced, so an entry answered
+ * right before a crash may be sent once more.
+ *
+ * The file is in the byte order of the machine which wrote it.
+ */
+typedef struct sprec_spool sprec_spool;
+typedef struct sprec_drainer sprec_drainer;
+
+typedef struct sprec_spool_entry {
+	uint64_t id;
+	const void *data;	/* the FLAC-encoded audio */
+	size_t length;
+	const char *language;
+	uint32_t sample_rate;
+	double created;		/* seconds since the epoch */
+} sprec_spool_entry;
+
+/*
+ * Opens (or creates) the spool at `path' and recovers its entries.
+ * Returns NULL on error, including a file which isn't a spool.
+ */
+sprec_spool *sprec_spool_open(const char *path);
+
+/*
+ * Closes the spool. The drainers must have been stopped.
+ */
+void sprec_spool_close(sprec_spool *spool);
+
+/*
+ * Appends `length' bytes of FLAC-encoded audio, to be recognized in
+ * `language', and syncs it to disk. Sets `*id' (if not NULL) to the
+ * identifier of the new entry.
+ * Returns 0 on success, non-0 on error.
+ */
+int sprec_spool_append(
+	sprec_spool *spool,
+	const void *data,
+	size_t length,
+	const char *language,
+	uint32_t sample_rate,
+	uint64_t *id
+);
+
+/*
+ * Encodes the WAV file at `wavfile' and appends it.
+ * Returns 0 on success, non-0 on error.
+ */
+int sprec_spool_append_file(sprec_spool *spool, const char *wavfile, const char *language, uint64_t *id);
+
+/*
+ * Returns the oldest entry, or NULL if there is none (or on error).
+ * Its audio is mapped from the file rather than read into memory.
+ * It should be released with sprec_spool_entry_free().
+ */
+sprec_spool_entry *sprec_spool_oldest(sprec_spool *spool);
+
+void sprec_spool_entry_free(sprec_spool_entry *entry);
+
+/*
+ * Removes the entry with the given identifier.
+ * Returns 0 on success, non-0 if there is no such entry.
+ */
+int sprec_spool_remove(sprec_spool *spool, uint64_t id);
+
+/*
+ * Number of entries and total length of their audio, in bytes
+ */
+size_t sprec_spool_count(sprec_spool *spool);
+uint64_t sprec_spool_size(sprec_spool *spool);
+
+/*
+ * Called by a drainer with the final response to an entry: a 2xx one
+ * or an error that won't go away by retrying (a 400 for bad audio,
+ * for instance). The entry is removed if the callback returns 0, and
+ * tried again later otherwise. `entry' and the response are freed
+ * when the callback returns. Without a callback, entries are removed
+ * after a 2xx response only.
+ */
+typedef int (*sprec_drain_callback)(const sprec_spool_entry *entry, sprec_server_response *resp, void *ctx);
+
+typedef struct sprec_drain_options {
+	double rate;		/* requests per second; default 2 */
+	unsigned burst;		/* requests which may be sent at once after
+				 * an idle period; default 1 */
+	double retry_delay;	/* after a transport error or a 403 (quota
+				 * exhausted), 408, 429 or 5xx response, or
+				 * an entry kept, the drainer waits this long
+				 * (in seconds; default 1), doubling at each
+				 * failure in a row, up to... */
+	double max_retry_delay;	/* ... this long; default 60 */
+	sprec_send_options send;	/* per request; default as with
+					 * sprec_send_options_init() */
+} sprec_drain_options;
+
+void sprec_drain_options_init(sprec_drain_options *opts);
+
+/*
+ * Starts a thread uploading the entries of the spool, oldest first, at
+ * the rate given by `opts' (the defaults if NULL), calling `cb' (which
+ * may be NULL) with the responses. Entries appended later are sent too.
+ * A spool should have a single drainer at a time.
+ * Returns NULL on error.
+ */
+sprec_drainer *sprec_spool_drain(
+	sprec_spool *spool,
+	const char *apikey,
+	const sprec_drain_options *opts,
+	sprec_drain_callback cb,
+	void *ctx
+);
+
+/*
+ * Stops the drainer, after the request in progress (if any) is over.
+ * The callback is not called after this returns.
+ */
+void sprec_drainer_stop(sprec_drainer *drainer);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !__SPREC_SPOOL_H__ */
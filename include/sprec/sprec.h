@@ -13,6 +13,26 @@
 #include <sprec/flac_encoder.h>
 #include <sprec/web_client.h>
 #include <sprec/recognize.h>
+#include <sprec/parser.h>
+#include <sprec/cache.h>
+#include <sprec/scheduler.h>
+#include <sprec/segment.h>
+#include <sprec/alloc.h>
+#include <sprec/pcm.h>
+#include <sprec/capture.h>
+#include <sprec/listen.h>
+#include <sprec/async.h>
+#include <sprec/future.h>
+#include <sprec/fanout.h>
+#include <sprec/pool.h>
+#include <sprec/spool.h>
+#include <sprec/client.h>
+#include <sprec/server.h>
+#include <sprec/adaptive.h>
+#include <sprec/archive.h>
+#include <sprec/levels.h>
+#include <sprec/init.h>
+#include <sprec/budget.h>
 
 #endif /* !__SPREC_SPREC_H__ */
 
@@ -25,6 +25,16 @@ extern "C" {
  */
 #define SPREC_WAV_HEADER_SIZE 36
 
+/*
+ * Format codes (`format_type'), as defined by Microsoft
+ */
+#ifndef WAVE_FORMAT_PCM
+#define WAVE_FORMAT_PCM 1
+#endif
+#ifndef WAVE_FORMAT_IEEE_FLOAT
+#define WAVE_FORMAT_IEEE_FLOAT 3
+#endif
+
 typedef struct sprec_wav_header {
 	char RIFF_marker[4];
 	uint32_t file_size;
@@ -43,14 +53,14 @@ typedef struct sprec_wav_header {
  * Allocates a new WAV file header from the raw header data
  * (i. e. the first SPREC_WAV_HEADER_SIZE bytes of a WAV file).
  * Returns NULL on error.
- * Should be free()'d after use.
+ * Should be freed with sprec_free() after use.
  */
 sprec_wav_header *sprec_wav_header_from_data(const FLAC__byte *ptr);
 
 /*
  * Allocates a new WAV file header from the given PCM parameters.
  * Returns NULL on error.
- * Should be free()'d after use.
+ * Should be freed with sprec_free() after use.
  */
 sprec_wav_header *sprec_wav_header_from_params(
 	uint32_t sample_rate,
@@ -58,6 +68,18 @@ sprec_wav_header *sprec_wav_header_from_params(
 	uint16_t channels
 );
 
+/*
+ * Size of the header of a WAV file written by libsprec,
+ * including the header of the data section
+ */
+#define SPREC_WAV_FILE_HEADER_SIZE 44
+
+/*
+ * Stores the header (the data section being `hdr->file_size' - 36 bytes
+ * long) in the first SPREC_WAV_FILE_HEADER_SIZE bytes at `ptr'
+ */
+void sprec_wav_header_pack(const sprec_wav_header *hdr, FLAC__byte *ptr);
+
 /*
  * Writes a WAV header to a file represented by `fd'.
  * The stream position indicator should be at the beginning
@@ -66,6 +88,27 @@ sprec_wav_header *sprec_wav_header_from_params(
  */
 int sprec_wav_header_write(FILE *fd, sprec_wav_header *hdr);
 
+/*
+ * Reads the header of the WAV file open as `f', which must be positioned
+ * at the beginning of the file, and leaves it positioned at the start of
+ * the data section. On success, returns 0, sets `*hdr' to the header of
+ * the file (to be freed with sprec_free()) and `*length' to the length
+ * of the data section in bytes. For WAVE_FORMAT_EXTENSIBLE files,
+ * `format_type' is set to the format code of the sub-format.
+ * Returns non-0 on error.
+ */
+int sprec_wav_read_header(FILE *f, sprec_wav_header **hdr, uint32_t *length);
+
+/*
+ * Reads the WAV file at `filename' into memory.
+ * On success, returns 0, sets `*hdr' to the header of the file
+ * and `*pcm' to the contents of its data section, which is
+ * `*length' bytes long. Both should be freed
+ * with sprec_free() after use.
+ * Returns non-0 on error.
+ */
+int sprec_wav_read(const char *filename, sprec_wav_header **hdr, void **pcm, size_t *length);
+
 /*
  * Records a WAV (PCM) audio file to the file `filename', with the
  * parameters represented by `hdr', for `duration_ms' milliseconds.
@@ -78,6 +121,13 @@ int sprec_wav_header_write(FILE *fd, sprec_wav_header *hdr);
  */
 int sprec_record_wav(const char *filename, sprec_wav_header *hdr, uint32_t duration_ms);
 
+/*
+ * Same as sprec_record_wav(), from the ALSA device named `device'
+ * (NULL means "pulse"). Ignored on Mac OS X and iOS, which always
+ * record from the default input.
+ */
+int sprec_record_wav_ex(const char *filename, sprec_wav_header *hdr, uint32_t duration_ms, const char *device);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -18,18 +18,89 @@ extern "C" {
 #include <unistd.h>
 #include <fcntl.h>
 #include <string.h>
+#include <stdint.h>
 
+#include <sprec/parser.h>
+
+/*
+ * `data' is the verbatim JSON returned by the API, `result' holds the
+ * alternatives parsed out of it while it was being received.
+ * `status' is the HTTP status code (0 if no response was received).
+ */
 typedef struct sprec_server_response {
 	char *data;
 	size_t length;
+	sprec_result result;
+	long status;
 } sprec_server_response;
 
+/*
+ * Format of the audio sent: FLAC, or L16 (raw 16 bit signed mono PCM,
+ * little endian), which costs no CPU time but about twice the bytes
+ */
+typedef enum sprec_audio_encoding {
+	SPREC_ENCODING_FLAC,
+	SPREC_ENCODING_L16
+} sprec_audio_encoding;
+
+/*
+ * Details of the last attempt of a request
+ */
+typedef struct sprec_send_stats {
+	unsigned attempts;	/* made in total, including retries */
+	size_t bytes;		/* of audio uploaded by the last attempt */
+	double upload_time;	/* seconds from its start to the end of the
+				 * upload, 0 if unknown */
+	double total_time;	/* seconds from its start to its end */
+} sprec_send_stats;
+
+/*
+ * Retry and hedging policy of sprec_send_audio_data_ex().
+ *
+ * A request that fails at the transport level or gets a 408, 429 or 5xx
+ * response is retried at most `max_retries' times, after a random delay
+ * between 0 and base_delay * 2^n seconds (n being the number of the
+ * retry, counted from 0), capped at `max_delay'.
+ *
+ * If `hedge' is non-zero, a second copy of the request is sent when the
+ * first one hasn't been answered in `hedge_delay' seconds, and the first
+ * good response wins. If `hedge_delay' is 0, the 95th percentile of the
+ * latency of recent successful requests is used instead (no hedging
+ * happens until enough requests have been made to estimate it).
+ *
+ * If `pool' is non-NULL, the requests (but not their hedged copies)
+ * are sent over its shared connections (see pool.h).
+ *
+ * `encoding' is the format of the audio, and `stats' (if not NULL)
+ * receives the details of the request; options with a `stats' pointer
+ * shouldn't be shared by several threads.
+ */
+typedef struct sprec_send_options {
+	unsigned max_retries;
+	double base_delay;
+	double max_delay;
+	int hedge;
+	double hedge_delay;
+	struct sprec_http_pool *pool;
+	sprec_audio_encoding encoding;
+	sprec_send_stats *stats;
+} sprec_send_options;
+
+/*
+ * Fills `opts' with the defaults: no retries, no hedging,
+ * 0.25 seconds base delay, 8 seconds maximal delay, no pool,
+ * FLAC audio, no stats.
+ */
+void sprec_send_options_init(sprec_send_options *opts);
+
 /*
  * Sends the FLAC-encoded audio data.
  * Returns a struct server_response pointer,
  * in which the API's JSON response is present.
  * Should be freed with sprec_free_response().
- * Returns NULL on error.
+ * Returns NULL on error, including errors of the
+ * transfer itself. HTTP error responses are returned
+ * as is; check the `status' field.
  */
 sprec_server_response *
 sprec_send_audio_data(
@@ -40,6 +111,27 @@ sprec_send_audio_data(
 	uint32_t sample_rate
 );
 
+/*
+ * Same as sprec_send_audio_data(), with retries and hedging as described
+ * by `opts'. If `opts' is NULL, the defaults are used. If every attempt
+ * failed, the last error response (or NULL) is returned.
+ */
+sprec_server_response *
+sprec_send_audio_data_ex(
+	const void *data,
+	size_t length,
+	const char *apikey,
+	const char *language,
+	uint32_t sample_rate,
+	const sprec_send_options *opts
+);
+
+/*
+ * Returns the 95th percentile of the latency (in seconds) of the
+ * recent successful requests, or 0 if there haven't been enough.
+ */
+double sprec_latency_p95(void);
+
 void sprec_free_response(sprec_server_response *resp);
 
 #ifdef __cplusplus
@@ -0,0 +1,469 @@
+/*
+ * adaptive.c
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sprec/adaptive.h>
+#include <sprec/wav.h>
+#include <sprec/flac_encoder.h>
+#include <sprec/alloc.h>
+#include <sprec/budget.h>
+#include "clock.h"
+#include "flac.h"
+
+#define CHUNK_FRAMES 4096
+
+/*
+ * The ways of sending the audio, in the order of the metrics
+ */
+static const struct {
+	sprec_audio_encoding encoding;
+	unsigned level;
+	double ratio;		/* initial guess */
+} sprec_adaptive_table[SPREC_ADAPTIVE_CHOICES] = {
+	{ SPREC_ENCODING_L16, 0, 1.0 },
+	{ SPREC_ENCODING_FLAC, 0, 0.65 },
+	{ SPREC_ENCODING_FLAC, 5, 0.58 },
+	{ SPREC_ENCODING_FLAC, 8, 0.56 }
+};
+
+/*
+ * The order in which the choices are first tried: the former
+ * fixed setting (level 5) first, then the cheapest one
+ */
+static const int sprec_adaptive_first[SPREC_ADAPTIVE_CHOICES] = { 2, 0, 1, 3 };
+
+struct sprec_adaptive {
+	sprec_allocator alloc;
+	sprec_adaptive_options opts;
+	sprec_encoder_pool *encoders;
+	pthread_mutex_t lock;
+	sprec_adaptive_metrics metrics;
+	uint64_t tried[SPREC_ADAPTIVE_CHOICES];	/* request number, 0 if never */
+};
+
+void sprec_adaptive_options_init(sprec_adaptive_options *opts)
+{
+	opts->smoothing = 0.2;
+	opts->explore = 32;
+	opts->allow_l16 = 1;
+	opts->min_level = 0;
+	opts->max_level = 8;
+}
+
+sprec_adaptive *sprec_adaptive_new(const sprec_adaptive_options *opts)
+{
+	sprec_adaptive *ad;
+	sprec_allocator alloc;
+	sprec_adaptive_choice *c;
+	int i, any = 0;
+
+	sprec_get_allocator(&alloc);
+
+	ad = sprec_allocator_calloc(&alloc, 1, sizeof *ad);
+	if (ad == NULL) {
+		return NULL;
+	}
+
+	ad->alloc = alloc;
+
+	if (opts != NULL) {
+		ad->opts = *opts;
+	} else {
+		sprec_adaptive_options_init(&ad->opts);
+	}
+
+	if (ad->opts.smoothing <= 0 || ad->opts.smoothing > 1) {
+		ad->opts.smoothing = 0.2;
+	}
+
+	ad->encoders = sprec_encoder_pool_new(4);
+	if (ad->encoders == NULL) {
+		sprec_allocator_free(&alloc, ad);
+		return NULL;
+	}
+
+	ad->metrics.last = -1;
+
+	for (i = 0; i < SPREC_ADAPTIVE_CHOICES; i++) {
+		c = &ad->metrics.choices[i];
+		c->encoding = sprec_adaptive_table[i].encoding;
+		c->level = sprec_adaptive_table[i].level;
+		c->ratio = sprec_adaptive_table[i].ratio;
+
+		if (c->encoding == SPREC_ENCODING_L16) {
+			c->enabled = ad->opts.allow_l16;
+		} else {
+			c->enabled = c->level >= ad->opts.min_level && c->level <= ad->opts.max_level;
+		}
+
+		any |= c->enabled;
+	}
+
+	/* nothing left to choose from: behave as before */
+	if (!any) {
+		ad->metrics.choices[2].enabled = 1;
+	}
+
+	pthread_mutex_init(&ad->lock, NULL);
+
+	return ad;
+}
+
+void sprec_adaptive_free(sprec_adaptive *ad)
+{
+	sprec_allocator alloc;
+
+	if (ad == NULL) {
+		return;
+	}
+
+	sprec_encoder_pool_free(ad->encoders);
+	pthread_mutex_destroy(&ad->lock);
+
+	alloc = ad->alloc;
+	sprec_allocator_free(&alloc, ad);
+}
+
+void sprec_adaptive_get_metrics(sprec_adaptive *ad, sprec_adaptive_metrics *metrics)
+{
+	pthread_mutex_lock(&ad->lock);
+	*metrics = ad->metrics;
+	pthread_mutex_unlock(&ad->lock);
+}
+
+static double sprec_ewma(double average, double x, double weight)
+{
+	return average > 0 ? average + weight * (x - average) : x;
+}
+
+/*
+ * Picks the way to send `bytes' bytes of 16 bit PCM.
+ * Must be called with the lock held.
+ */
+static int sprec_adaptive_decide(sprec_adaptive *ad, double bytes)
+{
+	sprec_adaptive_metrics *m = &ad->metrics;
+	sprec_adaptive_choice *c;
+	double best = 0;
+	int i, k, choice = -1;
+
+	m->requests++;
+
+	/*
+	 * Everything gets measured once...
+	 */
+	for (k = 0; k < SPREC_ADAPTIVE_CHOICES; k++) {
+		i = sprec_adaptive_first[k];
+		if (m->choices[i].enabled && ad->tried[i] == 0) {
+			return i;
+		}
+	}
+
+	/*
+	 * ...and again from time to time
+	 */
+	if (ad->opts.explore > 0 && m->requests % ad->opts.explore == 0) {
+		for (i = 0; i < SPREC_ADAPTIVE_CHOICES; i++) {
+			if (m->choices[i].enabled && (choice < 0 || ad->tried[i] < ad->tried[choice])) {
+				choice = i;
+			}
+		}
+		return choice;
+	}
+
+	/*
+	 * Otherwise, the fastest way to get the audio there:
+	 * encoding time plus upload time
+	 */
+	for (i = 0; i < SPREC_ADAPTIVE_CHOICES; i++) {
+		c = &m->choices[i];
+		if (!c->enabled) {
+			continue;
+		}
+
+		c->estimate = 0;
+		if (c->encode_rate > 0) {
+			c->estimate += bytes / c->encode_rate;
+		}
+		if (m->upload_rate > 0) {
+			c->estimate += bytes * c->ratio / m->upload_rate;
+		}
+
+		if (choice < 0 || c->estimate < best) {
+			choice = i;
+			best = c->estimate;
+		}
+	}
+
+	return choice;
+}
+
+/*
+ * Converts the audio to 16 bit mono, little endian
+ */
+static void sprec_adaptive_downmix(
+	const void *data,
+	size_t frames,
+	uint32_t channels,
+	sprec_pcm_format fmt,
+	unsigned char *out,
+	int32_t *tmp
+)
+{
+	const unsigned char *src = data;
+	size_t frame_size = sprec_pcm_sample_size(fmt) * channels;
+	int shift = sprec_pcm_output_bps(fmt) == 8 ? 8 : 0;
+	sprec_dither dither;
+	size_t i, n, done;
+	uint32_t ch;
+	int32_t sum;
+	int16_t v;
+
+	sprec_dither_init(&dither, SPREC_FLAC_DITHER_SEED);
+
+	for (done = 0; done < frames; done += n) {
+		n = frames - done < CHUNK_FRAMES ? frames - done : CHUNK_FRAMES;
+
+		sprec_pcm_convert(src + done * frame_size, fmt, n * channels, tmp, &dither);
+
+		for (i = 0; i < n; i++) {
+			sum = 0;
+			for (ch = 0; ch < channels; ch++) {
+				sum += tmp[i * channels + ch];
+			}
+
+			v = (int16_t)(sum / (int32_t)channels * (1 << shift));
+			out[2 * (done + i)] = (unsigned char)(v & 0xff);
+			out[2 * (done + i) + 1] = (unsigned char)((v >> 8) & 0xff);
+		}
+	}
+}
+
+/*
+ * Sends the audio under the reservation `res', which must cover
+ * the 16 bit audio, its encoded form and the response
+ */
+static sprec_server_response *sprec_adaptive_send(
+	sprec_adaptive *ad,
+	sprec_reservation *res,
+	const void *data,
+	size_t frames,
+	uint32_t rate,
+	uint32_t channels,
+	sprec_pcm_format fmt,
+	const char *apikey,
+	const char *language,
+	const sprec_send_options *send
+)
+{
+	sprec_server_response *resp;
+	sprec_adaptive_choice *c;
+	sprec_send_options opts;
+	sprec_send_stats stats;
+	sprec_encoder *enc = NULL;
+	unsigned char *pcm;
+	int32_t *tmp;
+	const void *payload;
+	size_t bytes, size;
+	double started = 0, encoded = 0;
+	int choice;
+
+	bytes = 2 * frames;
+
+	pcm = sprec_allocator_malloc(&ad->alloc, bytes);
+	tmp = sprec_allocator_malloc(&ad->alloc, CHUNK_FRAMES * channels * sizeof tmp[0]);
+	if (pcm == NULL || tmp == NULL) {
+		sprec_allocator_free(&ad->alloc, pcm);
+		sprec_allocator_free(&ad->alloc, tmp);
+		return NULL;
+	}
+
+	sprec_adaptive_downmix(data, frames, channels, fmt, pcm, tmp);
+	sprec_allocator_free(&ad->alloc, tmp);
+
+	if (sprec_reservation_shed(res)) {
+		sprec_allocator_free(&ad->alloc, pcm);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&ad->lock);
+	choice = sprec_adaptive_decide(ad, bytes);
+	ad->tried[choice] = ad->metrics.requests;
+	c = &ad->metrics.choices[choice];
+	c->chosen++;
+	ad->metrics.last = choice;
+	pthread_mutex_unlock(&ad->lock);
+
+	payload = pcm;
+	size = bytes;
+
+	if (sprec_adaptive_table[choice].encoding == SPREC_ENCODING_FLAC) {
+		enc = sprec_encoder_pool_acquire(ad->encoders);
+		if (enc == NULL) {
+			sprec_allocator_free(&ad->alloc, pcm);
+			return NULL;
+		}
+
+		sprec_encoder_set_level(enc, sprec_adaptive_table[choice].level);
+
+		started = sprec_clock_now();
+		if (sprec_encoder_encode_pcm(enc, pcm, frames, rate, 1, 16, &payload, &size) != 0) {
+			sprec_encoder_pool_release(ad->encoders, enc);
+			sprec_allocator_free(&ad->alloc, pcm);
+			return NULL;
+		}
+		encoded = sprec_clock_now();
+
+		if (sprec_reservation_shed(res)) {
+			sprec_encoder_pool_release(ad->encoders, enc);
+			sprec_allocator_free(&ad->alloc, pcm);
+			return NULL;
+		}
+	}
+
+	if (send != NULL) {
+		opts = *send;
+	} else {
+		sprec_send_options_init(&opts);
+	}
+
+	opts.encoding = sprec_adaptive_table[choice].encoding;
+	opts.stats = &stats;
+
+	resp = sprec_send_audio_data_ex(payload, size, apikey, language, rate, &opts);
+
+	pthread_mutex_lock(&ad->lock);
+
+	if (enc != NULL) {
+		if (encoded > started) {
+			c->encode_rate = sprec_ewma(c->encode_rate, bytes / (encoded - started), ad->opts.smoothing);
+		}
+		c->ratio = sprec_ewma(c->ratio, (double)size / bytes, ad->opts.smoothing);
+	}
+
+	if (stats.upload_time > 0 && stats.bytes > 0) {
+		ad->metrics.upload_rate = sprec_ewma(ad->metrics.upload_rate, stats.bytes / stats.upload_time, ad->opts.smoothing);
+	}
+
+	pthread_mutex_unlock(&ad->lock);
+
+	if (enc != NULL) {
+		sprec_encoder_pool_release(ad->encoders, enc);
+	}
+
+	sprec_allocator_free(&ad->alloc, pcm);
+
+	return resp;
+}
+
+sprec_server_response *sprec_adaptive_send_pcm(
+	sprec_adaptive *ad,
+	const void *data,
+	size_t frames,
+	uint32_t rate,
+	uint32_t channels,
+	sprec_pcm_format fmt,
+	const char *apikey,
+	const char *language,
+	const sprec_send_options *send
+)
+{
+	sprec_server_response *resp;
+	sprec_reservation res;
+
+	if (data == NULL || frames == 0 || channels == 0) {
+		return NULL;
+	}
+
+	if (sprec_budget_reserve(&res, sprec_budget_estimate(2 * frames), 0) != 0) {
+		return NULL;
+	}
+
+	resp = sprec_adaptive_send(ad, &res, data, frames, rate, channels, fmt, apikey, language, send);
+	sprec_budget_release(&res);
+
+	return resp;
+}
+
+sprec_server_response *sprec_adaptive_recognize_file(
+	sprec_adaptive *ad,
+	const char *wavfile,
+	const char *apikey,
+	const char *language,
+	const sprec_send_options *send
+)
+{
+	sprec_server_response *resp;
+	sprec_reservation res;
+	sprec_wav_header *hdr;
+	sprec_pcm_format fmt;
+	uint32_t announced;
+	size_t length;
+	void *pcm;
+	FILE *f;
+
+	/*
+	 * The file is read whole, so the header tells how much to reserve
+	 * for it on top of its 16 bit form
+	 */
+	f = fopen(wavfile, "rb");
+	if (f == NULL) {
+		return NULL;
+	}
+
+	if (sprec_wav_read_header(f, &hdr, &announced) != 0) {
+		fclose(f);
+		return NULL;
+	}
+
+	fclose(f);
+
+	if (hdr->bytes_per_frame == 0 || hdr->number_of_channels == 0 || sprec_pcm_format_from_wav(hdr, &fmt) != 0) {
+		sprec_free(hdr);
+		return NULL;
+	}
+
+	if (sprec_budget_reserve(&res, announced + sprec_budget_estimate(2 * (announced / hdr->bytes_per_frame)), 0) != 0) {
+		sprec_free(hdr);
+		return NULL;
+	}
+
+	sprec_free(hdr);
+
+	if (sprec_wav_read(wavfile, &hdr, &pcm, &length) != 0) {
+		sprec_budget_release(&res);
+		return NULL;
+	}
+
+	if (length < hdr->bytes_per_frame) {
+		sprec_free(pcm);
+		sprec_free(hdr);
+		sprec_budget_release(&res);
+		return NULL;
+	}
+
+	resp = sprec_adaptive_send(
+		ad,
+		&res,
+		pcm,
+		length / hdr->bytes_per_frame,
+		hdr->sample_rate,
+		hdr->number_of_channels,
+		fmt,
+		apikey,
+		language,
+		send
+	);
+
+	sprec_free(pcm);
+	sprec_free(hdr);
+	sprec_budget_release(&res);
+
+	return resp;
+}
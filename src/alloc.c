@@ -0,0 +1,346 @@
+/*
+ * alloc.c
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sprec/alloc.h>
+
+/*
+ * Alignment of arena allocations; enough for any standard type
+ */
+#define ARENA_ALIGN 16
+
+#define ARENA_CHUNK_MIN 0x1000
+
+/*
+ * Arena allocations are prefixed with their size, so that they can be
+ * grown by sprec_arena_realloc()
+ */
+#define ARENA_HEADER_SIZE ARENA_ALIGN
+
+typedef struct sprec_arena_chunk {
+	struct sprec_arena_chunk *next;
+	size_t size;
+	size_t used;
+	/* data follows, aligned to ARENA_ALIGN */
+} sprec_arena_chunk;
+
+#define CHUNK_HEADER_SIZE ((sizeof(sprec_arena_chunk) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+struct sprec_arena {
+	sprec_allocator iface;		/* what's handed out to callers */
+	sprec_allocator parent;		/* where the chunks come from */
+	sprec_arena_chunk *chunks;	/* most recent first */
+	size_t chunk_size;
+	size_t used;
+};
+
+static void *sprec_default_malloc(size_t size, void *ctx);
+static void *sprec_default_realloc(void *ptr, size_t size, void *ctx);
+static void sprec_default_free(void *ptr, void *ctx);
+
+static void *sprec_arena_malloc(size_t size, void *ctx);
+static void *sprec_arena_realloc(void *ptr, size_t size, void *ctx);
+static void sprec_arena_release(void *ptr, void *ctx);
+
+static sprec_allocator sprec_global_allocator = {
+	sprec_default_malloc,
+	sprec_default_realloc,
+	sprec_default_free,
+	NULL
+};
+
+static pthread_key_t sprec_thread_allocator_key;
+static pthread_once_t sprec_thread_allocator_once = PTHREAD_ONCE_INIT;
+static int sprec_thread_allocator_ok = 0;
+
+static void sprec_thread_allocator_init(void)
+{
+	sprec_thread_allocator_ok = pthread_key_create(&sprec_thread_allocator_key, NULL) == 0;
+}
+
+/*
+ * The allocator in effect for the calling thread
+ */
+static const sprec_allocator *sprec_current_allocator(void)
+{
+	const sprec_allocator *alloc;
+
+	pthread_once(&sprec_thread_allocator_once, sprec_thread_allocator_init);
+	if (sprec_thread_allocator_ok) {
+		alloc = pthread_getspecific(sprec_thread_allocator_key);
+		if (alloc != NULL) {
+			return alloc;
+		}
+	}
+
+	return &sprec_global_allocator;
+}
+
+void sprec_set_allocator(const sprec_allocator *alloc)
+{
+	if (alloc == NULL) {
+		sprec_global_allocator.malloc = sprec_default_malloc;
+		sprec_global_allocator.realloc = sprec_default_realloc;
+		sprec_global_allocator.free = sprec_default_free;
+		sprec_global_allocator.ctx = NULL;
+	} else {
+		sprec_global_allocator = *alloc;
+	}
+}
+
+void sprec_set_thread_allocator(const sprec_allocator *alloc)
+{
+	pthread_once(&sprec_thread_allocator_once, sprec_thread_allocator_init);
+	if (sprec_thread_allocator_ok) {
+		pthread_setspecific(sprec_thread_allocator_key, alloc);
+	}
+}
+
+void sprec_get_allocator(sprec_allocator *alloc)
+{
+	*alloc = *sprec_current_allocator();
+}
+
+void *sprec_malloc(size_t size)
+{
+	return sprec_allocator_malloc(sprec_current_allocator(), size);
+}
+
+void *sprec_calloc(size_t count, size_t size)
+{
+	return sprec_allocator_calloc(sprec_current_allocator(), count, size);
+}
+
+void *sprec_realloc(void *ptr, size_t size)
+{
+	return sprec_allocator_realloc(sprec_current_allocator(), ptr, size);
+}
+
+void sprec_free(void *ptr)
+{
+	sprec_allocator_free(sprec_current_allocator(), ptr);
+}
+
+char *sprec_strdup(const char *str)
+{
+	return sprec_allocator_strdup(sprec_current_allocator(), str);
+}
+
+void *sprec_allocator_malloc(const sprec_allocator *alloc, size_t size)
+{
+	return alloc->malloc(size ? size : 1, alloc->ctx);
+}
+
+void *sprec_allocator_calloc(const sprec_allocator *alloc, size_t count, size_t size)
+{
+	void *ptr;
+
+	if (size != 0 && count > SIZE_MAX / size) {
+		return NULL;
+	}
+
+	ptr = sprec_allocator_malloc(alloc, count * size);
+	if (ptr != NULL) {
+		memset(ptr, 0, count * size);
+	}
+
+	return ptr;
+}
+
+void *sprec_allocator_realloc(const sprec_allocator *alloc, void *ptr, size_t size)
+{
+	if (ptr == NULL) {
+		return sprec_allocator_malloc(alloc, size);
+	}
+
+	return alloc->realloc(ptr, size ? size : 1, alloc->ctx);
+}
+
+void sprec_allocator_free(const sprec_allocator *alloc, void *ptr)
+{
+	if (ptr != NULL) {
+		alloc->free(ptr, alloc->ctx);
+	}
+}
+
+char *sprec_allocator_strdup(const sprec_allocator *alloc, const char *str)
+{
+	size_t length = strlen(str) + 1;
+	char *copy;
+
+	copy = sprec_allocator_malloc(alloc, length);
+	if (copy != NULL) {
+		memcpy(copy, str, length);
+	}
+
+	return copy;
+}
+
+static void *sprec_default_malloc(size_t size, void *ctx)
+{
+	return malloc(size);
+}
+
+static void *sprec_default_realloc(void *ptr, size_t size, void *ctx)
+{
+	return realloc(ptr, size);
+}
+
+static void sprec_default_free(void *ptr, void *ctx)
+{
+	free(ptr);
+}
+
+/*
+ * Arena
+ */
+
+sprec_arena *sprec_arena_new(size_t chunk_size)
+{
+	sprec_arena *arena;
+
+	arena = sprec_malloc(sizeof(*arena));
+	if (arena == NULL) {
+		return NULL;
+	}
+
+	sprec_get_allocator(&arena->parent);
+	arena->iface.malloc = sprec_arena_malloc;
+	arena->iface.realloc = sprec_arena_realloc;
+	arena->iface.free = sprec_arena_release;
+	arena->iface.ctx = arena;
+	arena->chunks = NULL;
+	arena->chunk_size = chunk_size > ARENA_CHUNK_MIN ? chunk_size : ARENA_CHUNK_MIN;
+	arena->used = 0;
+
+	return arena;
+}
+
+void sprec_arena_reset(sprec_arena *arena)
+{
+	sprec_arena_chunk *chunk, *next, *keep = NULL;
+
+	/*
+	 * Keep one chunk of the regular size; oversized ones are released
+	 */
+	for (chunk = arena->chunks; chunk != NULL; chunk = next) {
+		next = chunk->next;
+		if (keep == NULL && chunk->size == arena->chunk_size) {
+			keep = chunk;
+		} else {
+			sprec_allocator_free(&arena->parent, chunk);
+		}
+	}
+
+	if (keep != NULL) {
+		keep->next = NULL;
+		keep->used = 0;
+	}
+
+	arena->chunks = keep;
+	arena->used = 0;
+}
+
+void sprec_arena_free(sprec_arena *arena)
+{
+	sprec_arena_chunk *chunk, *next;
+	sprec_allocator parent;
+
+	if (arena == NULL) {
+		return;
+	}
+
+	for (chunk = arena->chunks; chunk != NULL; chunk = next) {
+		next = chunk->next;
+		sprec_allocator_free(&arena->parent, chunk);
+	}
+
+	parent = arena->parent;
+	sprec_allocator_free(&parent, arena);
+}
+
+const sprec_allocator *sprec_arena_allocator(sprec_arena *arena)
+{
+	return &arena->iface;
+}
+
+size_t sprec_arena_used(const sprec_arena *arena)
+{
+	return arena->used;
+}
+
+static void *sprec_arena_malloc(size_t size, void *ctx)
+{
+	sprec_arena *arena = ctx;
+	sprec_arena_chunk *chunk = arena->chunks;
+	size_t need, chunk_size;
+	unsigned char *ptr;
+
+	if (size > SIZE_MAX - ARENA_HEADER_SIZE - ARENA_ALIGN - CHUNK_HEADER_SIZE) {
+		return NULL;
+	}
+
+	need = (ARENA_HEADER_SIZE + size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+	if (chunk == NULL || chunk->size - chunk->used < need) {
+		chunk_size = need > arena->chunk_size ? need : arena->chunk_size;
+
+		chunk = sprec_allocator_malloc(&arena->parent, CHUNK_HEADER_SIZE + chunk_size);
+		if (chunk == NULL) {
+			return NULL;
+		}
+
+		chunk->size = chunk_size;
+		chunk->used = 0;
+
+		/*
+		 * An oversized chunk goes behind the current one,
+		 * so that the space left in the latter isn't lost
+		 */
+		if (arena->chunks != NULL && chunk_size > arena->chunk_size) {
+			chunk->next = arena->chunks->next;
+			arena->chunks->next = chunk;
+		} else {
+			chunk->next = arena->chunks;
+			arena->chunks = chunk;
+		}
+	}
+
+	ptr = (unsigned char *)chunk + CHUNK_HEADER_SIZE + chunk->used;
+	chunk->used += need;
+	arena->used += need;
+
+	memcpy(ptr, &size, sizeof size);
+
+	return ptr + ARENA_HEADER_SIZE;
+}
+
+static void *sprec_arena_realloc(void *ptr, size_t size, void *ctx)
+{
+	size_t old_size;
+	void *copy;
+
+	memcpy(&old_size, (unsigned char *)ptr - ARENA_HEADER_SIZE, sizeof old_size);
+	if (size <= old_size) {
+		return ptr;
+	}
+
+	copy = sprec_arena_malloc(size, ctx);
+	if (copy != NULL) {
+		memcpy(copy, ptr, old_size);
+	}
+
+	return copy;
+}
+
+static void sprec_arena_release(void *ptr, void *ctx)
+{
+	/* memory is only released by sprec_arena_reset() */
+}
@@ -0,0 +1,582 @@
+/*
+ * archive.c
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sprec/archive.h>
+#include <sprec/wav.h>
+#include <sprec/flac_encoder.h>
+#include <sprec/alloc.h>
+#include "clock.h"
+
+/*
+ * The writer doesn't wait for a full block longer than this
+ * (in seconds), so that little is lost if the process dies
+ */
+#define FLUSH_INTERVAL 1.0
+
+struct sprec_archive {
+	sprec_allocator alloc;
+	sprec_archive_options opts;
+	int fd;
+	size_t bytes_per_frame;
+	sprec_wav_header hdr;		/* for WAV */
+	sprec_encoder *enc;		/* for FLAC */
+
+	/*
+	 * The queue, a ring of `capacity' bytes (a whole number of
+	 * frames). `head' and `tail' count the bytes that ever went in
+	 * and out of it. Protected by `lock', except for the contents:
+	 * the bytes between `tail' and `head' belong to the writer.
+	 */
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	unsigned char *ring;
+	size_t capacity;
+	uint64_t head;
+	uint64_t tail;
+	uint64_t limit;			/* bytes of audio the file can hold,
+					 * 0 if unlimited */
+	int closing;
+	sprec_archive_stats stats;
+
+	/*
+	 * State of the writer
+	 */
+	unsigned char *block;		/* FLAC output not written yet */
+	size_t blocklen;
+	uint64_t offset;		/* bytes written to the file */
+	uint64_t reserved;		/* bytes of disk space reserved */
+	uint64_t reserve_step;
+	int error;
+	pthread_t thread;
+};
+
+static void *sprec_archive_thread(void *ctx);
+
+void sprec_archive_options_init(sprec_archive_options *opts)
+{
+	opts->format = SPREC_ARCHIVE_WAV;
+	opts->queue_length = 10.0;
+	opts->block_size = 0x100000;
+	opts->preallocate = 600.0;
+	opts->level = 5;
+}
+
+static int sprec_archive_write_all(int fd, const void *data, size_t length)
+{
+	const unsigned char *p = data;
+	ssize_t n;
+
+	while (length > 0) {
+		n = write(fd, p, length);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+
+		p += n;
+		length -= n;
+	}
+
+	return 0;
+}
+
+static int sprec_archive_sync(int fd)
+{
+#ifdef __APPLE__
+	return fsync(fd);
+#else
+	return fdatasync(fd);
+#endif
+}
+
+/*
+ * Makes sure the disk space up to `end' is allocated, a large step at
+ * a time, so that the file system can lay the archive out contiguously
+ * and a full disk shows early. The size of the file is left alone.
+ */
+static void sprec_archive_reserve(sprec_archive *ar, uint64_t end)
+{
+	uint64_t length;
+
+	if (ar->reserve_step == 0 || end <= ar->reserved) {
+		return;
+	}
+
+	length = ar->reserve_step;
+	if (length < end - ar->reserved) {
+		length = end - ar->reserved;
+	}
+
+#if defined __linux__ && defined FALLOC_FL_KEEP_SIZE
+	fallocate(ar->fd, FALLOC_FL_KEEP_SIZE, ar->reserved, length);
+#elif defined F_PREALLOCATE
+	{
+		fstore_t store;
+
+		memset(&store, 0, sizeof store);
+		store.fst_flags = F_ALLOCATEALL;
+		store.fst_posmode = F_PEOFPOSMODE;
+		store.fst_length = length;
+		fcntl(ar->fd, F_PREALLOCATE, &store);
+	}
+#endif
+
+	/*
+	 * Not retried on failure: this is only an optimization
+	 */
+	ar->reserved += length;
+}
+
+static int sprec_archive_output(sprec_archive *ar, const struct iovec *iov, int iovcnt)
+{
+	size_t length = 0;
+	ssize_t n;
+	int i;
+
+	for (i = 0; i < iovcnt; i++) {
+		length += iov[i].iov_len;
+	}
+
+	sprec_archive_reserve(ar, ar->offset + length);
+
+	n = writev(ar->fd, iov, iovcnt);
+	if (n < 0 && errno != EINTR) {
+		return -1;
+	}
+
+	if (n < 0) {
+		n = 0;
+	}
+
+	ar->offset += n;
+
+	/*
+	 * Short write: the rest one piece at a time
+	 */
+	for (i = 0; i < iovcnt; i++) {
+		if ((size_t)n >= iov[i].iov_len) {
+			n -= iov[i].iov_len;
+			continue;
+		}
+
+		if (sprec_archive_write_all(ar->fd, (unsigned char *)iov[i].iov_base + n, iov[i].iov_len - n) != 0) {
+			return -1;
+		}
+
+		ar->offset += iov[i].iov_len - n;
+		n = 0;
+	}
+
+	return 0;
+}
+
+static int sprec_archive_flush_block(sprec_archive *ar)
+{
+	struct iovec iov;
+
+	if (ar->blocklen == 0) {
+		return 0;
+	}
+
+	iov.iov_base = ar->block;
+	iov.iov_len = ar->blocklen;
+	ar->blocklen = 0;
+
+	return sprec_archive_output(ar, &iov, 1);
+}
+
+/*
+ * Collects the output of the FLAC encoder into blocks
+ */
+static int sprec_archive_sink(const void *data, size_t size, void *ctx)
+{
+	sprec_archive *ar = ctx;
+	struct iovec iov;
+
+	if (ar->blocklen + size > ar->opts.block_size && sprec_archive_flush_block(ar) != 0) {
+		return -1;
+	}
+
+	if (size >= ar->opts.block_size) {
+		iov.iov_base = (void *)data;
+		iov.iov_len = size;
+		return sprec_archive_output(ar, &iov, 1);
+	}
+
+	memcpy(ar->block + ar->blocklen, data, size);
+	ar->blocklen += size;
+
+	return 0;
+}
+
+sprec_archive *sprec_archive_open(
+	const char *filename,
+	uint32_t rate,
+	uint32_t channels,
+	sprec_pcm_format fmt,
+	const sprec_archive_options *opts
+)
+{
+	sprec_archive *ar;
+	sprec_allocator alloc;
+	sprec_wav_header *hdr;
+	FLAC__byte buf[SPREC_WAV_FILE_HEADER_SIZE];
+	size_t frames;
+
+	if (rate == 0 || channels == 0 || sprec_pcm_sample_size(fmt) == 0) {
+		return NULL;
+	}
+
+	sprec_get_allocator(&alloc);
+
+	ar = sprec_allocator_calloc(&alloc, 1, sizeof *ar);
+	if (ar == NULL) {
+		return NULL;
+	}
+
+	ar->alloc = alloc;
+	ar->fd = -1;
+
+	if (opts != NULL) {
+		ar->opts = *opts;
+	} else {
+		sprec_archive_options_init(&ar->opts);
+	}
+
+	ar->bytes_per_frame = channels * sprec_pcm_sample_size(fmt);
+
+	frames = ar->opts.queue_length * rate;
+	if (frames == 0) {
+		frames = 1;
+	}
+
+	ar->capacity = frames * ar->bytes_per_frame;
+
+	/*
+	 * The writer must be able to start on a block
+	 * long before the queue is full
+	 */
+	if (ar->opts.block_size == 0 || ar->opts.block_size > ar->capacity / 2) {
+		ar->opts.block_size = ar->capacity / 2 > 0 ? ar->capacity / 2 : 1;
+	}
+
+	if (ar->opts.preallocate > 0) {
+		ar->reserve_step = (uint64_t)(ar->opts.preallocate * rate) * ar->bytes_per_frame;
+	}
+
+	ar->ring = sprec_allocator_malloc(&alloc, ar->capacity);
+	if (ar->ring == NULL) {
+		sprec_allocator_free(&alloc, ar);
+		return NULL;
+	}
+
+	ar->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (ar->fd < 0) {
+		goto error;
+	}
+
+	fcntl(ar->fd, F_SETFD, FD_CLOEXEC);
+
+	if (ar->opts.format == SPREC_ARCHIVE_FLAC) {
+		ar->block = sprec_allocator_malloc(&alloc, ar->opts.block_size);
+		ar->enc = sprec_encoder_new();
+		if (ar->block == NULL || ar->enc == NULL) {
+			goto error;
+		}
+
+		sprec_encoder_set_level(ar->enc, ar->opts.level);
+		sprec_encoder_set_sink(ar->enc, sprec_archive_sink, ar);
+
+		if (sprec_encoder_stream_begin(ar->enc, rate, channels, fmt) != 0) {
+			goto error;
+		}
+	} else {
+		/*
+		 * The header is written again with the length at the end
+		 */
+		hdr = sprec_wav_header_from_params(rate, sprec_pcm_sample_size(fmt) * 8, channels);
+		if (hdr == NULL) {
+			goto error;
+		}
+
+		ar->hdr = *hdr;
+		sprec_free(hdr);
+
+		if (fmt == SPREC_PCM_F32LE) {
+			ar->hdr.format_type = WAVE_FORMAT_IEEE_FLOAT;
+		}
+
+		ar->hdr.file_size = SPREC_WAV_FILE_HEADER_SIZE - 8;
+		sprec_wav_header_pack(&ar->hdr, buf);
+
+		if (sprec_archive_write_all(ar->fd, buf, sizeof buf) != 0) {
+			goto error;
+		}
+
+		ar->offset = sizeof buf;
+
+		/*
+		 * The RIFF size is 32 bits, and counts all but 8 bytes
+		 */
+		ar->limit = (UINT32_MAX - (SPREC_WAV_FILE_HEADER_SIZE - 8)) / ar->bytes_per_frame * ar->bytes_per_frame;
+	}
+
+	if (pthread_mutex_init(&ar->lock, NULL) != 0) {
+		goto error;
+	}
+
+	if (pthread_cond_init(&ar->cond, NULL) != 0) {
+		pthread_mutex_destroy(&ar->lock);
+		goto error;
+	}
+
+	if (pthread_create(&ar->thread, NULL, sprec_archive_thread, ar) != 0) {
+		pthread_cond_destroy(&ar->cond);
+		pthread_mutex_destroy(&ar->lock);
+		goto error;
+	}
+
+	return ar;
+
+error:
+	if (ar->fd >= 0) {
+		close(ar->fd);
+		unlink(filename);
+	}
+
+	sprec_encoder_free(ar->enc);
+	sprec_allocator_free(&alloc, ar->block);
+	sprec_allocator_free(&alloc, ar->ring);
+	sprec_allocator_free(&alloc, ar);
+	return NULL;
+}
+
+size_t sprec_archive_write(sprec_archive *ar, const void *pcm, size_t frames)
+{
+	const unsigned char *src = pcm;
+	size_t bytes, avail, start, first;
+	uint64_t queued;
+
+	pthread_mutex_lock(&ar->lock);
+
+	bytes = frames * ar->bytes_per_frame;
+	if (ar->limit > 0 && bytes > ar->limit - ar->head) {
+		bytes = ar->limit - ar->head;
+		ar->stats.truncated += frames - bytes / ar->bytes_per_frame;
+		frames = bytes / ar->bytes_per_frame;
+	}
+
+	avail = ar->capacity - (ar->head - ar->tail);
+	if (bytes > avail) {
+		bytes = avail;
+	}
+
+	/*
+	 * Both pieces are whole frames, the ring being a whole number of them
+	 */
+	start = ar->head % ar->capacity;
+	first = bytes < ar->capacity - start ? bytes : ar->capacity - start;
+	memcpy(ar->ring + start, src, first);
+	memcpy(ar->ring, src + first, bytes - first);
+	ar->head += bytes;
+
+	ar->stats.frames += bytes / ar->bytes_per_frame;
+	ar->stats.dropped += frames - bytes / ar->bytes_per_frame;
+
+	queued = ar->head - ar->tail;
+	if (queued > ar->stats.queue_peak) {
+		ar->stats.queue_peak = queued;
+	}
+
+	if (queued >= ar->opts.block_size) {
+		pthread_cond_signal(&ar->cond);
+	}
+
+	pthread_mutex_unlock(&ar->lock);
+
+	return bytes / ar->bytes_per_frame;
+}
+
+void sprec_archive_get_stats(sprec_archive *ar, sprec_archive_stats *stats)
+{
+	pthread_mutex_lock(&ar->lock);
+	*stats = ar->stats;
+	pthread_mutex_unlock(&ar->lock);
+}
+
+/*
+ * Writes out (or encodes) `length' bytes of the queue from `tail' on
+ */
+static int sprec_archive_consume(sprec_archive *ar, uint64_t tail, size_t length)
+{
+	struct iovec iov[2];
+	size_t start, first;
+	int i, n;
+
+	start = tail % ar->capacity;
+	first = length < ar->capacity - start ? length : ar->capacity - start;
+
+	iov[0].iov_base = ar->ring + start;
+	iov[0].iov_len = first;
+	iov[1].iov_base = ar->ring;
+	iov[1].iov_len = length - first;
+	n = iov[1].iov_len > 0 ? 2 : 1;
+
+	if (ar->enc == NULL) {
+		return sprec_archive_output(ar, iov, n);
+	}
+
+	for (i = 0; i < n; i++) {
+		if (sprec_encoder_stream_write(ar->enc, iov[i].iov_base, iov[i].iov_len / ar->bytes_per_frame) != 0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void *sprec_archive_thread(void *ctx)
+{
+	sprec_archive *ar = ctx;
+	struct timespec ts;
+	double deadline;
+	uint64_t tail;
+	size_t length;
+	int closing;
+
+	sprec_set_thread_allocator(&ar->alloc);
+
+	for (;;) {
+		deadline = sprec_clock_now() + FLUSH_INTERVAL;
+		sprec_clock_abstime(deadline, &ts);
+
+		pthread_mutex_lock(&ar->lock);
+
+		while (!ar->closing && ar->head - ar->tail < ar->opts.block_size) {
+			if (pthread_cond_timedwait(&ar->cond, &ar->lock, &ts) != 0 && sprec_clock_now() >= deadline) {
+				break;
+			}
+		}
+
+		tail = ar->tail;
+		length = ar->head - ar->tail;
+		closing = ar->closing;
+
+		pthread_mutex_unlock(&ar->lock);
+
+		/*
+		 * After an error, the audio is only taken
+		 * off the queue, to keep it from filling up
+		 */
+		if (length > 0 && !ar->error && sprec_archive_consume(ar, tail, length) != 0) {
+			ar->error = 1;
+		}
+
+		pthread_mutex_lock(&ar->lock);
+		ar->tail += length;
+		ar->stats.bytes = ar->offset + ar->blocklen;
+		pthread_mutex_unlock(&ar->lock);
+
+		if (closing && length == 0) {
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Completes the file once the writer is done
+ */
+static int sprec_archive_finish(sprec_archive *ar)
+{
+	unsigned char streaminfo[SPREC_FLAC_STREAMINFO_SIZE];
+	FLAC__byte buf[SPREC_WAV_FILE_HEADER_SIZE];
+	const void *flac;
+	size_t size;
+
+	if (ar->error) {
+		return -1;
+	}
+
+	if (ar->enc != NULL) {
+		if (sprec_encoder_stream_end(ar->enc, streaminfo, &flac, &size) != 0
+		 || sprec_archive_flush_block(ar) != 0
+		 || pwrite(ar->fd, streaminfo, sizeof streaminfo, SPREC_FLAC_STREAMINFO_OFFSET) != sizeof streaminfo) {
+			return -1;
+		}
+	} else {
+		if (ar->offset - 8 > UINT32_MAX) {
+			return -1;
+		}
+
+		ar->hdr.file_size = ar->offset - 8;
+		sprec_wav_header_pack(&ar->hdr, buf);
+
+		if (pwrite(ar->fd, buf, sizeof buf, 0) != sizeof buf) {
+			return -1;
+		}
+	}
+
+	/*
+	 * Gives back the space reserved beyond the end
+	 */
+	if (ar->reserved > ar->offset && ftruncate(ar->fd, ar->offset) != 0) {
+		return -1;
+	}
+
+	return sprec_archive_sync(ar->fd);
+}
+
+int sprec_archive_close(sprec_archive *ar, sprec_archive_stats *stats)
+{
+	sprec_allocator alloc;
+	int err;
+
+	if (ar == NULL) {
+		return -1;
+	}
+
+	pthread_mutex_lock(&ar->lock);
+	ar->closing = 1;
+	pthread_cond_signal(&ar->cond);
+	pthread_mutex_unlock(&ar->lock);
+
+	pthread_join(ar->thread, NULL);
+
+	err = sprec_archive_finish(ar);
+
+	if (close(ar->fd) != 0) {
+		err = -1;
+	}
+
+	ar->stats.bytes = ar->offset;
+	if (stats != NULL) {
+		*stats = ar->stats;
+	}
+
+	alloc = ar->alloc;
+	sprec_encoder_free(ar->enc);
+	pthread_cond_destroy(&ar->cond);
+	pthread_mutex_destroy(&ar->lock);
+	sprec_allocator_free(&alloc, ar->block);
+	sprec_allocator_free(&alloc, ar->ring);
+	sprec_allocator_free(&alloc, ar);
+
+	return err;
+}
@@ -0,0 +1,271 @@
+/*
+ * async.c
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <curl/curl.h>
+#include <sprec/async.h>
+#include <sprec/alloc.h>
+#include "request.h"
+
+typedef struct sprec_async_request {
+	sprec_request req;
+	sprec_async_callback cb;
+	void *ctx;
+	struct sprec_async_request *prev;
+	struct sprec_async_request *next;
+} sprec_async_request;
+
+struct sprec_async {
+	sprec_allocator alloc;
+	CURLM *multi;
+	sprec_async_socket_callback socket_cb;
+	sprec_async_timer_callback timer_cb;
+	void *ctx;
+	sprec_async_request *requests;	/* in flight */
+	size_t pending;
+};
+
+static int sprec_async_handle_socket(CURL *easy, curl_socket_t fd, int what, void *userp, void *socketp);
+static int sprec_async_handle_timer(CURLM *multi, long timeout_ms, void *userp);
+static void sprec_async_check_done(sprec_async *async);
+
+sprec_async *sprec_async_new(
+	sprec_async_socket_callback socket_cb,
+	sprec_async_timer_callback timer_cb,
+	void *ctx
+)
+{
+	sprec_async *async;
+
+	if (socket_cb == NULL || timer_cb == NULL) {
+		return NULL;
+	}
+
+	async = sprec_calloc(1, sizeof *async);
+	if (async == NULL) {
+		return NULL;
+	}
+
+	sprec_get_allocator(&async->alloc);
+
+	async->multi = curl_multi_init();
+	if (async->multi == NULL) {
+		sprec_free(async);
+		return NULL;
+	}
+
+	async->socket_cb = socket_cb;
+	async->timer_cb = timer_cb;
+	async->ctx = ctx;
+
+	curl_multi_setopt(async->multi, CURLMOPT_SOCKETFUNCTION, sprec_async_handle_socket);
+	curl_multi_setopt(async->multi, CURLMOPT_SOCKETDATA, async);
+	curl_multi_setopt(async->multi, CURLMOPT_TIMERFUNCTION, sprec_async_handle_timer);
+	curl_multi_setopt(async->multi, CURLMOPT_TIMERDATA, async);
+	sprec_multi_use_http2(async->multi, 0, 0);
+
+	return async;
+}
+
+void sprec_async_free(sprec_async *async)
+{
+	sprec_allocator alloc;
+	sprec_async_request *areq, *next;
+
+	if (async == NULL) {
+		return;
+	}
+
+	alloc = async->alloc;
+
+	for (areq = async->requests; areq != NULL; areq = next) {
+		next = areq->next;
+
+		curl_multi_remove_handle(async->multi, areq->req.conn_hndl);
+
+		/* abandoned */
+		areq->req.done = 0;
+		sprec_request_finish(&areq->req);
+		sprec_allocator_free(&alloc, areq);
+	}
+
+	curl_multi_cleanup(async->multi);
+	sprec_allocator_free(&alloc, async);
+}
+
+int sprec_async_send(
+	sprec_async *async,
+	const void *data,
+	size_t length,
+	const char *apikey,
+	const char *language,
+	uint32_t sample_rate,
+	sprec_async_callback cb,
+	void *ctx
+)
+{
+	sprec_async_request *areq;
+
+	if (data == NULL) {
+		return -1;
+	}
+
+	areq = sprec_allocator_malloc(&async->alloc, sizeof *areq);
+	if (areq == NULL) {
+		return -1;
+	}
+
+	if (sprec_request_init(&areq->req, data, length, apikey, language, sample_rate) != 0) {
+		sprec_allocator_free(&async->alloc, areq);
+		return -1;
+	}
+
+	areq->cb = cb;
+	areq->ctx = ctx;
+
+	sprec_request_use_http2(&areq->req);
+	curl_easy_setopt(areq->req.conn_hndl, CURLOPT_PRIVATE, areq);
+
+	/*
+	 * Adding the handle makes cURL ask for a timeout of 0,
+	 * which kicks off the transfer from the caller's loop
+	 */
+	if (curl_multi_add_handle(async->multi, areq->req.conn_hndl) != CURLM_OK) {
+		sprec_request_finish(&areq->req);
+		sprec_allocator_free(&async->alloc, areq);
+		return -1;
+	}
+
+	areq->prev = NULL;
+	areq->next = async->requests;
+	if (async->requests != NULL) {
+		async->requests->prev = areq;
+	}
+	async->requests = areq;
+	async->pending++;
+
+	return 0;
+}
+
+void sprec_async_socket_action(sprec_async *async, int fd, int what)
+{
+	int mask = 0, running;
+
+	if (what & SPREC_POLL_IN) {
+		mask |= CURL_CSELECT_IN;
+	}
+
+	if (what & SPREC_POLL_OUT) {
+		mask |= CURL_CSELECT_OUT;
+	}
+
+	if (what & SPREC_POLL_ERR) {
+		mask |= CURL_CSELECT_ERR;
+	}
+
+	curl_multi_socket_action(async->multi, fd, mask, &running);
+	sprec_async_check_done(async);
+}
+
+void sprec_async_timeout(sprec_async *async)
+{
+	int running;
+
+	curl_multi_socket_action(async->multi, CURL_SOCKET_TIMEOUT, 0, &running);
+	sprec_async_check_done(async);
+}
+
+size_t sprec_async_pending(const sprec_async *async)
+{
+	return async->pending;
+}
+
+static int sprec_async_handle_socket(CURL *easy, curl_socket_t fd, int what, void *userp, void *socketp)
+{
+	sprec_async *async = userp;
+	int events = 0;
+
+	switch (what) {
+	case CURL_POLL_IN:
+		events = SPREC_POLL_IN;
+		break;
+	case CURL_POLL_OUT:
+		events = SPREC_POLL_OUT;
+		break;
+	case CURL_POLL_INOUT:
+		events = SPREC_POLL_IN | SPREC_POLL_OUT;
+		break;
+	case CURL_POLL_REMOVE:
+		events = SPREC_POLL_REMOVE;
+		break;
+	default:
+		return 0;
+	}
+
+	async->socket_cb(fd, events, async->ctx);
+
+	return 0;
+}
+
+static int sprec_async_handle_timer(CURLM *multi, long timeout_ms, void *userp)
+{
+	sprec_async *async = userp;
+
+	async->timer_cb(timeout_ms, async->ctx);
+
+	return 0;
+}
+
+/*
+ * Completes the finished transfers
+ */
+static void sprec_async_check_done(sprec_async *async)
+{
+	sprec_async_request *areq;
+	sprec_server_response *resp;
+	CURLMsg *msg;
+	char *priv;
+	int left;
+
+	while ((msg = curl_multi_info_read(async->multi, &left)) != NULL) {
+		if (msg->msg != CURLMSG_DONE) {
+			continue;
+		}
+
+		priv = NULL;
+		curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &priv);
+		areq = (sprec_async_request *)priv;
+
+		areq->req.done = 1;
+		areq->req.result = msg->data.result;
+
+		curl_multi_remove_handle(async->multi, areq->req.conn_hndl);
+
+		if (areq->prev != NULL) {
+			areq->prev->next = areq->next;
+		} else {
+			async->requests = areq->next;
+		}
+
+		if (areq->next != NULL) {
+			areq->next->prev = areq->prev;
+		}
+
+		async->pending--;
+
+		resp = sprec_request_finish(&areq->req);
+
+		if (areq->cb != NULL) {
+			areq->cb(resp, areq->ctx);
+		} else {
+			sprec_free_response(resp);
+		}
+
+		sprec_allocator_free(&async->alloc, areq);
+	}
+}
@@ -0,0 +1,297 @@
+/*
+ * budget.c
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <sprec/budget.h>
+#include "clock.h"
+
+enum {
+	RESERVATION_IDLE,
+	RESERVATION_WAITING,
+	RESERVATION_ACTIVE
+};
+
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	sprec_budget_options opts;
+	size_t used;
+	size_t peak;
+	size_t active;
+	size_t waiting;
+	uint64_t ticket;
+	uint64_t granted;
+	uint64_t blocked;
+	uint64_t rejected;
+	uint64_t shed;
+	sprec_reservation *holders;
+	sprec_reservation *waiters;
+} sprec_budget = {
+	PTHREAD_MUTEX_INITIALIZER,
+	PTHREAD_COND_INITIALIZER,
+	{ 0, SPREC_BUDGET_BLOCK, 10.0 },
+	0, 0, 0, 0, 0, 0, 0, 0, 0,
+	NULL,
+	NULL
+};
+
+static void sprec_budget_link(sprec_reservation **list, sprec_reservation *res)
+{
+	res->prev = NULL;
+	res->next = *list;
+	if (*list != NULL) {
+		(*list)->prev = res;
+	}
+	*list = res;
+}
+
+static void sprec_budget_unlink(sprec_reservation **list, sprec_reservation *res)
+{
+	if (res->prev != NULL) {
+		res->prev->next = res->next;
+	} else {
+		*list = res->next;
+	}
+
+	if (res->next != NULL) {
+		res->next->prev = res->prev;
+	}
+
+	res->prev = NULL;
+	res->next = NULL;
+}
+
+/*
+ * Non-0 if another reservation waiting should be admitted before `res'
+ */
+static int sprec_budget_outranked(const sprec_reservation *res)
+{
+	const sprec_reservation *w;
+
+	for (w = sprec_budget.waiters; w != NULL; w = w->next) {
+		if (w != res && (w->priority > res->priority || (w->priority == res->priority && w->ticket < res->ticket))) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static int sprec_budget_fits(const sprec_reservation *res)
+{
+	size_t limit = sprec_budget.opts.limit;
+
+	return limit == 0 || (sprec_budget.used + res->bytes <= limit && !sprec_budget_outranked(res));
+}
+
+static void sprec_budget_admit(sprec_reservation *res)
+{
+	res->state = RESERVATION_ACTIVE;
+	sprec_budget_link(&sprec_budget.holders, res);
+
+	sprec_budget.used += res->bytes;
+	if (sprec_budget.used > sprec_budget.peak) {
+		sprec_budget.peak = sprec_budget.used;
+	}
+
+	sprec_budget.active++;
+	sprec_budget.granted++;
+}
+
+/*
+ * Asks holders of a lower priority than `res' to give up enough memory
+ * for it, the lowest priority (and the most recent among equal ones)
+ * first. Returns non-0, asking nothing, if they don't hold enough.
+ */
+static int sprec_budget_shed_for(const sprec_reservation *res)
+{
+	sprec_reservation *h, *victim;
+	size_t need, lower = 0, freeing = 0;
+
+	need = sprec_budget.used + res->bytes - sprec_budget.opts.limit;
+
+	for (h = sprec_budget.holders; h != NULL; h = h->next) {
+		if (h->priority < res->priority) {
+			lower += h->bytes;
+			freeing += h->shed ? h->bytes : 0;
+		}
+	}
+
+	if (lower < need) {
+		return -1;
+	}
+
+	while (freeing < need) {
+		victim = NULL;
+
+		for (h = sprec_budget.holders; h != NULL; h = h->next) {
+			if (h->shed || h->priority >= res->priority) {
+				continue;
+			}
+
+			if (victim == NULL
+			 || h->priority < victim->priority
+			 || (h->priority == victim->priority && h->ticket > victim->ticket)) {
+				victim = h;
+			}
+		}
+
+		victim->shed = 1;
+		freeing += victim->bytes;
+		sprec_budget.shed++;
+	}
+
+	return 0;
+}
+
+void sprec_budget_options_init(sprec_budget_options *opts)
+{
+	opts->limit = 0;
+	opts->policy = SPREC_BUDGET_BLOCK;
+	opts->timeout = 10.0;
+}
+
+int sprec_budget_configure(const sprec_budget_options *opts)
+{
+	sprec_budget_options defaults;
+
+	if (opts == NULL) {
+		sprec_budget_options_init(&defaults);
+		opts = &defaults;
+	}
+
+	if (opts->policy != SPREC_BUDGET_BLOCK && opts->policy != SPREC_BUDGET_REJECT && opts->policy != SPREC_BUDGET_SHED) {
+		return -1;
+	}
+
+	pthread_mutex_lock(&sprec_budget.lock);
+	sprec_budget.opts = *opts;
+
+	/* the limit may have been raised */
+	pthread_cond_broadcast(&sprec_budget.cond);
+	pthread_mutex_unlock(&sprec_budget.lock);
+
+	return 0;
+}
+
+void sprec_budget_get_stats(sprec_budget_stats *stats)
+{
+	pthread_mutex_lock(&sprec_budget.lock);
+
+	stats->limit = sprec_budget.opts.limit;
+	stats->used = sprec_budget.used;
+	stats->peak = sprec_budget.peak;
+	stats->active = sprec_budget.active;
+	stats->waiting = sprec_budget.waiting;
+	stats->granted = sprec_budget.granted;
+	stats->blocked = sprec_budget.blocked;
+	stats->rejected = sprec_budget.rejected;
+	stats->shed = sprec_budget.shed;
+
+	pthread_mutex_unlock(&sprec_budget.lock);
+}
+
+size_t sprec_budget_estimate(size_t pcm_bytes)
+{
+	return 2 * pcm_bytes + SPREC_BUDGET_RESPONSE;
+}
+
+int sprec_budget_reserve(sprec_reservation *res, size_t bytes, int priority)
+{
+	struct timespec ts;
+	double deadline = -1.0;
+	int err = 0;
+
+	pthread_mutex_lock(&sprec_budget.lock);
+
+	res->bytes = bytes;
+	res->priority = priority;
+	res->shed = 0;
+	res->ticket = sprec_budget.ticket++;
+	res->prev = NULL;
+	res->next = NULL;
+
+	if (sprec_budget_fits(res)) {
+		sprec_budget_admit(res);
+		pthread_mutex_unlock(&sprec_budget.lock);
+		return 0;
+	}
+
+	if (bytes > sprec_budget.opts.limit
+	 || sprec_budget.opts.policy == SPREC_BUDGET_REJECT
+	 || (sprec_budget.opts.policy == SPREC_BUDGET_SHED && sprec_budget_shed_for(res) != 0)) {
+		res->state = RESERVATION_IDLE;
+		sprec_budget.rejected++;
+		pthread_mutex_unlock(&sprec_budget.lock);
+		return -1;
+	}
+
+	res->state = RESERVATION_WAITING;
+	sprec_budget_link(&sprec_budget.waiters, res);
+	sprec_budget.waiting++;
+	sprec_budget.blocked++;
+
+	if (sprec_budget.opts.timeout >= 0) {
+		deadline = sprec_clock_now() + sprec_budget.opts.timeout;
+		sprec_clock_abstime(deadline, &ts);
+	}
+
+	while (!sprec_budget_fits(res) && err != ETIMEDOUT) {
+		if (deadline < 0) {
+			pthread_cond_wait(&sprec_budget.cond, &sprec_budget.lock);
+		} else {
+			err = pthread_cond_timedwait(&sprec_budget.cond, &sprec_budget.lock, &ts);
+		}
+	}
+
+	sprec_budget_unlink(&sprec_budget.waiters, res);
+	sprec_budget.waiting--;
+
+	if (sprec_budget_fits(res)) {
+		sprec_budget_admit(res);
+		err = 0;
+	} else {
+		res->state = RESERVATION_IDLE;
+		sprec_budget.rejected++;
+		err = -1;
+	}
+
+	/*
+	 * Whoever this one was ahead of may go now
+	 */
+	pthread_cond_broadcast(&sprec_budget.cond);
+	pthread_mutex_unlock(&sprec_budget.lock);
+
+	return err;
+}
+
+int sprec_reservation_shed(sprec_reservation *res)
+{
+	int shed;
+
+	pthread_mutex_lock(&sprec_budget.lock);
+	shed = res->shed;
+	pthread_mutex_unlock(&sprec_budget.lock);
+
+	return shed;
+}
+
+void sprec_budget_release(sprec_reservation *res)
+{
+	pthread_mutex_lock(&sprec_budget.lock);
+
+	if (res->state == RESERVATION_ACTIVE) {
+		sprec_budget_unlink(&sprec_budget.holders, res);
+		res->state = RESERVATION_IDLE;
+		sprec_budget.used -= res->bytes;
+		sprec_budget.active--;
+		pthread_cond_broadcast(&sprec_budget.cond);
+	}
+
+	pthread_mutex_unlock(&sprec_budget.lock);
+}
@@ -0,0 +1,612 @@
+/*
+ * cache.c
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sprec/cache.h>
+#include <sprec/alloc.h>
+
+#define DISK_MAGIC "SPRECCA1"
+#define DISK_SLOT_SIZE 2048
+#define DISK_WAYS 4
+
+/*
+ * The disk tier is an array of fixed-size slots, DISK_WAYS-way set
+ * associative. A slot is valid iff its stamp is non-zero and the
+ * checksum matches the value, so a torn write (crash in the middle
+ * of a store) only ever loses that single entry.
+ */
+typedef struct sprec_disk_header {
+	char magic[8];
+	uint32_t slot_size;
+	uint32_t reserved;
+	uint64_t nslots;
+	uint64_t clock;
+	char padding[32];
+} sprec_disk_header;
+
+typedef struct sprec_disk_slot {
+	uint64_t key[2];
+	uint64_t stamp;
+	uint32_t length;
+	uint32_t check;
+	char value[DISK_SLOT_SIZE - 32];
+} sprec_disk_slot;
+
+typedef struct sprec_cache_entry {
+	uint64_t key[2];
+	struct sprec_cache_entry *hnext;	/* hash chain */
+	struct sprec_cache_entry *prev;		/* LRU list, most recent first */
+	struct sprec_cache_entry *next;
+	char *json;
+	size_t length;
+} sprec_cache_entry;
+
+struct sprec_cache {
+	sprec_allocator alloc;	/* allocator in effect at creation */
+	pthread_mutex_t lock;
+
+	sprec_cache_entry **buckets;
+	size_t nbuckets;
+	size_t max_entries;
+	size_t count;
+	sprec_cache_entry *head;
+	sprec_cache_entry *tail;
+
+	int fd;
+	void *map;
+	size_t maplen;
+	sprec_disk_header *disk;
+	sprec_disk_slot *slots;
+
+	sprec_cache_stats stats;
+};
+
+static void sprec_cache_key(const void *data, size_t length, const char *language, uint64_t key[2]);
+static int sprec_cache_open_disk(sprec_cache *cache, const char *path, size_t nslots);
+static sprec_cache_entry *sprec_cache_find(sprec_cache *cache, const uint64_t key[2]);
+static int sprec_cache_insert(sprec_cache *cache, const uint64_t key[2], const char *json, size_t length);
+static void sprec_cache_unlink(sprec_cache *cache, sprec_cache_entry *entry);
+static void sprec_cache_push_front(sprec_cache *cache, sprec_cache_entry *entry);
+static sprec_disk_slot *sprec_cache_disk_find(sprec_cache *cache, const uint64_t key[2]);
+static void sprec_cache_disk_store(sprec_cache *cache, const uint64_t key[2], const char *json, size_t length);
+static sprec_server_response *sprec_cache_response(const char *json, size_t length);
+
+sprec_cache *sprec_cache_new(size_t max_entries, const char *disk_path, size_t disk_slots)
+{
+	sprec_cache *cache;
+
+	cache = sprec_calloc(1, sizeof *cache);
+	if (cache == NULL) {
+		return NULL;
+	}
+
+	if (pthread_mutex_init(&cache->lock, NULL) != 0) {
+		sprec_free(cache);
+		return NULL;
+	}
+
+	sprec_get_allocator(&cache->alloc);
+
+	cache->fd = -1;
+	cache->max_entries = max_entries;
+
+	/*
+	 * Keep the load factor of the hash table at or below 0.5
+	 */
+	cache->nbuckets = 16;
+	while (cache->nbuckets < max_entries * 2) {
+		cache->nbuckets *= 2;
+	}
+
+	cache->buckets = sprec_allocator_calloc(&cache->alloc, cache->nbuckets, sizeof cache->buckets[0]);
+	if (cache->buckets == NULL) {
+		sprec_cache_free(cache);
+		return NULL;
+	}
+
+	if (disk_path != NULL && sprec_cache_open_disk(cache, disk_path, disk_slots) != 0) {
+		sprec_cache_free(cache);
+		return NULL;
+	}
+
+	return cache;
+}
+
+void sprec_cache_free(sprec_cache *cache)
+{
+	sprec_cache_entry *entry, *next;
+	sprec_allocator alloc;
+
+	if (cache == NULL) {
+		return;
+	}
+
+	alloc = cache->alloc;
+
+	for (entry = cache->head; entry != NULL; entry = next) {
+		next = entry->next;
+		sprec_allocator_free(&alloc, entry->json);
+		sprec_allocator_free(&alloc, entry);
+	}
+
+	if (cache->map != NULL) {
+		msync(cache->map, cache->maplen, MS_SYNC);
+		munmap(cache->map, cache->maplen);
+	}
+
+	if (cache->fd >= 0) {
+		close(cache->fd);
+	}
+
+	pthread_mutex_destroy(&cache->lock);
+	sprec_allocator_free(&alloc, cache->buckets);
+	sprec_allocator_free(&alloc, cache);
+}
+
+sprec_server_response *sprec_cache_lookup(
+	sprec_cache *cache,
+	const void *data,
+	size_t length,
+	const char *language
+)
+{
+	sprec_server_response *resp = NULL;
+	sprec_cache_entry *entry;
+	sprec_disk_slot *slot;
+	uint64_t key[2];
+
+	sprec_cache_key(data, length, language, key);
+
+	pthread_mutex_lock(&cache->lock);
+
+	entry = sprec_cache_find(cache, key);
+	if (entry != NULL) {
+		sprec_cache_unlink(cache, entry);
+		sprec_cache_push_front(cache, entry);
+		resp = sprec_cache_response(entry->json, entry->length);
+		cache->stats.hits++;
+	} else if ((slot = sprec_cache_disk_find(cache, key)) != NULL) {
+		/*
+		 * Promote the entry to the memory tier
+		 */
+		sprec_cache_insert(cache, key, slot->value, slot->length);
+		resp = sprec_cache_response(slot->value, slot->length);
+		cache->stats.disk_hits++;
+	} else {
+		cache->stats.misses++;
+	}
+
+	pthread_mutex_unlock(&cache->lock);
+
+	return resp;
+}
+
+int sprec_cache_store(
+	sprec_cache *cache,
+	const void *data,
+	size_t length,
+	const char *language,
+	const sprec_server_response *resp
+)
+{
+	uint64_t key[2];
+	int err;
+
+	if (resp == NULL || resp->data == NULL) {
+		return -1;
+	}
+
+	sprec_cache_key(data, length, language, key);
+
+	pthread_mutex_lock(&cache->lock);
+
+	err = sprec_cache_insert(cache, key, resp->data, resp->length);
+	sprec_cache_disk_store(cache, key, resp->data, resp->length);
+	cache->stats.stores++;
+
+	pthread_mutex_unlock(&cache->lock);
+
+	return err;
+}
+
+sprec_server_response *
+sprec_send_audio_data_cached(
+	sprec_cache *cache,
+	const void *data,
+	size_t length,
+	const char *apikey,
+	const char *language,
+	uint32_t sample_rate
+)
+{
+	sprec_server_response *resp;
+
+	if (cache == NULL || data == NULL) {
+		return sprec_send_audio_data(data, length, apikey, language, sample_rate);
+	}
+
+	resp = sprec_cache_lookup(cache, data, length, language);
+	if (resp != NULL) {
+		return resp;
+	}
+
+	resp = sprec_send_audio_data(data, length, apikey, language, sample_rate);
+	if (resp != NULL && resp->status == 200 && resp->result.count > 0) {
+		sprec_cache_store(cache, data, length, language, resp);
+	}
+
+	return resp;
+}
+
+void sprec_cache_get_stats(sprec_cache *cache, sprec_cache_stats *stats)
+{
+	pthread_mutex_lock(&cache->lock);
+	*stats = cache->stats;
+	stats->entries = cache->count;
+	pthread_mutex_unlock(&cache->lock);
+}
+
+/*
+ * MurmurHash3 (x64, 128 bit variant) of the payload,
+ * seeded with the FNV-1a hash of the language code.
+ */
+static uint64_t sprec_rotl64(uint64_t x, int r)
+{
+	return x << r | x >> (64 - r);
+}
+
+static uint64_t sprec_fmix64(uint64_t k)
+{
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ULL;
+	k ^= k >> 33;
+	return k;
+}
+
+static void sprec_cache_key(const void *data, size_t length, const char *language, uint64_t key[2])
+{
+	const uint64_t c1 = 0x87c37b91114253d5ULL;
+	const uint64_t c2 = 0x4cf5ad432745937fULL;
+	const unsigned char *p = data;
+	const unsigned char *tail;
+	uint64_t seed = 0xcbf29ce484222325ULL;
+	uint64_t h1, h2, k1, k2;
+	size_t i, nblocks = length / 16;
+	const char *l;
+
+	for (l = language ? language : "en-US"; *l != '\0'; l++) {
+		seed = (seed ^ (unsigned char)*l) * 0x100000001b3ULL;
+	}
+
+	h1 = h2 = seed;
+
+	for (i = 0; i < nblocks; i++) {
+		memcpy(&k1, p + i * 16 + 0, 8);
+		memcpy(&k2, p + i * 16 + 8, 8);
+
+		k1 *= c1; k1 = sprec_rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+		h1 = sprec_rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+
+		k2 *= c2; k2 = sprec_rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+		h2 = sprec_rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+	}
+
+	tail = p + nblocks * 16;
+	k1 = k2 = 0;
+
+	for (i = length & 15; i > 8; i--) {
+		k2 ^= (uint64_t)tail[i - 1] << (i - 9) * 8;
+	}
+
+	for (i = (length & 15) < 8 ? length & 15 : 8; i > 0; i--) {
+		k1 ^= (uint64_t)tail[i - 1] << (i - 1) * 8;
+	}
+
+	k2 *= c2; k2 = sprec_rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+	k1 *= c1; k1 = sprec_rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+
+	h1 ^= length;
+	h2 ^= length;
+	h1 += h2;
+	h2 += h1;
+	h1 = sprec_fmix64(h1);
+	h2 = sprec_fmix64(h2);
+	h1 += h2;
+	h2 += h1;
+
+	key[0] = h1;
+	key[1] = h2;
+}
+
+static uint32_t sprec_cache_checksum(const char *value, size_t length)
+{
+	uint32_t h = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < length; i++) {
+		h = (h ^ (unsigned char)value[i]) * 16777619u;
+	}
+
+	/* never 0, so that a zeroed slot can't be valid */
+	return h | 1;
+}
+
+static int sprec_cache_open_disk(sprec_cache *cache, const char *path, size_t nslots)
+{
+	struct stat st;
+	size_t len;
+	int fd;
+
+	/*
+	 * Round the number of slots up to a whole number of sets
+	 */
+	if (nslots < DISK_WAYS) {
+		nslots = DISK_WAYS;
+	}
+
+	nslots = (nslots + DISK_WAYS - 1) / DISK_WAYS * DISK_WAYS;
+	len = sizeof(sprec_disk_header) + nslots * sizeof(sprec_disk_slot);
+
+	fd = open(path, O_RDWR | O_CREAT, 0644);
+	if (fd < 0) {
+		return -1;
+	}
+
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return -1;
+	}
+
+	/*
+	 * A file with a different geometry is discarded
+	 */
+	if ((size_t)st.st_size != len) {
+		if (ftruncate(fd, 0) != 0 || ftruncate(fd, len) != 0) {
+			close(fd);
+			return -1;
+		}
+	}
+
+	cache->map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (cache->map == MAP_FAILED) {
+		cache->map = NULL;
+		close(fd);
+		return -1;
+	}
+
+	cache->fd = fd;
+	cache->maplen = len;
+	cache->disk = cache->map;
+	cache->slots = (sprec_disk_slot *)(cache->disk + 1);
+
+	if (memcmp(cache->disk->magic, DISK_MAGIC, sizeof cache->disk->magic) != 0
+	 || cache->disk->slot_size != sizeof(sprec_disk_slot)
+	 || cache->disk->nslots != nslots) {
+		memset(cache->map, 0, len);
+		memcpy(cache->disk->magic, DISK_MAGIC, sizeof cache->disk->magic);
+		cache->disk->slot_size = sizeof(sprec_disk_slot);
+		cache->disk->nslots = nslots;
+	}
+
+	return 0;
+}
+
+static sprec_cache_entry *sprec_cache_find(sprec_cache *cache, const uint64_t key[2])
+{
+	sprec_cache_entry *entry;
+
+	entry = cache->buckets[key[0] & (cache->nbuckets - 1)];
+	while (entry != NULL) {
+		if (entry->key[0] == key[0] && entry->key[1] == key[1]) {
+			return entry;
+		}
+
+		entry = entry->hnext;
+	}
+
+	return NULL;
+}
+
+static int sprec_cache_insert(sprec_cache *cache, const uint64_t key[2], const char *json, size_t length)
+{
+	sprec_cache_entry *entry, **pp;
+	char *copy;
+
+	if (cache->max_entries == 0) {
+		return 0;
+	}
+
+	copy = sprec_allocator_malloc(&cache->alloc, length + 1);
+	if (copy == NULL) {
+		return -1;
+	}
+
+	memcpy(copy, json, length);
+	copy[length] = '\0';
+
+	entry = sprec_cache_find(cache, key);
+	if (entry != NULL) {
+		/* replace the value */
+		sprec_allocator_free(&cache->alloc, entry->json);
+		sprec_cache_unlink(cache, entry);
+	} else if (cache->count >= cache->max_entries) {
+		/*
+		 * Evict the least recently used entry
+		 */
+		entry = cache->tail;
+		sprec_cache_unlink(cache, entry);
+
+		pp = &cache->buckets[entry->key[0] & (cache->nbuckets - 1)];
+		while (*pp != entry) {
+			pp = &(*pp)->hnext;
+		}
+		*pp = entry->hnext;
+
+		sprec_allocator_free(&cache->alloc, entry->json);
+		sprec_allocator_free(&cache->alloc, entry);
+		cache->count--;
+		entry = NULL;
+	}
+
+	if (entry == NULL) {
+		entry = sprec_allocator_malloc(&cache->alloc, sizeof *entry);
+		if (entry == NULL) {
+			sprec_allocator_free(&cache->alloc, copy);
+			return -1;
+		}
+
+		entry->key[0] = key[0];
+		entry->key[1] = key[1];
+
+		pp = &cache->buckets[key[0] & (cache->nbuckets - 1)];
+		entry->hnext = *pp;
+		*pp = entry;
+		cache->count++;
+	}
+
+	entry->json = copy;
+	entry->length = length;
+	sprec_cache_push_front(cache, entry);
+
+	return 0;
+}
+
+static void sprec_cache_unlink(sprec_cache *cache, sprec_cache_entry *entry)
+{
+	if (entry->prev != NULL) {
+		entry->prev->next = entry->next;
+	} else {
+		cache->head = entry->next;
+	}
+
+	if (entry->next != NULL) {
+		entry->next->prev = entry->prev;
+	} else {
+		cache->tail = entry->prev;
+	}
+
+	entry->prev = entry->next = NULL;
+}
+
+static void sprec_cache_push_front(sprec_cache *cache, sprec_cache_entry *entry)
+{
+	entry->prev = NULL;
+	entry->next = cache->head;
+
+	if (cache->head != NULL) {
+		cache->head->prev = entry;
+	} else {
+		cache->tail = entry;
+	}
+
+	cache->head = entry;
+}
+
+static sprec_disk_slot *sprec_cache_disk_set(sprec_cache *cache, const uint64_t key[2])
+{
+	size_t nsets = cache->disk->nslots / DISK_WAYS;
+	return &cache->slots[key[1] % nsets * DISK_WAYS];
+}
+
+static sprec_disk_slot *sprec_cache_disk_find(sprec_cache *cache, const uint64_t key[2])
+{
+	sprec_disk_slot *set;
+	int i;
+
+	if (cache->disk == NULL) {
+		return NULL;
+	}
+
+	set = sprec_cache_disk_set(cache, key);
+	for (i = 0; i < DISK_WAYS; i++) {
+		sprec_disk_slot *slot = &set[i];
+
+		if (slot->stamp != 0
+		 && slot->key[0] == key[0]
+		 && slot->key[1] == key[1]
+		 && slot->length <= SPREC_CACHE_DISK_VALUE_MAX
+		 && slot->check == sprec_cache_checksum(slot->value, slot->length)) {
+			slot->stamp = ++cache->disk->clock;
+			return slot;
+		}
+	}
+
+	return NULL;
+}
+
+static void sprec_cache_disk_store(sprec_cache *cache, const uint64_t key[2], const char *json, size_t length)
+{
+	sprec_disk_slot *set, *victim;
+	int i;
+
+	if (cache->disk == NULL || length > SPREC_CACHE_DISK_VALUE_MAX) {
+		return;
+	}
+
+	/*
+	 * Overwrite the same key, or an empty slot,
+	 * or else the least recently used one
+	 */
+	set = sprec_cache_disk_set(cache, key);
+	victim = &set[0];
+
+	for (i = 0; i < DISK_WAYS; i++) {
+		if (set[i].key[0] == key[0] && set[i].key[1] == key[1]) {
+			victim = &set[i];
+			break;
+		}
+
+		if (set[i].stamp < victim->stamp) {
+			victim = &set[i];
+		}
+	}
+
+	/*
+	 * Invalidate first, validate last
+	 */
+	victim->stamp = 0;
+	memcpy(victim->value, json, length);
+	victim->value[length] = '\0';
+	victim->length = length;
+	victim->check = sprec_cache_checksum(json, length);
+	victim->key[0] = key[0];
+	victim->key[1] = key[1];
+	victim->stamp = ++cache->disk->clock;
+}
+
+static sprec_server_response *sprec_cache_response(const char *json, size_t length)
+{
+	sprec_server_response *resp;
+
+	resp = sprec_malloc(sizeof *resp);
+	if (resp == NULL) {
+		return NULL;
+	}
+
+	resp->data = sprec_malloc(length + 1);
+	if (resp->data == NULL) {
+		sprec_free(resp);
+		return NULL;
+	}
+
+	memcpy(resp->data, json, length);
+	resp->data[length] = '\0';
+	resp->length = length;
+	resp->status = 200;
+
+	sprec_result_parse(resp->data, resp->length, &resp->result);
+
+	return resp;
+}
@@ -0,0 +1,1315 @@
+/*
+ * capture.c
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sprec/capture.h>
+#include <sprec/alloc.h>
+#include "clock.h"
+
+#if defined _WIN64 || defined _WIN32
+	#error "This has to be implemented yet!"
+#elif defined __APPLE__
+	#include <AudioToolbox/AudioQueue.h>
+	#include <mach/mach_time.h>
+
+	#define NUM_BUFFERS 3
+#else
+	#include <alsa/asoundlib.h>
+	#include <poll.h>
+	#include <sched.h>
+	#include <errno.h>
+
+	/*
+	 * The device buffer holds this many periods,
+	 * to ride out scheduling hiccups of the capture thread
+	 */
+	#define NUM_PERIODS 8
+
+	/*
+	 * Size of the stack given to a capture thread which locks its
+	 * memory, enough for the callbacks; it is locked as a whole
+	 */
+	#define LOCKED_STACK_SIZE (256 * 1024)
+
+	/*
+	 * Devices serviced by one thread waiting in poll()
+	 */
+	typedef struct sprec_capture_loop {
+		sprec_capture **caps;
+		size_t count;
+		struct pollfd *fds;	/* the wake-up pipe first, then the devices' */
+		nfds_t nfds;
+		int wake[2];
+		pthread_t thread;
+		const sprec_allocator *alloc;
+		int locked;		/* by the thread, see sprec_capture_loop_lock() */
+		void *stack;		/* locked, with a guard page below; NULL
+					 * if the thread has the default one */
+		size_t stack_size;	/* the guard page included */
+	} sprec_capture_loop;
+#endif
+
+struct sprec_capture {
+	sprec_allocator alloc;
+	char *device;
+	uint32_t rate;
+	uint32_t channels;
+	sprec_pcm_format format;
+	size_t bytes_per_frame;
+	sprec_capture_callback cb;
+	void *ctx;
+	sprec_capture_manager *mgr;	/* NULL if not managed */
+	int realtime;
+	int lock_memory;
+
+	pthread_mutex_t lock;
+	int running;
+	sprec_capture_stats stats;
+
+#if defined __APPLE__
+	AudioStreamBasicDescription desc;
+	AudioQueueRef queue;
+	AudioQueueBufferRef buffers[NUM_BUFFERS];
+#else
+	snd_pcm_t *pcm;
+	snd_pcm_uframes_t period_frames;
+	unsigned char *buffer;
+	unsigned npfds;
+	sprec_capture *self;		/* a loop of one, when not managed */
+	sprec_capture_loop loop;
+#endif
+};
+
+struct sprec_capture_manager {
+	sprec_allocator alloc;
+	sprec_capture **caps;
+	size_t count;
+	size_t size;
+	int running;
+#if !defined __APPLE__
+	sprec_capture_loop loop;
+#endif
+};
+
+static int sprec_capture_is_running(sprec_capture *cap)
+{
+	int running;
+
+	pthread_mutex_lock(&cap->lock);
+	running = cap->running;
+	pthread_mutex_unlock(&cap->lock);
+
+	return running;
+}
+
+static void sprec_capture_set_running(sprec_capture *cap, int running)
+{
+	pthread_mutex_lock(&cap->lock);
+	cap->running = running;
+	pthread_mutex_unlock(&cap->lock);
+}
+
+void sprec_capture_params_init(sprec_capture_params *params)
+{
+	params->device = "default";
+	params->sample_rate = 16000;
+	params->channels = 2;
+	params->format = SPREC_PCM_S16LE;
+	params->period = 0.02;
+	params->realtime = 0;
+	params->lock_memory = 0;
+}
+
+uint32_t sprec_capture_sample_rate(const sprec_capture *cap)
+{
+	return cap->rate;
+}
+
+uint64_t sprec_capture_overruns(sprec_capture *cap)
+{
+	uint64_t overruns;
+
+	pthread_mutex_lock(&cap->lock);
+	overruns = cap->stats.overruns;
+	pthread_mutex_unlock(&cap->lock);
+
+	return overruns;
+}
+
+void sprec_capture_get_stats(sprec_capture *cap, sprec_capture_stats *stats)
+{
+	pthread_mutex_lock(&cap->lock);
+	*stats = cap->stats;
+	pthread_mutex_unlock(&cap->lock);
+}
+
+/*
+ * Counts a period delivered `latency' seconds after its first frame
+ * was captured, whose callback took `busy' seconds
+ */
+static void sprec_capture_account(sprec_capture *cap, size_t frames, double latency, double busy)
+{
+	sprec_capture_stats *stats = &cap->stats;
+
+	if (latency < 0) {
+		latency = 0;
+	}
+
+	pthread_mutex_lock(&cap->lock);
+
+	stats->periods++;
+	stats->frames += frames;
+	stats->latency = latency;
+	stats->latency_mean += (latency - stats->latency_mean) / stats->periods;
+
+	if (latency > stats->latency_max) {
+		stats->latency_max = latency;
+	}
+
+	if (busy > stats->callback_max) {
+		stats->callback_max = busy;
+	}
+
+	pthread_mutex_unlock(&cap->lock);
+}
+
+static sprec_capture *sprec_capture_alloc(
+	const sprec_capture_params *params,
+	sprec_capture_callback cb,
+	void *ctx
+)
+{
+	sprec_capture *cap;
+	pthread_mutexattr_t attr;
+	int err;
+
+	cap = sprec_calloc(1, sizeof *cap);
+	if (cap == NULL) {
+		return NULL;
+	}
+
+	pthread_mutexattr_init(&attr);
+
+#if defined _POSIX_THREAD_PRIO_INHERIT && _POSIX_THREAD_PRIO_INHERIT > 0
+	/*
+	 * A real-time capture thread mustn't be kept waiting
+	 * by an ordinary one reading the statistics
+	 */
+	if (params->realtime > 0) {
+		pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+	}
+#endif
+
+	err = pthread_mutex_init(&cap->lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+
+	if (err != 0) {
+		sprec_free(cap);
+		return NULL;
+	}
+
+	sprec_get_allocator(&cap->alloc);
+
+	cap->device = sprec_strdup(params->device);
+	if (cap->device == NULL) {
+		pthread_mutex_destroy(&cap->lock);
+		sprec_free(cap);
+		return NULL;
+	}
+
+	cap->rate = params->sample_rate;
+	cap->channels = params->channels;
+	cap->format = params->format;
+	cap->bytes_per_frame = params->channels * sprec_pcm_sample_size(params->format);
+	cap->cb = cb;
+	cap->ctx = ctx;
+	cap->realtime = params->realtime;
+	cap->lock_memory = params->lock_memory;
+
+	return cap;
+}
+
+static void sprec_capture_dealloc(sprec_capture *cap)
+{
+	sprec_allocator alloc = cap->alloc;
+
+	pthread_mutex_destroy(&cap->lock);
+	sprec_allocator_free(&alloc, cap->device);
+	sprec_allocator_free(&alloc, cap);
+}
+
+/*
+ * Removes `cap' from its manager, if it has one
+ */
+static void sprec_capture_detach(sprec_capture *cap)
+{
+	sprec_capture_manager *mgr = cap->mgr;
+	size_t i;
+
+	if (mgr == NULL) {
+		return;
+	}
+
+	for (i = 0; i < mgr->count; i++) {
+		if (mgr->caps[i] == cap) {
+			memmove(&mgr->caps[i], &mgr->caps[i + 1], (mgr->count - i - 1) * sizeof mgr->caps[0]);
+			mgr->count--;
+			break;
+		}
+	}
+
+	cap->mgr = NULL;
+}
+
+sprec_capture_manager *sprec_capture_manager_new(void)
+{
+	sprec_capture_manager *mgr;
+
+	mgr = sprec_calloc(1, sizeof *mgr);
+	if (mgr == NULL) {
+		return NULL;
+	}
+
+	sprec_get_allocator(&mgr->alloc);
+
+	return mgr;
+}
+
+void sprec_capture_manager_free(sprec_capture_manager *mgr)
+{
+	sprec_allocator alloc;
+
+	if (mgr == NULL) {
+		return;
+	}
+
+	sprec_capture_manager_stop(mgr);
+
+	while (mgr->count > 0) {
+		sprec_capture_close(mgr->caps[mgr->count - 1]);
+	}
+
+	alloc = mgr->alloc;
+	sprec_allocator_free(&alloc, mgr->caps);
+	sprec_allocator_free(&alloc, mgr);
+}
+
+sprec_capture *sprec_capture_manager_open(
+	sprec_capture_manager *mgr,
+	const sprec_capture_params *params,
+	sprec_capture_callback cb,
+	void *ctx
+)
+{
+	sprec_capture *cap, **tmp;
+	size_t size;
+
+	if (mgr->running) {
+		return NULL;
+	}
+
+	if (mgr->count == mgr->size) {
+		size = mgr->size ? mgr->size * 2 : 4;
+		tmp = sprec_allocator_realloc(&mgr->alloc, mgr->caps, size * sizeof mgr->caps[0]);
+		if (tmp == NULL) {
+			return NULL;
+		}
+
+		mgr->caps = tmp;
+		mgr->size = size;
+	}
+
+	cap = sprec_capture_open(params, cb, ctx);
+	if (cap == NULL) {
+		return NULL;
+	}
+
+	cap->mgr = mgr;
+	mgr->caps[mgr->count++] = cap;
+
+	return cap;
+}
+
+#if defined __APPLE__
+
+/*
+ * Mac OS X or iOS
+ *
+ * Every queue has its own thread in the system;
+ * the manager simply starts and stops all of them.
+ */
+
+static void sprec_capture_handle_buffer(
+	void *data,
+	AudioQueueRef queue,
+	AudioQueueBufferRef buffer,
+	const AudioTimeStamp *start_time,
+	UInt32 num_packets,
+	const AudioStreamPacketDescription *desc
+)
+{
+	sprec_capture *cap = data;
+	mach_timebase_info_data_t timebase;
+	uint64_t now;
+	double latency = 0, called;
+	size_t frames;
+
+	if (!sprec_capture_is_running(cap)) {
+		return;
+	}
+
+	frames = buffer->mAudioDataByteSize / cap->bytes_per_frame;
+
+	if (frames > 0) {
+		/*
+		 * The time stamp is that of the first frame of the buffer
+		 */
+		now = mach_absolute_time();
+		if (start_time != NULL
+		 && (start_time->mFlags & kAudioTimeStampHostTimeValid)
+		 && start_time->mHostTime < now
+		 && mach_timebase_info(&timebase) == KERN_SUCCESS) {
+			latency = (double)(now - start_time->mHostTime) * timebase.numer / timebase.denom / 1e9;
+		}
+
+		called = sprec_clock_now();
+		cap->cb(buffer->mAudioData, frames, cap->ctx);
+		sprec_capture_account(cap, frames, latency, sprec_clock_now() - called);
+	}
+
+	/*
+	 * Hand the buffer straight back, so that
+	 * the queue never runs out of them
+	 */
+	AudioQueueEnqueueBuffer(queue, buffer, 0, NULL);
+}
+
+sprec_capture *sprec_capture_open(
+	const sprec_capture_params *params,
+	sprec_capture_callback cb,
+	void *ctx
+)
+{
+	sprec_capture *cap;
+	UInt32 size;
+	int i;
+
+	cap = sprec_capture_alloc(params, cb, ctx);
+	if (cap == NULL) {
+		return NULL;
+	}
+
+	cap->desc.mFormatID = kAudioFormatLinearPCM;
+	cap->desc.mSampleRate = params->sample_rate;
+	cap->desc.mChannelsPerFrame = params->channels;
+	cap->desc.mBitsPerChannel = sprec_pcm_sample_size(params->format) * 8;
+	cap->desc.mBytesPerFrame = cap->bytes_per_frame;
+	cap->desc.mFramesPerPacket = 1;
+	cap->desc.mBytesPerPacket = cap->bytes_per_frame;
+
+	switch (params->format) {
+	case SPREC_PCM_U8:
+		cap->desc.mFormatFlags = kLinearPCMFormatFlagIsPacked;
+		break;
+	case SPREC_PCM_F32LE:
+		cap->desc.mFormatFlags = kLinearPCMFormatFlagIsFloat | kLinearPCMFormatFlagIsPacked;
+		break;
+	default:
+		cap->desc.mFormatFlags = kLinearPCMFormatFlagIsSignedInteger | kLinearPCMFormatFlagIsPacked;
+		break;
+	}
+
+	if (AudioQueueNewInput(&cap->desc, sprec_capture_handle_buffer, cap, NULL, NULL, 0, &cap->queue)) {
+		sprec_capture_dealloc(cap);
+		return NULL;
+	}
+
+	size = params->period * params->sample_rate * cap->bytes_per_frame;
+	if (size < cap->bytes_per_frame) {
+		size = cap->bytes_per_frame;
+	}
+
+	for (i = 0; i < NUM_BUFFERS; i++) {
+		if (AudioQueueAllocateBuffer(cap->queue, size, &cap->buffers[i])) {
+			AudioQueueDispose(cap->queue, true);
+			sprec_capture_dealloc(cap);
+			return NULL;
+		}
+	}
+
+	return cap;
+}
+
+static int sprec_capture_queue_start(sprec_capture *cap)
+{
+	int i;
+
+	sprec_capture_set_running(cap, 1);
+
+	for (i = 0; i < NUM_BUFFERS; i++) {
+		cap->buffers[i]->mAudioDataByteSize = 0;
+		AudioQueueEnqueueBuffer(cap->queue, cap->buffers[i], 0, NULL);
+	}
+
+	if (AudioQueueStart(cap->queue, NULL)) {
+		sprec_capture_set_running(cap, 0);
+		AudioQueueReset(cap->queue);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void sprec_capture_queue_stop(sprec_capture *cap)
+{
+	/*
+	 * An immediate stop is synchronous:
+	 * no callback is running when it returns
+	 */
+	sprec_capture_set_running(cap, 0);
+	AudioQueueStop(cap->queue, true);
+}
+
+int sprec_capture_start(sprec_capture *cap)
+{
+	if (cap->mgr != NULL || sprec_capture_is_running(cap)) {
+		return -1;
+	}
+
+	return sprec_capture_queue_start(cap);
+}
+
+void sprec_capture_stop(sprec_capture *cap)
+{
+	if (cap->mgr != NULL || !sprec_capture_is_running(cap)) {
+		return;
+	}
+
+	sprec_capture_queue_stop(cap);
+}
+
+void sprec_capture_close(sprec_capture *cap)
+{
+	int i;
+
+	if (cap == NULL) {
+		return;
+	}
+
+	sprec_capture_stop(cap);
+	sprec_capture_detach(cap);
+
+	for (i = 0; i < NUM_BUFFERS; i++) {
+		AudioQueueFreeBuffer(cap->queue, cap->buffers[i]);
+	}
+
+	AudioQueueDispose(cap->queue, true);
+	sprec_capture_dealloc(cap);
+}
+
+int sprec_capture_poll_count(sprec_capture *cap)
+{
+	return -1;
+}
+
+int sprec_capture_poll_descriptors(sprec_capture *cap, struct pollfd *fds, unsigned n)
+{
+	return -1;
+}
+
+int sprec_capture_begin(sprec_capture *cap)
+{
+	return -1;
+}
+
+int sprec_capture_process(sprec_capture *cap, struct pollfd *fds, unsigned n)
+{
+	return -1;
+}
+
+void sprec_capture_end(sprec_capture *cap)
+{
+}
+
+int sprec_capture_manager_start(sprec_capture_manager *mgr)
+{
+	size_t i;
+
+	if (mgr->running) {
+		return -1;
+	}
+
+	for (i = 0; i < mgr->count; i++) {
+		if (sprec_capture_queue_start(mgr->caps[i]) != 0) {
+			while (i-- > 0) {
+				sprec_capture_queue_stop(mgr->caps[i]);
+			}
+
+			return -1;
+		}
+	}
+
+	mgr->running = 1;
+
+	return 0;
+}
+
+void sprec_capture_manager_stop(sprec_capture_manager *mgr)
+{
+	size_t i;
+
+	if (!mgr->running) {
+		return;
+	}
+
+	for (i = 0; i < mgr->count; i++) {
+		sprec_capture_queue_stop(mgr->caps[i]);
+	}
+
+	mgr->running = 0;
+}
+
+#else
+
+/*
+ * Linux, Solaris, etc.
+ *
+ * Devices are opened in non-blocking mode and read from whenever poll()
+ * says a period is available, so any number of them can be serviced
+ * by one thread. A capture which isn't managed runs a loop of its own.
+ */
+
+static snd_pcm_format_t sprec_capture_alsa_format(sprec_pcm_format fmt)
+{
+	switch (fmt) {
+	case SPREC_PCM_U8:	return SND_PCM_FORMAT_U8;
+	case SPREC_PCM_S16LE:	return SND_PCM_FORMAT_S16_LE;
+	case SPREC_PCM_S24LE:	return SND_PCM_FORMAT_S24_3LE;
+	case SPREC_PCM_S32LE:	return SND_PCM_FORMAT_S32_LE;
+	case SPREC_PCM_F32LE:	return SND_PCM_FORMAT_FLOAT_LE;
+	}
+
+	return SND_PCM_FORMAT_S16_LE;
+}
+
+/*
+ * Reads everything available from the device.
+ * Returns 0 on success, non-0 if the device failed for good.
+ */
+static int sprec_capture_read(sprec_capture *cap)
+{
+	snd_pcm_sframes_t n, delay;
+	double queried, called;
+
+	for (;;) {
+		/*
+		 * What is waiting in the device when a period is read
+		 * tells how long ago its first frame was captured
+		 */
+		if (snd_pcm_delay(cap->pcm, &delay) < 0) {
+			delay = 0;
+		}
+
+		queried = sprec_clock_now();
+		n = snd_pcm_readi(cap->pcm, cap->buffer, cap->period_frames);
+
+		if (n == -EAGAIN || n == 0) {
+			return 0;
+		}
+
+		if (n < 0) {
+			/*
+			 * -EPIPE means overrun, -ESTRPIPE suspension;
+			 * the audio is lost, but capture goes on
+			 * after a recovery
+			 */
+			if (n == -EPIPE || n == -ESTRPIPE) {
+				pthread_mutex_lock(&cap->lock);
+				if (n == -EPIPE) {
+					cap->stats.overruns++;
+				} else {
+					cap->stats.suspends++;
+				}
+				pthread_mutex_unlock(&cap->lock);
+			}
+
+			if (snd_pcm_recover(cap->pcm, n, 1) < 0) {
+				return -1;
+			}
+
+			/*
+			 * Capture doesn't restart by itself after a recovery,
+			 * and poll() would wait for it forever
+			 */
+			if (snd_pcm_state(cap->pcm) == SND_PCM_STATE_PREPARED && snd_pcm_start(cap->pcm) < 0) {
+				return -1;
+			}
+
+			continue;
+		}
+
+		called = sprec_clock_now();
+		cap->cb(cap->buffer, n, cap->ctx);
+
+		sprec_capture_account(
+			cap,
+			n,
+			(double)delay / cap->rate + (called - queried),
+			sprec_clock_now() - called
+		);
+	}
+}
+
+/*
+ * Maps and locks a stack for the capture thread, so that the callbacks
+ * never fault on it. Returns non-0, leaving the thread the default
+ * stack, if that can't be done.
+ */
+static int sprec_capture_loop_map_stack(sprec_capture_loop *loop)
+{
+	long page = sysconf(_SC_PAGESIZE);
+	unsigned char *base;
+	size_t size;
+
+	if (page <= 0) {
+		return -1;
+	}
+
+	size = LOCKED_STACK_SIZE + page;
+	base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED) {
+		return -1;
+	}
+
+	/*
+	 * Stacks grow down: an overflow hits the guard page instead
+	 * of whatever is mapped below. mlock() faults the rest in.
+	 */
+	if (mprotect(base, page, PROT_NONE) != 0 || mlock(base + page, LOCKED_STACK_SIZE) != 0) {
+		munmap(base, size);
+		return -1;
+	}
+
+	loop->stack = base;
+	loop->stack_size = size;
+
+	return 0;
+}
+
+static void sprec_capture_loop_unmap_stack(sprec_capture_loop *loop)
+{
+	if (loop->stack != NULL) {
+		munmap(loop->stack, loop->stack_size);
+		loop->stack = NULL;
+	}
+}
+
+/*
+ * Touches and locks in memory everything else the capture thread works
+ * with: the buffers of the devices and the descriptors polled. Either
+ * all of it is locked (the stack included), or none of it.
+ * Returns 1 if it is.
+ */
+static int sprec_capture_loop_lock(sprec_capture_loop *loop)
+{
+	size_t i, size;
+
+	if (loop->stack == NULL) {
+		return 0;
+	}
+
+	if (mlock(loop->fds, loop->nfds * sizeof loop->fds[0]) != 0) {
+		return 0;
+	}
+
+	for (i = 0; i < loop->count; i++) {
+		size = loop->caps[i]->period_frames * loop->caps[i]->bytes_per_frame;
+		memset(loop->caps[i]->buffer, 0, size);
+
+		if (mlock(loop->caps[i]->buffer, size) != 0) {
+			break;
+		}
+	}
+
+	if (i < loop->count) {
+		while (i-- > 0) {
+			munlock(loop->caps[i]->buffer, loop->caps[i]->period_frames * loop->caps[i]->bytes_per_frame);
+		}
+
+		munlock(loop->fds, loop->nfds * sizeof loop->fds[0]);
+		return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * The stack is unmapped by sprec_capture_loop_stop(),
+ * once the thread is gone
+ */
+static void sprec_capture_loop_unlock(sprec_capture_loop *loop)
+{
+	size_t i;
+
+	for (i = 0; i < loop->count; i++) {
+		munlock(loop->caps[i]->buffer, loop->caps[i]->period_frames * loop->caps[i]->bytes_per_frame);
+	}
+
+	munlock(loop->fds, loop->nfds * sizeof loop->fds[0]);
+}
+
+/*
+ * Sets up the calling thread as the most demanding device of the loop
+ * asks, and records what could be done in the statistics of every one
+ */
+static void sprec_capture_loop_setup(sprec_capture_loop *loop)
+{
+	struct sched_param param;
+	int priority = 0, lock = 0, realtime = 0, lo, hi;
+	size_t i;
+
+	for (i = 0; i < loop->count; i++) {
+		if (loop->caps[i]->realtime > priority) {
+			priority = loop->caps[i]->realtime;
+		}
+
+		lock |= loop->caps[i]->lock_memory;
+	}
+
+	if (priority > 0) {
+		lo = sched_get_priority_min(SCHED_FIFO);
+		hi = sched_get_priority_max(SCHED_FIFO);
+		if (priority < lo) {
+			priority = lo;
+		}
+		if (priority > hi) {
+			priority = hi;
+		}
+
+		memset(&param, 0, sizeof param);
+		param.sched_priority = priority;
+
+		/*
+		 * Fails with EPERM without the privileges;
+		 * capture goes on at normal priority then
+		 */
+		realtime = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+	}
+
+	loop->locked = lock ? sprec_capture_loop_lock(loop) : 0;
+
+	for (i = 0; i < loop->count; i++) {
+		pthread_mutex_lock(&loop->caps[i]->lock);
+		loop->caps[i]->stats.realtime = realtime;
+		loop->caps[i]->stats.locked = loop->locked;
+		pthread_mutex_unlock(&loop->caps[i]->lock);
+	}
+}
+
+static void *sprec_capture_loop_thread(void *ctx)
+{
+	sprec_capture_loop *loop = ctx;
+	sprec_capture *cap;
+	unsigned short revents;
+	size_t i, j, first;
+
+	sprec_capture_loop_setup(loop);
+
+	for (;;) {
+		if (poll(loop->fds, loop->nfds, -1) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			break;
+		}
+
+		/*
+		 * Asked to stop
+		 */
+		if (loop->fds[0].revents != 0) {
+			break;
+		}
+
+		for (i = 0, first = 1; i < loop->count; i++, first += cap->npfds) {
+			cap = loop->caps[i];
+
+			if (cap->npfds == 0 || loop->fds[first].fd < 0) {
+				continue;
+			}
+
+			if (snd_pcm_poll_descriptors_revents(cap->pcm, &loop->fds[first], cap->npfds, &revents) < 0) {
+				continue;
+			}
+
+			if ((revents & (POLLIN | POLLERR)) == 0) {
+				continue;
+			}
+
+			/*
+			 * A broken device is ignored from now on
+			 * (poll() skips negative descriptors)
+			 */
+			if (sprec_capture_read(cap) != 0) {
+				for (j = 0; j < cap->npfds; j++) {
+					loop->fds[first + j].fd = -1;
+				}
+			}
+		}
+	}
+
+	if (loop->locked) {
+		sprec_capture_loop_unlock(loop);
+	}
+
+	return NULL;
+}
+
+static int sprec_capture_loop_start(
+	sprec_capture_loop *loop,
+	sprec_capture **caps,
+	size_t count,
+	const sprec_allocator *alloc
+)
+{
+	pthread_attr_t attr;
+	size_t i;
+	nfds_t n = 1;
+	int lock = 0, err;
+
+	for (i = 0; i < count; i++) {
+		n += caps[i]->npfds;
+		lock |= caps[i]->lock_memory;
+	}
+
+	loop->fds = sprec_allocator_malloc(alloc, n * sizeof loop->fds[0]);
+	if (loop->fds == NULL) {
+		return -1;
+	}
+
+	if (pipe(loop->wake) != 0) {
+		sprec_allocator_free(alloc, loop->fds);
+		return -1;
+	}
+
+	loop->fds[0].fd = loop->wake[0];
+	loop->fds[0].events = POLLIN;
+	loop->fds[0].revents = 0;
+
+	for (i = 0, n = 1; i < count; n += caps[i]->npfds, i++) {
+		if (snd_pcm_prepare(caps[i]->pcm) < 0
+		 || snd_pcm_start(caps[i]->pcm) < 0
+		 || snd_pcm_poll_descriptors(caps[i]->pcm, &loop->fds[n], caps[i]->npfds) != (int)caps[i]->npfds) {
+			break;
+		}
+	}
+
+	loop->caps = caps;
+	loop->count = count;
+	loop->nfds = n;
+	loop->alloc = alloc;
+	loop->stack = NULL;
+
+	/*
+	 * The stack of the thread has to be locked before it runs on it;
+	 * without one, the thread doesn't lock anything
+	 */
+	if (lock) {
+		sprec_capture_loop_map_stack(loop);
+	}
+
+	err = i < count || pthread_attr_init(&attr) != 0;
+	if (!err) {
+		if (loop->stack != NULL) {
+			pthread_attr_setstack(&attr, (unsigned char *)loop->stack + (loop->stack_size - LOCKED_STACK_SIZE), LOCKED_STACK_SIZE);
+		}
+
+		err = pthread_create(&loop->thread, &attr, sprec_capture_loop_thread, loop) != 0;
+		pthread_attr_destroy(&attr);
+	}
+
+	if (err) {
+		for (i = 0; i < count; i++) {
+			snd_pcm_drop(caps[i]->pcm);
+		}
+
+		sprec_capture_loop_unmap_stack(loop);
+		close(loop->wake[0]);
+		close(loop->wake[1]);
+		sprec_allocator_free(alloc, loop->fds);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void sprec_capture_loop_stop(sprec_capture_loop *loop)
+{
+	char c = 0;
+	size_t i;
+
+	while (write(loop->wake[1], &c, 1) < 0 && errno == EINTR) {
+		;
+	}
+
+	pthread_join(loop->thread, NULL);
+	sprec_capture_loop_unmap_stack(loop);
+
+	for (i = 0; i < loop->count; i++) {
+		snd_pcm_drop(loop->caps[i]->pcm);
+	}
+
+	close(loop->wake[0]);
+	close(loop->wake[1]);
+	sprec_allocator_free(loop->alloc, loop->fds);
+}
+
+sprec_capture *sprec_capture_open(
+	const sprec_capture_params *params,
+	sprec_capture_callback cb,
+	void *ctx
+)
+{
+	sprec_capture *cap;
+	snd_pcm_hw_params_t *hw;
+	snd_pcm_uframes_t frames, buffer_frames;
+	unsigned int rate;
+	int dir = 0, npfds;
+
+	if (params->channels == 0 || sprec_pcm_sample_size(params->format) == 0) {
+		return NULL;
+	}
+
+	cap = sprec_capture_alloc(params, cb, ctx);
+	if (cap == NULL) {
+		return NULL;
+	}
+
+	if (snd_pcm_open(&cap->pcm, params->device, SND_PCM_STREAM_CAPTURE, SND_PCM_NONBLOCK) < 0) {
+		sprec_capture_dealloc(cap);
+		return NULL;
+	}
+
+	snd_pcm_hw_params_alloca(&hw);
+	snd_pcm_hw_params_any(cap->pcm, hw);
+
+	rate = params->sample_rate;
+	frames = params->period * params->sample_rate;
+	if (frames == 0) {
+		frames = 1;
+	}
+
+	buffer_frames = frames * NUM_PERIODS;
+
+	if (snd_pcm_hw_params_set_access(cap->pcm, hw, SND_PCM_ACCESS_RW_INTERLEAVED) < 0
+	 || snd_pcm_hw_params_set_format(cap->pcm, hw, sprec_capture_alsa_format(params->format)) < 0
+	 || snd_pcm_hw_params_set_channels(cap->pcm, hw, params->channels) < 0
+	 || snd_pcm_hw_params_set_rate_near(cap->pcm, hw, &rate, &dir) < 0
+	 || snd_pcm_hw_params_set_period_size_near(cap->pcm, hw, &frames, &dir) < 0
+	 || snd_pcm_hw_params_set_buffer_size_near(cap->pcm, hw, &buffer_frames) < 0
+	 || snd_pcm_hw_params(cap->pcm, hw) < 0
+	 || snd_pcm_hw_params_get_period_size(hw, &frames, &dir) < 0
+	 || (npfds = snd_pcm_poll_descriptors_count(cap->pcm)) < 0) {
+		snd_pcm_close(cap->pcm);
+		sprec_capture_dealloc(cap);
+		return NULL;
+	}
+
+	cap->rate = rate;
+	cap->period_frames = frames;
+	cap->npfds = npfds;
+	cap->self = cap;
+
+	cap->buffer = sprec_allocator_malloc(&cap->alloc, frames * cap->bytes_per_frame);
+	if (cap->buffer == NULL) {
+		snd_pcm_close(cap->pcm);
+		sprec_capture_dealloc(cap);
+		return NULL;
+	}
+
+	return cap;
+}
+
+int sprec_capture_start(sprec_capture *cap)
+{
+	if (cap->mgr != NULL || sprec_capture_is_running(cap)) {
+		return -1;
+	}
+
+	if (sprec_capture_loop_start(&cap->loop, &cap->self, 1, &cap->alloc) != 0) {
+		return -1;
+	}
+
+	sprec_capture_set_running(cap, 1);
+
+	return 0;
+}
+
+void sprec_capture_stop(sprec_capture *cap)
+{
+	if (cap->mgr != NULL || !sprec_capture_is_running(cap)) {
+		return;
+	}
+
+	sprec_capture_loop_stop(&cap->loop);
+	sprec_capture_set_running(cap, 0);
+}
+
+void sprec_capture_close(sprec_capture *cap)
+{
+	if (cap == NULL) {
+		return;
+	}
+
+	sprec_capture_stop(cap);
+	sprec_capture_detach(cap);
+	snd_pcm_close(cap->pcm);
+	sprec_allocator_free(&cap->alloc, cap->buffer);
+	sprec_capture_dealloc(cap);
+}
+
+int sprec_capture_poll_count(sprec_capture *cap)
+{
+	return cap->npfds;
+}
+
+int sprec_capture_poll_descriptors(sprec_capture *cap, struct pollfd *fds, unsigned n)
+{
+	return snd_pcm_poll_descriptors(cap->pcm, fds, n);
+}
+
+int sprec_capture_begin(sprec_capture *cap)
+{
+	if (cap->mgr != NULL || sprec_capture_is_running(cap)) {
+		return -1;
+	}
+
+	if (snd_pcm_prepare(cap->pcm) < 0 || snd_pcm_start(cap->pcm) < 0) {
+		return -1;
+	}
+
+	sprec_capture_set_running(cap, 1);
+
+	return 0;
+}
+
+int sprec_capture_process(sprec_capture *cap, struct pollfd *fds, unsigned n)
+{
+	unsigned short revents;
+
+	if (snd_pcm_poll_descriptors_revents(cap->pcm, fds, n, &revents) < 0) {
+		return -1;
+	}
+
+	if ((revents & (POLLIN | POLLERR)) == 0) {
+		return 0;
+	}
+
+	return sprec_capture_read(cap);
+}
+
+void sprec_capture_end(sprec_capture *cap)
+{
+	if (cap->mgr != NULL || !sprec_capture_is_running(cap)) {
+		return;
+	}
+
+	snd_pcm_drop(cap->pcm);
+	sprec_capture_set_running(cap, 0);
+}
+
+int sprec_capture_manager_start(sprec_capture_manager *mgr)
+{
+	if (mgr->running) {
+		return -1;
+	}
+
+	if (sprec_capture_loop_start(&mgr->loop, mgr->caps, mgr->count, &mgr->alloc) != 0) {
+		return -1;
+	}
+
+	mgr->running = 1;
+
+	return 0;
+}
+
+void sprec_capture_manager_stop(sprec_capture_manager *mgr)
+{
+	if (!mgr->running) {
+		return;
+	}
+
+	sprec_capture_loop_stop(&mgr->loop);
+	mgr->running = 0;
+}
+
+#endif
+
+typedef struct sprec_capture_recording {
+	unsigned char *data;
+	size_t size;			/* bytes wanted */
+	size_t length;			/* bytes captured */
+	size_t bytes_per_frame;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int full;
+} sprec_capture_recording;
+
+static void sprec_capture_record_cb(const void *pcm, size_t frames, void *ctx)
+{
+	sprec_capture_recording *rec = ctx;
+	size_t n = frames * rec->bytes_per_frame;
+
+	if (n > rec->size - rec->length) {
+		n = rec->size - rec->length;
+	}
+
+	if (n == 0) {
+		return;
+	}
+
+	/*
+	 * Only this thread touches `length' until capture stops
+	 */
+	memcpy(rec->data + rec->length, pcm, n);
+	rec->length += n;
+
+	if (rec->length == rec->size) {
+		pthread_mutex_lock(&rec->lock);
+		rec->full = 1;
+		pthread_cond_signal(&rec->cond);
+		pthread_mutex_unlock(&rec->lock);
+	}
+}
+
+int sprec_capture_record_wav(
+	const sprec_capture_params *params,
+	const char *filename,
+	sprec_wav_header *hdr,
+	uint32_t duration_ms,
+	sprec_capture_stats *stats
+)
+{
+	sprec_capture_params p;
+	sprec_capture_recording rec;
+	sprec_capture *cap;
+	struct timespec ts;
+	double deadline;
+	int locked = 0, err = 0;
+	FILE *f;
+
+	if (params != NULL) {
+		p = *params;
+	} else {
+		sprec_capture_params_init(&p);
+	}
+
+	if (hdr == NULL || hdr->bytes_per_frame == 0 || sprec_pcm_format_from_wav(hdr, &p.format) != 0) {
+		return -1;
+	}
+
+	p.sample_rate = hdr->sample_rate;
+	p.channels = hdr->number_of_channels;
+
+	memset(&rec, 0, sizeof rec);
+	rec.bytes_per_frame = hdr->bytes_per_frame;
+
+	cap = sprec_capture_open(&p, sprec_capture_record_cb, &rec);
+	if (cap == NULL) {
+		return -1;
+	}
+
+	hdr->sample_rate = sprec_capture_sample_rate(cap);
+	hdr->bytes_per_second = hdr->sample_rate * hdr->bytes_per_frame;
+
+	rec.size = (uint64_t)hdr->sample_rate * duration_ms / 1000 * hdr->bytes_per_frame;
+	rec.data = sprec_malloc(rec.size > 0 ? rec.size : 1);
+	if (rec.data == NULL) {
+		sprec_capture_close(cap);
+		return -1;
+	}
+
+	/*
+	 * No page fault while capturing
+	 */
+	memset(rec.data, 0, rec.size);
+	if (p.lock_memory && rec.size > 0) {
+		locked = mlock(rec.data, rec.size) == 0;
+	}
+
+	pthread_mutex_init(&rec.lock, NULL);
+	pthread_cond_init(&rec.cond, NULL);
+
+	if (rec.size > 0) {
+		if (sprec_capture_start(cap) != 0) {
+			err = -1;
+		} else {
+			/*
+			 * A device which stops delivering
+			 * mustn't keep us waiting forever
+			 */
+			deadline = sprec_clock_now() + duration_ms / 1000.0 + 2;
+			sprec_clock_abstime(deadline, &ts);
+
+			pthread_mutex_lock(&rec.lock);
+			while (!rec.full) {
+				if (pthread_cond_timedwait(&rec.cond, &rec.lock, &ts) != 0 && sprec_clock_now() >= deadline) {
+					break;
+				}
+			}
+			pthread_mutex_unlock(&rec.lock);
+
+			sprec_capture_stop(cap);
+
+			if (rec.length < rec.size) {
+				err = -1;
+			}
+		}
+	}
+
+	if (stats != NULL) {
+		sprec_capture_get_stats(cap, stats);
+	}
+
+	sprec_capture_close(cap);
+
+	if (locked) {
+		munlock(rec.data, rec.size);
+	}
+
+	/*
+	 * The header tells the length actually captured
+	 */
+	if (err == 0 || rec.length > 0) {
+		hdr->file_size = rec.length + SPREC_WAV_FILE_HEADER_SIZE - 8;
+
+		f = fopen(filename, "wb");
+		if (f == NULL) {
+			err = -1;
+		} else {
+			if (sprec_wav_header_write(f, hdr) != 0
+			 || (rec.length > 0 && fwrite(rec.data, rec.length, 1, f) != 1)) {
+				err = -1;
+			}
+
+			if (fclose(f) != 0) {
+				err = -1;
+			}
+		}
+	}
+
+	pthread_cond_destroy(&rec.cond);
+	pthread_mutex_destroy(&rec.lock);
+	sprec_free(rec.data);
+
+	return err;
+}
@@ -0,0 +1,349 @@
+/*
+ * client.c
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sprec/client.h>
+#include <sprec/wav.h>
+#include <sprec/parser.h>
+#include <sprec/alloc.h>
+#include "ipc.h"
+
+struct sprec_client {
+	sprec_allocator alloc;
+	pthread_mutex_t lock;
+	int sock;
+	sprec_client_error error;
+};
+
+int sprec_client_socket_path(char *path, size_t size)
+{
+	return sprec_ipc_socket_path(path, size, 0);
+}
+
+sprec_client *sprec_client_connect(const char *path)
+{
+	struct sockaddr_un addr;
+	sprec_client *client;
+	sprec_allocator alloc;
+	char buf[sizeof addr.sun_path];
+
+	if (path == NULL) {
+		if (sprec_ipc_socket_path(buf, sizeof buf, 0) != 0) {
+			return NULL;
+		}
+		path = buf;
+	}
+
+	if (strlen(path) >= sizeof addr.sun_path) {
+		return NULL;
+	}
+
+	sprec_get_allocator(&alloc);
+
+	client = sprec_allocator_calloc(&alloc, 1, sizeof *client);
+	if (client == NULL) {
+		return NULL;
+	}
+
+	client->alloc = alloc;
+
+	client->sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (client->sock < 0) {
+		sprec_allocator_free(&alloc, client);
+		return NULL;
+	}
+
+	fcntl(client->sock, F_SETFD, FD_CLOEXEC);
+
+#ifdef SO_NOSIGPIPE
+	{
+		int one = 1;
+		setsockopt(client->sock, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof one);
+	}
+#endif
+
+	memset(&addr, 0, sizeof addr);
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	if (connect(client->sock, (struct sockaddr *)&addr, sizeof addr) != 0) {
+		close(client->sock);
+		sprec_allocator_free(&alloc, client);
+		return NULL;
+	}
+
+	pthread_mutex_init(&client->lock, NULL);
+
+	return client;
+}
+
+void sprec_client_close(sprec_client *client)
+{
+	sprec_allocator alloc;
+
+	if (client == NULL) {
+		return;
+	}
+
+	close(client->sock);
+	pthread_mutex_destroy(&client->lock);
+
+	alloc = client->alloc;
+	sprec_allocator_free(&alloc, client);
+}
+
+sprec_client_error sprec_client_last_error(sprec_client *client)
+{
+	sprec_client_error error;
+
+	pthread_mutex_lock(&client->lock);
+	error = client->error;
+	pthread_mutex_unlock(&client->lock);
+
+	return error;
+}
+
+/*
+ * Reads and drops `length' bytes, so that the next response is read
+ * from its start. If that fails, the connection is shut down, as it
+ * can't be used anymore.
+ */
+static void sprec_client_skip(sprec_client *client, uint64_t length)
+{
+	char buf[512];
+	size_t n;
+
+	while (length > 0) {
+		n = length < sizeof buf ? length : sizeof buf;
+		if (sprec_ipc_read(client->sock, buf, n) != 0) {
+			shutdown(client->sock, SHUT_RDWR);
+			return;
+		}
+		length -= n;
+	}
+}
+
+/*
+ * Sends one request about the audio in `fd' and waits for the response
+ */
+static sprec_server_response *sprec_client_request(sprec_client *client, sprec_ipc_request *req, int fd)
+{
+	sprec_server_response *resp = NULL;
+	sprec_ipc_response hdr;
+
+	req->magic = SPREC_IPC_MAGIC;
+	req->version = SPREC_IPC_VERSION;
+
+	pthread_mutex_lock(&client->lock);
+
+	client->error = SPREC_CLIENT_ERR_TRANSPORT;
+
+	if (sprec_ipc_write_fd(client->sock, req, sizeof *req, fd) != 0
+	 || sprec_ipc_read(client->sock, &hdr, sizeof hdr) != 0
+	 || hdr.magic != SPREC_IPC_MAGIC) {
+		goto out;
+	}
+
+	client->error = hdr.error;
+	if (hdr.error != SPREC_CLIENT_OK) {
+		goto out;
+	}
+
+	/*
+	 * The JSON follows the header even if it can't be used
+	 */
+	resp = sprec_malloc(sizeof *resp);
+	if (resp != NULL) {
+		resp->data = sprec_malloc(hdr.length + 1);
+		if (resp->data == NULL) {
+			sprec_free(resp);
+			resp = NULL;
+		}
+	}
+
+	if (resp == NULL) {
+		sprec_client_skip(client, hdr.length);
+		client->error = SPREC_CLIENT_ERR_NOMEM;
+		goto out;
+	}
+
+	if (sprec_ipc_read(client->sock, resp->data, hdr.length) != 0) {
+		sprec_free_response(resp);
+		resp = NULL;
+		client->error = SPREC_CLIENT_ERR_TRANSPORT;
+		goto out;
+	}
+
+	resp->data[hdr.length] = '\0';
+	resp->length = hdr.length;
+	resp->status = hdr.status;
+	sprec_result_parse(resp->data, resp->length, &resp->result);
+
+out:
+	pthread_mutex_unlock(&client->lock);
+
+	return resp;
+}
+
+static int sprec_client_fill(sprec_ipc_request *req, const char *apikey, const char *language)
+{
+	memset(req, 0, sizeof *req);
+
+	if (strlen(apikey) >= sizeof req->apikey || strlen(language) >= sizeof req->language) {
+		return -1;
+	}
+
+	strcpy(req->apikey, apikey);
+	strcpy(req->language, language);
+
+	return 0;
+}
+
+sprec_server_response *sprec_client_send_audio_data(
+	sprec_client *client,
+	const void *data,
+	size_t length,
+	const char *apikey,
+	const char *language,
+	uint32_t sample_rate
+)
+{
+	sprec_server_response *resp;
+	sprec_ipc_request req;
+	const char *p = data;
+	size_t left = length;
+	ssize_t n;
+	int fd;
+
+	if (data == NULL || sprec_client_fill(&req, apikey, language) != 0) {
+		return NULL;
+	}
+
+	/*
+	 * The only copy made: from the caller's buffer to shared memory
+	 */
+	fd = sprec_ipc_shared_file(NULL, 0);
+	if (fd < 0) {
+		return NULL;
+	}
+
+	while (left > 0) {
+		n = write(fd, p, left);
+		if (n <= 0) {
+			close(fd);
+			return NULL;
+		}
+		p += n;
+		left -= n;
+	}
+
+	/* the server copies the audio if this fails */
+	sprec_ipc_seal(fd);
+
+	req.type = SPREC_IPC_FLAC;
+	req.sample_rate = sample_rate;
+	req.offset = 0;
+	req.length = length;
+
+	resp = sprec_client_request(client, &req, fd);
+	close(fd);
+
+	return resp;
+}
+
+sprec_server_response *sprec_client_recognize_file(
+	sprec_client *client,
+	const char *wavfile,
+	const char *apikey,
+	const char *language
+)
+{
+	sprec_server_response *resp;
+	sprec_ipc_request req;
+	int fd;
+
+	if (sprec_client_fill(&req, apikey, language) != 0) {
+		return NULL;
+	}
+
+	/*
+	 * A file of the user's can't be sealed: the server reads it
+	 * into memory of its own instead of mapping it
+	 */
+	fd = open(wavfile, O_RDONLY);
+	if (fd < 0) {
+		return NULL;
+	}
+
+	req.type = SPREC_IPC_WAV;
+
+	resp = sprec_client_request(client, &req, fd);
+	close(fd);
+
+	return resp;
+}
+
+char *sprec_client_recognize_sync(sprec_client *client, const char *apikey, const char *lang, double dur_s)
+{
+	sprec_server_response *resp;
+	sprec_wav_header *hdr;
+	sprec_ipc_request req;
+	char path[64], *text;
+	int fd, err;
+
+	if (sprec_client_fill(&req, apikey, lang) != 0) {
+		return NULL;
+	}
+
+	/*
+	 * sample rate = 16000Hz, bit depth = 16bps, stereo,
+	 * as sprec_recognize_sync() records
+	 */
+	hdr = sprec_wav_header_from_params(16000, 16, 2);
+	if (hdr == NULL) {
+		return NULL;
+	}
+
+	fd = sprec_ipc_shared_file(path, sizeof path);
+	if (fd < 0) {
+		sprec_free(hdr);
+		return NULL;
+	}
+
+	err = sprec_record_wav(path, hdr, 1000 * dur_s);
+	sprec_ipc_release(path);
+	sprec_free(hdr);
+
+	if (err != 0) {
+		close(fd);
+		return NULL;
+	}
+
+	sprec_ipc_seal(fd);
+
+	req.type = SPREC_IPC_WAV;
+
+	resp = sprec_client_request(client, &req, fd);
+	close(fd);
+
+	if (resp == NULL) {
+		return NULL;
+	}
+
+	text = sprec_strdup(resp->data);
+	sprec_free_response(resp);
+
+	return text;
+}
@@ -0,0 +1,45 @@
+/*
+ * clock.c
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#include <sys/time.h>
+#include <unistd.h>
+#include <errno.h>
+#include "clock.h"
+
+double sprec_clock_now(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+void sprec_clock_abstime(double deadline, struct timespec *ts)
+{
+	ts->tv_sec = (time_t)deadline;
+	ts->tv_nsec = (long)((deadline - ts->tv_sec) * 1e9);
+
+	if (ts->tv_nsec >= 1000000000L) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000L;
+	}
+}
+
+void sprec_clock_sleep(double seconds)
+{
+	struct timespec ts, rem;
+
+	if (seconds <= 0) {
+		return;
+	}
+
+	ts.tv_sec = (time_t)seconds;
+	ts.tv_nsec = (long)((seconds - ts.tv_sec) * 1e9);
+
+	while (nanosleep(&ts, &rem) != 0 && errno == EINTR) {
+		ts = rem;
+	}
+}
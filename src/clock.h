@@ -0,0 +1,35 @@
+/*
+ * clock.h
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#ifndef __SPREC_CLOCK_H__
+#define __SPREC_CLOCK_H__
+
+#include <time.h>
+
+/*
+ * Internal time helpers. Wall-clock time is used throughout because
+ * pthread_cond_timedwait() takes a CLOCK_REALTIME deadline and
+ * clock_gettime() isn't available on every platform we support.
+ */
+
+/*
+ * Current time in seconds
+ */
+double sprec_clock_now(void);
+
+/*
+ * Converts a deadline returned by sprec_clock_now() + offset
+ * to the form expected by pthread_cond_timedwait()
+ */
+void sprec_clock_abstime(double deadline, struct timespec *ts);
+
+/*
+ * Sleeps for the given number of seconds
+ */
+void sprec_clock_sleep(double seconds);
+
+#endif /* !__SPREC_CLOCK_H__ */
@@ -0,0 +1,250 @@
+/*
+ * fanout.c
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <curl/curl.h>
+#include <sprec/fanout.h>
+#include <sprec/wav.h>
+#include <sprec/flac_encoder.h>
+#include <sprec/alloc.h>
+#include <sprec/budget.h>
+#include "request.h"
+
+enum {
+	REQUEST_IDLE,		/* couldn't be set up */
+	REQUEST_RUNNING,
+	REQUEST_FINISHED
+};
+
+void sprec_fanout_options_init(sprec_fanout_options *opts)
+{
+	opts->mode = SPREC_FANOUT_ALL;
+	opts->confidence = 1.0;
+}
+
+static int sprec_response_is_useful(const sprec_server_response *resp)
+{
+	return resp != NULL && resp->status >= 200 && resp->status < 300 && resp->result.count > 0;
+}
+
+static double sprec_response_confidence(const sprec_server_response *resp)
+{
+	double confidence = resp->result.alternatives[0].confidence;
+
+	return confidence > 0 ? confidence : 0;
+}
+
+int sprec_send_audio_data_fanout(
+	const void *data,
+	size_t length,
+	const char *apikey,
+	const char *const *languages,
+	size_t count,
+	uint32_t sample_rate,
+	const sprec_fanout_options *opts,
+	sprec_server_response **resps
+)
+{
+	sprec_fanout_options defaults;
+	sprec_request *reqs;
+	unsigned char *state;
+	CURLM *multi;
+	CURLMsg *msg;
+	size_t i;
+	int running, left, chosen = -1, stop = 0;
+
+	if (opts == NULL) {
+		sprec_fanout_options_init(&defaults);
+		opts = &defaults;
+	}
+
+	for (i = 0; i < count; i++) {
+		resps[i] = NULL;
+	}
+
+	if (data == NULL || count == 0) {
+		return -1;
+	}
+
+	reqs = sprec_calloc(count, sizeof reqs[0]);
+	state = sprec_calloc(count, sizeof state[0]);
+	multi = curl_multi_init();
+	if (reqs == NULL || state == NULL || multi == NULL) {
+		sprec_free(reqs);
+		sprec_free(state);
+		if (multi != NULL) {
+			curl_multi_cleanup(multi);
+		}
+		return -1;
+	}
+
+	/*
+	 * All the requests upload the same buffer, and
+	 * share one HTTP/2 connection where possible
+	 */
+	sprec_multi_use_http2(multi, 0, 0);
+
+	for (i = 0; i < count; i++) {
+		if (sprec_request_init(&reqs[i], data, length, apikey, languages[i], sample_rate) != 0) {
+			continue;
+		}
+
+		sprec_request_use_http2(&reqs[i]);
+		curl_easy_setopt(reqs[i].conn_hndl, CURLOPT_PRIVATE, (char *)&reqs[i]);
+		curl_multi_add_handle(multi, reqs[i].conn_hndl);
+		state[i] = REQUEST_RUNNING;
+	}
+
+	while (!stop) {
+		curl_multi_perform(multi, &running);
+
+		while (!stop && (msg = curl_multi_info_read(multi, &left)) != NULL) {
+			char *priv = NULL;
+
+			if (msg->msg != CURLMSG_DONE) {
+				continue;
+			}
+
+			curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &priv);
+			i = (sprec_request *)priv - reqs;
+
+			reqs[i].done = 1;
+			reqs[i].result = msg->data.result;
+			curl_multi_remove_handle(multi, reqs[i].conn_hndl);
+
+			resps[i] = sprec_request_finish(&reqs[i]);
+			state[i] = REQUEST_FINISHED;
+
+			if (!sprec_response_is_useful(resps[i])) {
+				continue;
+			}
+
+			/*
+			 * Good enough to give up on the rest?
+			 */
+			if (opts->mode == SPREC_FANOUT_FIRST) {
+				chosen = i;
+				stop = 1;
+			} else if (opts->mode == SPREC_FANOUT_BEST && sprec_response_confidence(resps[i]) >= opts->confidence) {
+				stop = 1;
+			}
+		}
+
+		if (running == 0) {
+			break;
+		}
+
+		if (!stop) {
+			curl_multi_wait(multi, NULL, 0, 1000, NULL);
+		}
+	}
+
+	/*
+	 * Cancel whatever is still in progress
+	 */
+	for (i = 0; i < count; i++) {
+		if (state[i] == REQUEST_RUNNING) {
+			curl_multi_remove_handle(multi, reqs[i].conn_hndl);
+			reqs[i].done = 0;
+			sprec_request_finish(&reqs[i]);
+		}
+	}
+
+	curl_multi_cleanup(multi);
+	sprec_free(reqs);
+	sprec_free(state);
+
+	if (chosen < 0) {
+		for (i = 0; i < count; i++) {
+			if (!sprec_response_is_useful(resps[i])) {
+				continue;
+			}
+
+			if (chosen < 0 || sprec_response_confidence(resps[i]) > sprec_response_confidence(resps[chosen])) {
+				chosen = i;
+			}
+		}
+	}
+
+	if (opts->mode != SPREC_FANOUT_ALL) {
+		for (i = 0; i < count; i++) {
+			if ((int)i != chosen) {
+				sprec_free_response(resps[i]);
+				resps[i] = NULL;
+			}
+		}
+	}
+
+	return chosen;
+}
+
+int sprec_recognize_file_fanout(
+	const char *wavfile,
+	const char *apikey,
+	const char *const *languages,
+	size_t count,
+	const sprec_fanout_options *opts,
+	sprec_server_response **resps
+)
+{
+	sprec_reservation res;
+	sprec_wav_header *hdr;
+	sprec_encoder *enc;
+	const void *flac;
+	size_t i, size;
+	uint32_t length;
+	int chosen;
+	FILE *f;
+
+	for (i = 0; i < count; i++) {
+		resps[i] = NULL;
+	}
+
+	f = fopen(wavfile, "rb");
+	if (f == NULL) {
+		return -1;
+	}
+
+	if (sprec_wav_read_header(f, &hdr, &length) != 0) {
+		fclose(f);
+		return -1;
+	}
+
+	fclose(f);
+
+	/*
+	 * Encoded once, uploaded `count' times: one response for each
+	 */
+	if (sprec_budget_reserve(&res, sprec_budget_estimate(length) + (count > 1 ? count - 1 : 0) * SPREC_BUDGET_RESPONSE, 0) != 0) {
+		sprec_free(hdr);
+		return -1;
+	}
+
+	enc = sprec_encoder_new();
+	if (enc == NULL) {
+		sprec_budget_release(&res);
+		sprec_free(hdr);
+		return -1;
+	}
+
+	if (sprec_encoder_encode_file(enc, wavfile, &flac, &size) != 0 || sprec_reservation_shed(&res)) {
+		sprec_encoder_free(enc);
+		sprec_budget_release(&res);
+		sprec_free(hdr);
+		return -1;
+	}
+
+	chosen = sprec_send_audio_data_fanout(flac, size, apikey, languages, count, hdr->sample_rate, opts, resps);
+
+	sprec_encoder_free(enc);
+	sprec_budget_release(&res);
+	sprec_free(hdr);
+
+	return chosen;
+}
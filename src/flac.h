@@ -0,0 +1,30 @@
+/*
+ * flac.h
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#ifndef __SPREC_FLAC_H__
+#define __SPREC_FLAC_H__
+
+#include <FLAC/all.h>
+
+/*
+ * Internal helpers for assembling FLAC streams
+ */
+
+/*
+ * Dither noise is seeded the same way for every stream, so that
+ * encoding the same audio always gives the same bytes (which is
+ * what a cache keyed on the payload wants)
+ */
+#define SPREC_FLAC_DITHER_SEED 0x5eed
+
+/*
+ * Stores the body of a STREAMINFO block, as it appears
+ * in the stream, in SPREC_FLAC_STREAMINFO_SIZE bytes at `p'
+ */
+void sprec_flac_pack_streaminfo(const FLAC__StreamMetadata_StreamInfo *info, unsigned char *p);
+
+#endif /* !__SPREC_FLAC_H__ */
@@ -8,26 +8,92 @@
 
 #include <stdlib.h>
 #include <unistd.h>
+#include <pthread.h>
 
 #include <sprec/flac_encoder.h>
 #include <sprec/wav.h>
+#include <sprec/alloc.h>
+#include <sprec/pcm.h>
 
 #include <FLAC/all.h>
 
-#define BUFSIZE 0x5000
+#include "flac.h"
 
 /*
- * Search a NUL-terminated C string in a byte array
- * Returns: location of the string, or
- * NULL if not found
+ * Default number of frames converted and passed to libFLAC at a time
  */
-static const char *memstr(const void *haystack, const char *needle, size_t size);
+#define CHUNK_FRAMES 0x5000
+
+#define CHUNK_FRAMES_MIN 64
+
+/*
+ * By default, an output buffer larger than this is not kept around
+ * by sprec_encoder_reset(), so that one huge recording
+ * doesn't pin a lot of memory in an encoder pool
+ */
+#define OUTPUT_KEEP_MAX 0x400000
 
 typedef struct sprec_encoder_state {
+	const sprec_allocator *alloc;
 	unsigned char *buf;
-	size_t length;
+	size_t length;		/* bytes written, even if not buffered */
+	size_t capacity;
+	sprec_encoder_sink sink;
+	void *sink_ctx;
+	unsigned char streaminfo[SPREC_FLAC_STREAMINFO_SIZE];
+	int has_streaminfo;
+	int discard;		/* the stream is abandoned, drop what it writes */
 } sprec_encoder_state;
 
+struct sprec_encoder {
+	sprec_allocator alloc;	/* allocator in effect at creation */
+	sprec_encoder_options opts;
+	FLAC__StreamEncoder *flac;
+	int active;		/* a stream is being encoded */
+	uint32_t channels;	/* of the stream */
+	sprec_pcm_format fmt;
+	unsigned level;
+	sprec_dither dither;
+
+	FLAC__byte *raw;	/* raw PCM read from a file */
+	size_t rawcap;
+	FLAC__int32 *pcm;	/* samples converted for libFLAC */
+	size_t pcmcap;
+
+	sprec_encoder_state out;
+};
+
+struct sprec_encoder_pool {
+	sprec_allocator alloc;
+	sprec_encoder_options opts;
+	pthread_mutex_t lock;
+	sprec_encoder **idle;
+	size_t nidle;
+	size_t max_idle;
+};
+
+static sprec_encoder *sprec_encoder_create(const sprec_allocator *alloc, const sprec_encoder_options *opts);
+
+static int sprec_encoder_begin(
+	sprec_encoder *enc,
+	uint32_t rate,
+	uint32_t channels,
+	sprec_pcm_format fmt,
+	uint32_t total
+);
+
+static int sprec_encoder_feed(
+	sprec_encoder *enc,
+	const FLAC__byte *data,
+	size_t frames,
+	uint32_t channels,
+	sprec_pcm_format fmt
+);
+
+static int sprec_encoder_end(sprec_encoder *enc);
+static void sprec_encoder_abort(sprec_encoder *enc);
+static void *sprec_encoder_detach(sprec_encoder *enc, size_t *size);
+
 static FLAC__StreamEncoderWriteStatus flac_write_callback(
 	const FLAC__StreamEncoder *encoder,
 	const FLAC__byte buffer[],
@@ -38,71 +104,404 @@ static FLAC__StreamEncoderWriteStatus flac_write_callback(
 )
 {
 	sprec_encoder_state *flac_data = client_data;
+	unsigned char *tmp;
+	size_t capacity;
+
+	if (flac_data->discard) {
+		return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+	}
+
+	/*
+	 * With a sink, nothing is buffered
+	 */
+	if (flac_data->sink != NULL) {
+		if (flac_data->sink(buffer, bytes, flac_data->sink_ctx) != 0) {
+			return FLAC__STREAM_ENCODER_WRITE_STATUS_FATAL_ERROR;
+		}
+
+		flac_data->length += bytes;
+		return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+	}
+
+	/*
+	 * Grow the buffer geometrically, so that a stream of
+	 * many small frames doesn't cost a realloc() each
+	 */
+	if (flac_data->length + bytes > flac_data->capacity) {
+		capacity = flac_data->capacity ? flac_data->capacity * 2 : 0x1000;
+		while (capacity < flac_data->length + bytes) {
+			capacity *= 2;
+		}
+
+		tmp = sprec_allocator_realloc(flac_data->alloc, flac_data->buf, capacity);
+		if (tmp == NULL) {
+			return FLAC__STREAM_ENCODER_WRITE_STATUS_FATAL_ERROR;
+		}
+
+		flac_data->buf = tmp;
+		flac_data->capacity = capacity;
+	}
 
-	flac_data->buf = realloc(flac_data->buf, flac_data->length + bytes);
 	memcpy(flac_data->buf + flac_data->length, buffer, bytes);
 	flac_data->length += bytes;
 
 	return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
 }
 
-void *sprec_flac_encode(const char *wavfile, size_t *size)
+void sprec_flac_pack_streaminfo(const FLAC__StreamMetadata_StreamInfo *info, unsigned char *p)
 {
-	FLAC__StreamEncoder *encoder;
-	FILE *infile;
-	const char *dataloc;
-	uint32_t rate;		/* sample rate */
-	uint32_t total;		/* number of samples in file */
-	uint32_t channels;	/* number of channels */
-	uint32_t bps;		/* bits per sample */
-	uint32_t dataoff;	/* offset of PCM data within the file */
-	int err;
+	uint64_t x;
+	int i;
 
 	/*
-	 * BUFFSIZE samples * 2 bytes per sample * 2 channels
-	 * Initialized to 0 in case file is not long enough.
+	 * Packed big endian, as in the stream
 	 */
-	FLAC__byte buffer[BUFSIZE * 2 * 2] = { 0 };
+	p[0] = info->min_blocksize >> 8;
+	p[1] = info->min_blocksize;
+	p[2] = info->max_blocksize >> 8;
+	p[3] = info->max_blocksize;
+	p[4] = info->min_framesize >> 16;
+	p[5] = info->min_framesize >> 8;
+	p[6] = info->min_framesize;
+	p[7] = info->max_framesize >> 16;
+	p[8] = info->max_framesize >> 8;
+	p[9] = info->max_framesize;
+
+	x = (uint64_t)info->sample_rate << 44
+	  | (uint64_t)(info->channels - 1) << 41
+	  | (uint64_t)(info->bits_per_sample - 1) << 36
+	  | (info->total_samples & 0xfffffffffULL);
+
+	for (i = 0; i < 8; i++) {
+		p[10 + i] = x >> (56 - 8 * i);
+	}
+
+	memcpy(p + 18, info->md5sum, 16);
+}
+
+/*
+ * Called by libFLAC when the stream is finished, with the final
+ * STREAMINFO; it can only write that itself when it can seek
+ */
+static void flac_metadata_callback(
+	const FLAC__StreamEncoder *encoder,
+	const FLAC__StreamMetadata *metadata,
+	void *client_data
+)
+{
+	sprec_encoder_state *flac_data = client_data;
+
+	if (flac_data->discard || metadata->type != FLAC__METADATA_TYPE_STREAMINFO) {
+		return;
+	}
+
+	sprec_flac_pack_streaminfo(&metadata->data.stream_info, flac_data->streaminfo);
+	flac_data->has_streaminfo = 1;
+}
+
+void *sprec_flac_encode(const char *wavfile, size_t *size)
+{
+	sprec_encoder *enc;
+	const void *flac;
+	void *buf = NULL;
+
+	enc = sprec_encoder_new();
+	if (enc == NULL) {
+		return NULL;
+	}
+
+	if (sprec_encoder_encode_file(enc, wavfile, &flac, size) == 0) {
+		buf = sprec_encoder_detach(enc, size);
+	}
+
+	sprec_encoder_free(enc);
+
+	return buf;
+}
+
+void *sprec_flac_encode_pcm(
+	const void *data,
+	size_t frames,
+	uint32_t rate,
+	uint32_t channels,
+	uint32_t bps,
+	size_t *size
+)
+{
+	sprec_encoder *enc;
+	const void *flac;
+	void *buf = NULL;
+
+	enc = sprec_encoder_new();
+	if (enc == NULL) {
+		return NULL;
+	}
+
+	if (sprec_encoder_encode_pcm(enc, data, frames, rate, channels, bps, &flac, size) == 0) {
+		buf = sprec_encoder_detach(enc, size);
+	}
+
+	sprec_encoder_free(enc);
+
+	return buf;
+}
+
+void sprec_encoder_options_init(sprec_encoder_options *opts)
+{
+	opts->chunk_frames = CHUNK_FRAMES;
+	opts->output_keep = OUTPUT_KEEP_MAX;
+	opts->dither = 1;
+	opts->level = 5;
+}
+
+size_t sprec_encoder_memory_bound(const sprec_encoder_options *opts, uint32_t channels, uint32_t bps)
+{
+	sprec_encoder_options defaults;
+	size_t frames;
+
+	if (opts == NULL) {
+		sprec_encoder_options_init(&defaults);
+		opts = &defaults;
+	}
+
+	frames = opts->chunk_frames > CHUNK_FRAMES_MIN ? opts->chunk_frames : CHUNK_FRAMES_MIN;
 
 	/*
-	 * BUFFSIZE samples * 2 channels
+	 * The context, the raw chunk read from a file and the converted one
 	 */
-	FLAC__int32 pcm[BUFSIZE * 2] = { 0 };
+	return sizeof(sprec_encoder)
+	     + frames * channels * ((bps + 7) / 8)
+	     + frames * channels * sizeof(FLAC__int32);
+}
+
+sprec_encoder *sprec_encoder_new(void)
+{
+	return sprec_encoder_new_ex(NULL);
+}
+
+sprec_encoder *sprec_encoder_new_ex(const sprec_encoder_options *opts)
+{
+	sprec_allocator alloc;
+
+	sprec_get_allocator(&alloc);
+	return sprec_encoder_create(&alloc, opts);
+}
+
+static sprec_encoder *sprec_encoder_create(const sprec_allocator *alloc, const sprec_encoder_options *opts)
+{
+	sprec_encoder *enc;
+
+	enc = sprec_allocator_calloc(alloc, 1, sizeof *enc);
+	if (enc == NULL) {
+		return NULL;
+	}
+
+	enc->alloc = *alloc;
+	enc->out.alloc = &enc->alloc;
+
+	if (opts != NULL) {
+		enc->opts = *opts;
+	} else {
+		sprec_encoder_options_init(&enc->opts);
+	}
+
+	if (enc->opts.chunk_frames < CHUNK_FRAMES_MIN) {
+		enc->opts.chunk_frames = CHUNK_FRAMES_MIN;
+	}
+
+	if (enc->opts.level > 8) {
+		enc->opts.level = 8;
+	}
+	enc->level = enc->opts.level;
+
+	enc->flac = FLAC__stream_encoder_new();
+	if (enc->flac == NULL) {
+		sprec_allocator_free(alloc, enc);
+		return NULL;
+	}
+
+	return enc;
+}
+
+void sprec_encoder_free(sprec_encoder *enc)
+{
+	sprec_allocator alloc;
+
+	if (enc == NULL) {
+		return;
+	}
+
+	sprec_encoder_abort(enc);
+	FLAC__stream_encoder_delete(enc->flac);
+	alloc = enc->alloc;
+	sprec_allocator_free(&alloc, enc->raw);
+	sprec_allocator_free(&alloc, enc->pcm);
+	sprec_allocator_free(&alloc, enc->out.buf);
+	sprec_allocator_free(&alloc, enc);
+}
 
+void sprec_encoder_reset(sprec_encoder *enc)
+{
 	/*
-	 * Read the first 64kB of the file. This somewhat guarantees
-	 * that we will find the beginning of the data section, even
-	 * if the WAV header is non-standard and contains
-	 * other garbage before the data (NB Apple's 4kB FLLR section!)
+	 * The previous user's sink is detached before the stream it may
+	 * have left unfinished is finished (which drops what it writes)
 	 */
-	infile = fopen(wavfile, "r");
-	if (infile == NULL) {
-		return NULL;
+	enc->out.sink = NULL;
+	enc->out.sink_ctx = NULL;
+	sprec_encoder_abort(enc);
+
+	enc->out.length = 0;
+	enc->out.discard = 0;
+	enc->level = enc->opts.level;
+
+	if (enc->out.capacity > enc->opts.output_keep) {
+		sprec_allocator_free(&enc->alloc, enc->out.buf);
+		enc->out.buf = NULL;
+		enc->out.capacity = 0;
+	}
+}
+
+void sprec_encoder_set_sink(sprec_encoder *enc, sprec_encoder_sink sink, void *ctx)
+{
+	enc->out.sink = sink;
+	enc->out.sink_ctx = ctx;
+}
+
+void sprec_encoder_set_level(sprec_encoder *enc, unsigned level)
+{
+	enc->level = level > 8 ? 8 : level;
+}
+
+int sprec_encoder_encode_pcm(
+	sprec_encoder *enc,
+	const void *data,
+	size_t frames,
+	uint32_t rate,
+	uint32_t channels,
+	uint32_t bps,
+	const void **flac,
+	size_t *size
+)
+{
+	sprec_pcm_format fmt;
+
+	if (sprec_pcm_format_from_bps(bps, &fmt) != 0) {
+		return -1;
+	}
+
+	return sprec_encoder_encode_pcm_ex(enc, data, frames, rate, channels, fmt, flac, size);
+}
+
+int sprec_encoder_encode_pcm_ex(
+	sprec_encoder *enc,
+	const void *data,
+	size_t frames,
+	uint32_t rate,
+	uint32_t channels,
+	sprec_pcm_format fmt,
+	const void **flac,
+	size_t *size
+)
+{
+	if (data == NULL || channels == 0 || sprec_pcm_sample_size(fmt) == 0) {
+		return -1;
 	}
 
-	fread(buffer, sizeof buffer, 1, infile);
+	if (sprec_encoder_begin(enc, rate, channels, fmt, frames) != 0) {
+		return -1;
+	}
+
+	if (sprec_encoder_feed(enc, data, frames, channels, fmt) != 0) {
+		sprec_encoder_abort(enc);
+		return -1;
+	}
+
+	if (sprec_encoder_end(enc) != 0) {
+		return -1;
+	}
+
+	*flac = enc->out.sink != NULL ? NULL : enc->out.buf;
+	*size = enc->out.length;
+	return 0;
+}
+
+int sprec_encoder_stream_begin(sprec_encoder *enc, uint32_t rate, uint32_t channels, sprec_pcm_format fmt)
+{
+	if (channels == 0 || sprec_pcm_sample_size(fmt) == 0) {
+		return -1;
+	}
 
 	/*
-	 * Search the offset of the data section
+	 * 0 means the length is unknown
 	 */
-	dataloc = memstr(buffer, "data", sizeof buffer);
-	if (dataloc == NULL) {
-		fclose(infile);
-		return NULL;
+	return sprec_encoder_begin(enc, rate, channels, fmt, 0);
+}
+
+int sprec_encoder_stream_write(sprec_encoder *enc, const void *data, size_t frames)
+{
+	if (!enc->active || data == NULL) {
+		return -1;
+	}
+
+	if (sprec_encoder_feed(enc, data, frames, enc->channels, enc->fmt) != 0) {
+		sprec_encoder_abort(enc);
+		return -1;
 	}
 
-	dataoff = dataloc - (char *)buffer;
+	return 0;
+}
+
+int sprec_encoder_stream_end(sprec_encoder *enc, unsigned char *streaminfo, const void **flac, size_t *size)
+{
+	if (!enc->active || sprec_encoder_end(enc) != 0 || !enc->out.has_streaminfo) {
+		return -1;
+	}
 
 	/*
-	 * For an explanation on why the 4 + 4 byte extra offset is there,
-	 * see the comment for calculating the number of total_samples.
+	 * What is still in memory can be fixed up right away
 	 */
-	fseek(infile, dataoff + 4 + 4, SEEK_SET);
+	if (enc->out.sink == NULL && enc->out.length >= SPREC_FLAC_STREAMINFO_OFFSET + SPREC_FLAC_STREAMINFO_SIZE) {
+		memcpy(enc->out.buf + SPREC_FLAC_STREAMINFO_OFFSET, enc->out.streaminfo, SPREC_FLAC_STREAMINFO_SIZE);
+	}
+
+	if (streaminfo != NULL) {
+		memcpy(streaminfo, enc->out.streaminfo, SPREC_FLAC_STREAMINFO_SIZE);
+	}
+
+	*flac = enc->out.sink != NULL ? NULL : enc->out.buf;
+	*size = enc->out.length;
+	return 0;
+}
+
+int sprec_encoder_encode_file(
+	sprec_encoder *enc,
+	const char *wavfile,
+	const void **flac,
+	size_t *size
+)
+{
+	FILE *infile;
+	sprec_wav_header *hdr;
+	uint32_t rate;		/* sample rate */
+	uint32_t total;		/* number of samples in file */
+	uint32_t channels;	/* number of channels */
+	sprec_pcm_format fmt;	/* sample format */
+	uint32_t length;	/* length of the data section */
+	size_t bytes_per_frame, chunk, left, readn;
 
-	sprec_wav_header *hdr = sprec_wav_header_from_data(buffer);
-	if (hdr == NULL) {
+	infile = fopen(wavfile, "rb");
+	if (infile == NULL) {
+		return -1;
+	}
+
+	/*
+	 * Find the data section. The header is read chunk by chunk,
+	 * so non-standard headers with other garbage before the data
+	 * (NB Apple's 4kB FLLR section!) cost no extra memory.
+	 */
+	if (sprec_wav_read_header(infile, &hdr, &length) != 0) {
 		fclose(infile);
-		return NULL;
+		return -1;
 	}
 
 	/*
@@ -113,127 +512,285 @@ void *sprec_flac_encode(const char *wavfile, size_t *size)
 	 */
 	rate = hdr->sample_rate;
 	channels = hdr->number_of_channels;
-	bps = hdr->bits_per_sample;
+
+	if (channels == 0 || sprec_pcm_format_from_wav(hdr, &fmt) != 0) {
+		sprec_free(hdr);
+		fclose(infile);
+		return -1;
+	}
+
+	sprec_free(hdr);
+	bytes_per_frame = channels * sprec_pcm_sample_size(fmt);
+	total = length / bytes_per_frame;
+	chunk = enc->opts.chunk_frames;
+
+	if (enc->rawcap < chunk * bytes_per_frame) {
+		FLAC__byte *tmp = sprec_allocator_realloc(&enc->alloc, enc->raw, chunk * bytes_per_frame);
+		if (tmp == NULL) {
+			fclose(infile);
+			return -1;
+		}
+
+		enc->raw = tmp;
+		enc->rawcap = chunk * bytes_per_frame;
+	}
 
 	/*
-	 * hdr->file_size contains actual file size - 8 bytes.
-	 * the eight bytes at position `data_offset' are:
-	 * 'data' then a 32-bit unsigned int, representing
-	 * the length of the data section.
+	 * Initialize the FLAC encoder
 	 */
-	total = ((hdr->file_size + 8) - (dataoff + 4 + 4)) / (channels * bps / 8);
+	if (sprec_encoder_begin(enc, rate, channels, fmt, total) != 0) {
+		fclose(infile);
+		return -1;
+	}
 
 	/*
-	 * Create and initialize the FLAC encoder
+	 * Feed the PCM data to the encoder chunk by chunk
 	 */
-	encoder = FLAC__stream_encoder_new();
-	if (encoder == NULL) {
-		fclose(infile);
-		free(hdr);
+	for (left = total; left > 0; left -= readn) {
+		readn = fread(enc->raw, bytes_per_frame, left < chunk ? left : chunk, infile);
+		if (readn == 0) {
+			/* the file is shorter than its header claims */
+			break;
+		}
+
+		if (sprec_encoder_feed(enc, enc->raw, readn, channels, fmt) != 0) {
+			fclose(infile);
+			sprec_encoder_abort(enc);
+			return -1;
+		}
+	}
+
+	fclose(infile);
+
+	/*
+	 * Write out/finalize the output stream
+	 */
+	if (sprec_encoder_end(enc) != 0) {
+		return -1;
+	}
+
+	*flac = enc->out.sink != NULL ? NULL : enc->out.buf;
+	*size = enc->out.length;
+	return 0;
+}
+
+sprec_encoder_pool *sprec_encoder_pool_new(size_t max_idle)
+{
+	return sprec_encoder_pool_new_ex(max_idle, NULL);
+}
+
+sprec_encoder_pool *sprec_encoder_pool_new_ex(size_t max_idle, const sprec_encoder_options *opts)
+{
+	sprec_encoder_pool *pool;
+
+	pool = sprec_calloc(1, sizeof *pool);
+	if (pool == NULL) {
+		return NULL;
+	}
+
+	sprec_get_allocator(&pool->alloc);
+
+	if (opts != NULL) {
+		pool->opts = *opts;
+	} else {
+		sprec_encoder_options_init(&pool->opts);
+	}
+
+	pool->idle = sprec_calloc(max_idle ? max_idle : 1, sizeof pool->idle[0]);
+	if (pool->idle == NULL) {
+		sprec_free(pool);
+		return NULL;
+	}
+
+	if (pthread_mutex_init(&pool->lock, NULL) != 0) {
+		sprec_free(pool->idle);
+		sprec_free(pool);
 		return NULL;
 	}
 
+	pool->max_idle = max_idle;
+
+	return pool;
+}
+
+void sprec_encoder_pool_free(sprec_encoder_pool *pool)
+{
+	sprec_allocator alloc;
+	size_t i;
+
+	if (pool == NULL) {
+		return;
+	}
+
+	for (i = 0; i < pool->nidle; i++) {
+		sprec_encoder_free(pool->idle[i]);
+	}
+
+	pthread_mutex_destroy(&pool->lock);
+	alloc = pool->alloc;
+	sprec_allocator_free(&alloc, pool->idle);
+	sprec_allocator_free(&alloc, pool);
+}
+
+sprec_encoder *sprec_encoder_pool_acquire(sprec_encoder_pool *pool)
+{
+	sprec_encoder *enc = NULL;
+
+	pthread_mutex_lock(&pool->lock);
+	if (pool->nidle > 0) {
+		enc = pool->idle[--pool->nidle];
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	/*
+	 * Creating an encoder doesn't need the lock
+	 */
+	if (enc == NULL) {
+		enc = sprec_encoder_create(&pool->alloc, &pool->opts);
+	}
+
+	return enc;
+}
+
+void sprec_encoder_pool_release(sprec_encoder_pool *pool, sprec_encoder *enc)
+{
+	if (enc == NULL) {
+		return;
+	}
+
+	sprec_encoder_reset(enc);
+
+	pthread_mutex_lock(&pool->lock);
+	if (pool->nidle < pool->max_idle) {
+		pool->idle[pool->nidle++] = enc;
+		enc = NULL;
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	/* the pool is full */
+	sprec_encoder_free(enc);
+}
+
+/*
+ * Configures the FLAC encoder and starts a new stream.
+ * FLAC__stream_encoder_finish() resets every setting
+ * to its default, so this has to be done every time.
+ */
+static int sprec_encoder_begin(
+	sprec_encoder *enc,
+	uint32_t rate,
+	uint32_t channels,
+	sprec_pcm_format fmt,
+	uint32_t total
+)
+{
+	FLAC__StreamEncoder *encoder = enc->flac;
+	int err;
+
+	sprec_encoder_abort(enc);
+	enc->out.length = 0;
+	enc->out.has_streaminfo = 0;
+	sprec_dither_init(&enc->dither, SPREC_FLAC_DITHER_SEED);
+
 	FLAC__stream_encoder_set_verify(encoder, true);
-	FLAC__stream_encoder_set_compression_level(encoder, 5);
+	FLAC__stream_encoder_set_compression_level(encoder, enc->level);
 	FLAC__stream_encoder_set_channels(encoder, channels);
-	FLAC__stream_encoder_set_bits_per_sample(encoder, bps);
+	FLAC__stream_encoder_set_bits_per_sample(encoder, sprec_pcm_output_bps(fmt));
 	FLAC__stream_encoder_set_sample_rate(encoder, rate);
 	FLAC__stream_encoder_set_total_samples_estimate(encoder, total);
 
-	sprec_encoder_state flac_data = {
-		.buf = NULL,
-		.length = 0
-	};
-
 	err = FLAC__stream_encoder_init_stream(
 		encoder,
 		flac_write_callback,
 		NULL, // seek() stream
 		NULL, // tell() stream
-		NULL, // metadata writer
-		&flac_data
+		flac_metadata_callback,
+		&enc->out
 	);
 
 	if (err) {
-		fclose(infile);
-		free(hdr);
-		free(flac_data.buf);
-		FLAC__stream_encoder_delete(encoder);
-		return NULL;
+		return -1;
 	}
 
-	/*
-	 * Feed the PCM data to the encoder in 64kB chunks
-	 */
-	size_t left = total;
-	while (left > 0) {
-		size_t readn = fread(buffer, channels * bps / 8, BUFSIZE, infile);
-
-		for (size_t i = 0; i < readn * channels; i++) {
-			if (bps == 16) {
-				/*
-				 * 16 bps, signed little endian
-				 */
-				uint16_t lsb = *(uint8_t *)(buffer + i * 2 + 0);
-				uint16_t msb = *(uint8_t *)(buffer + i * 2 + 1);
-				uint16_t usample = (msb << 8) | lsb;
-
-				/* hooray, shifting into the sign bit is UB,
-				 * so we must memcpy() into the signed integer.
-				 * Thanks C standard, what a waste of LOC...
-				 */
-				int16_t ssample;
-				memcpy(&ssample, &usample, sizeof ssample);
-				pcm[i] = ssample;
-			} else {
-				/*
-				 * 8 bps, unsigned
-				 */
-				pcm[i] = *(uint8_t *)(buffer + i);
-			}
-		}
+	enc->active = 1;
+	enc->channels = channels;
+	enc->fmt = fmt;
+	return 0;
+}
 
-		FLAC__bool succ = FLAC__stream_encoder_process_interleaved(encoder, pcm, readn);
-		if (!succ) {
-			fclose(infile);
-			free(hdr);
-			FLAC__stream_encoder_delete(encoder);
-			free(flac_data.buf);
-			return NULL;
+static int sprec_encoder_feed(
+	sprec_encoder *enc,
+	const FLAC__byte *data,
+	size_t frames,
+	uint32_t channels,
+	sprec_pcm_format fmt
+)
+{
+	size_t bytes_per_frame = channels * sprec_pcm_sample_size(fmt);
+	size_t chunk = enc->opts.chunk_frames;
+	size_t n;
+
+	if (enc->pcmcap < chunk * channels) {
+		FLAC__int32 *tmp = sprec_allocator_realloc(&enc->alloc, enc->pcm, chunk * channels * sizeof tmp[0]);
+		if (tmp == NULL) {
+			return -1;
 		}
 
-		left -= readn;
+		enc->pcm = tmp;
+		enc->pcmcap = chunk * channels;
 	}
 
-	/*
-	 * Write out/finalize the output stream
-	 */
-	FLAC__stream_encoder_finish(encoder);
+	for (; frames > 0; frames -= n) {
+		n = frames < chunk ? frames : chunk;
 
-	/*
-	 * Clean up
-	 */
-	FLAC__stream_encoder_delete(encoder);
-	fclose(infile);
-	free(hdr);
+		sprec_pcm_convert(data, fmt, n * channels, enc->pcm, enc->opts.dither ? &enc->dither : NULL);
+		data += n * bytes_per_frame;
 
-	*size = flac_data.length;
-	return flac_data.buf;
+		if (!FLAC__stream_encoder_process_interleaved(enc->flac, enc->pcm, n)) {
+			return -1;
+		}
+	}
+
+	return 0;
 }
 
-static const char *memstr(const void *haystack, const char *needle, size_t size)
+static int sprec_encoder_end(sprec_encoder *enc)
 {
-	const char *p;
-	const char *hs = haystack;
-	size_t needlesize = strlen(needle);
+	FLAC__bool succ;
 
-	for (p = haystack; p + needlesize <= hs + size; p++) {
-		if (memcmp(p, needle, needlesize) == 0) {
-			/* found it */
-			return p;
-		}
+	enc->active = 0;
+	succ = FLAC__stream_encoder_finish(enc->flac);
+
+	return succ ? 0 : -1;
+}
+
+/*
+ * Abandons the stream being encoded, if any,
+ * so that the encoder can be configured again.
+ * Finishing it flushes the last frames: they are dropped
+ * rather than written to the caller's sink or buffer.
+ */
+static void sprec_encoder_abort(sprec_encoder *enc)
+{
+	if (enc->active) {
+		enc->active = 0;
+		enc->out.discard = 1;
+		FLAC__stream_encoder_finish(enc->flac);
+		enc->out.discard = 0;
 	}
+}
+
+/*
+ * Hands the ownership of the output buffer over to the caller
+ */
+static void *sprec_encoder_detach(sprec_encoder *enc, size_t *size)
+{
+	void *buf = enc->out.buf;
+
+	*size = enc->out.length;
+	enc->out.buf = NULL;
+	enc->out.length = 0;
+	enc->out.capacity = 0;
 
-	/* not found */
-	return NULL;
+	return buf;
 }
@@ -0,0 +1,695 @@
+/*
+ * flac_parallel.c
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sprec/flac_encoder.h>
+#include <sprec/wav.h>
+#include <sprec/alloc.h>
+#include "flac.h"
+#include "md5.h"
+
+#define SEGMENT_LENGTH 0x40000
+
+/*
+ * libFLAC's block sizes at the low and the high compression levels
+ */
+#define BLOCKSIZE_FAST 1152
+#define BLOCKSIZE 4096
+
+/*
+ * "fLaC", and a STREAMINFO block marked as the last metadata block
+ */
+#define STREAM_HEADER_SIZE (SPREC_FLAC_STREAMINFO_OFFSET + SPREC_FLAC_STREAMINFO_SIZE)
+
+/*
+ * Samples packed for the MD5 signature at a time
+ */
+#define MD5_CHUNK 4096
+
+typedef struct sprec_flac_segment {
+	const sprec_allocator *alloc;
+	unsigned char *data;		/* the frames, as libFLAC wrote them */
+	size_t length;
+	size_t capacity;
+	size_t *offsets;		/* where each frame starts in `data' */
+	size_t nframes;
+	size_t frames_capacity;
+	FLAC__int32 *samples;		/* the samples encoded, for the MD5 */
+	size_t nsamples;
+	int done;
+	int failed;
+} sprec_flac_segment;
+
+typedef struct sprec_flac_job {
+	sprec_allocator alloc;
+	const unsigned char *data;
+	size_t frames;
+	uint32_t rate;
+	uint32_t channels;
+	sprec_pcm_format fmt;
+	size_t bytes_per_frame;
+	unsigned level;
+	unsigned blocksize;
+	size_t segment_length;
+
+	/*
+	 * Protected by `lock'. Workers take the segments in order, but
+	 * never more than `window' ahead of the stitching, which bounds
+	 * the memory used whatever the length of the audio.
+	 */
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	sprec_flac_segment *segments;
+	size_t nsegments;
+	size_t next;
+	size_t stitched;
+	size_t window;
+	int failed;
+} sprec_flac_job;
+
+/*
+ * The output stream being put together
+ */
+typedef struct sprec_flac_output {
+	const sprec_allocator *alloc;
+	unsigned char *buf;
+	size_t length;
+	size_t capacity;
+	uint64_t frame_number;
+	unsigned min_framesize;
+	unsigned max_framesize;
+} sprec_flac_output;
+
+static uint8_t sprec_crc8_table[256];
+static uint16_t sprec_crc16_table[256];
+static pthread_once_t sprec_crc_once = PTHREAD_ONCE_INIT;
+
+/*
+ * The checksums of FLAC frame headers (polynomial x^8 + x^2 + x + 1)
+ * and of whole frames (x^16 + x^15 + x^2 + 1), MSB first, from 0
+ */
+static void sprec_crc_init(void)
+{
+	unsigned i, j, c8, c16;
+
+	for (i = 0; i < 256; i++) {
+		c8 = i;
+		c16 = i << 8;
+
+		for (j = 0; j < 8; j++) {
+			c8 = c8 & 0x80 ? (c8 << 1) ^ 0x07 : c8 << 1;
+			c16 = c16 & 0x8000 ? (c16 << 1) ^ 0x8005 : c16 << 1;
+		}
+
+		sprec_crc8_table[i] = c8 & 0xff;
+		sprec_crc16_table[i] = c16 & 0xffff;
+	}
+}
+
+static uint8_t sprec_crc8(const unsigned char *p, size_t length)
+{
+	uint8_t crc = 0;
+
+	while (length-- > 0) {
+		crc = sprec_crc8_table[crc ^ *p++];
+	}
+
+	return crc;
+}
+
+static uint16_t sprec_crc16(uint16_t crc, const unsigned char *p, size_t length)
+{
+	while (length-- > 0) {
+		crc = (crc << 8) ^ sprec_crc16_table[(crc >> 8) ^ *p++];
+	}
+
+	return crc;
+}
+
+/*
+ * Frame numbers are coded like UTF-8 characters (of up to 31 bits).
+ * Returns the length of the one whose first byte is `c', 0 if invalid.
+ */
+static size_t sprec_flac_coded_length(unsigned char c)
+{
+	size_t n;
+
+	if (c < 0x80) {
+		return 1;
+	}
+
+	for (n = 2; n <= 7; n++) {
+		if ((c & (0xff00 >> (n + 1))) == ((0xff00 >> n) & 0xff)) {
+			return n;
+		}
+	}
+
+	return 0;
+}
+
+static size_t sprec_flac_code_number(uint64_t x, unsigned char *p)
+{
+	size_t n, k;
+
+	if (x < 0x80) {
+		p[0] = x;
+		return 1;
+	}
+
+	for (n = 2; n < 7 && x >= (uint64_t)1 << (5 * n + 1); n++) {
+		;
+	}
+
+	p[0] = ((0xff00 >> n) & 0xff) | (x >> (6 * (n - 1)));
+	for (k = 1; k < n; k++) {
+		p[k] = 0x80 | ((x >> (6 * (n - 1 - k))) & 0x3f);
+	}
+
+	return n;
+}
+
+static FLAC__StreamEncoderWriteStatus sprec_flac_segment_write(
+	const FLAC__StreamEncoder *encoder,
+	const FLAC__byte buffer[],
+	size_t bytes,
+	unsigned samples,
+	unsigned current_frame,
+	void *client_data
+)
+{
+	sprec_flac_segment *seg = client_data;
+	unsigned char *data;
+	size_t *offsets, capacity;
+
+	/*
+	 * libFLAC writes each frame at once, and the metadata
+	 * (which isn't needed) with no samples
+	 */
+	if (samples == 0) {
+		return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+	}
+
+	if (seg->length + bytes > seg->capacity) {
+		capacity = seg->capacity ? seg->capacity * 2 : 0x10000;
+		while (capacity < seg->length + bytes) {
+			capacity *= 2;
+		}
+
+		data = sprec_allocator_realloc(seg->alloc, seg->data, capacity);
+		if (data == NULL) {
+			return FLAC__STREAM_ENCODER_WRITE_STATUS_FATAL_ERROR;
+		}
+
+		seg->data = data;
+		seg->capacity = capacity;
+	}
+
+	if (seg->nframes == seg->frames_capacity) {
+		capacity = seg->frames_capacity ? seg->frames_capacity * 2 : 64;
+
+		offsets = sprec_allocator_realloc(seg->alloc, seg->offsets, capacity * sizeof offsets[0]);
+		if (offsets == NULL) {
+			return FLAC__STREAM_ENCODER_WRITE_STATUS_FATAL_ERROR;
+		}
+
+		seg->offsets = offsets;
+		seg->frames_capacity = capacity;
+	}
+
+	seg->offsets[seg->nframes++] = seg->length;
+	memcpy(seg->data + seg->length, buffer, bytes);
+	seg->length += bytes;
+
+	return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+}
+
+static void sprec_flac_segment_clear(sprec_flac_segment *seg)
+{
+	sprec_allocator_free(seg->alloc, seg->data);
+	sprec_allocator_free(seg->alloc, seg->offsets);
+	sprec_allocator_free(seg->alloc, seg->samples);
+	seg->data = NULL;
+	seg->offsets = NULL;
+	seg->samples = NULL;
+}
+
+/*
+ * Encodes segment `i' as a stream of its own,
+ * of which only the frames are kept
+ */
+static int sprec_flac_encode_segment(sprec_flac_job *job, FLAC__StreamEncoder *encoder, size_t i)
+{
+	sprec_flac_segment *seg = &job->segments[i];
+	size_t start = i * job->segment_length;
+	size_t frames = job->frames - start < job->segment_length ? job->frames - start : job->segment_length;
+	sprec_dither dither;
+	FLAC__bool ok;
+
+	seg->alloc = &job->alloc;
+	seg->nsamples = frames * job->channels;
+	seg->samples = sprec_allocator_malloc(&job->alloc, seg->nsamples * sizeof seg->samples[0]);
+	if (seg->samples == NULL) {
+		return -1;
+	}
+
+	/*
+	 * Seeded by the position, so that the noise
+	 * doesn't depend on the number of threads
+	 */
+	sprec_dither_init(&dither, SPREC_FLAC_DITHER_SEED + i);
+	sprec_pcm_convert(job->data + start * job->bytes_per_frame, job->fmt, seg->nsamples, seg->samples, &dither);
+
+	/*
+	 * The whole stream gets its MD5 signature in the end
+	 */
+	FLAC__stream_encoder_set_verify(encoder, true);
+	FLAC__stream_encoder_set_compression_level(encoder, job->level);
+	FLAC__stream_encoder_set_blocksize(encoder, job->blocksize);
+	FLAC__stream_encoder_set_do_md5(encoder, false);
+	FLAC__stream_encoder_set_channels(encoder, job->channels);
+	FLAC__stream_encoder_set_bits_per_sample(encoder, sprec_pcm_output_bps(job->fmt));
+	FLAC__stream_encoder_set_sample_rate(encoder, job->rate);
+	FLAC__stream_encoder_set_total_samples_estimate(encoder, frames);
+
+	if (FLAC__stream_encoder_init_stream(encoder, sprec_flac_segment_write, NULL, NULL, NULL, seg)) {
+		return -1;
+	}
+
+	ok = FLAC__stream_encoder_process_interleaved(encoder, seg->samples, frames);
+
+	return FLAC__stream_encoder_finish(encoder) && ok ? 0 : -1;
+}
+
+static void *sprec_flac_worker(void *ctx)
+{
+	sprec_flac_job *job = ctx;
+	FLAC__StreamEncoder *encoder;
+	size_t i;
+	int err;
+
+	sprec_set_thread_allocator(&job->alloc);
+	encoder = FLAC__stream_encoder_new();
+
+	for (;;) {
+		pthread_mutex_lock(&job->lock);
+
+		while (!job->failed && job->next < job->nsegments && job->next >= job->stitched + job->window) {
+			pthread_cond_wait(&job->cond, &job->lock);
+		}
+
+		if (job->failed || job->next >= job->nsegments) {
+			pthread_mutex_unlock(&job->lock);
+			break;
+		}
+
+		i = job->next++;
+		pthread_mutex_unlock(&job->lock);
+
+		err = encoder == NULL || sprec_flac_encode_segment(job, encoder, i) != 0;
+
+		pthread_mutex_lock(&job->lock);
+		job->segments[i].done = 1;
+		if (err) {
+			job->segments[i].failed = 1;
+			job->failed = 1;
+		}
+		pthread_cond_broadcast(&job->cond);
+		pthread_mutex_unlock(&job->lock);
+	}
+
+	if (encoder != NULL) {
+		FLAC__stream_encoder_delete(encoder);
+	}
+
+	return NULL;
+}
+
+static int sprec_flac_output_reserve(sprec_flac_output *out, size_t length)
+{
+	unsigned char *buf;
+	size_t capacity;
+
+	if (out->length + length <= out->capacity) {
+		return 0;
+	}
+
+	capacity = out->capacity ? out->capacity : 0x10000;
+	while (capacity < out->length + length) {
+		capacity *= 2;
+	}
+
+	buf = sprec_allocator_realloc(out->alloc, out->buf, capacity);
+	if (buf == NULL) {
+		return -1;
+	}
+
+	out->buf = buf;
+	out->capacity = capacity;
+
+	return 0;
+}
+
+/*
+ * Appends the frame at `frame', `length' bytes long,
+ * with the next frame number in its header
+ */
+static int sprec_flac_append_frame(sprec_flac_output *out, const unsigned char *frame, size_t length)
+{
+	unsigned char *p;
+	size_t coded, header, extra, size;
+	unsigned bs, sr;
+	uint16_t crc;
+
+	/*
+	 * Sync code, fixed block size; then the coded frame number,
+	 * the block size and the sample rate when they don't fit
+	 * in their codes, and the CRC-8 of the header
+	 */
+	if (length < 6 || frame[0] != 0xff || frame[1] != 0xf8) {
+		return -1;
+	}
+
+	coded = sprec_flac_coded_length(frame[4]);
+	if (coded == 0) {
+		return -1;
+	}
+
+	bs = frame[2] >> 4;
+	sr = frame[2] & 0x0f;
+	extra = (bs == 6) + 2 * (bs == 7) + (sr == 12) + 2 * (sr == 13 || sr == 14);
+	header = 4 + coded + extra;
+
+	if (length < header + 1 + 2) {
+		return -1;
+	}
+
+	if (sprec_flac_output_reserve(out, length + 7) != 0) {
+		return -1;
+	}
+
+	p = out->buf + out->length;
+	memcpy(p, frame, 4);
+	size = 4 + sprec_flac_code_number(out->frame_number, p + 4);
+	memcpy(p + size, frame + 4 + coded, extra);
+	size += extra;
+	p[size] = sprec_crc8(p, size);
+	size++;
+
+	/*
+	 * The subframes are left as they are; only the CRC-16
+	 * of the whole frame, at its end, changes
+	 */
+	memcpy(p + size, frame + header + 1, length - header - 1 - 2);
+	size += length - header - 1 - 2;
+	crc = sprec_crc16(0, p, size);
+	p[size++] = crc >> 8;
+	p[size++] = crc & 0xff;
+
+	out->length += size;
+	out->frame_number++;
+
+	if (out->min_framesize == 0 || size < out->min_framesize) {
+		out->min_framesize = size;
+	}
+
+	if (size > out->max_framesize) {
+		out->max_framesize = size;
+	}
+
+	return 0;
+}
+
+/*
+ * Adds the samples of a segment to the MD5 signature, as FLAC
+ * defines it: little endian, in as many bytes as the samples need
+ */
+static void sprec_flac_md5_samples(sprec_md5 *md5, const FLAC__int32 *samples, size_t n, uint32_t bps)
+{
+	unsigned char buf[2 * MD5_CHUNK];
+	size_t i, k, chunk;
+
+	for (i = 0; i < n; i += chunk) {
+		chunk = n - i < MD5_CHUNK ? n - i : MD5_CHUNK;
+
+		if (bps == 8) {
+			for (k = 0; k < chunk; k++) {
+				buf[k] = samples[i + k] & 0xff;
+			}
+			sprec_md5_update(md5, buf, chunk);
+		} else {
+			for (k = 0; k < chunk; k++) {
+				buf[2 * k] = samples[i + k] & 0xff;
+				buf[2 * k + 1] = (samples[i + k] >> 8) & 0xff;
+			}
+			sprec_md5_update(md5, buf, 2 * chunk);
+		}
+	}
+}
+
+void sprec_flac_parallel_options_init(sprec_flac_parallel_options *opts)
+{
+	opts->threads = 0;
+	opts->level = 5;
+	opts->segment_length = SEGMENT_LENGTH;
+}
+
+void *sprec_flac_encode_parallel(
+	const void *data,
+	size_t frames,
+	uint32_t rate,
+	uint32_t channels,
+	sprec_pcm_format fmt,
+	const sprec_flac_parallel_options *opts,
+	size_t *size
+)
+{
+	sprec_flac_parallel_options defaults;
+	FLAC__StreamMetadata_StreamInfo info;
+	sprec_flac_output out;
+	sprec_flac_segment *seg;
+	sprec_flac_job job;
+	pthread_t *threads;
+	sprec_md5 md5;
+	size_t i, j, nthreads, started, blocks, end;
+	long ncpu;
+	int err = 0;
+
+	if (data == NULL || channels == 0 || channels > 8 || rate == 0 || sprec_pcm_sample_size(fmt) == 0) {
+		return NULL;
+	}
+
+	if (opts == NULL) {
+		sprec_flac_parallel_options_init(&defaults);
+		opts = &defaults;
+	}
+
+	pthread_once(&sprec_crc_once, sprec_crc_init);
+
+	memset(&job, 0, sizeof job);
+	sprec_get_allocator(&job.alloc);
+	job.data = data;
+	job.frames = frames;
+	job.rate = rate;
+	job.channels = channels;
+	job.fmt = fmt;
+	job.bytes_per_frame = channels * sprec_pcm_sample_size(fmt);
+	job.level = opts->level > 8 ? 8 : opts->level;
+	job.blocksize = job.level <= 2 ? BLOCKSIZE_FAST : BLOCKSIZE;
+
+	/*
+	 * Every segment but the last is a whole number of frames,
+	 * so that only the last frame of the stream is short
+	 */
+	blocks = (opts->segment_length + job.blocksize - 1) / job.blocksize;
+	job.segment_length = (blocks > 0 ? blocks : 1) * job.blocksize;
+	job.nsegments = (frames + job.segment_length - 1) / job.segment_length;
+
+	nthreads = opts->threads;
+	if (nthreads == 0) {
+		ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+		nthreads = ncpu > 0 ? ncpu : 1;
+	}
+	if (nthreads > job.nsegments) {
+		nthreads = job.nsegments;
+	}
+
+	job.window = 2 * nthreads;
+
+	memset(&out, 0, sizeof out);
+	out.alloc = &job.alloc;
+
+	job.segments = sprec_allocator_calloc(&job.alloc, job.nsegments + 1, sizeof job.segments[0]);
+	threads = sprec_allocator_calloc(&job.alloc, nthreads + 1, sizeof threads[0]);
+	if (job.segments == NULL || threads == NULL || sprec_flac_output_reserve(&out, STREAM_HEADER_SIZE) != 0) {
+		sprec_allocator_free(&job.alloc, job.segments);
+		sprec_allocator_free(&job.alloc, threads);
+		sprec_allocator_free(&job.alloc, out.buf);
+		return NULL;
+	}
+
+	pthread_mutex_init(&job.lock, NULL);
+	pthread_cond_init(&job.cond, NULL);
+
+	for (started = 0; started < nthreads; started++) {
+		if (pthread_create(&threads[started], NULL, sprec_flac_worker, &job) != 0) {
+			break;
+		}
+	}
+
+	if (started == 0 && job.nsegments > 0) {
+		err = -1;
+	}
+
+	/*
+	 * The header is filled in at the end
+	 */
+	out.length = STREAM_HEADER_SIZE;
+	sprec_md5_init(&md5);
+
+	for (i = 0; i < job.nsegments && err == 0; i++) {
+		seg = &job.segments[i];
+
+		pthread_mutex_lock(&job.lock);
+		while (!seg->done && !job.failed) {
+			pthread_cond_wait(&job.cond, &job.lock);
+		}
+		err = job.failed ? -1 : 0;
+		pthread_mutex_unlock(&job.lock);
+
+		for (j = 0; j < seg->nframes && err == 0; j++) {
+			end = j + 1 < seg->nframes ? seg->offsets[j + 1] : seg->length;
+			err = sprec_flac_append_frame(&out, seg->data + seg->offsets[j], end - seg->offsets[j]);
+		}
+
+		if (err == 0) {
+			sprec_flac_md5_samples(&md5, seg->samples, seg->nsamples, sprec_pcm_output_bps(fmt));
+		}
+
+		sprec_flac_segment_clear(seg);
+
+		pthread_mutex_lock(&job.lock);
+		job.stitched++;
+		if (err != 0) {
+			job.failed = 1;
+		}
+		pthread_cond_broadcast(&job.cond);
+		pthread_mutex_unlock(&job.lock);
+	}
+
+	for (i = 0; i < started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	/*
+	 * Segments encoded ahead of a failure
+	 */
+	for (i = 0; i < job.nsegments; i++) {
+		sprec_flac_segment_clear(&job.segments[i]);
+	}
+
+	pthread_cond_destroy(&job.cond);
+	pthread_mutex_destroy(&job.lock);
+	sprec_allocator_free(&job.alloc, job.segments);
+	sprec_allocator_free(&job.alloc, threads);
+
+	if (err != 0) {
+		sprec_allocator_free(&job.alloc, out.buf);
+		return NULL;
+	}
+
+	memset(&info, 0, sizeof info);
+	info.min_blocksize = job.blocksize;
+	info.max_blocksize = job.blocksize;
+	info.min_framesize = out.min_framesize;
+	info.max_framesize = out.max_framesize;
+	info.sample_rate = rate;
+	info.channels = channels;
+	info.bits_per_sample = sprec_pcm_output_bps(fmt);
+	info.total_samples = frames;
+	sprec_md5_final(&md5, info.md5sum);
+
+	memcpy(out.buf, "fLaC", 4);
+	out.buf[4] = 0x80;	/* last metadata block, STREAMINFO */
+	out.buf[5] = 0;
+	out.buf[6] = 0;
+	out.buf[7] = SPREC_FLAC_STREAMINFO_SIZE;
+	sprec_flac_pack_streaminfo(&info, out.buf + SPREC_FLAC_STREAMINFO_OFFSET);
+
+	*size = out.length;
+
+	return out.buf;
+}
+
+void *sprec_flac_encode_file_parallel(
+	const char *wavfile,
+	const sprec_flac_parallel_options *opts,
+	size_t *size
+)
+{
+	sprec_wav_header *hdr;
+	sprec_pcm_format fmt;
+	struct stat st;
+	uint32_t length;
+	void *map, *flac = NULL;
+	size_t mapped;
+	long offset;
+	FILE *f;
+
+	f = fopen(wavfile, "rb");
+	if (f == NULL) {
+		return NULL;
+	}
+
+	if (sprec_wav_read_header(f, &hdr, &length) != 0) {
+		fclose(f);
+		return NULL;
+	}
+
+	offset = ftell(f);
+
+	if (offset < 0
+	 || fstat(fileno(f), &st) != 0
+	 || (uint64_t)st.st_size < (uint64_t)offset + length
+	 || hdr->bytes_per_frame == 0
+	 || sprec_pcm_format_from_wav(hdr, &fmt) != 0) {
+		sprec_free(hdr);
+		fclose(f);
+		return NULL;
+	}
+
+	mapped = offset + length;
+	map = mmap(NULL, mapped, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+	fclose(f);
+
+	if (map == MAP_FAILED) {
+		sprec_free(hdr);
+		return NULL;
+	}
+
+	flac = sprec_flac_encode_parallel(
+		(const unsigned char *)map + offset,
+		length / hdr->bytes_per_frame,
+		hdr->sample_rate,
+		hdr->number_of_channels,
+		fmt,
+		opts,
+		size
+	);
+
+	munmap(map, mapped);
+	sprec_free(hdr);
+
+	return flac;
+}
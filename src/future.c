@@ -0,0 +1,647 @@
+/*
+ * future.c
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sprec/future.h>
+#include <sprec/wav.h>
+#include <sprec/flac_encoder.h>
+#include <sprec/alloc.h>
+#include <sprec/budget.h>
+#include "clock.h"
+
+typedef enum sprec_future_kind {
+	SPREC_FUTURE_LIVE,
+	SPREC_FUTURE_FILE
+} sprec_future_kind;
+
+struct sprec_future {
+	sprec_allocator alloc;		/* the caller's */
+	sprec_executor *exec;
+	sprec_future_kind kind;
+	char *apikey;
+	char *lang;
+	char *path;
+	double duration;
+	double created;
+	struct sprec_future *next;	/* in the queue of the executor */
+
+	/* protected by sprec_future_lock */
+	int refs;
+	sprec_future_stage stage;
+	sprec_future_result result;
+};
+
+struct sprec_executor {
+	sprec_allocator alloc;
+	sprec_send_options send;
+	sprec_encoder_pool *pool;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	sprec_future *head;
+	sprec_future *tail;
+	int shutdown;
+	pthread_t *threads;
+	unsigned nthreads;
+};
+
+/*
+ * A single lock and condition for the state of all futures, so that
+ * a set of them (even from different executors) can be waited for
+ * at once. Futures finish rarely enough for this not to matter.
+ */
+static pthread_mutex_t sprec_future_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sprec_future_cond = PTHREAD_COND_INITIALIZER;
+
+static pthread_once_t sprec_default_executor_once = PTHREAD_ONCE_INIT;
+static sprec_executor *sprec_default_executor;
+
+static void *sprec_executor_thread(void *ctx);
+static void sprec_future_run(sprec_executor *exec, sprec_future *future);
+static void sprec_future_complete(sprec_future *future, sprec_future_error error, sprec_server_response *resp);
+static void sprec_future_release(sprec_future *future);
+
+static void sprec_default_executor_setup(void)
+{
+	sprec_default_executor = sprec_executor_new(0, NULL);
+}
+
+sprec_executor *sprec_executor_new(unsigned threads, const sprec_send_options *send)
+{
+	sprec_executor *exec;
+	long ncpu;
+
+	if (threads == 0) {
+		ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = ncpu > 1 ? ncpu : 1;
+	}
+
+	exec = sprec_calloc(1, sizeof *exec);
+	if (exec == NULL) {
+		return NULL;
+	}
+
+	sprec_get_allocator(&exec->alloc);
+
+	if (send != NULL) {
+		exec->send = *send;
+	} else {
+		sprec_send_options_init(&exec->send);
+	}
+
+	exec->threads = sprec_calloc(threads, sizeof exec->threads[0]);
+	if (exec->threads == NULL) {
+		sprec_free(exec);
+		return NULL;
+	}
+
+	exec->pool = sprec_encoder_pool_new(threads);
+	if (exec->pool == NULL) {
+		sprec_free(exec->threads);
+		sprec_free(exec);
+		return NULL;
+	}
+
+	if (pthread_mutex_init(&exec->lock, NULL) != 0) {
+		sprec_encoder_pool_free(exec->pool);
+		sprec_free(exec->threads);
+		sprec_free(exec);
+		return NULL;
+	}
+
+	if (pthread_cond_init(&exec->cond, NULL) != 0) {
+		pthread_mutex_destroy(&exec->lock);
+		sprec_encoder_pool_free(exec->pool);
+		sprec_free(exec->threads);
+		sprec_free(exec);
+		return NULL;
+	}
+
+	for (exec->nthreads = 0; exec->nthreads < threads; exec->nthreads++) {
+		if (pthread_create(&exec->threads[exec->nthreads], NULL, sprec_executor_thread, exec) != 0) {
+			break;
+		}
+	}
+
+	if (exec->nthreads == 0) {
+		sprec_executor_free(exec);
+		return NULL;
+	}
+
+	return exec;
+}
+
+void sprec_executor_free(sprec_executor *exec)
+{
+	sprec_allocator alloc;
+	sprec_future *queued, *next;
+	unsigned i;
+
+	if (exec == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&exec->lock);
+	exec->shutdown = 1;
+	queued = exec->head;
+	exec->head = exec->tail = NULL;
+	pthread_cond_broadcast(&exec->cond);
+	pthread_mutex_unlock(&exec->lock);
+
+	for (; queued != NULL; queued = next) {
+		next = queued->next;
+		sprec_future_complete(queued, SPREC_FUTURE_ERR_CANCELLED, NULL);
+		sprec_future_release(queued);
+	}
+
+	for (i = 0; i < exec->nthreads; i++) {
+		pthread_join(exec->threads[i], NULL);
+	}
+
+	alloc = exec->alloc;
+	pthread_cond_destroy(&exec->cond);
+	pthread_mutex_destroy(&exec->lock);
+	sprec_encoder_pool_free(exec->pool);
+	sprec_allocator_free(&alloc, exec->threads);
+	sprec_allocator_free(&alloc, exec);
+}
+
+static sprec_future *sprec_future_submit(
+	sprec_executor *exec,
+	sprec_future_kind kind,
+	const char *path,
+	const char *apikey,
+	const char *lang,
+	double duration
+)
+{
+	sprec_future *future;
+
+	if (exec == NULL) {
+		pthread_once(&sprec_default_executor_once, sprec_default_executor_setup);
+		exec = sprec_default_executor;
+		if (exec == NULL) {
+			return NULL;
+		}
+	}
+
+	future = sprec_calloc(1, sizeof *future);
+	if (future == NULL) {
+		return NULL;
+	}
+
+	sprec_get_allocator(&future->alloc);
+
+	future->apikey = sprec_strdup(apikey);
+	future->lang = lang ? sprec_strdup(lang) : NULL;
+	future->path = path ? sprec_strdup(path) : NULL;
+	if (future->apikey == NULL || (lang && future->lang == NULL) || (path && future->path == NULL)) {
+		sprec_free(future->apikey);
+		sprec_free(future->lang);
+		sprec_free(future->path);
+		sprec_free(future);
+		return NULL;
+	}
+
+	future->exec = exec;
+	future->kind = kind;
+	future->duration = duration;
+	future->created = sprec_clock_now();
+	future->stage = SPREC_STAGE_QUEUED;
+
+	/*
+	 * One reference for the caller, one for the executor
+	 */
+	future->refs = 2;
+
+	pthread_mutex_lock(&exec->lock);
+
+	if (exec->shutdown) {
+		pthread_mutex_unlock(&exec->lock);
+		future->refs = 1;
+		sprec_future_release(future);
+		return NULL;
+	}
+
+	if (exec->tail != NULL) {
+		exec->tail->next = future;
+	} else {
+		exec->head = future;
+	}
+	exec->tail = future;
+
+	pthread_cond_signal(&exec->cond);
+	pthread_mutex_unlock(&exec->lock);
+
+	return future;
+}
+
+sprec_future *sprec_future_recognize(
+	sprec_executor *exec,
+	const char *apikey,
+	const char *lang,
+	double dur_s
+)
+{
+	return sprec_future_submit(exec, SPREC_FUTURE_LIVE, NULL, apikey, lang, dur_s);
+}
+
+sprec_future *sprec_future_recognize_file(
+	sprec_executor *exec,
+	const char *wavfile,
+	const char *apikey,
+	const char *lang
+)
+{
+	return sprec_future_submit(exec, SPREC_FUTURE_FILE, wavfile, apikey, lang, 0.0);
+}
+
+int sprec_future_poll(sprec_future *future)
+{
+	int done;
+
+	pthread_mutex_lock(&sprec_future_lock);
+	done = future->stage == SPREC_STAGE_DONE;
+	pthread_mutex_unlock(&sprec_future_lock);
+
+	return done;
+}
+
+sprec_future_stage sprec_future_progress(sprec_future *future)
+{
+	sprec_future_stage stage;
+
+	pthread_mutex_lock(&sprec_future_lock);
+	stage = future->stage;
+	pthread_mutex_unlock(&sprec_future_lock);
+
+	return stage;
+}
+
+/*
+ * Waits until at least `need' of the futures are finished
+ * (or all of them, if `need' is 0).
+ * Returns the index of the first finished one, or -1 on timeout.
+ */
+static long sprec_future_wait_for(sprec_future *const *futures, size_t count, size_t need, double timeout)
+{
+	struct timespec ts;
+	size_t i, done;
+	long first;
+	int timedout = 0;
+
+	if (need == 0) {
+		need = count;
+	}
+
+	if (timeout >= 0) {
+		sprec_clock_abstime(sprec_clock_now() + timeout, &ts);
+	}
+
+	pthread_mutex_lock(&sprec_future_lock);
+
+	for (;;) {
+		first = -1;
+		done = 0;
+
+		for (i = 0; i < count; i++) {
+			if (futures[i]->stage == SPREC_STAGE_DONE) {
+				if (first < 0) {
+					first = i;
+				}
+				done++;
+			}
+		}
+
+		if (done >= need || timedout) {
+			break;
+		}
+
+		if (timeout < 0) {
+			pthread_cond_wait(&sprec_future_cond, &sprec_future_lock);
+		} else if (pthread_cond_timedwait(&sprec_future_cond, &sprec_future_lock, &ts) == ETIMEDOUT) {
+			/* check once more */
+			timedout = 1;
+		}
+	}
+
+	pthread_mutex_unlock(&sprec_future_lock);
+
+	if (done < need) {
+		return -1;
+	}
+
+	return first < 0 ? 0 : first;
+}
+
+int sprec_future_wait(sprec_future *future, double timeout)
+{
+	return sprec_future_wait_for(&future, 1, 1, timeout) < 0;
+}
+
+int sprec_future_wait_any(sprec_future *const *futures, size_t count, double timeout, size_t *index)
+{
+	long i;
+
+	if (count == 0) {
+		return -1;
+	}
+
+	i = sprec_future_wait_for(futures, count, 1, timeout);
+	if (i < 0) {
+		return -1;
+	}
+
+	*index = i;
+
+	return 0;
+}
+
+int sprec_future_wait_all(sprec_future *const *futures, size_t count, double timeout)
+{
+	if (count == 0) {
+		return 0;
+	}
+
+	return sprec_future_wait_for(futures, count, 0, timeout) < 0;
+}
+
+const sprec_future_result *sprec_future_get(sprec_future *future)
+{
+	const sprec_future_result *result = NULL;
+
+	pthread_mutex_lock(&sprec_future_lock);
+	if (future->stage == SPREC_STAGE_DONE) {
+		result = &future->result;
+	}
+	pthread_mutex_unlock(&sprec_future_lock);
+
+	return result;
+}
+
+int sprec_future_cancel(sprec_future *future)
+{
+	sprec_executor *exec;
+	sprec_future **p;
+	sprec_future *prev = NULL;
+
+	/*
+	 * Once finished, the executor may be gone
+	 */
+	if (sprec_future_poll(future)) {
+		return -1;
+	}
+
+	exec = future->exec;
+
+	pthread_mutex_lock(&exec->lock);
+
+	for (p = &exec->head; *p != NULL; prev = *p, p = &(*p)->next) {
+		if (*p == future) {
+			break;
+		}
+	}
+
+	if (*p == NULL) {
+		/* already taken by a worker */
+		pthread_mutex_unlock(&exec->lock);
+		return -1;
+	}
+
+	*p = future->next;
+	if (exec->tail == future) {
+		exec->tail = prev;
+	}
+
+	pthread_mutex_unlock(&exec->lock);
+
+	sprec_future_complete(future, SPREC_FUTURE_ERR_CANCELLED, NULL);
+	sprec_future_release(future);
+
+	return 0;
+}
+
+void sprec_future_free(sprec_future *future)
+{
+	if (future == NULL) {
+		return;
+	}
+
+	sprec_future_release(future);
+}
+
+static void sprec_future_release(sprec_future *future)
+{
+	sprec_allocator alloc;
+	sprec_server_response *resp;
+	int last;
+
+	pthread_mutex_lock(&sprec_future_lock);
+	last = --future->refs == 0;
+	pthread_mutex_unlock(&sprec_future_lock);
+
+	if (!last) {
+		return;
+	}
+
+	/*
+	 * This may be a worker thread, so the caller's allocator is used
+	 * explicitly for everything that was allocated on its behalf
+	 */
+	alloc = future->alloc;
+	resp = future->result.resp;
+	if (resp != NULL) {
+		sprec_allocator_free(&alloc, resp->data);
+		sprec_allocator_free(&alloc, resp);
+	}
+
+	sprec_allocator_free(&alloc, future->apikey);
+	sprec_allocator_free(&alloc, future->lang);
+	sprec_allocator_free(&alloc, future->path);
+	sprec_allocator_free(&alloc, future);
+}
+
+static void sprec_future_set_stage(sprec_future *future, sprec_future_stage stage)
+{
+	pthread_mutex_lock(&sprec_future_lock);
+	future->stage = stage;
+	pthread_mutex_unlock(&sprec_future_lock);
+}
+
+static void sprec_future_complete(sprec_future *future, sprec_future_error error, sprec_server_response *resp)
+{
+	pthread_mutex_lock(&sprec_future_lock);
+
+	future->result.error = error;
+	future->result.resp = resp;
+	future->result.status = resp ? resp->status : 0;
+	future->stage = SPREC_STAGE_DONE;
+
+	pthread_cond_broadcast(&sprec_future_cond);
+	pthread_mutex_unlock(&sprec_future_lock);
+}
+
+static void *sprec_executor_thread(void *ctx)
+{
+	sprec_executor *exec = ctx;
+	sprec_future *future;
+
+	for (;;) {
+		pthread_mutex_lock(&exec->lock);
+
+		while (exec->head == NULL && !exec->shutdown) {
+			pthread_cond_wait(&exec->cond, &exec->lock);
+		}
+
+		future = exec->head;
+		if (future == NULL) {
+			pthread_mutex_unlock(&exec->lock);
+			break;
+		}
+
+		exec->head = future->next;
+		if (exec->head == NULL) {
+			exec->tail = NULL;
+		}
+
+		pthread_mutex_unlock(&exec->lock);
+
+		/*
+		 * The result is handed to the caller,
+		 * so it must come from its allocator
+		 */
+		sprec_set_thread_allocator(&future->alloc);
+		sprec_future_run(exec, future);
+		sprec_future_release(future);
+		sprec_set_thread_allocator(NULL);
+	}
+
+	return NULL;
+}
+
+static void sprec_future_run(sprec_executor *exec, sprec_future *future)
+{
+	sprec_future_result *result = &future->result;
+	sprec_wav_header *hdr = NULL;
+	sprec_server_response *resp;
+	sprec_future_error error;
+	sprec_encoder *enc;
+	sprec_reservation res;
+	const char *wavfile = future->path;
+	char tmpfile[L_tmpnam + 5];
+	const void *flac;
+	size_t size;
+	uint32_t length;
+	double t;
+	FILE *f;
+
+	t = sprec_clock_now();
+	result->queued = t - future->created;
+
+	/*
+	 * sample rate = 16000Hz, bit depth = 16bps, stereo,
+	 * as in sprec_recognize_sync()
+	 */
+	if (future->kind == SPREC_FUTURE_LIVE) {
+		sprec_future_set_stage(future, SPREC_STAGE_RECORDING);
+
+		sprintf(tmpfile, "%s.wav", tmpnam(NULL));
+		wavfile = tmpfile;
+
+		hdr = sprec_wav_header_from_params(16000, 16, 2);
+		if (hdr == NULL) {
+			sprec_future_complete(future, SPREC_FUTURE_ERR_NOMEM, NULL);
+			return;
+		}
+
+		length = future->duration * hdr->bytes_per_second;
+		if (sprec_budget_reserve(&res, sprec_budget_estimate(length), 0) != 0) {
+			sprec_free(hdr);
+			sprec_future_complete(future, SPREC_FUTURE_ERR_NOMEM, NULL);
+			return;
+		}
+
+		if (sprec_record_wav(wavfile, hdr, 1000 * future->duration) != 0) {
+			sprec_budget_release(&res);
+			sprec_free(hdr);
+			remove(wavfile);
+			sprec_future_complete(future, SPREC_FUTURE_ERR_RECORD, NULL);
+			return;
+		}
+
+		result->recording = sprec_clock_now() - t;
+	} else {
+		f = fopen(wavfile, "rb");
+		if (f == NULL || sprec_wav_read_header(f, &hdr, &length) != 0) {
+			if (f != NULL) {
+				fclose(f);
+			}
+			sprec_future_complete(future, SPREC_FUTURE_ERR_ENCODE, NULL);
+			return;
+		}
+
+		fclose(f);
+
+		if (sprec_budget_reserve(&res, sprec_budget_estimate(length), 0) != 0) {
+			sprec_free(hdr);
+			sprec_future_complete(future, SPREC_FUTURE_ERR_NOMEM, NULL);
+			return;
+		}
+	}
+
+	sprec_future_set_stage(future, SPREC_STAGE_ENCODING);
+	t = sprec_clock_now();
+
+	/*
+	 * A recognition shed for one of higher priority fails
+	 * between stages, which is when its memory is given back
+	 */
+	enc = NULL;
+	resp = NULL;
+	if (sprec_reservation_shed(&res)) {
+		error = SPREC_FUTURE_ERR_NOMEM;
+	} else if ((enc = sprec_encoder_pool_acquire(exec->pool)) == NULL) {
+		error = SPREC_FUTURE_ERR_NOMEM;
+	} else if (sprec_encoder_encode_file(enc, wavfile, &flac, &size) != 0) {
+		error = SPREC_FUTURE_ERR_ENCODE;
+	} else if (sprec_reservation_shed(&res)) {
+		error = SPREC_FUTURE_ERR_NOMEM;
+	} else {
+		result->encoding = sprec_clock_now() - t;
+
+		sprec_future_set_stage(future, SPREC_STAGE_UPLOADING);
+		t = sprec_clock_now();
+
+		resp = sprec_send_audio_data_ex(flac, size, future->apikey, future->lang, hdr->sample_rate, &exec->send);
+
+		result->uploading = sprec_clock_now() - t;
+
+		if (resp == NULL) {
+			error = SPREC_FUTURE_ERR_TRANSPORT;
+		} else if (resp->status < 200 || resp->status >= 300) {
+			error = SPREC_FUTURE_ERR_HTTP;
+		} else {
+			error = SPREC_FUTURE_OK;
+		}
+	}
+
+	if (enc != NULL) {
+		sprec_encoder_pool_release(exec->pool, enc);
+	}
+
+	if (future->kind == SPREC_FUTURE_LIVE) {
+		remove(wavfile);
+	}
+
+	sprec_free(hdr);
+	sprec_budget_release(&res);
+	sprec_future_complete(future, error, resp);
+}
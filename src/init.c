@@ -0,0 +1,212 @@
+/*
+ * init.c
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#include <pthread.h>
+#include <curl/curl.h>
+#include <sprec/init.h>
+#include "clock.h"
+#include "request.h"
+
+/*
+ * libcurl doesn't reuse connections idle for longer than 118 s
+ * (CURLOPT_MAXAGE_CONN), and servers close them sooner or later;
+ * one used within this many seconds is assumed to be still open
+ */
+#define WARM_INTERVAL 60.0
+
+/*
+ * Longest a warm-up may take, in seconds
+ */
+#define WARM_UP_TIMEOUT 10L
+
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	unsigned refs;
+	CURLSH *share;
+	pthread_mutex_t share_locks[CURL_LOCK_DATA_LAST];
+	int warming;		/* a warm-up thread is running */
+	double used;		/* when a shared connection was last used */
+} sprec_global = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, NULL, { PTHREAD_MUTEX_INITIALIZER }, 0, 0.0 };
+
+static void sprec_share_lock(CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr)
+{
+	pthread_mutex_lock(&sprec_global.share_locks[data]);
+}
+
+static void sprec_share_unlock(CURL *handle, curl_lock_data data, void *userptr)
+{
+	pthread_mutex_unlock(&sprec_global.share_locks[data]);
+}
+
+int sprec_init(void)
+{
+	int i;
+
+	pthread_mutex_lock(&sprec_global.lock);
+
+	if (sprec_global.refs++ > 0) {
+		pthread_mutex_unlock(&sprec_global.lock);
+		return 0;
+	}
+
+	if (curl_global_init(CURL_GLOBAL_DEFAULT) != CURLE_OK) {
+		sprec_global.refs = 0;
+		pthread_mutex_unlock(&sprec_global.lock);
+		return -1;
+	}
+
+	sprec_global.share = curl_share_init();
+	if (sprec_global.share == NULL) {
+		curl_global_cleanup();
+		sprec_global.refs = 0;
+		pthread_mutex_unlock(&sprec_global.lock);
+		return -1;
+	}
+
+	for (i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+		pthread_mutex_init(&sprec_global.share_locks[i], NULL);
+	}
+
+	curl_share_setopt(sprec_global.share, CURLSHOPT_LOCKFUNC, sprec_share_lock);
+	curl_share_setopt(sprec_global.share, CURLSHOPT_UNLOCKFUNC, sprec_share_unlock);
+	curl_share_setopt(sprec_global.share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+	curl_share_setopt(sprec_global.share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+
+	/*
+	 * Connections can be shared since libcurl 7.57.0; before that,
+	 * a warm-up still saves the DNS lookup and a full TLS handshake
+	 */
+#if LIBCURL_VERSION_NUM >= 0x073900
+	curl_share_setopt(sprec_global.share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+
+	sprec_global.used = 0.0;
+
+	pthread_mutex_unlock(&sprec_global.lock);
+
+	return 0;
+}
+
+void sprec_shutdown(void)
+{
+	int i;
+
+	pthread_mutex_lock(&sprec_global.lock);
+
+	if (sprec_global.refs == 0 || --sprec_global.refs > 0) {
+		pthread_mutex_unlock(&sprec_global.lock);
+		return;
+	}
+
+	while (sprec_global.warming) {
+		pthread_cond_wait(&sprec_global.cond, &sprec_global.lock);
+	}
+
+	curl_share_cleanup(sprec_global.share);
+	sprec_global.share = NULL;
+
+	for (i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+		pthread_mutex_destroy(&sprec_global.share_locks[i]);
+	}
+
+	curl_global_cleanup();
+
+	pthread_mutex_unlock(&sprec_global.lock);
+}
+
+CURLSH *sprec_curl_share(void)
+{
+	CURLSH *share;
+
+	pthread_mutex_lock(&sprec_global.lock);
+	share = sprec_global.share;
+	pthread_mutex_unlock(&sprec_global.lock);
+
+	return share;
+}
+
+void sprec_connection_used(void)
+{
+	pthread_mutex_lock(&sprec_global.lock);
+	sprec_global.used = sprec_clock_now();
+	pthread_mutex_unlock(&sprec_global.lock);
+}
+
+/*
+ * A HEAD request opens the connection the same way a recognition
+ * request would (so that it can be reused by one), and leaves it
+ * in the shared cache
+ */
+static void *sprec_warm_up_thread(void *arg)
+{
+	CURLSH *share = arg;
+	CURLcode result = CURLE_FAILED_INIT;
+	CURL *curl;
+
+	curl = curl_easy_init();
+	if (curl != NULL) {
+		curl_easy_setopt(curl, CURLOPT_URL, SPREC_API_URL);
+		curl_easy_setopt(curl, CURLOPT_SHARE, share);
+		curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+		curl_easy_setopt(curl, CURLOPT_TIMEOUT, WARM_UP_TIMEOUT);
+		curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+
+		/* as in sprec_request_init_ex() */
+		curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0);
+
+		result = curl_easy_perform(curl);
+		curl_easy_cleanup(curl);
+	}
+
+	pthread_mutex_lock(&sprec_global.lock);
+	if (result == CURLE_OK) {
+		sprec_global.used = sprec_clock_now();
+	}
+	sprec_global.warming = 0;
+	pthread_cond_broadcast(&sprec_global.cond);
+	pthread_mutex_unlock(&sprec_global.lock);
+
+	return NULL;
+}
+
+int sprec_warm_up(void)
+{
+	pthread_attr_t attr;
+	pthread_t thread;
+	int err;
+
+	pthread_mutex_lock(&sprec_global.lock);
+
+	if (sprec_global.share == NULL) {
+		pthread_mutex_unlock(&sprec_global.lock);
+		return -1;
+	}
+
+	if (sprec_global.warming || (sprec_global.used > 0 && sprec_clock_now() - sprec_global.used < WARM_INTERVAL)) {
+		pthread_mutex_unlock(&sprec_global.lock);
+		return 0;
+	}
+
+	/*
+	 * Nobody waits for the thread but sprec_shutdown(), through `warming'
+	 */
+	err = pthread_attr_init(&attr);
+	if (err == 0) {
+		pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+		err = pthread_create(&thread, &attr, sprec_warm_up_thread, sprec_global.share);
+		pthread_attr_destroy(&attr);
+	}
+
+	if (err == 0) {
+		sprec_global.warming = 1;
+	}
+
+	pthread_mutex_unlock(&sprec_global.lock);
+
+	return err == 0 ? 0 : -1;
+}
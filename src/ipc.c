@@ -0,0 +1,255 @@
+/*
+ * ipc.c
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sprec/client.h>
+#include "ipc.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0	/* SO_NOSIGPIPE is set on the socket instead */
+#endif
+
+#ifndef MSG_CMSG_CLOEXEC
+#define MSG_CMSG_CLOEXEC 0
+#endif
+
+int sprec_ipc_write(int sock, const void *data, size_t length)
+{
+	return sprec_ipc_write_fd(sock, data, length, -1);
+}
+
+int sprec_ipc_read(int sock, void *data, size_t length)
+{
+	const char *p = data;
+	ssize_t n;
+
+	while (length > 0) {
+		n = recv(sock, (char *)p, length, 0);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return -1;
+		}
+
+		p += n;
+		length -= n;
+	}
+
+	return 0;
+}
+
+int sprec_ipc_write_fd(int sock, const void *data, size_t length, int fd)
+{
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(sizeof(int))];
+	} control;
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct iovec iov;
+	ssize_t n;
+
+	while (length > 0) {
+		memset(&msg, 0, sizeof msg);
+		iov.iov_base = (void *)data;
+		iov.iov_len = length;
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+
+		/*
+		 * The descriptor goes with the first byte
+		 */
+		if (fd >= 0) {
+			memset(&control, 0, sizeof control);
+			msg.msg_control = control.buf;
+			msg.msg_controllen = sizeof control.buf;
+
+			cmsg = CMSG_FIRSTHDR(&msg);
+			cmsg->cmsg_level = SOL_SOCKET;
+			cmsg->cmsg_type = SCM_RIGHTS;
+			cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+			memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+		}
+
+		n = sendmsg(sock, &msg, MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+
+		data = (const char *)data + n;
+		length -= n;
+		fd = -1;
+	}
+
+	return 0;
+}
+
+int sprec_ipc_read_fd(int sock, void *data, size_t length, int *fd)
+{
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(sizeof(int))];
+	} control;
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct iovec iov;
+	ssize_t n;
+	int received;
+
+	*fd = -1;
+
+	do {
+		memset(&msg, 0, sizeof msg);
+		iov.iov_base = data;
+		iov.iov_len = length;
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control.buf;
+		msg.msg_controllen = sizeof control.buf;
+
+		n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+	} while (n < 0 && errno == EINTR);
+
+	if (n <= 0) {
+		return -1;
+	}
+
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+			memcpy(&received, CMSG_DATA(cmsg), sizeof(int));
+			if (*fd < 0) {
+				*fd = received;
+			} else {
+				close(received);
+			}
+		}
+	}
+
+	if (sprec_ipc_read(sock, (char *)data + n, length - n) != 0) {
+		if (*fd >= 0) {
+			close(*fd);
+			*fd = -1;
+		}
+		return -1;
+	}
+
+	return 0;
+}
+
+int sprec_ipc_shared_file(char *path, size_t size)
+{
+	char tmpl[] = "/tmp/sprec-XXXXXX";
+	int fd;
+
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+#ifdef MFD_ALLOW_SEALING
+	fd = memfd_create("sprec", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#else
+	fd = memfd_create("sprec", MFD_CLOEXEC);
+#endif
+	if (fd >= 0) {
+		if (path != NULL) {
+			snprintf(path, size, "/proc/self/fd/%d", fd);
+		}
+		return fd;
+	}
+#endif
+
+	fd = mkstemp(tmpl);
+	if (fd < 0) {
+		return -1;
+	}
+
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+	if (path != NULL) {
+		snprintf(path, size, "%s", tmpl);
+	} else {
+		unlink(tmpl);
+	}
+
+	return fd;
+}
+
+int sprec_ipc_seal(int fd)
+{
+#ifdef F_ADD_SEALS
+	return fcntl(fd, F_ADD_SEALS, SPREC_IPC_SEALS) == 0 ? 0 : -1;
+#else
+	return -1;
+#endif
+}
+
+int sprec_ipc_is_sealed(int fd)
+{
+#ifdef F_GET_SEALS
+	int seals = fcntl(fd, F_GET_SEALS);
+
+	return seals >= 0 && (seals & SPREC_IPC_SEALS) == SPREC_IPC_SEALS;
+#else
+	return 0;
+#endif
+}
+
+int sprec_ipc_socket_path(char *path, size_t size, int create)
+{
+	const char *env;
+	char dir[32];
+	struct stat st;
+	int n;
+
+	env = getenv("SPREC_SOCKET");
+	if (env != NULL) {
+		n = snprintf(path, size, "%s", env);
+		return n < 0 || (size_t)n >= size ? -1 : 0;
+	}
+
+	env = getenv("XDG_RUNTIME_DIR");
+	if (env != NULL && env[0] == '/') {
+		n = snprintf(path, size, "%s/%s", env, SPREC_DAEMON_SOCKET);
+		return n < 0 || (size_t)n >= size ? -1 : 0;
+	}
+
+	snprintf(dir, sizeof dir, "/tmp/sprecd-%lu", (unsigned long)geteuid());
+
+	if (create && mkdir(dir, 0700) != 0 && errno != EEXIST) {
+		return -1;
+	}
+
+	if (lstat(dir, &st) != 0) {
+		return -1;
+	}
+
+	if (!S_ISDIR(st.st_mode) || st.st_uid != geteuid() || (st.st_mode & 077) != 0) {
+		errno = EPERM;
+		return -1;
+	}
+
+	n = snprintf(path, size, "%s/%s", dir, SPREC_DAEMON_SOCKET);
+	return n < 0 || (size_t)n >= size ? -1 : 0;
+}
+
+void sprec_ipc_release(const char *path)
+{
+	if (strncmp(path, "/proc/self/fd/", 14) != 0) {
+		unlink(path);
+	}
+}
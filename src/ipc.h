@@ -0,0 +1,100 @@
+/*
+ * ipc.h
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#ifndef __SPREC_IPC_H__
+#define __SPREC_IPC_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <fcntl.h>
+
+/*
+ * Internal: the protocol spoken over the Unix-domain socket between
+ * sprec_client (client.c) and sprec_server (server.c). Each request
+ * is one sprec_ipc_request with the descriptor of a file holding the
+ * audio attached to it; each response is one sprec_ipc_response,
+ * followed by `length' bytes of JSON. Both ends run on the same
+ * machine, so the structures are sent as they are.
+ */
+
+#define SPREC_IPC_MAGIC 0x43525053	/* "SPRC" */
+#define SPREC_IPC_VERSION 1
+#define SPREC_IPC_APIKEY_MAX 128
+#define SPREC_IPC_LANGUAGE_MAX 64
+
+enum {
+	SPREC_IPC_FLAC = 1,	/* FLAC data at `offset' */
+	SPREC_IPC_WAV		/* a WAV file, to be encoded by the server */
+};
+
+typedef struct sprec_ipc_request {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t type;
+	uint32_t sample_rate;	/* of FLAC data */
+	uint32_t reserved;
+	uint64_t offset;
+	uint64_t length;
+	char apikey[SPREC_IPC_APIKEY_MAX];
+	char language[SPREC_IPC_LANGUAGE_MAX];
+} sprec_ipc_request;
+
+typedef struct sprec_ipc_response {
+	uint32_t magic;
+	int32_t error;		/* a sprec_client_error */
+	int64_t status;		/* HTTP status, 0 if none */
+	uint64_t length;	/* of the JSON that follows */
+} sprec_ipc_response;
+
+/*
+ * Writes or reads exactly `length' bytes.
+ * Return 0 on success, non-0 on error or end of file.
+ */
+int sprec_ipc_write(int sock, const void *data, size_t length);
+int sprec_ipc_read(int sock, void *data, size_t length);
+
+/*
+ * Same as above, passing the descriptor `fd' along
+ * (received as -1 if none was sent)
+ */
+int sprec_ipc_write_fd(int sock, const void *data, size_t length, int fd);
+int sprec_ipc_read_fd(int sock, void *data, size_t length, int *fd);
+
+/*
+ * Creates an anonymous file in shared memory (a memfd where available,
+ * a deleted temporary file otherwise). If `path' is not NULL, it
+ * receives a name under which the file can be opened again, which is
+ * to be passed to sprec_ipc_release() once it isn't needed anymore.
+ * Returns the descriptor, or -1 on error.
+ */
+int sprec_ipc_shared_file(char *path, size_t size);
+void sprec_ipc_release(const char *path);
+
+/*
+ * A file with these seals can't change while the server maps it.
+ * sprec_ipc_seal() adds them to a file made by sprec_ipc_shared_file()
+ * once it has been written, and fails where files can't be sealed.
+ * sprec_ipc_is_sealed() tells if a file received has all of them.
+ */
+#ifdef F_ADD_SEALS
+#define SPREC_IPC_SEALS (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE)
+#endif
+
+int sprec_ipc_seal(int fd);
+int sprec_ipc_is_sealed(int fd);
+
+/*
+ * Puts the default path of the socket in `path' (`size' bytes): the
+ * SPREC_SOCKET environment variable, or SPREC_DAEMON_SOCKET in
+ * $XDG_RUNTIME_DIR, or in /tmp/sprecd-<uid>. The latter is created
+ * (with mode 0700) if `create' is non-0, and refused with EPERM unless
+ * it belongs to the user and no one else may enter it, as anyone can
+ * make files in /tmp. Returns 0 on success, non-0 on error.
+ */
+int sprec_ipc_socket_path(char *path, size_t size, int create);
+
+#endif /* !__SPREC_IPC_H__ */
@@ -0,0 +1,354 @@
+/*
+ * levels.c
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#include <string.h>
+#include <math.h>
+#include <sprec/levels.h>
+
+#if defined __SSE2__
+	#include <emmintrin.h>
+#endif
+
+/*
+ * Length of the windows whose levels make up the histogram (in seconds)
+ */
+#define WINDOW_LENGTH 0.01
+
+/*
+ * Percentiles of the window levels taken
+ * as the noise floor and the speech level
+ */
+#define NOISE_PERCENTILE 0.1
+#define SPEECH_PERCENTILE 0.9
+
+/*
+ * Float audio is converted to 16 bits, so it is clipped
+ * within one 16 bit step of full scale
+ */
+#define CLIP_F32 (32767.0f / 32768.0f)
+
+/*
+ * What a run of samples adds up to
+ */
+typedef struct sprec_level_sums {
+	double energy;		/* sum of squares, relative to full scale */
+	float peak;		/* largest magnitude, relative to full scale */
+	uint64_t clipped;
+} sprec_level_sums;
+
+static void sprec_levels_scalar(
+	const unsigned char *src,
+	sprec_pcm_format fmt,
+	size_t start,
+	size_t end,
+	sprec_level_sums *sums
+)
+{
+	uint64_t energy = 0;
+	int32_t x, m, peak = 0;
+	float f, clip;
+	size_t i;
+
+	switch (fmt) {
+	case SPREC_PCM_U8:
+	case SPREC_PCM_S16LE:
+		/*
+		 * In integers, exactly like the SIMD code
+		 */
+		for (i = start; i < end; i++) {
+			if (fmt == SPREC_PCM_U8) {
+				x = ((int32_t)src[i] - 128) * 256;
+			} else {
+				x = (int16_t)(src[2 * i] | src[2 * i + 1] << 8);
+			}
+
+			m = x < 0 ? -x : x;
+			energy += (uint64_t)(x * x);
+			peak = m > peak ? m : peak;
+			sums->clipped += m >= (fmt == SPREC_PCM_U8 ? 127 * 256 : 32767);
+		}
+
+		sums->energy += energy / (32768.0 * 32768.0);
+		sums->peak = peak / 32768.0f > sums->peak ? peak / 32768.0f : sums->peak;
+		break;
+	default:
+		clip = fmt == SPREC_PCM_S24LE ? 8388607.0f / 8388608.0f
+		     : fmt == SPREC_PCM_S32LE ? 2147483647.0f / 2147483648.0f
+		     : CLIP_F32;
+
+		for (i = start; i < end; i++) {
+			f = fabsf(sprec_pcm_sample(src, fmt, i));
+			sums->energy += (double)f * f;
+			sums->peak = f > sums->peak ? f : sums->peak;
+			sums->clipped += f >= clip;
+		}
+		break;
+	}
+}
+
+#if defined __SSE2__
+
+/*
+ * Number of bits set in a 4 bit mask
+ */
+static const unsigned char sprec_bits4[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+
+/*
+ * Measures as many samples as it can in whole vectors.
+ * Returns the number of samples measured.
+ */
+static size_t sprec_levels_sse2(const unsigned char *src, sprec_pcm_format fmt, size_t nsamples, sprec_level_sums *sums)
+{
+	__m128i v, sq, mask, energy, clipped, hi, lo;
+	__m128 f, a, peak;
+	__m128d e;
+	int16_t hi16[8], lo16[8];
+	uint64_t e64[2];
+	int32_t c32[4], m = 0;
+	float p4[4];
+	double ed[2];
+	size_t i = 0;
+	int k;
+
+	switch (fmt) {
+	case SPREC_PCM_S16LE:
+		energy = _mm_setzero_si128();
+		clipped = _mm_setzero_si128();
+		hi = _mm_setzero_si128();
+		lo = _mm_setzero_si128();
+
+		for (; i + 8 <= nsamples; i += 8) {
+			v = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+
+			/*
+			 * Pairs of squares fit in 32 bits unsigned
+			 * (even two of -32768), summed in 64 bits
+			 */
+			sq = _mm_madd_epi16(v, v);
+			energy = _mm_add_epi64(energy, _mm_unpacklo_epi32(sq, _mm_setzero_si128()));
+			energy = _mm_add_epi64(energy, _mm_unpackhi_epi32(sq, _mm_setzero_si128()));
+
+			hi = _mm_max_epi16(hi, v);
+			lo = _mm_min_epi16(lo, v);
+
+			mask = _mm_or_si128(_mm_cmpgt_epi16(v, _mm_set1_epi16(32766)), _mm_cmplt_epi16(v, _mm_set1_epi16(-32766)));
+			clipped = _mm_sub_epi32(clipped, _mm_madd_epi16(mask, _mm_set1_epi16(1)));
+		}
+
+		_mm_storeu_si128((__m128i *)e64, energy);
+		_mm_storeu_si128((__m128i *)c32, clipped);
+		_mm_storeu_si128((__m128i *)hi16, hi);
+		_mm_storeu_si128((__m128i *)lo16, lo);
+
+		for (k = 0; k < 8; k++) {
+			m = hi16[k] > m ? hi16[k] : m;
+			m = -lo16[k] > m ? -lo16[k] : m;
+		}
+
+		sums->energy += (e64[0] + e64[1]) / (32768.0 * 32768.0);
+		sums->clipped += (uint32_t)c32[0] + (uint32_t)c32[1] + (uint32_t)c32[2] + (uint32_t)c32[3];
+		sums->peak = m / 32768.0f > sums->peak ? m / 32768.0f : sums->peak;
+		break;
+	case SPREC_PCM_F32LE:
+		e = _mm_setzero_pd();
+		peak = _mm_setzero_ps();
+
+		for (; i + 4 <= nsamples; i += 4) {
+			f = _mm_loadu_ps((const float *)(src + 4 * i));
+			f = _mm_and_ps(f, _mm_cmpord_ps(f, f));	/* NaN as 0, like sprec_pcm_sample() */
+			a = _mm_andnot_ps(_mm_set1_ps(-0.0f), f);
+
+			e = _mm_add_pd(e, _mm_mul_pd(_mm_cvtps_pd(a), _mm_cvtps_pd(a)));
+			a = _mm_movehl_ps(a, a);
+			e = _mm_add_pd(e, _mm_mul_pd(_mm_cvtps_pd(a), _mm_cvtps_pd(a)));
+
+			a = _mm_andnot_ps(_mm_set1_ps(-0.0f), f);
+			peak = _mm_max_ps(peak, a);
+			sums->clipped += sprec_bits4[_mm_movemask_ps(_mm_cmpge_ps(a, _mm_set1_ps(CLIP_F32)))];
+		}
+
+		_mm_storeu_pd(ed, e);
+		_mm_storeu_ps(p4, peak);
+
+		sums->energy += ed[0] + ed[1];
+		for (k = 0; k < 4; k++) {
+			sums->peak = p4[k] > sums->peak ? p4[k] : sums->peak;
+		}
+		break;
+	default:
+		break;
+	}
+
+	return i;
+}
+
+#endif /* __SSE2__ */
+
+static void sprec_levels_sum(const unsigned char *src, sprec_pcm_format fmt, size_t nsamples, sprec_level_sums *sums)
+{
+	size_t done = 0;
+
+#if defined __SSE2__
+	done = sprec_levels_sse2(src, fmt, nsamples, sums);
+#endif
+
+	sprec_levels_scalar(src, fmt, done, nsamples, sums);
+}
+
+/*
+ * Level of a mean power in dBFS, no lower than the floor
+ */
+static double sprec_levels_db(double power)
+{
+	double db = power > 0 ? 10.0 * log10(power) : SPREC_LEVEL_FLOOR;
+
+	return db > SPREC_LEVEL_FLOOR ? db : SPREC_LEVEL_FLOOR;
+}
+
+static size_t sprec_levels_bin(double power)
+{
+	double x = (sprec_levels_db(power) - SPREC_LEVEL_FLOOR) * 2.0 + 0.5;
+
+	return x < SPREC_LEVEL_BINS - 1 ? (size_t)x : SPREC_LEVEL_BINS - 1;
+}
+
+static double sprec_levels_percentile(const uint32_t *histogram, uint64_t windows, double p)
+{
+	uint64_t sum = 0, target = ceil(p * windows);
+	size_t i;
+
+	for (i = 0; i < SPREC_LEVEL_BINS - 1; i++) {
+		sum += histogram[i];
+		if (sum >= target && sum > 0) {
+			break;
+		}
+	}
+
+	return SPREC_LEVEL_FLOOR + i * 0.5;
+}
+
+void sprec_level_limits_init(sprec_level_limits *limits)
+{
+	limits->min_rms = -60.0;
+	limits->min_speech = -45.0;
+	limits->min_snr = 6.0;
+	limits->max_clipping = 0.01;
+}
+
+void sprec_level_meter_init(sprec_level_meter *meter, uint32_t rate, uint32_t channels, sprec_pcm_format fmt)
+{
+	meter->fmt = fmt;
+	meter->channels = channels;
+	meter->window = (size_t)(rate * WINDOW_LENGTH) * channels;
+	if (meter->window == 0) {
+		meter->window = 1;
+	}
+
+	sprec_level_meter_reset(meter);
+}
+
+void sprec_level_meter_reset(sprec_level_meter *meter)
+{
+	meter->fill = 0;
+	meter->window_energy = 0.0;
+	meter->energy = 0.0;
+	meter->peak = 0.0f;
+	meter->samples = 0;
+	meter->clipped = 0;
+	meter->windows = 0;
+	memset(meter->histogram, 0, sizeof meter->histogram);
+}
+
+double sprec_level_meter_update(sprec_level_meter *meter, const void *pcm, size_t frames)
+{
+	const unsigned char *src = pcm;
+	size_t size = sprec_pcm_sample_size(meter->fmt);
+	size_t nsamples = frames * meter->channels;
+	sprec_level_sums sums;
+	double energy = 0.0;
+	size_t i, n;
+
+	for (i = 0; i < nsamples; i += n) {
+		n = meter->window - meter->fill;
+		n = nsamples - i < n ? nsamples - i : n;
+
+		memset(&sums, 0, sizeof sums);
+		sprec_levels_sum(src + i * size, meter->fmt, n, &sums);
+
+		energy += sums.energy;
+		meter->window_energy += sums.energy;
+		meter->fill += n;
+		meter->clipped += sums.clipped;
+		meter->peak = sums.peak > meter->peak ? sums.peak : meter->peak;
+
+		if (meter->fill == meter->window) {
+			meter->histogram[sprec_levels_bin(meter->window_energy / meter->window)]++;
+			meter->windows++;
+			meter->window_energy = 0.0;
+			meter->fill = 0;
+		}
+	}
+
+	meter->energy += energy;
+	meter->samples += nsamples;
+
+	return nsamples ? energy / nsamples : 0.0;
+}
+
+void sprec_level_meter_read(const sprec_level_meter *meter, sprec_levels *levels)
+{
+	uint32_t histogram[SPREC_LEVEL_BINS];
+	uint64_t windows = meter->windows;
+
+	memcpy(histogram, meter->histogram, sizeof histogram);
+	if (meter->fill > 0) {
+		histogram[sprec_levels_bin(meter->window_energy / meter->fill)]++;
+		windows++;
+	}
+
+	levels->samples = meter->samples;
+	levels->clipped = meter->clipped;
+	levels->peak = meter->peak > 0 ? 20.0 * log10(meter->peak) : SPREC_LEVEL_FLOOR;
+	levels->peak = levels->peak > SPREC_LEVEL_FLOOR ? levels->peak : SPREC_LEVEL_FLOOR;
+	levels->rms = sprec_levels_db(meter->samples ? meter->energy / meter->samples : 0.0);
+	levels->clipping = meter->samples ? (double)meter->clipped / meter->samples : 0.0;
+
+	if (windows > 0) {
+		levels->noise_floor = sprec_levels_percentile(histogram, windows, NOISE_PERCENTILE);
+		levels->speech = sprec_levels_percentile(histogram, windows, SPEECH_PERCENTILE);
+	} else {
+		levels->noise_floor = SPREC_LEVEL_FLOOR;
+		levels->speech = SPREC_LEVEL_FLOOR;
+	}
+
+	levels->snr = levels->speech - levels->noise_floor;
+}
+
+int sprec_levels_acceptable(const sprec_levels *levels, const sprec_level_limits *limits)
+{
+	return levels->samples > 0
+	    && levels->rms >= limits->min_rms
+	    && levels->speech >= limits->min_speech
+	    && levels->snr >= limits->min_snr
+	    && levels->clipping <= limits->max_clipping;
+}
+
+void sprec_levels_measure(
+	const void *pcm,
+	size_t frames,
+	uint32_t rate,
+	uint32_t channels,
+	sprec_pcm_format fmt,
+	sprec_levels *levels
+)
+{
+	sprec_level_meter meter;
+
+	sprec_level_meter_init(&meter, rate, channels, fmt);
+	sprec_level_meter_update(&meter, pcm, frames);
+	sprec_level_meter_read(&meter, levels);
+}
@@ -0,0 +1,562 @@
+/*
+ * listen.c
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <sprec/listen.h>
+#include <sprec/flac_encoder.h>
+#include <sprec/pcm.h>
+#include <sprec/levels.h>
+#include <sprec/alloc.h>
+#include <sprec/init.h>
+#include <sprec/budget.h>
+
+/*
+ * Loudness is measured over windows of this length (in seconds)
+ */
+#define WINDOW_LENGTH 0.01
+
+typedef struct sprec_listen_buffer {
+	unsigned char *data;
+	size_t frames;
+	uint64_t start;		/* position of the first frame in the stream */
+	sprec_level_meter meter;	/* levels of the utterance */
+} sprec_listen_buffer;
+
+struct sprec_listener {
+	sprec_allocator alloc;
+	char *apikey;
+	char *language;
+	sprec_send_options send;
+	int has_send;
+	sprec_level_limits reject;
+	int has_reject;
+	sprec_listen_callback cb;
+	void *ctx;
+
+	sprec_capture *cap;
+	sprec_archive *archive;
+	sprec_reservation res;
+	uint32_t rate;
+	uint32_t channels;
+	sprec_pcm_format fmt;
+	size_t bytes_per_frame;
+
+	/* in frames */
+	size_t win;
+	size_t capacity;
+	size_t min_frames;
+	size_t max_frames;
+	size_t silence_frames;
+	size_t pre_roll;
+	double threshold;
+
+	/*
+	 * State of the capture thread. `cur' is the buffer being filled;
+	 * while speaking, `onset' is where the speech started in it and
+	 * `silence' is the length of the silence at its end.
+	 */
+	sprec_listen_buffer *cur;
+	uint64_t position;
+	int speaking;
+	size_t onset;
+	size_t silence;
+
+	/*
+	 * Shared with the upload thread, protected by `lock'
+	 */
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	sprec_listen_buffer *buffers;
+	size_t nbuffers;
+	sprec_listen_buffer **spare;	/* stack of unused buffers */
+	size_t nspare;
+	sprec_listen_buffer **queue;	/* ring of finished utterances */
+	size_t queue_length;
+	size_t head;
+	size_t count;
+	int stopping;
+	int warm;		/* speech has started, connect */
+	uint64_t dropped;
+	pthread_t thread;
+};
+
+static void sprec_listen_handle_audio(const void *pcm, size_t frames, void *ctx);
+static void *sprec_listen_thread(void *ctx);
+static void sprec_listen_dealloc(sprec_listener *l);
+
+void sprec_listen_options_init(sprec_listen_options *opts)
+{
+	sprec_capture_params_init(&opts->capture);
+	opts->silence_threshold = -40.0;
+	opts->silence_length = 0.6;
+	opts->min_length = 0.3;
+	opts->max_length = 15.0;
+	opts->pre_roll = 0.3;
+	opts->queue_length = 4;
+	opts->send = NULL;
+	opts->archive = NULL;
+	opts->archive_options = NULL;
+	opts->reject = NULL;
+}
+
+sprec_listener *sprec_listen(
+	const char *apikey,
+	const char *language,
+	const sprec_listen_options *opts,
+	sprec_listen_callback cb,
+	void *ctx
+)
+{
+	sprec_listen_options defaults;
+	sprec_listener *l;
+	size_t i, size;
+
+	if (opts == NULL) {
+		sprec_listen_options_init(&defaults);
+		opts = &defaults;
+	}
+
+	if (opts->queue_length == 0 || opts->max_length <= 0) {
+		return NULL;
+	}
+
+	l = sprec_calloc(1, sizeof *l);
+	if (l == NULL) {
+		return NULL;
+	}
+
+	sprec_get_allocator(&l->alloc);
+
+	if (pthread_mutex_init(&l->lock, NULL) != 0) {
+		sprec_free(l);
+		return NULL;
+	}
+
+	if (pthread_cond_init(&l->cond, NULL) != 0) {
+		pthread_mutex_destroy(&l->lock);
+		sprec_free(l);
+		return NULL;
+	}
+
+	l->cb = cb;
+	l->ctx = ctx;
+	l->channels = opts->capture.channels;
+	l->fmt = opts->capture.format;
+	l->bytes_per_frame = l->channels * sprec_pcm_sample_size(l->fmt);
+	l->queue_length = opts->queue_length;
+	l->threshold = pow(10.0, opts->silence_threshold / 10.0);
+
+	if (opts->send != NULL) {
+		l->send = *opts->send;
+		l->has_send = 1;
+	}
+
+	if (opts->reject != NULL) {
+		l->reject = *opts->reject;
+		l->has_reject = 1;
+	}
+
+	l->apikey = sprec_strdup(apikey);
+	l->language = sprec_strdup(language);
+	if (l->apikey == NULL || l->language == NULL) {
+		sprec_listen_dealloc(l);
+		return NULL;
+	}
+
+	l->cap = sprec_capture_open(&opts->capture, sprec_listen_handle_audio, l);
+	if (l->cap == NULL) {
+		sprec_listen_dealloc(l);
+		return NULL;
+	}
+
+	/*
+	 * The device may have picked another sample rate
+	 */
+	l->rate = sprec_capture_sample_rate(l->cap);
+	l->win = l->rate * WINDOW_LENGTH;
+	if (l->win == 0) {
+		l->win = 1;
+	}
+
+	l->min_frames = opts->min_length * l->rate;
+	l->max_frames = opts->max_length * l->rate;
+	l->silence_frames = opts->silence_length * l->rate;
+	l->pre_roll = opts->pre_roll * l->rate;
+	if (l->max_frames < l->win) {
+		l->max_frames = l->win;
+	}
+
+	if (opts->archive != NULL) {
+		l->archive = sprec_archive_open(opts->archive, l->rate, l->channels, l->fmt, opts->archive_options);
+		if (l->archive == NULL) {
+			sprec_listen_dealloc(l);
+			return NULL;
+		}
+	}
+
+	/*
+	 * Every buffer is allocated up front, so that the capture thread
+	 * never has to. One is being filled, `queue_length' are waiting
+	 * and one is being uploaded, so there is always a spare one.
+	 */
+	l->capacity = l->max_frames + l->pre_roll + l->win;
+	l->nbuffers = l->queue_length + 2;
+
+	/*
+	 * The buffers, plus the encoded form of the one being
+	 * uploaded and its response
+	 */
+	size = l->capacity * l->bytes_per_frame;
+	if (sprec_budget_reserve(&l->res, sprec_budget_estimate(size) + (l->nbuffers - 1) * size, INT_MAX) != 0) {
+		sprec_listen_dealloc(l);
+		return NULL;
+	}
+
+	l->buffers = sprec_calloc(l->nbuffers, sizeof l->buffers[0]);
+	l->spare = sprec_calloc(l->nbuffers, sizeof l->spare[0]);
+	l->queue = sprec_calloc(l->queue_length, sizeof l->queue[0]);
+	if (l->buffers == NULL || l->spare == NULL || l->queue == NULL) {
+		sprec_listen_dealloc(l);
+		return NULL;
+	}
+
+	for (i = 0; i < l->nbuffers; i++) {
+		l->buffers[i].data = sprec_malloc(size);
+		if (l->buffers[i].data == NULL) {
+			sprec_listen_dealloc(l);
+			return NULL;
+		}
+
+		sprec_level_meter_init(&l->buffers[i].meter, l->rate, l->channels, l->fmt);
+		l->spare[l->nspare++] = &l->buffers[i];
+	}
+
+	l->cur = l->spare[--l->nspare];
+
+	if (pthread_create(&l->thread, NULL, sprec_listen_thread, l) != 0) {
+		sprec_listen_dealloc(l);
+		return NULL;
+	}
+
+	if (!l->has_send || l->send.pool == NULL) {
+		sprec_warm_up();
+	}
+
+	if (sprec_capture_start(l->cap) != 0) {
+		pthread_mutex_lock(&l->lock);
+		l->stopping = 1;
+		pthread_cond_signal(&l->cond);
+		pthread_mutex_unlock(&l->lock);
+
+		pthread_join(l->thread, NULL);
+		sprec_listen_dealloc(l);
+		return NULL;
+	}
+
+	return l;
+}
+
+void sprec_listener_stop(sprec_listener *l)
+{
+	if (l == NULL) {
+		return;
+	}
+
+	sprec_capture_stop(l->cap);
+
+	pthread_mutex_lock(&l->lock);
+
+	/*
+	 * Flush what has been said so far
+	 */
+	if (l->speaking && l->cur->frames - l->onset - l->silence >= l->min_frames) {
+		if (l->count < l->queue_length) {
+			l->queue[(l->head + l->count) % l->queue_length] = l->cur;
+			l->count++;
+			l->cur = NULL;
+		} else {
+			l->dropped++;
+		}
+	}
+
+	l->stopping = 1;
+	pthread_cond_signal(&l->cond);
+	pthread_mutex_unlock(&l->lock);
+
+	pthread_join(l->thread, NULL);
+	sprec_listen_dealloc(l);
+}
+
+uint64_t sprec_listener_dropped(sprec_listener *l)
+{
+	uint64_t dropped;
+
+	pthread_mutex_lock(&l->lock);
+	dropped = l->dropped;
+	pthread_mutex_unlock(&l->lock);
+
+	return dropped;
+}
+
+void sprec_listener_archive_stats(sprec_listener *l, sprec_archive_stats *stats)
+{
+	if (l->archive != NULL) {
+		sprec_archive_get_stats(l->archive, stats);
+	} else {
+		memset(stats, 0, sizeof *stats);
+	}
+}
+
+static void sprec_listen_dealloc(sprec_listener *l)
+{
+	sprec_allocator alloc = l->alloc;
+	size_t i;
+
+	sprec_capture_close(l->cap);
+
+	if (l->archive != NULL) {
+		sprec_archive_close(l->archive, NULL);
+	}
+
+	if (l->buffers != NULL) {
+		for (i = 0; i < l->nbuffers; i++) {
+			sprec_allocator_free(&alloc, l->buffers[i].data);
+		}
+	}
+
+	sprec_allocator_free(&alloc, l->buffers);
+	sprec_allocator_free(&alloc, l->spare);
+	sprec_allocator_free(&alloc, l->queue);
+	sprec_budget_release(&l->res);
+	sprec_allocator_free(&alloc, l->apikey);
+	sprec_allocator_free(&alloc, l->language);
+	pthread_cond_destroy(&l->cond);
+	pthread_mutex_destroy(&l->lock);
+	sprec_allocator_free(&alloc, l);
+}
+
+/*
+ * Hands the current buffer over to the upload thread
+ * and carries on with a spare one
+ */
+static void sprec_listen_submit(sprec_listener *l)
+{
+	pthread_mutex_lock(&l->lock);
+
+	if (l->count < l->queue_length && l->nspare > 0) {
+		l->queue[(l->head + l->count) % l->queue_length] = l->cur;
+		l->count++;
+		l->cur = l->spare[--l->nspare];
+		pthread_cond_signal(&l->cond);
+	} else {
+		l->dropped++;
+	}
+
+	pthread_mutex_unlock(&l->lock);
+
+	l->cur->frames = 0;
+	l->cur->start = l->position;
+	sprec_level_meter_reset(&l->cur->meter);
+}
+
+/*
+ * Has the upload thread get a connection ready
+ * while the utterance is being spoken
+ */
+static void sprec_listen_warm_up(sprec_listener *l)
+{
+	pthread_mutex_lock(&l->lock);
+	l->warm = 1;
+	pthread_cond_signal(&l->cond);
+	pthread_mutex_unlock(&l->lock);
+}
+
+/*
+ * Keeps only the last `pre_roll' frames of the current buffer
+ */
+static void sprec_listen_trim(sprec_listener *l)
+{
+	sprec_listen_buffer *buf = l->cur;
+	size_t excess;
+
+	if (buf->frames <= l->pre_roll) {
+		return;
+	}
+
+	excess = buf->frames - l->pre_roll;
+	memmove(buf->data, buf->data + excess * l->bytes_per_frame, l->pre_roll * l->bytes_per_frame);
+	buf->frames = l->pre_roll;
+	buf->start += excess;
+}
+
+static void sprec_listen_handle_audio(const void *pcm, size_t frames, void *ctx)
+{
+	sprec_listener *l = ctx;
+	const unsigned char *src = pcm;
+	size_t pos, n;
+	int loud;
+
+	if (l->archive != NULL) {
+		sprec_archive_write(l->archive, pcm, frames);
+	}
+
+	for (pos = 0; pos < frames; pos += n) {
+		sprec_listen_buffer *buf = l->cur;
+
+		n = frames - pos < l->win ? frames - pos : l->win;
+
+		/*
+		 * The levels of the utterance are measured in the same pass
+		 * (those of the silence before it are forgotten at the onset)
+		 */
+		loud = sprec_level_meter_update(&buf->meter, src + pos * l->bytes_per_frame, n) >= l->threshold;
+
+		if (buf->frames == 0) {
+			buf->start = l->position;
+		}
+
+		memcpy(buf->data + buf->frames * l->bytes_per_frame, src + pos * l->bytes_per_frame, n * l->bytes_per_frame);
+		buf->frames += n;
+		l->position += n;
+
+		if (!l->speaking) {
+			if (!loud) {
+				sprec_listen_trim(l);
+				continue;
+			}
+
+			l->speaking = 1;
+			l->onset = buf->frames - n;
+			l->silence = 0;
+			sprec_listen_warm_up(l);
+
+			sprec_level_meter_reset(&buf->meter);
+			sprec_level_meter_update(&buf->meter, buf->data, buf->frames);
+		}
+
+		l->silence = loud ? 0 : l->silence + n;
+
+		/*
+		 * End of the utterance, or of a too short sound
+		 */
+		if (l->silence >= l->silence_frames && l->silence > 0) {
+			if (buf->frames - l->onset - l->silence >= l->min_frames) {
+				sprec_listen_submit(l);
+			} else {
+				sprec_listen_trim(l);
+			}
+
+			l->speaking = 0;
+			continue;
+		}
+
+		/*
+		 * Too long: cut here, the next one starts right away
+		 */
+		if (buf->frames - l->onset >= l->max_frames || buf->frames + l->win > l->capacity) {
+			sprec_listen_submit(l);
+			l->onset = 0;
+			l->silence = 0;
+		}
+	}
+}
+
+static void *sprec_listen_thread(void *ctx)
+{
+	sprec_listener *l = ctx;
+	sprec_listen_buffer *buf;
+	sprec_encoder *enc;
+	sprec_utterance utt;
+	const void *flac;
+	size_t size;
+
+	/*
+	 * Everything here is done on behalf of the caller of sprec_listen()
+	 */
+	sprec_set_thread_allocator(&l->alloc);
+
+	enc = sprec_encoder_new();
+
+	for (;;) {
+		pthread_mutex_lock(&l->lock);
+
+		while (l->count == 0 && !l->stopping && !l->warm) {
+			pthread_cond_wait(&l->cond, &l->lock);
+		}
+
+		/*
+		 * Speech has started: connect now, unless the requests
+		 * go through a pool, which keeps connections of its own
+		 */
+		if (l->warm) {
+			l->warm = 0;
+			pthread_mutex_unlock(&l->lock);
+
+			if (!l->has_send || l->send.pool == NULL) {
+				sprec_warm_up();
+			}
+			continue;
+		}
+
+		if (l->count == 0) {
+			pthread_mutex_unlock(&l->lock);
+			break;
+		}
+
+		buf = l->queue[l->head];
+		l->head = (l->head + 1) % l->queue_length;
+		l->count--;
+
+		pthread_mutex_unlock(&l->lock);
+
+		utt.start = (double)buf->start / l->rate;
+		utt.end = (double)(buf->start + buf->frames) / l->rate;
+		utt.resp = NULL;
+		sprec_level_meter_read(&buf->meter, &utt.levels);
+		utt.rejected = l->has_reject && !sprec_levels_acceptable(&utt.levels, &l->reject);
+
+		if (!utt.rejected && enc != NULL && sprec_encoder_encode_pcm_ex(
+			enc,
+			buf->data,
+			buf->frames,
+			l->rate,
+			l->channels,
+			l->fmt,
+			&flac,
+			&size
+		) == 0) {
+			utt.resp = sprec_send_audio_data_ex(
+				flac,
+				size,
+				l->apikey,
+				l->language,
+				l->rate,
+				l->has_send ? &l->send : NULL
+			);
+		}
+
+		if (l->cb != NULL) {
+			l->cb(&utt, l->ctx);
+		}
+
+		sprec_free_response(utt.resp);
+
+		pthread_mutex_lock(&l->lock);
+		buf->frames = 0;
+		sprec_level_meter_reset(&buf->meter);
+		l->spare[l->nspare++] = buf;
+		pthread_mutex_unlock(&l->lock);
+	}
+
+	sprec_encoder_free(enc);
+
+	return NULL;
+}
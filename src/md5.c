@@ -0,0 +1,148 @@
+/*
+ * md5.c
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#include <string.h>
+#include "md5.h"
+
+/*
+ * Shift amounts and sines of RFC 1321, round after round
+ */
+static const unsigned sprec_md5_shift[64] = {
+	7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+	5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20,
+	4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+	6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+};
+
+static const uint32_t sprec_md5_sine[64] = {
+	0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee,
+	0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+	0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be,
+	0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+	0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa,
+	0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+	0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed,
+	0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+	0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c,
+	0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+	0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05,
+	0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+	0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039,
+	0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+	0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1,
+	0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+};
+
+static void sprec_md5_block(uint32_t state[4], const unsigned char *p)
+{
+	uint32_t m[16], a, b, c, d, f, tmp;
+	unsigned i, g;
+
+	for (i = 0; i < 16; i++) {
+		m[i] = (uint32_t)p[4 * i]
+		     | (uint32_t)p[4 * i + 1] << 8
+		     | (uint32_t)p[4 * i + 2] << 16
+		     | (uint32_t)p[4 * i + 3] << 24;
+	}
+
+	a = state[0];
+	b = state[1];
+	c = state[2];
+	d = state[3];
+
+	for (i = 0; i < 64; i++) {
+		switch (i / 16) {
+		case 0:
+			f = (b & c) | (~b & d);
+			g = i;
+			break;
+		case 1:
+			f = (d & b) | (~d & c);
+			g = (5 * i + 1) % 16;
+			break;
+		case 2:
+			f = b ^ c ^ d;
+			g = (3 * i + 5) % 16;
+			break;
+		default:
+			f = c ^ (b | ~d);
+			g = (7 * i) % 16;
+			break;
+		}
+
+		tmp = d;
+		d = c;
+		c = b;
+		f += a + sprec_md5_sine[i] + m[g];
+		b += (f << sprec_md5_shift[i]) | (f >> (32 - sprec_md5_shift[i]));
+		a = tmp;
+	}
+
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+}
+
+void sprec_md5_init(sprec_md5 *md5)
+{
+	md5->state[0] = 0x67452301;
+	md5->state[1] = 0xefcdab89;
+	md5->state[2] = 0x98badcfe;
+	md5->state[3] = 0x10325476;
+	md5->length = 0;
+}
+
+void sprec_md5_update(sprec_md5 *md5, const void *data, size_t length)
+{
+	const unsigned char *p = data;
+	size_t used = md5->length % 64, n;
+
+	md5->length += length;
+
+	if (used > 0) {
+		n = 64 - used < length ? 64 - used : length;
+		memcpy(md5->buffer + used, p, n);
+		p += n;
+		length -= n;
+
+		if (used + n < 64) {
+			return;
+		}
+
+		sprec_md5_block(md5->state, md5->buffer);
+	}
+
+	for (; length >= 64; p += 64, length -= 64) {
+		sprec_md5_block(md5->state, p);
+	}
+
+	memcpy(md5->buffer, p, length);
+}
+
+void sprec_md5_final(sprec_md5 *md5, unsigned char digest[16])
+{
+	static const unsigned char padding[64] = { 0x80 };
+	unsigned char bits[8];
+	uint64_t length = md5->length * 8;
+	size_t used = md5->length % 64;
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		bits[i] = length >> (8 * i);
+	}
+
+	/*
+	 * Pad to 56 bytes into a block, then the length in bits
+	 */
+	sprec_md5_update(md5, padding, used < 56 ? 56 - used : 120 - used);
+	sprec_md5_update(md5, bits, 8);
+
+	for (i = 0; i < 16; i++) {
+		digest[i] = md5->state[i / 4] >> (8 * (i % 4));
+	}
+}
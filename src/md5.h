@@ -0,0 +1,30 @@
+/*
+ * md5.h
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#ifndef __SPREC_MD5_H__
+#define __SPREC_MD5_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * MD5 (RFC 1321), for the signature of the audio in the STREAMINFO
+ * block of a FLAC stream assembled by libsprec itself
+ */
+typedef struct sprec_md5 {
+	uint32_t state[4];
+	uint64_t length;		/* bytes hashed */
+	unsigned char buffer[64];	/* a partial block */
+} sprec_md5;
+
+void sprec_md5_init(sprec_md5 *md5);
+
+void sprec_md5_update(sprec_md5 *md5, const void *data, size_t length);
+
+void sprec_md5_final(sprec_md5 *md5, unsigned char digest[16]);
+
+#endif /* !__SPREC_MD5_H__ */
@@ -0,0 +1,606 @@
+/*
+ * parser.c
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#include <string.h>
+#include <sprec/parser.h>
+
+/*
+ * Lexer states
+ */
+enum {
+	P_VALUE,		/* a value is expected */
+	P_VALUE_OR_END,		/* right after '[' */
+	P_KEY,			/* after ',' in an object */
+	P_KEY_OR_END,		/* right after '{' */
+	P_COLON,		/* after an object key */
+	P_AFTER,		/* after a value inside a container */
+	P_STRING,
+	P_ESCAPE,
+	P_UNICODE,
+	P_SCALAR,		/* number, true, false or null */
+	P_ERROR
+};
+
+/*
+ * What a container means in the response schema
+ */
+enum {
+	C_NONE,
+	C_TOP,			/* {"result": ..., "result_index": ...} */
+	C_RESULTS,		/* [ result, ... ] */
+	C_RESULT,		/* {"alternative": ..., "final": ...} */
+	C_ALTS,			/* [ alternative, ... ] */
+	C_ALT			/* {"transcript": ..., "confidence": ...} */
+};
+
+static int sprec_parser_fail(sprec_parser *p);
+static int sprec_parser_step(sprec_parser *p, char c);
+static int sprec_parser_begin_value(sprec_parser *p, char c);
+static int sprec_parser_end_value(sprec_parser *p);
+static int sprec_parser_end_scalar(sprec_parser *p);
+static int sprec_parser_end_string(sprec_parser *p);
+static int sprec_parser_value_ctx(const sprec_parser *p);
+static int sprec_parser_key_is(const sprec_parser *p, const char *key);
+static void sprec_parser_put_byte(sprec_parser *p, unsigned char c);
+static void sprec_parser_put_codepoint(sprec_parser *p, unsigned long cp);
+static void sprec_parser_flush_surrogate(sprec_parser *p);
+static int sprec_parse_double(const char *s, double *out);
+
+void sprec_parser_init(sprec_parser *parser, sprec_result *result)
+{
+	memset(parser, 0, sizeof *parser);
+	memset(result, 0, sizeof *result);
+
+	parser->result = result;
+	parser->state = P_VALUE;
+}
+
+int sprec_parser_feed(sprec_parser *parser, const char *data, size_t length)
+{
+	size_t i;
+
+	if (parser->error) {
+		return -1;
+	}
+
+	for (i = 0; i < length; i++) {
+		if (sprec_parser_step(parser, data[i])) {
+			return sprec_parser_fail(parser);
+		}
+	}
+
+	return 0;
+}
+
+int sprec_parser_finish(sprec_parser *parser)
+{
+	if (parser->error) {
+		return -1;
+	}
+
+	/*
+	 * A top-level scalar is only terminated by the end of input
+	 */
+	if (parser->state == P_SCALAR && parser->depth == 0) {
+		if (sprec_parser_end_scalar(parser)) {
+			return sprec_parser_fail(parser);
+		}
+	}
+
+	if (parser->state != P_VALUE || parser->depth != 0) {
+		return sprec_parser_fail(parser);
+	}
+
+	return 0;
+}
+
+int sprec_result_parse(const char *json, size_t length, sprec_result *result)
+{
+	sprec_parser parser;
+
+	sprec_parser_init(&parser, result);
+
+	if (sprec_parser_feed(&parser, json, length)) {
+		return -1;
+	}
+
+	return sprec_parser_finish(&parser);
+}
+
+const sprec_alternative *sprec_result_best(const sprec_result *result)
+{
+	const sprec_alternative *best = NULL;
+	size_t i;
+
+	for (i = 0; i < result->count; i++) {
+		const sprec_alternative *alt = &result->alternatives[i];
+		if (best == NULL || alt->confidence > best->confidence) {
+			best = alt;
+		}
+	}
+
+	return best;
+}
+
+static int sprec_parser_fail(sprec_parser *p)
+{
+	p->error = 1;
+	p->state = P_ERROR;
+	return -1;
+}
+
+static int sprec_is_space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static int sprec_is_scalar_char(char c)
+{
+	return (c >= '0' && c <= '9')
+	    || (c >= 'a' && c <= 'z')
+	    || (c >= 'A' && c <= 'Z')
+	    || c == '-' || c == '+' || c == '.';
+}
+
+static int sprec_hex_value(char c)
+{
+	if (c >= '0' && c <= '9') {
+		return c - '0';
+	}
+
+	if (c >= 'a' && c <= 'f') {
+		return c - 'a' + 10;
+	}
+
+	if (c >= 'A' && c <= 'F') {
+		return c - 'A' + 10;
+	}
+
+	return -1;
+}
+
+static int sprec_parser_step(sprec_parser *p, char c)
+{
+	int h;
+
+	switch (p->state) {
+	case P_STRING:
+		if (c == '"') {
+			return sprec_parser_end_string(p);
+		}
+
+		if (c == '\\') {
+			p->state = P_ESCAPE;
+			return 0;
+		}
+
+		sprec_parser_flush_surrogate(p);
+		sprec_parser_put_byte(p, c);
+		return 0;
+
+	case P_ESCAPE:
+		p->state = P_STRING;
+
+		switch (c) {
+		case '"':
+		case '\\':
+		case '/':
+			break;
+		case 'b': c = '\b'; break;
+		case 'f': c = '\f'; break;
+		case 'n': c = '\n'; break;
+		case 'r': c = '\r'; break;
+		case 't': c = '\t'; break;
+		case 'u':
+			p->state = P_UNICODE;
+			p->codepoint = 0;
+			p->hexdigits = 0;
+			return 0;
+		default:
+			return -1;
+		}
+
+		sprec_parser_flush_surrogate(p);
+		sprec_parser_put_byte(p, c);
+		return 0;
+
+	case P_UNICODE:
+		h = sprec_hex_value(c);
+		if (h < 0) {
+			return -1;
+		}
+
+		p->codepoint = p->codepoint << 4 | h;
+		if (++p->hexdigits < 4) {
+			return 0;
+		}
+
+		p->state = P_STRING;
+
+		if (p->codepoint >= 0xd800 && p->codepoint <= 0xdbff) {
+			/* high surrogate, wait for its pair */
+			sprec_parser_flush_surrogate(p);
+			p->surrogate = p->codepoint;
+		} else if (p->codepoint >= 0xdc00 && p->codepoint <= 0xdfff) {
+			if (p->surrogate) {
+				sprec_parser_put_codepoint(
+					p,
+					0x10000 + ((p->surrogate - 0xd800) << 10) + (p->codepoint - 0xdc00)
+				);
+				p->surrogate = 0;
+			} else {
+				sprec_parser_put_codepoint(p, 0xfffd);
+			}
+		} else {
+			sprec_parser_flush_surrogate(p);
+			sprec_parser_put_codepoint(p, p->codepoint);
+		}
+
+		return 0;
+
+	case P_SCALAR:
+		if (sprec_is_scalar_char(c)) {
+			if (p->scalarlen >= sizeof p->scalar - 1) {
+				return -1;
+			}
+
+			p->scalar[p->scalarlen++] = c;
+			return 0;
+		}
+
+		/*
+		 * The scalar ended with this character,
+		 * which still has to be processed
+		 */
+		if (sprec_parser_end_scalar(p)) {
+			return -1;
+		}
+
+		return sprec_parser_step(p, c);
+
+	case P_ERROR:
+		return -1;
+
+	default:
+		break;
+	}
+
+	if (sprec_is_space(c)) {
+		return 0;
+	}
+
+	switch (p->state) {
+	case P_VALUE_OR_END:
+		if (c == ']') {
+			p->depth--;
+			return sprec_parser_end_value(p);
+		}
+		/* fall through */
+	case P_VALUE:
+		return sprec_parser_begin_value(p, c);
+
+	case P_KEY_OR_END:
+		if (c == '}') {
+			p->depth--;
+			return sprec_parser_end_value(p);
+		}
+		/* fall through */
+	case P_KEY:
+		if (c != '"') {
+			return -1;
+		}
+
+		p->in_key = 1;
+		p->keylen = 0;
+		p->str = NULL;
+		p->state = P_STRING;
+		return 0;
+
+	case P_COLON:
+		if (c != ':') {
+			return -1;
+		}
+
+		p->state = P_VALUE;
+		return 0;
+
+	case P_AFTER:
+		if (c == ',') {
+			p->state = p->kind[p->depth - 1] == '{' ? P_KEY : P_VALUE;
+			return 0;
+		}
+
+		if ((c == '}' && p->kind[p->depth - 1] == '{')
+		 || (c == ']' && p->kind[p->depth - 1] == '[')) {
+			p->depth--;
+			return sprec_parser_end_value(p);
+		}
+
+		return -1;
+
+	default:
+		return -1;
+	}
+}
+
+static int sprec_parser_begin_value(sprec_parser *p, char c)
+{
+	int ctx = sprec_parser_value_ctx(p);
+	sprec_result *res = p->result;
+
+	switch (c) {
+	case '{':
+	case '[':
+		if (p->depth >= SPREC_PARSER_MAX_DEPTH) {
+			return -1;
+		}
+
+		if (c == '{' && ctx == C_ALT) {
+			if (res->count < SPREC_MAX_ALTERNATIVES) {
+				p->alt = &res->alternatives[res->count++];
+				p->alt->transcript[0] = '\0';
+				p->alt->confidence = -1.0;
+			} else {
+				p->alt = NULL;
+				res->truncated = 1;
+			}
+		}
+
+		p->kind[p->depth] = c;
+		p->ctx[p->depth] = ctx;
+		p->depth++;
+		p->state = c == '{' ? P_KEY_OR_END : P_VALUE_OR_END;
+		return 0;
+
+	case '"':
+		p->in_key = 0;
+		p->str = NULL;
+		p->strlen = 0;
+
+		if (p->depth > 0
+		 && p->ctx[p->depth - 1] == C_ALT
+		 && p->alt != NULL
+		 && sprec_parser_key_is(p, "transcript")) {
+			p->str = p->alt->transcript;
+			p->strcap = sizeof p->alt->transcript;
+		}
+
+		p->state = P_STRING;
+		return 0;
+
+	default:
+		if (!sprec_is_scalar_char(c)) {
+			return -1;
+		}
+
+		p->scalar[0] = c;
+		p->scalarlen = 1;
+		p->state = P_SCALAR;
+		return 0;
+	}
+}
+
+static int sprec_parser_end_value(sprec_parser *p)
+{
+	p->state = p->depth > 0 ? P_AFTER : P_VALUE;
+	return 0;
+}
+
+static int sprec_parser_end_scalar(sprec_parser *p)
+{
+	int parent = p->depth > 0 ? p->ctx[p->depth - 1] : C_NONE;
+	const char *s = p->scalar;
+	double num;
+
+	p->scalar[p->scalarlen] = '\0';
+
+	if (strcmp(s, "true") == 0 || strcmp(s, "false") == 0) {
+		if (parent == C_RESULT && sprec_parser_key_is(p, "final")) {
+			p->result->final = s[0] == 't';
+		}
+	} else if (strcmp(s, "null") != 0) {
+		if (sprec_parse_double(s, &num)) {
+			return -1;
+		}
+
+		if (parent == C_ALT && p->alt != NULL && sprec_parser_key_is(p, "confidence")) {
+			p->alt->confidence = num;
+		} else if (parent == C_TOP && sprec_parser_key_is(p, "result_index")) {
+			p->result->result_index = (int)num;
+		}
+	}
+
+	return sprec_parser_end_value(p);
+}
+
+static int sprec_parser_end_string(sprec_parser *p)
+{
+	size_t i, need;
+	unsigned char lead;
+
+	sprec_parser_flush_surrogate(p);
+
+	if (p->in_key) {
+		p->state = P_COLON;
+		return 0;
+	}
+
+	if (p->str != NULL) {
+		/*
+		 * If the value was truncated, don't leave a partial
+		 * UTF-8 sequence dangling at the end
+		 */
+		if (p->strlen == p->strcap - 1) {
+			i = p->strlen;
+			while (i > 0 && ((unsigned char)p->str[i - 1] & 0xc0) == 0x80 && p->strlen - i < 3) {
+				i--;
+			}
+
+			if (i > 0) {
+				lead = p->str[i - 1];
+				need = lead >= 0xf0 ? 4 : lead >= 0xe0 ? 3 : lead >= 0xc0 ? 2 : 1;
+				if (p->strlen - (i - 1) < need) {
+					p->strlen = i - 1;
+				}
+			}
+		}
+
+		p->str[p->strlen] = '\0';
+		p->str = NULL;
+	}
+
+	return sprec_parser_end_value(p);
+}
+
+static int sprec_parser_value_ctx(const sprec_parser *p)
+{
+	if (p->depth == 0) {
+		return C_TOP;
+	}
+
+	switch (p->ctx[p->depth - 1]) {
+	case C_TOP:
+		return sprec_parser_key_is(p, "result") ? C_RESULTS : C_NONE;
+	case C_RESULTS:
+		return C_RESULT;
+	case C_RESULT:
+		return sprec_parser_key_is(p, "alternative") ? C_ALTS : C_NONE;
+	case C_ALTS:
+		return C_ALT;
+	default:
+		return C_NONE;
+	}
+}
+
+static int sprec_parser_key_is(const sprec_parser *p, const char *key)
+{
+	size_t len = strlen(key);
+	return p->kind[p->depth - 1] == '{'
+	    && p->keylen == len
+	    && memcmp(p->key, key, len) == 0;
+}
+
+static void sprec_parser_put_byte(sprec_parser *p, unsigned char c)
+{
+	if (p->in_key) {
+		/*
+		 * Keys we care about are short; an overlong key
+		 * gets an impossible length so it never matches.
+		 */
+		if (p->keylen < sizeof p->key) {
+			p->key[p->keylen] = c;
+		}
+
+		if (p->keylen <= sizeof p->key) {
+			p->keylen++;
+		}
+
+		return;
+	}
+
+	if (p->str == NULL) {
+		return;
+	}
+
+	if (p->strlen < p->strcap - 1) {
+		p->str[p->strlen++] = c;
+	} else {
+		p->result->truncated = 1;
+	}
+}
+
+static void sprec_parser_put_codepoint(sprec_parser *p, unsigned long cp)
+{
+	if (cp < 0x80) {
+		sprec_parser_put_byte(p, cp);
+	} else if (cp < 0x800) {
+		sprec_parser_put_byte(p, 0xc0 | cp >> 6);
+		sprec_parser_put_byte(p, 0x80 | (cp & 0x3f));
+	} else if (cp < 0x10000) {
+		sprec_parser_put_byte(p, 0xe0 | cp >> 12);
+		sprec_parser_put_byte(p, 0x80 | (cp >> 6 & 0x3f));
+		sprec_parser_put_byte(p, 0x80 | (cp & 0x3f));
+	} else {
+		sprec_parser_put_byte(p, 0xf0 | cp >> 18);
+		sprec_parser_put_byte(p, 0x80 | (cp >> 12 & 0x3f));
+		sprec_parser_put_byte(p, 0x80 | (cp >> 6 & 0x3f));
+		sprec_parser_put_byte(p, 0x80 | (cp & 0x3f));
+	}
+}
+
+static void sprec_parser_flush_surrogate(sprec_parser *p)
+{
+	/*
+	 * An unpaired high surrogate becomes U+FFFD
+	 */
+	if (p->surrogate) {
+		p->surrogate = 0;
+		sprec_parser_put_codepoint(p, 0xfffd);
+	}
+}
+
+/*
+ * strtod() honors LC_NUMERIC, which may have been changed by the host
+ * application, so we parse JSON numbers ourselves.
+ */
+static int sprec_parse_double(const char *s, double *out)
+{
+	double val = 0.0, scale = 1.0;
+	int sign = 1, esign = 1, exp = 0, digits = 0;
+
+	if (*s == '-') {
+		sign = -1;
+		s++;
+	}
+
+	while (*s >= '0' && *s <= '9') {
+		val = val * 10.0 + (*s++ - '0');
+		digits++;
+	}
+
+	if (*s == '.') {
+		s++;
+		while (*s >= '0' && *s <= '9') {
+			scale /= 10.0;
+			val += (*s++ - '0') * scale;
+			digits++;
+		}
+	}
+
+	if (digits == 0) {
+		return -1;
+	}
+
+	if (*s == 'e' || *s == 'E') {
+		s++;
+		if (*s == '+' || *s == '-') {
+			esign = *s++ == '-' ? -1 : 1;
+		}
+
+		if (*s < '0' || *s > '9') {
+			return -1;
+		}
+
+		while (*s >= '0' && *s <= '9') {
+			if (exp < 400) {
+				exp = exp * 10 + (*s - '0');
+			}
+			s++;
+		}
+
+		while (exp-- > 0) {
+			val = esign > 0 ? val * 10.0 : val / 10.0;
+		}
+	}
+
+	if (*s != '\0') {
+		return -1;
+	}
+
+	*out = sign * val;
+	return 0;
+}
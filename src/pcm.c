@@ -0,0 +1,369 @@
+/*
+ * pcm.c
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#include <string.h>
+#include <math.h>
+#include <sprec/pcm.h>
+
+#if defined __SSE2__
+	#include <emmintrin.h>
+#endif
+
+/*
+ * The SIMD and the scalar code produce exactly the same output: both
+ * compute in single precision, round to nearest, and sample `i' of
+ * a call always takes its dither noise from generator `i % 4'.
+ */
+
+/*
+ * Input scale factors to 16 bit units
+ */
+#define SCALE_S24 (1.0f / 256.0f)
+#define SCALE_S32 (1.0f / 65536.0f)
+#define SCALE_F32 32768.0f
+
+/*
+ * Little endian readers. Shifting into the sign bit is UB,
+ * so the unsigned value is memcpy()'d into the signed one.
+ */
+static int32_t sprec_read_s16(const unsigned char *p)
+{
+	uint16_t u = (uint16_t)(p[0] | p[1] << 8);
+	int16_t s;
+
+	memcpy(&s, &u, sizeof s);
+	return s;
+}
+
+static int32_t sprec_read_s24(const unsigned char *p)
+{
+	uint32_t u = (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16;
+
+	/* sign-extend */
+	return (int32_t)(u ^ 0x800000) - 0x800000;
+}
+
+static int32_t sprec_read_s32(const unsigned char *p)
+{
+	uint32_t u = (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+	int32_t s;
+
+	memcpy(&s, &u, sizeof s);
+	return s;
+}
+
+static float sprec_read_f32(const unsigned char *p)
+{
+	uint32_t u = (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+	float f;
+
+	memcpy(&f, &u, sizeof f);
+	return f;
+}
+
+/*
+ * One step of a xorshift32 generator, as a float in [0, 1)
+ */
+static float sprec_dither_uniform(uint32_t *state)
+{
+	uint32_t x = *state;
+	float f;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+
+	x = (x >> 9) | 0x3f800000;
+	memcpy(&f, &x, sizeof f);
+
+	return f - 1.0f;
+}
+
+/*
+ * Rounds a sample in 16 bit units, with dither if `state' is not NULL
+ */
+static int32_t sprec_quantize(float f, uint32_t *state)
+{
+	/* NaN would end up as the minimum, a full scale click */
+	if (f != f) {
+		f = 0.0f;
+	}
+
+	if (state != NULL) {
+		float u1 = sprec_dither_uniform(state);
+		float u2 = sprec_dither_uniform(state);
+		f += (u1 + u2) - 1.0f;
+	}
+
+	f = f > -32768.0f ? f : -32768.0f;
+	f = f < 32767.0f ? f : 32767.0f;
+
+	return (int32_t)lrintf(f);
+}
+
+static void sprec_convert_scalar(
+	const unsigned char *src,
+	sprec_pcm_format fmt,
+	size_t start,
+	size_t end,
+	int32_t *dst,
+	sprec_dither *dither
+)
+{
+	size_t i;
+	float f;
+
+	for (i = start; i < end; i++) {
+		switch (fmt) {
+		case SPREC_PCM_U8:
+			dst[i] = (int32_t)src[i] - 128;
+			continue;
+		case SPREC_PCM_S16LE:
+			dst[i] = sprec_read_s16(src + 2 * i);
+			continue;
+		case SPREC_PCM_S24LE:
+			f = (float)sprec_read_s24(src + 3 * i) * SCALE_S24;
+			break;
+		case SPREC_PCM_S32LE:
+			f = (float)sprec_read_s32(src + 4 * i) * SCALE_S32;
+			break;
+		case SPREC_PCM_F32LE:
+		default:
+			f = sprec_read_f32(src + 4 * i) * SCALE_F32;
+			break;
+		}
+
+		dst[i] = sprec_quantize(f, dither != NULL ? &dither->state[i & 3] : NULL);
+	}
+}
+
+#if defined __SSE2__
+
+static __m128 sprec_dither_uniform4(__m128i *state)
+{
+	__m128i x = *state;
+
+	x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+	x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+	x = _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+	*state = x;
+
+	x = _mm_or_si128(_mm_srli_epi32(x, 9), _mm_set1_epi32(0x3f800000));
+
+	return _mm_sub_ps(_mm_castsi128_ps(x), _mm_set1_ps(1.0f));
+}
+
+static __m128i sprec_quantize4(__m128 f, __m128i *state)
+{
+	/* NaN to 0, as in sprec_quantize() */
+	f = _mm_and_ps(f, _mm_cmpord_ps(f, f));
+
+	if (state != NULL) {
+		__m128 u1 = sprec_dither_uniform4(state);
+		__m128 u2 = sprec_dither_uniform4(state);
+		f = _mm_add_ps(f, _mm_sub_ps(_mm_add_ps(u1, u2), _mm_set1_ps(1.0f)));
+	}
+
+	f = _mm_max_ps(f, _mm_set1_ps(-32768.0f));
+	f = _mm_min_ps(f, _mm_set1_ps(32767.0f));
+
+	return _mm_cvtps_epi32(f);
+}
+
+/*
+ * Converts as many samples as it can in whole vectors.
+ * Returns the number of samples converted.
+ */
+static size_t sprec_convert_sse2(
+	const unsigned char *src,
+	sprec_pcm_format fmt,
+	size_t nsamples,
+	int32_t *dst,
+	sprec_dither *dither
+)
+{
+	__m128i state, *pstate = NULL;
+	__m128i v, lo, hi;
+	__m128 f;
+	size_t i = 0;
+
+	if (dither != NULL) {
+		state = _mm_loadu_si128((const __m128i *)dither->state);
+		pstate = &state;
+	}
+
+	switch (fmt) {
+	case SPREC_PCM_U8:
+		for (; i + 16 <= nsamples; i += 16) {
+			v = _mm_loadu_si128((const __m128i *)(src + i));
+			lo = _mm_sub_epi16(_mm_unpacklo_epi8(v, _mm_setzero_si128()), _mm_set1_epi16(128));
+			hi = _mm_sub_epi16(_mm_unpackhi_epi8(v, _mm_setzero_si128()), _mm_set1_epi16(128));
+			_mm_storeu_si128((__m128i *)(dst + i), _mm_srai_epi32(_mm_unpacklo_epi16(lo, lo), 16));
+			_mm_storeu_si128((__m128i *)(dst + i + 4), _mm_srai_epi32(_mm_unpackhi_epi16(lo, lo), 16));
+			_mm_storeu_si128((__m128i *)(dst + i + 8), _mm_srai_epi32(_mm_unpacklo_epi16(hi, hi), 16));
+			_mm_storeu_si128((__m128i *)(dst + i + 12), _mm_srai_epi32(_mm_unpackhi_epi16(hi, hi), 16));
+		}
+		break;
+	case SPREC_PCM_S16LE:
+		for (; i + 8 <= nsamples; i += 8) {
+			v = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+			_mm_storeu_si128((__m128i *)(dst + i), _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+			_mm_storeu_si128((__m128i *)(dst + i + 4), _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16));
+		}
+		break;
+	case SPREC_PCM_S24LE:
+		/* no byte shuffle in SSE2; gather the samples one by one */
+		for (; i + 4 <= nsamples; i += 4) {
+			const unsigned char *p = src + 3 * i;
+			v = _mm_set_epi32(sprec_read_s24(p + 9), sprec_read_s24(p + 6), sprec_read_s24(p + 3), sprec_read_s24(p));
+			f = _mm_mul_ps(_mm_cvtepi32_ps(v), _mm_set1_ps(SCALE_S24));
+			_mm_storeu_si128((__m128i *)(dst + i), sprec_quantize4(f, pstate));
+		}
+		break;
+	case SPREC_PCM_S32LE:
+		for (; i + 4 <= nsamples; i += 4) {
+			v = _mm_loadu_si128((const __m128i *)(src + 4 * i));
+			f = _mm_mul_ps(_mm_cvtepi32_ps(v), _mm_set1_ps(SCALE_S32));
+			_mm_storeu_si128((__m128i *)(dst + i), sprec_quantize4(f, pstate));
+		}
+		break;
+	case SPREC_PCM_F32LE:
+		for (; i + 4 <= nsamples; i += 4) {
+			f = _mm_mul_ps(_mm_loadu_ps((const float *)(src + 4 * i)), _mm_set1_ps(SCALE_F32));
+			_mm_storeu_si128((__m128i *)(dst + i), sprec_quantize4(f, pstate));
+		}
+		break;
+	}
+
+	if (dither != NULL) {
+		_mm_storeu_si128((__m128i *)dither->state, state);
+	}
+
+	return i;
+}
+
+#endif /* __SSE2__ */
+
+size_t sprec_pcm_sample_size(sprec_pcm_format fmt)
+{
+	switch (fmt) {
+	case SPREC_PCM_U8:	return 1;
+	case SPREC_PCM_S16LE:	return 2;
+	case SPREC_PCM_S24LE:	return 3;
+	case SPREC_PCM_S32LE:	return 4;
+	case SPREC_PCM_F32LE:	return 4;
+	}
+
+	return 0;
+}
+
+uint32_t sprec_pcm_output_bps(sprec_pcm_format fmt)
+{
+	return fmt == SPREC_PCM_U8 ? 8 : 16;
+}
+
+int sprec_pcm_format_from_bps(uint32_t bps, sprec_pcm_format *fmt)
+{
+	switch (bps) {
+	case 8:		*fmt = SPREC_PCM_U8; return 0;
+	case 16:	*fmt = SPREC_PCM_S16LE; return 0;
+	case 24:	*fmt = SPREC_PCM_S24LE; return 0;
+	case 32:	*fmt = SPREC_PCM_S32LE; return 0;
+	}
+
+	return -1;
+}
+
+int sprec_pcm_format_from_wav(const sprec_wav_header *hdr, sprec_pcm_format *fmt)
+{
+	if (hdr->format_type == WAVE_FORMAT_IEEE_FLOAT) {
+		if (hdr->bits_per_sample != 32) {
+			return -1;
+		}
+
+		*fmt = SPREC_PCM_F32LE;
+		return 0;
+	}
+
+	if (hdr->format_type != WAVE_FORMAT_PCM) {
+		return -1;
+	}
+
+	return sprec_pcm_format_from_bps(hdr->bits_per_sample, fmt);
+}
+
+void sprec_dither_init(sprec_dither *dither, uint32_t seed)
+{
+	uint32_t x = seed, z;
+	int i;
+
+	/*
+	 * Spread the seed over the generators (splitmix-like);
+	 * xorshift gets stuck at 0, so avoid that
+	 */
+	for (i = 0; i < 4; i++) {
+		x += 0x9e3779b9;
+		z = (x ^ (x >> 16)) * 0x85ebca6b;
+		z = (z ^ (z >> 13)) * 0xc2b2ae35;
+		z ^= z >> 16;
+
+		dither->state[i] = z != 0 ? z : 0x6d2b79f5;
+	}
+}
+
+void sprec_pcm_convert(
+	const void *src,
+	sprec_pcm_format fmt,
+	size_t nsamples,
+	int32_t *dst,
+	sprec_dither *dither
+)
+{
+	size_t done = 0;
+
+#if defined __SSE2__
+	done = sprec_convert_sse2(src, fmt, nsamples, dst, dither);
+#endif
+
+	sprec_convert_scalar(src, fmt, done, nsamples, dst, dither);
+}
+
+float sprec_pcm_sample(const void *src, sprec_pcm_format fmt, size_t index)
+{
+	const unsigned char *p = src;
+	float f;
+
+	switch (fmt) {
+	case SPREC_PCM_U8:
+		return (p[index] - 128) / 128.0f;
+	case SPREC_PCM_S16LE:
+		return sprec_read_s16(p + 2 * index) / 32768.0f;
+	case SPREC_PCM_S24LE:
+		return sprec_read_s24(p + 3 * index) / 8388608.0f;
+	case SPREC_PCM_S32LE:
+		return sprec_read_s32(p + 4 * index) / 2147483648.0f;
+	case SPREC_PCM_F32LE:
+		f = sprec_read_f32(p + 4 * index);
+		return f == f ? f : 0.0f;
+	}
+
+	return 0.0f;
+}
+
+double sprec_pcm_power(const void *src, sprec_pcm_format fmt, size_t nsamples)
+{
+	double sum = 0.0, x;
+	size_t i;
+
+	for (i = 0; i < nsamples; i++) {
+		x = sprec_pcm_sample(src, fmt, i);
+		sum += x * x;
+	}
+
+	return nsamples ? sum / nsamples : 0.0;
+}
@@ -0,0 +1,276 @@
+/*
+ * pool.c
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <curl/curl.h>
+#include <sprec/pool.h>
+#include <sprec/alloc.h>
+#include "request.h"
+
+/*
+ * Without curl_multi_wakeup() (libcurl < 7.68.0), this is how long
+ * a new request may wait for the thread to notice it, in ms
+ */
+#define SPREC_POOL_POLL_INTERVAL 20
+
+/*
+ * A request submitted to the pool. It lives on the stack of the
+ * sending thread, which waits for `finished' before returning.
+ */
+typedef struct sprec_pool_job {
+	sprec_request req;
+	int finished;
+	struct sprec_pool_job *next;
+} sprec_pool_job;
+
+struct sprec_http_pool {
+	sprec_allocator alloc;
+	sprec_http_options opts;
+	int multiplex;
+	CURLM *multi;
+	pthread_mutex_t lock;
+	pthread_cond_t done;
+	sprec_pool_job *queue;	/* submitted, not yet added to `multi' */
+	sprec_pool_job *queue_tail;
+	int shutdown;
+	pthread_t thread;
+};
+
+static void *sprec_http_pool_thread(void *arg);
+
+void sprec_http_options_init(sprec_http_options *opts)
+{
+	opts->http2 = 1;
+	opts->max_streams = 100;
+	opts->max_connections = 4;
+}
+
+sprec_http_pool *sprec_http_pool_new(const sprec_http_options *opts)
+{
+	sprec_http_pool *pool;
+	sprec_allocator alloc;
+
+	sprec_get_allocator(&alloc);
+
+	pool = sprec_allocator_calloc(&alloc, 1, sizeof *pool);
+	if (pool == NULL) {
+		return NULL;
+	}
+
+	pool->alloc = alloc;
+
+	if (opts != NULL) {
+		pool->opts = *opts;
+	} else {
+		sprec_http_options_init(&pool->opts);
+	}
+
+	pool->multi = curl_multi_init();
+	if (pool->multi == NULL) {
+		sprec_allocator_free(&alloc, pool);
+		return NULL;
+	}
+
+	pool->multiplex = pool->opts.http2 && sprec_http2_available();
+	if (pool->multiplex) {
+		sprec_multi_use_http2(pool->multi, pool->opts.max_streams, pool->opts.max_connections);
+	} else if (pool->opts.max_connections > 0) {
+		curl_multi_setopt(pool->multi, CURLMOPT_MAX_HOST_CONNECTIONS, pool->opts.max_connections);
+	}
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->done, NULL);
+
+	if (pthread_create(&pool->thread, NULL, sprec_http_pool_thread, pool) != 0) {
+		pthread_cond_destroy(&pool->done);
+		pthread_mutex_destroy(&pool->lock);
+		curl_multi_cleanup(pool->multi);
+		sprec_allocator_free(&alloc, pool);
+		return NULL;
+	}
+
+	return pool;
+}
+
+static void sprec_http_pool_wake(sprec_http_pool *pool)
+{
+#if LIBCURL_VERSION_NUM >= 0x074400
+	curl_multi_wakeup(pool->multi);
+#endif
+}
+
+void sprec_http_pool_free(sprec_http_pool *pool)
+{
+	sprec_allocator alloc;
+
+	if (pool == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	pool->shutdown = 1;
+	pthread_mutex_unlock(&pool->lock);
+
+	sprec_http_pool_wake(pool);
+	pthread_join(pool->thread, NULL);
+
+	curl_multi_cleanup(pool->multi);
+	pthread_cond_destroy(&pool->done);
+	pthread_mutex_destroy(&pool->lock);
+
+	alloc = pool->alloc;
+	sprec_allocator_free(&alloc, pool);
+}
+
+int sprec_http_pool_multiplexing(const sprec_http_pool *pool)
+{
+	return pool->multiplex;
+}
+
+sprec_server_response *sprec_http_pool_send(
+	sprec_http_pool *pool,
+	const void *data,
+	size_t length,
+	const char *apikey,
+	const char *language,
+	uint32_t sample_rate
+)
+{
+	return sprec_http_pool_send_ex(pool, data, length, apikey, language, sample_rate, SPREC_ENCODING_FLAC, NULL);
+}
+
+sprec_server_response *sprec_http_pool_send_ex(
+	sprec_http_pool *pool,
+	const void *data,
+	size_t length,
+	const char *apikey,
+	const char *language,
+	uint32_t sample_rate,
+	sprec_audio_encoding encoding,
+	sprec_send_stats *stats
+)
+{
+	sprec_server_response *resp;
+	sprec_pool_job job;
+
+	memset(&job, 0, sizeof job);
+
+	/*
+	 * The request is set up (and its response allocated) here,
+	 * only the transfer itself happens on the pool's thread
+	 */
+	if (sprec_request_init_ex(&job.req, data, length, apikey, language, sample_rate, encoding) != 0) {
+		return NULL;
+	}
+
+	if (pool->multiplex) {
+		sprec_request_use_http2(&job.req);
+	}
+
+	curl_easy_setopt(job.req.conn_hndl, CURLOPT_PRIVATE, (char *)&job);
+
+	pthread_mutex_lock(&pool->lock);
+
+	if (pool->queue_tail != NULL) {
+		pool->queue_tail->next = &job;
+	} else {
+		pool->queue = &job;
+	}
+	pool->queue_tail = &job;
+
+	pthread_mutex_unlock(&pool->lock);
+
+	sprec_http_pool_wake(pool);
+
+	pthread_mutex_lock(&pool->lock);
+	while (!job.finished) {
+		pthread_cond_wait(&pool->done, &pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	resp = sprec_request_finish(&job.req);
+	sprec_request_stats(&job.req, length, stats);
+
+	return resp;
+}
+
+static void sprec_http_pool_complete(sprec_http_pool *pool, sprec_pool_job *job, int done, CURLcode result)
+{
+	job->req.done = done;
+	job->req.result = result;
+
+	pthread_mutex_lock(&pool->lock);
+	job->finished = 1;
+	pthread_cond_broadcast(&pool->done);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+static void *sprec_http_pool_thread(void *arg)
+{
+	sprec_http_pool *pool = arg;
+	sprec_pool_job *job, *next;
+	CURLMsg *msg;
+	int running, left;
+
+	sprec_set_thread_allocator(&pool->alloc);
+
+	for (;;) {
+		pthread_mutex_lock(&pool->lock);
+
+		if (pool->shutdown) {
+			pthread_mutex_unlock(&pool->lock);
+			break;
+		}
+
+		job = pool->queue;
+		pool->queue = NULL;
+		pool->queue_tail = NULL;
+
+		pthread_mutex_unlock(&pool->lock);
+
+		for (; job != NULL; job = next) {
+			next = job->next;
+
+			if (curl_multi_add_handle(pool->multi, job->req.conn_hndl) != CURLM_OK) {
+				sprec_http_pool_complete(pool, job, 0, CURLE_FAILED_INIT);
+			}
+		}
+
+		curl_multi_perform(pool->multi, &running);
+
+		while ((msg = curl_multi_info_read(pool->multi, &left)) != NULL) {
+			char *priv = NULL;
+			CURL *easy;
+			CURLcode result;
+
+			if (msg->msg != CURLMSG_DONE) {
+				continue;
+			}
+
+			/* `msg' is freed along with the handle's state in the multi */
+			easy = msg->easy_handle;
+			result = msg->data.result;
+
+			curl_easy_getinfo(easy, CURLINFO_PRIVATE, &priv);
+			job = (sprec_pool_job *)priv;
+
+			/* the handle must be out of the multi before `job' is finished */
+			curl_multi_remove_handle(pool->multi, easy);
+			sprec_http_pool_complete(pool, job, 1, result);
+		}
+
+#if LIBCURL_VERSION_NUM >= 0x074400
+		curl_multi_poll(pool->multi, NULL, 0, 1000, NULL);
+#else
+		curl_multi_wait(pool->multi, NULL, 0, SPREC_POOL_POLL_INTERVAL, NULL);
+#endif
+	}
+
+	return NULL;
+}
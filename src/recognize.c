@@ -11,27 +11,52 @@
 #include <unistd.h>
 #include <pthread.h>
 #include <sprec/wav.h>
+#include <sprec/alloc.h>
 #include <sprec/flac_encoder.h>
 #include <sprec/web_client.h>
 #include <sprec/recognize.h>
+#include <sprec/init.h>
+#include <sprec/budget.h>
+
+/*
+ * Number of idle encoder contexts kept for reuse by the recognizer
+ */
+#define ENCODER_POOL_SIZE 8
 
 struct sprec_recattr_internal {
+	sprec_allocator alloc;	/* the caller's, for freeing the context */
 	char *apikey;
 	char *language;
 	double duration;
+	int priority;
 	sprec_callback callback;
 	void *userdata;
 };
 
 void *sprec_pthread_fn(void *ctx);
 
+static pthread_once_t sprec_encoder_pool_once = PTHREAD_ONCE_INIT;
+static sprec_encoder_pool *sprec_shared_encoder_pool;
+
+static void sprec_encoder_pool_setup(void)
+{
+	sprec_shared_encoder_pool = sprec_encoder_pool_new(ENCODER_POOL_SIZE);
+}
+
 char *sprec_recognize_sync(const char *apikey, const char *lang, double dur_s)
+{
+	return sprec_recognize_sync_ex(apikey, lang, dur_s, 0);
+}
+
+char *sprec_recognize_sync_ex(const char *apikey, const char *lang, double dur_s, int priority)
 {
 	struct sprec_wav_header *hdr;
-	sprec_server_response *resp;
-	int err;
+	sprec_server_response *resp = NULL;
+	sprec_encoder *enc = NULL;
+	sprec_reservation res;
+	const void *buf;
 	size_t len;
-	char *text, *tmpstub, *buf;
+	char *text = NULL, *tmpstub;
 	char wavfile[L_tmpnam + 5];
 
 
@@ -46,43 +71,72 @@ char *sprec_recognize_sync(const char *apikey, const char *lang, double dur_s)
 		return NULL;
 	}
 
-	err = sprec_record_wav(wavfile, hdr, 1000 * dur_s);
-	if (err != 0) {
-		free(hdr);
+	/*
+	 * Wait for (or give up on) memory before recording,
+	 * not with the audio already captured
+	 */
+	len = (size_t)(dur_s * hdr->bytes_per_second);
+	if (sprec_budget_reserve(&res, sprec_budget_estimate(len), priority) != 0) {
+		sprec_free(hdr);
 		return NULL;
 	}
 
+	/*
+	 * Connect while recording, not after it
+	 */
+	sprec_warm_up();
+
+	if (sprec_record_wav(wavfile, hdr, 1000 * dur_s) != 0 || sprec_reservation_shed(&res)) {
+		goto out;
+	}
+
 
 	/*
-	 * Convert the WAV file to FLAC data...
+	 * Convert the WAV file to FLAC data,
+	 * using one of the shared encoder contexts...
 	 */
-	buf = sprec_flac_encode(wavfile, &len);
-	if (buf == NULL) {
-		free(hdr);
-		return NULL;
+	pthread_once(&sprec_encoder_pool_once, sprec_encoder_pool_setup);
+	if (sprec_shared_encoder_pool == NULL) {
+		goto out;
+	}
+
+	enc = sprec_encoder_pool_acquire(sprec_shared_encoder_pool);
+	if (enc == NULL) {
+		goto out;
+	}
+
+	if (sprec_encoder_encode_file(enc, wavfile, &buf, &len) != 0 || sprec_reservation_shed(&res)) {
+		goto out;
 	}
 
 	/*
 	 * ...and send it to Google
 	 */
 	resp = sprec_send_audio_data(buf, len, apikey, lang, hdr->sample_rate);
-	free(buf);
-	free(hdr);
-
 	if (resp == NULL) {
-		return NULL;
+		goto out;
 	}
 
 	/*
 	 * Get the JSON from the response object,
 	 * then parse it to get the actual text and confidence
 	 */
-	text = strdup(resp->data);
+	text = sprec_strdup(resp->data);
+
+out:
 	sprec_free_response(resp);
 
+	if (enc != NULL) {
+		sprec_encoder_pool_release(sprec_shared_encoder_pool, enc);
+	}
+
+	sprec_budget_release(&res);
+	sprec_free(hdr);
+
 	/*
 	 * Remove the temporary files in order
 	 * not fill the /tmp folder with garbage
+	 * (the recording may have failed half-way)
 	 */
 	remove(wavfile);
 
@@ -96,6 +150,18 @@ pthread_t sprec_recognize_async(
 	sprec_callback cb,
 	void *userdata
 )
+{
+	return sprec_recognize_async_ex(apikey, lang, dur_s, 0, cb, userdata);
+}
+
+pthread_t sprec_recognize_async_ex(
+	const char *apikey,
+	const char *lang,
+	double dur_s,
+	int priority,
+	sprec_callback cb,
+	void *userdata
+)
 {
 	pthread_t tid;
 	pthread_attr_t tattr;
@@ -103,46 +169,49 @@ pthread_t sprec_recognize_async(
 	struct sprec_recattr_internal *context;
 
 	/* Fill in the context structure */
-	context = malloc(sizeof *context);
+	context = sprec_malloc(sizeof *context);
 	if (context == NULL) {
 		cb(NULL, userdata);
 		return 0;
 	}
 
-	context->apikey = strdup(apikey);
+	sprec_get_allocator(&context->alloc);
+
+	context->apikey = sprec_strdup(apikey);
 	if (context->apikey == NULL) {
-		free(context);
+		sprec_free(context);
 		cb(NULL, userdata);
 		return 0;
 	}
 
-	context->language = strdup(lang);
+	context->language = sprec_strdup(lang);
 	if (context->language == NULL) {
-		free(context->apikey);
-		free(context);
+		sprec_free(context->apikey);
+		sprec_free(context);
 		cb(NULL, userdata);
 		return 0;
 	}
 
 	context->duration = dur_s;
+	context->priority = priority;
 	context->callback = cb;
 	context->userdata = userdata;
 
 	/* Create a new thread */
 	err = pthread_attr_init(&tattr);
 	if (err != 0) {
-		free(context->apikey);
-		free(context->language);
-		free(context);
+		sprec_free(context->apikey);
+		sprec_free(context->language);
+		sprec_free(context);
 		cb(NULL, userdata);
 		return 0;
 	}
 
 	err = pthread_create(&tid, &tattr, sprec_pthread_fn, context);
 	if (err != 0) {
-		free(context->apikey);
-		free(context->language);
-		free(context);
+		sprec_free(context->apikey);
+		sprec_free(context->language);
+		sprec_free(context);
 		cb(NULL, userdata);
 		return 0;
 	}
@@ -155,17 +224,24 @@ pthread_t sprec_recognize_async(
 void *sprec_pthread_fn(void *ctx)
 {
 	struct sprec_recattr_internal *context;
+	sprec_allocator alloc;
 
-	/* Use the synchronous recognition function */
+	/*
+	 * Use the synchronous recognition function.
+	 * The result is allocated and freed by this thread,
+	 * the context was allocated by the calling one.
+	 */
 	context = ctx;
-	char *res = sprec_recognize_sync(context->apikey, context->language, context->duration);
+	char *res = sprec_recognize_sync_ex(context->apikey, context->language, context->duration, context->priority);
 	/* Call the callback */
 	context->callback(res, context->userdata);
 
-	free(res);
-	free(context->apikey);
-	free(context->language);
-	free(context);
+	sprec_free(res);
+
+	alloc = context->alloc;
+	sprec_allocator_free(&alloc, context->apikey);
+	sprec_allocator_free(&alloc, context->language);
+	sprec_allocator_free(&alloc, context);
 
 	return NULL;
 }
@@ -0,0 +1,147 @@
+/*
+ * request.h
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#ifndef __SPREC_REQUEST_H__
+#define __SPREC_REQUEST_H__
+
+#include <stdint.h>
+#include <curl/curl.h>
+#include <sprec/web_client.h>
+#include <sprec/alloc.h>
+
+/*
+ * Internal: one recognition request, shared by the blocking
+ * client (web_client.c), the event-driven one (async.c) and the
+ * connection pool (pool.c).
+ */
+
+/*
+ * Where recognition requests go
+ */
+#define SPREC_API_URL "https://www.google.com/speech-api/v2/recognize"
+
+/*
+ * State of one transfer: the response being accumulated
+ * and the parser consuming it on the fly
+ */
+typedef struct sprec_transfer {
+	sprec_server_response *resp;
+	sprec_parser parser;
+	sprec_allocator alloc;	/* the response is allocated with this */
+} sprec_transfer;
+
+/*
+ * One HTTP request with everything cURL needs to perform it
+ */
+typedef struct sprec_request {
+	CURL *conn_hndl;
+	struct curl_httppost *form;
+	struct curl_slist *headers;
+	sprec_transfer transfer;
+	CURLcode result;
+	double started;
+	double uploaded;	/* when the upload was over, 0 if unknown */
+	double finished;
+	int done;
+} sprec_request;
+
+/*
+ * Sets up the cURL handle of `req' for uploading `length' bytes of
+ * FLAC audio at `data', which must stay valid until the request is
+ * finished. Returns 0 on success, non-0 on error.
+ */
+int sprec_request_init(
+	sprec_request *req,
+	const void *data,
+	size_t length,
+	const char *apikey,
+	const char *language,
+	uint32_t sample_rate
+);
+
+/*
+ * Same as sprec_request_init(), for audio in the given format
+ */
+int sprec_request_init_ex(
+	sprec_request *req,
+	const void *data,
+	size_t length,
+	const char *apikey,
+	const char *language,
+	uint32_t sample_rate,
+	sprec_audio_encoding encoding
+);
+
+/*
+ * Releases the cURL resources of the request and returns its response,
+ * or NULL (freeing the response) if the transfer itself failed.
+ * `done' and `result' must have been set, and the handle removed
+ * from any multi handle, before calling this.
+ */
+sprec_server_response *sprec_request_finish(sprec_request *req);
+
+/*
+ * Fills `stats' (if not NULL) with the timings of the request, which
+ * must have been finished, as its last attempt
+ */
+void sprec_request_stats(const sprec_request *req, size_t length, sprec_send_stats *stats);
+
+/*
+ * Same as sprec_http_pool_send(), for audio in the given format,
+ * filling `stats' (if not NULL) as sprec_request_stats() does
+ */
+struct sprec_http_pool;
+
+sprec_server_response *sprec_http_pool_send_ex(
+	struct sprec_http_pool *pool,
+	const void *data,
+	size_t length,
+	const char *apikey,
+	const char *language,
+	uint32_t sample_rate,
+	sprec_audio_encoding encoding,
+	sprec_send_stats *stats
+);
+
+/*
+ * Non-0 if a request getting this status (0 for a transport
+ * error) is worth sending again later
+ */
+int sprec_status_is_retryable(long status);
+
+/*
+ * Non-0 if libcurl was built with HTTP/2 support
+ */
+int sprec_http2_available(void);
+
+/*
+ * Makes the request use HTTP/2 if the server and libcurl support it
+ * (HTTP/1.1 otherwise), and wait for a connection it can share
+ * instead of opening a new one right away.
+ */
+void sprec_request_use_http2(sprec_request *req);
+
+/*
+ * Lets the transfers of `multi' share HTTP/2 connections, with at most
+ * `max_streams' transfers per connection and `max_connections'
+ * connections to the host (0 means libcurl's default for either).
+ */
+void sprec_multi_use_http2(CURLM *multi, long max_streams, long max_connections);
+
+/*
+ * The cache of DNS lookups, TLS sessions and connections set up by
+ * sprec_init() (see init.c), or NULL without it
+ */
+CURLSH *sprec_curl_share(void);
+
+/*
+ * Notes that a connection in the shared cache has just been used,
+ * so that sprec_warm_up() needn't open another one
+ */
+void sprec_connection_used(void);
+
+#endif /* !__SPREC_REQUEST_H__ */
@@ -0,0 +1,390 @@
+/*
+ * scheduler.c
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <sprec/scheduler.h>
+#include <sprec/alloc.h>
+#include "clock.h"
+
+typedef struct sprec_key {
+	char *apikey;
+	double rate;
+	double burst;
+	double tokens;
+	double refilled;	/* time of the last refill */
+	double backoff_until;
+	unsigned failures;
+	uint64_t requests;
+	uint64_t rejected;
+} sprec_key;
+
+/*
+ * A request waiting for a key. These live on the stack of
+ * the waiting threads and form a list ordered by priority.
+ */
+typedef struct sprec_waiter {
+	int priority;
+	uint64_t ticket;
+	struct sprec_waiter *next;
+} sprec_waiter;
+
+struct sprec_scheduler {
+	sprec_allocator alloc;	/* allocator in effect at creation */
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	sprec_key *keys;
+	size_t nkeys;
+	size_t next_key;	/* round-robin start position */
+	sprec_waiter *queue;
+	size_t queued;
+	uint64_t tickets;
+};
+
+static long sprec_scheduler_acquire(sprec_scheduler *sched, int priority, uint64_t ticket, double deadline);
+static long sprec_scheduler_pick(sprec_scheduler *sched, double now, double *wake);
+static void sprec_scheduler_report(sprec_scheduler *sched, long index, long status);
+static void sprec_scheduler_enqueue(sprec_scheduler *sched, sprec_waiter *w);
+static void sprec_scheduler_dequeue(sprec_scheduler *sched, sprec_waiter *w);
+
+sprec_scheduler *sprec_scheduler_new(const sprec_key_config *keys, size_t nkeys)
+{
+	sprec_scheduler *sched;
+	double now = sprec_clock_now();
+	size_t i;
+
+	if (nkeys == 0) {
+		return NULL;
+	}
+
+	sched = sprec_calloc(1, sizeof *sched);
+	if (sched == NULL) {
+		return NULL;
+	}
+
+	if (pthread_mutex_init(&sched->lock, NULL) != 0) {
+		sprec_free(sched);
+		return NULL;
+	}
+
+	if (pthread_cond_init(&sched->cond, NULL) != 0) {
+		pthread_mutex_destroy(&sched->lock);
+		sprec_free(sched);
+		return NULL;
+	}
+
+	sprec_get_allocator(&sched->alloc);
+
+	sched->keys = sprec_allocator_calloc(&sched->alloc, nkeys, sizeof sched->keys[0]);
+	if (sched->keys == NULL) {
+		sprec_scheduler_free(sched);
+		return NULL;
+	}
+
+	sched->nkeys = nkeys;
+
+	for (i = 0; i < nkeys; i++) {
+		sprec_key *key = &sched->keys[i];
+
+		key->apikey = sprec_allocator_strdup(&sched->alloc, keys[i].apikey);
+		if (key->apikey == NULL) {
+			sprec_scheduler_free(sched);
+			return NULL;
+		}
+
+		key->rate = keys[i].rate;
+		key->burst = keys[i].burst < 1.0 ? 1.0 : keys[i].burst;
+		key->tokens = key->burst;
+		key->refilled = now;
+	}
+
+	return sched;
+}
+
+void sprec_scheduler_free(sprec_scheduler *sched)
+{
+	sprec_allocator alloc;
+	size_t i;
+
+	if (sched == NULL) {
+		return;
+	}
+
+	alloc = sched->alloc;
+
+	for (i = 0; sched->keys != NULL && i < sched->nkeys; i++) {
+		sprec_allocator_free(&alloc, sched->keys[i].apikey);
+	}
+
+	pthread_cond_destroy(&sched->cond);
+	pthread_mutex_destroy(&sched->lock);
+	sprec_allocator_free(&alloc, sched->keys);
+	sprec_allocator_free(&alloc, sched);
+}
+
+sprec_server_response *
+sprec_scheduler_send(
+	sprec_scheduler *sched,
+	const void *data,
+	size_t length,
+	const char *language,
+	uint32_t sample_rate,
+	int priority,
+	double timeout
+)
+{
+	sprec_server_response *resp, *rejected = NULL;
+	double deadline;
+	uint64_t ticket;
+	size_t attempt;
+	long index;
+
+	deadline = timeout < 0 ? HUGE_VAL : sprec_clock_now() + timeout;
+
+	pthread_mutex_lock(&sched->lock);
+	ticket = sched->tickets++;
+	pthread_mutex_unlock(&sched->lock);
+
+	/*
+	 * On rejection, retry with another key, keeping our
+	 * place in the queue (the ticket is not renewed)
+	 */
+	for (attempt = 0; attempt < sched->nkeys; attempt++) {
+		index = sprec_scheduler_acquire(sched, priority, ticket, deadline);
+		if (index < 0) {
+			break;
+		}
+
+		resp = sprec_send_audio_data(
+			data,
+			length,
+			sched->keys[index].apikey,
+			language,
+			sample_rate
+		);
+
+		sprec_scheduler_report(sched, index, resp ? resp->status : 0);
+
+		if (resp == NULL || (resp->status != 403 && resp->status != 429)) {
+			sprec_free_response(rejected);
+			return resp;
+		}
+
+		sprec_free_response(rejected);
+		rejected = resp;
+	}
+
+	return rejected;
+}
+
+size_t sprec_scheduler_queued(sprec_scheduler *sched)
+{
+	size_t n;
+
+	pthread_mutex_lock(&sched->lock);
+	n = sched->queued;
+	pthread_mutex_unlock(&sched->lock);
+
+	return n;
+}
+
+int sprec_scheduler_get_key_stats(sprec_scheduler *sched, size_t index, sprec_key_stats *stats)
+{
+	sprec_key *key;
+	double now, wake;
+
+	if (index >= sched->nkeys) {
+		return -1;
+	}
+
+	pthread_mutex_lock(&sched->lock);
+
+	/* refills every bucket as a side effect */
+	now = sprec_clock_now();
+	wake = HUGE_VAL;
+	sprec_scheduler_pick(sched, now, &wake);
+
+	key = &sched->keys[index];
+	stats->tokens = key->tokens;
+	stats->backoff = key->backoff_until > now ? key->backoff_until - now : 0.0;
+	stats->failures = key->failures;
+	stats->requests = key->requests;
+	stats->rejected = key->rejected;
+
+	pthread_mutex_unlock(&sched->lock);
+
+	return 0;
+}
+
+/*
+ * Waits until the request is at the head of the queue and a key has a
+ * token, then takes the token. Returns the index of the key, or -1 if
+ * `deadline' has passed.
+ */
+static long sprec_scheduler_acquire(sprec_scheduler *sched, int priority, uint64_t ticket, double deadline)
+{
+	sprec_waiter self;
+	struct timespec ts;
+	double now, wake;
+	long index;
+
+	self.priority = priority;
+	self.ticket = ticket;
+
+	pthread_mutex_lock(&sched->lock);
+	sprec_scheduler_enqueue(sched, &self);
+
+	for (;;) {
+		now = sprec_clock_now();
+		wake = deadline;
+
+		/*
+		 * Only the head of the queue may take a key, so that a
+		 * refilled token goes to the most important request
+		 */
+		if (sched->queue == &self) {
+			index = sprec_scheduler_pick(sched, now, &wake);
+			if (index >= 0) {
+				sched->keys[index].tokens -= 1.0;
+				sprec_scheduler_dequeue(sched, &self);
+				pthread_cond_broadcast(&sched->cond);
+				pthread_mutex_unlock(&sched->lock);
+				return index;
+			}
+
+			if (wake > deadline) {
+				wake = deadline;
+			}
+		}
+
+		if (now >= deadline) {
+			sprec_scheduler_dequeue(sched, &self);
+			pthread_cond_broadcast(&sched->cond);
+			pthread_mutex_unlock(&sched->lock);
+			return -1;
+		}
+
+		if (wake == HUGE_VAL) {
+			pthread_cond_wait(&sched->cond, &sched->lock);
+		} else {
+			sprec_clock_abstime(wake, &ts);
+			pthread_cond_timedwait(&sched->cond, &sched->lock, &ts);
+		}
+	}
+}
+
+/*
+ * Refills the buckets and returns the usable key with the most tokens,
+ * or -1 if there is none, in which case `*wake' is lowered to the time
+ * the earliest key becomes usable. Must be called with the lock held.
+ */
+static long sprec_scheduler_pick(sprec_scheduler *sched, double now, double *wake)
+{
+	long best = -1;
+	size_t i;
+
+	for (i = 0; i < sched->nkeys; i++) {
+		size_t index = (sched->next_key + i) % sched->nkeys;
+		sprec_key *key = &sched->keys[index];
+		double ready;
+
+		key->tokens += (now - key->refilled) * key->rate;
+		if (key->tokens > key->burst) {
+			key->tokens = key->burst;
+		}
+		key->refilled = now;
+
+		if (key->backoff_until <= now && key->tokens >= 1.0) {
+			if (best < 0 || key->tokens > sched->keys[best].tokens) {
+				best = index;
+			}
+			continue;
+		}
+
+		if (key->tokens >= 1.0) {
+			ready = key->backoff_until;
+		} else if (key->rate > 0) {
+			ready = now + (1.0 - key->tokens) / key->rate;
+			if (ready < key->backoff_until) {
+				ready = key->backoff_until;
+			}
+		} else {
+			ready = HUGE_VAL;
+		}
+
+		if (ready < *wake) {
+			*wake = ready;
+		}
+	}
+
+	if (best >= 0) {
+		sched->next_key = (best + 1) % sched->nkeys;
+	}
+
+	return best;
+}
+
+static void sprec_scheduler_report(sprec_scheduler *sched, long index, long status)
+{
+	sprec_key *key = &sched->keys[index];
+	double backoff;
+	unsigned i;
+
+	pthread_mutex_lock(&sched->lock);
+
+	key->requests++;
+
+	if (status == 403 || status == 429) {
+		key->rejected++;
+		key->failures++;
+
+		backoff = SPREC_SCHEDULER_MIN_BACKOFF;
+		for (i = 1; i < key->failures && backoff < SPREC_SCHEDULER_MAX_BACKOFF; i++) {
+			backoff *= 2;
+		}
+
+		if (backoff > SPREC_SCHEDULER_MAX_BACKOFF) {
+			backoff = SPREC_SCHEDULER_MAX_BACKOFF;
+		}
+
+		key->backoff_until = sprec_clock_now() + backoff;
+	} else if (status >= 200 && status < 300) {
+		key->failures = 0;
+	}
+
+	pthread_cond_broadcast(&sched->cond);
+	pthread_mutex_unlock(&sched->lock);
+}
+
+static void sprec_scheduler_enqueue(sprec_scheduler *sched, sprec_waiter *w)
+{
+	sprec_waiter **pp = &sched->queue;
+
+	while (*pp != NULL
+	    && ((*pp)->priority > w->priority
+	     || ((*pp)->priority == w->priority && (*pp)->ticket < w->ticket))) {
+		pp = &(*pp)->next;
+	}
+
+	w->next = *pp;
+	*pp = w;
+	sched->queued++;
+}
+
+static void sprec_scheduler_dequeue(sprec_scheduler *sched, sprec_waiter *w)
+{
+	sprec_waiter **pp = &sched->queue;
+
+	while (*pp != w) {
+		pp = &(*pp)->next;
+	}
+
+	*pp = w->next;
+	sched->queued--;
+}
@@ -0,0 +1,489 @@
+/*
+ * segment.c
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <pthread.h>
+#include <sprec/segment.h>
+#include <sprec/flac_encoder.h>
+#include <sprec/pcm.h>
+#include <sprec/alloc.h>
+#include <sprec/budget.h>
+
+/*
+ * Loudness is measured over windows of this length (in seconds)
+ */
+#define WINDOW_LENGTH 0.01
+
+typedef struct sprec_segment_job {
+	const unsigned char *pcm;
+	sprec_pcm_format fmt;
+	size_t bytes_per_frame;
+	const sprec_wav_header *hdr;
+	const char *apikey;
+	const char *language;
+	const sprec_send_options *send;
+	sprec_segment_result *results;
+	size_t (*bounds)[2];	/* first and past-the-last frame of each segment */
+	size_t count;
+	size_t next;		/* next segment to be processed */
+	pthread_mutex_t lock;
+	sprec_allocator alloc;	/* the caller's, used by all the workers */
+	sprec_reservation *res;
+} sprec_segment_job;
+
+static int sprec_segment_split(
+	const unsigned char *pcm,
+	size_t frames,
+	const sprec_wav_header *hdr,
+	sprec_pcm_format fmt,
+	const sprec_segment_options *opts,
+	size_t (**bounds)[2],
+	size_t *count
+);
+static int sprec_segment_run(
+	const void *pcm,
+	size_t length,
+	const sprec_wav_header *hdr,
+	const char *apikey,
+	const char *language,
+	const sprec_segment_options *opts,
+	sprec_reservation *res,
+	sprec_segment_result **results,
+	size_t *count
+);
+static void *sprec_segment_worker(void *ctx);
+static void *sprec_segment_thread(void *ctx);
+
+void sprec_segment_options_init(sprec_segment_options *opts)
+{
+	long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+
+	opts->max_length = 15.0;
+	opts->min_length = 2.0;
+	opts->overlap = 0.5;
+	opts->silence_threshold = -40.0;
+	opts->silence_length = 0.3;
+	opts->workers = ncpu > 4 ? ncpu : 4;
+	opts->send = NULL;
+}
+
+/*
+ * Memory the segments of `length' bytes of audio hold at once: each
+ * worker encodes one (at most `max_length' seconds long, and as large
+ * once encoded, at worst) and waits for its response
+ */
+static size_t sprec_segment_estimate(size_t length, const sprec_wav_header *hdr, const sprec_segment_options *opts)
+{
+	sprec_pcm_format fmt;
+	size_t segment = 0, workers;
+
+	/* `bytes_per_frame' isn't among what sprec_recognize_long_pcm() uses */
+	if (sprec_pcm_format_from_wav(hdr, &fmt) == 0) {
+		segment = (size_t)(opts->max_length * hdr->sample_rate) * hdr->number_of_channels * sprec_pcm_sample_size(fmt);
+	}
+
+	if (segment == 0 || segment > length) {
+		segment = length;
+	}
+
+	workers = opts->workers > 0 ? opts->workers : 1;
+	if (segment > 0 && workers > length / segment + 1) {
+		workers = length / segment + 1;
+	}
+
+	return workers * (segment + SPREC_BUDGET_RESPONSE);
+}
+
+int sprec_recognize_long(
+	const char *wavfile,
+	const char *apikey,
+	const char *language,
+	const sprec_segment_options *opts,
+	sprec_segment_result **results,
+	size_t *count
+)
+{
+	sprec_segment_options defaults;
+	sprec_reservation res;
+	sprec_wav_header *hdr;
+	uint32_t announced;
+	void *pcm;
+	size_t length;
+	FILE *f;
+	int err;
+
+	if (opts == NULL) {
+		sprec_segment_options_init(&defaults);
+		opts = &defaults;
+	}
+
+	/*
+	 * The file is read whole, so it is reserved for
+	 * along with the segments, before reading it
+	 */
+	f = fopen(wavfile, "rb");
+	if (f == NULL) {
+		return -1;
+	}
+
+	if (sprec_wav_read_header(f, &hdr, &announced) != 0) {
+		fclose(f);
+		return -1;
+	}
+
+	fclose(f);
+
+	err = sprec_budget_reserve(&res, announced + sprec_segment_estimate(announced, hdr, opts), 0);
+	sprec_free(hdr);
+
+	if (err != 0) {
+		return -1;
+	}
+
+	if (sprec_wav_read(wavfile, &hdr, &pcm, &length) != 0) {
+		sprec_budget_release(&res);
+		return -1;
+	}
+
+	err = sprec_segment_run(pcm, length, hdr, apikey, language, opts, &res, results, count);
+
+	sprec_free(pcm);
+	sprec_free(hdr);
+	sprec_budget_release(&res);
+
+	return err;
+}
+
+int sprec_recognize_long_pcm(
+	const void *pcm,
+	size_t length,
+	const sprec_wav_header *hdr,
+	const char *apikey,
+	const char *language,
+	const sprec_segment_options *opts,
+	sprec_segment_result **results,
+	size_t *count
+)
+{
+	sprec_segment_options defaults;
+	sprec_reservation res;
+	int err;
+
+	if (opts == NULL) {
+		sprec_segment_options_init(&defaults);
+		opts = &defaults;
+	}
+
+	if (sprec_budget_reserve(&res, sprec_segment_estimate(length, hdr, opts), 0) != 0) {
+		return -1;
+	}
+
+	err = sprec_segment_run(pcm, length, hdr, apikey, language, opts, &res, results, count);
+	sprec_budget_release(&res);
+
+	return err;
+}
+
+/*
+ * Recognizes the segments of the audio under the reservation `res'
+ */
+static int sprec_segment_run(
+	const void *pcm,
+	size_t length,
+	const sprec_wav_header *hdr,
+	const char *apikey,
+	const char *language,
+	const sprec_segment_options *opts,
+	sprec_reservation *res,
+	sprec_segment_result **results,
+	size_t *count
+)
+{
+	sprec_segment_job job;
+	pthread_t *threads;
+	size_t i, nthreads, started;
+
+	memset(&job, 0, sizeof job);
+
+	if (sprec_pcm_format_from_wav(hdr, &job.fmt) != 0) {
+		return -1;
+	}
+
+	job.pcm = pcm;
+	job.bytes_per_frame = hdr->number_of_channels * sprec_pcm_sample_size(job.fmt);
+	job.hdr = hdr;
+	job.apikey = apikey;
+	job.language = language;
+	job.send = opts->send;
+	job.res = res;
+	sprec_get_allocator(&job.alloc);
+
+	if (job.bytes_per_frame == 0 || hdr->sample_rate == 0) {
+		return -1;
+	}
+
+	if (sprec_segment_split(job.pcm, length / job.bytes_per_frame, hdr, job.fmt, opts, &job.bounds, &job.count) != 0) {
+		return -1;
+	}
+
+	job.results = sprec_calloc(job.count ? job.count : 1, sizeof job.results[0]);
+	if (job.results == NULL) {
+		sprec_free(job.bounds);
+		return -1;
+	}
+
+	for (i = 0; i < job.count; i++) {
+		job.results[i].start = (double)job.bounds[i][0] / hdr->sample_rate;
+		job.results[i].end = (double)job.bounds[i][1] / hdr->sample_rate;
+	}
+
+	if (pthread_mutex_init(&job.lock, NULL) != 0) {
+		sprec_free(job.results);
+		sprec_free(job.bounds);
+		return -1;
+	}
+
+	/*
+	 * The calling thread is one of the workers
+	 */
+	nthreads = opts->workers < job.count ? opts->workers : job.count;
+	nthreads = nthreads > 1 ? nthreads - 1 : 0;
+	started = 0;
+
+	threads = sprec_malloc((nthreads ? nthreads : 1) * sizeof threads[0]);
+	if (threads != NULL) {
+		for (started = 0; started < nthreads; started++) {
+			if (pthread_create(&threads[started], NULL, sprec_segment_thread, &job) != 0) {
+				break;
+			}
+		}
+	}
+
+	sprec_segment_worker(&job);
+
+	for (i = 0; i < started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	sprec_free(threads);
+	pthread_mutex_destroy(&job.lock);
+	sprec_free(job.bounds);
+
+	*results = job.results;
+	*count = job.count;
+
+	return 0;
+}
+
+void sprec_segment_results_free(sprec_segment_result *results, size_t count)
+{
+	size_t i;
+
+	if (results == NULL) {
+		return;
+	}
+
+	for (i = 0; i < count; i++) {
+		sprec_free_response(results[i].resp);
+	}
+
+	sprec_free(results);
+}
+
+static void *sprec_segment_thread(void *ctx)
+{
+	sprec_segment_job *job = ctx;
+
+	/*
+	 * The responses are returned to the caller,
+	 * so they must come from its allocator
+	 */
+	sprec_set_thread_allocator(&job->alloc);
+
+	return sprec_segment_worker(job);
+}
+
+static void *sprec_segment_worker(void *ctx)
+{
+	sprec_segment_job *job = ctx;
+	const sprec_wav_header *hdr = job->hdr;
+	sprec_encoder *enc;
+	const void *flac;
+	size_t i, size;
+
+	/*
+	 * Each worker reuses one encoder context for all its segments
+	 */
+	enc = sprec_encoder_new();
+	if (enc == NULL) {
+		return NULL;
+	}
+
+	for (;;) {
+		pthread_mutex_lock(&job->lock);
+		i = job->next++;
+		pthread_mutex_unlock(&job->lock);
+
+		if (i >= job->count) {
+			break;
+		}
+
+		/*
+		 * Once shed, the segments left fail
+		 */
+		if (sprec_reservation_shed(job->res)) {
+			continue;
+		}
+
+		if (sprec_encoder_encode_pcm_ex(
+			enc,
+			job->pcm + job->bounds[i][0] * job->bytes_per_frame,
+			job->bounds[i][1] - job->bounds[i][0],
+			hdr->sample_rate,
+			hdr->number_of_channels,
+			job->fmt,
+			&flac,
+			&size
+		) != 0 || sprec_reservation_shed(job->res)) {
+			continue;
+		}
+
+		job->results[i].resp = sprec_send_audio_data_ex(
+			flac,
+			size,
+			job->apikey,
+			job->language,
+			hdr->sample_rate,
+			job->send
+		);
+	}
+
+	sprec_encoder_free(enc);
+
+	return NULL;
+}
+
+static int sprec_segment_push(size_t (**bounds)[2], size_t *count, size_t *cap, size_t start, size_t end)
+{
+	size_t (*tmp)[2];
+
+	if (*count == *cap) {
+		*cap = *cap ? *cap * 2 : 16;
+		tmp = sprec_realloc(*bounds, *cap * sizeof (*bounds)[0]);
+		if (tmp == NULL) {
+			return -1;
+		}
+		*bounds = tmp;
+	}
+
+	(*bounds)[*count][0] = start;
+	(*bounds)[*count][1] = end;
+	(*count)++;
+
+	return 0;
+}
+
+static int sprec_segment_split(
+	const unsigned char *pcm,
+	size_t frames,
+	const sprec_wav_header *hdr,
+	sprec_pcm_format fmt,
+	const sprec_segment_options *opts,
+	size_t (**bounds)[2],
+	size_t *count
+)
+{
+	size_t rate = hdr->sample_rate;
+	size_t channels = hdr->number_of_channels;
+	size_t bpf = channels * sprec_pcm_sample_size(fmt);
+	size_t win = rate * WINDOW_LENGTH;
+	size_t max_frames = opts->max_length * rate;
+	size_t min_frames = opts->min_length * rate;
+	size_t overlap = opts->overlap * rate;
+	size_t silence_frames = opts->silence_length * rate;
+	double threshold = pow(10.0, opts->silence_threshold / 10.0);
+	size_t cap = 0, start = 0, pos, n;
+	size_t run_start = 0, run_length = 0;	/* current run of silence */
+	int voiced = 0;				/* segment has non-silent audio */
+
+	*bounds = NULL;
+	*count = 0;
+
+	if (win == 0) {
+		win = 1;
+	}
+
+	if (max_frames < win) {
+		max_frames = win;
+	}
+
+	if (overlap >= max_frames / 2) {
+		overlap = max_frames / 2;
+	}
+
+	for (pos = 0; pos < frames; pos += n) {
+		n = frames - pos < win ? frames - pos : win;
+
+		if (sprec_pcm_power(pcm + pos * bpf, fmt, n * channels) < threshold) {
+			if (run_length == 0) {
+				run_start = pos;
+			}
+			run_length += n;
+		} else {
+			run_length = 0;
+			voiced = 1;
+		}
+
+		/*
+		 * Cut in the middle of a long enough pause...
+		 */
+		if (run_length >= silence_frames && run_length > 0 && pos + n - start >= min_frames) {
+			size_t cut = run_start + run_length / 2;
+
+			if (voiced && sprec_segment_push(bounds, count, &cap, start, cut) != 0) {
+				sprec_free(*bounds);
+				return -1;
+			}
+
+			start = cut;
+			run_start = cut;
+			run_length = pos + n - cut;
+			voiced = 0;
+			continue;
+		}
+
+		/*
+		 * ...or wherever the segment becomes too long
+		 */
+		if (pos + n - start >= max_frames) {
+			size_t cut = start + max_frames;
+
+			if (voiced && sprec_segment_push(bounds, count, &cap, start, cut) != 0) {
+				sprec_free(*bounds);
+				return -1;
+			}
+
+			start = cut - overlap;
+			run_length = 0;
+			voiced = 0;
+
+			/* re-measure the overlapping part */
+			pos = start;
+			n = 0;
+		}
+	}
+
+	if (voiced && start < frames && sprec_segment_push(bounds, count, &cap, start, frames) != 0) {
+		sprec_free(*bounds);
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,692 @@
+/*
+ * server.c
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sprec/server.h>
+#include <sprec/client.h>
+#include <sprec/cache.h>
+#include <sprec/wav.h>
+#include <sprec/pcm.h>
+#include <sprec/flac_encoder.h>
+#include <sprec/alloc.h>
+#include <sprec/budget.h>
+#include "ipc.h"
+
+typedef struct sprec_connection {
+	sprec_server *srv;
+	int sock;
+	int finished;		/* the thread is about to exit */
+	pthread_t thread;
+	struct sprec_connection *next;
+} sprec_connection;
+
+struct sprec_server {
+	sprec_allocator alloc;
+	sprec_server_options opts;
+	char *path;
+	int listener;
+	int wake[2];		/* written to by sprec_server_stop() */
+	sprec_http_pool *pool;
+	sprec_cache *cache;
+	sprec_encoder_pool *encoders;
+	pthread_mutex_t lock;
+	sprec_connection *connections;
+	size_t nconnections;
+};
+
+static void *sprec_connection_thread(void *arg);
+
+void sprec_server_options_init(sprec_server_options *opts)
+{
+	opts->path = NULL;
+	opts->max_clients = 64;
+	opts->cache_entries = 1024;
+	opts->cache_path = NULL;
+	opts->cache_slots = 4096;
+	opts->encoders = 4;
+	sprec_http_options_init(&opts->http);
+	sprec_send_options_init(&opts->send);
+}
+
+/*
+ * Removes the socket left at `path' by a daemon which didn't exit
+ * cleanly. Anything else there is left alone: a file which isn't a
+ * socket (the path is likely mistyped), or the socket of a daemon
+ * still running. Returns non-0 (with errno set) in those cases.
+ */
+static int sprec_server_remove_stale(const char *path, const struct sockaddr_un *addr)
+{
+	struct stat st;
+	int sock, live;
+
+	if (lstat(path, &st) != 0) {
+		return errno == ENOENT ? 0 : -1;
+	}
+
+	if (!S_ISSOCK(st.st_mode)) {
+		errno = EEXIST;
+		return -1;
+	}
+
+	sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (sock < 0) {
+		return -1;
+	}
+
+	live = connect(sock, (const struct sockaddr *)addr, sizeof *addr) == 0;
+	close(sock);
+
+	if (live) {
+		errno = EADDRINUSE;
+		return -1;
+	}
+
+	return unlink(path) == 0 || errno == ENOENT ? 0 : -1;
+}
+
+/*
+ * Only processes of the user the daemon runs as may use it
+ */
+static int sprec_server_peer_allowed(int sock)
+{
+#ifdef SO_PEERCRED
+	struct ucred cred;
+	socklen_t len = sizeof cred;
+
+	if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0) {
+		return 0;
+	}
+
+	return cred.uid == geteuid();
+#else
+	uid_t uid;
+	gid_t gid;
+
+	if (getpeereid(sock, &uid, &gid) != 0) {
+		return 0;
+	}
+
+	return uid == geteuid();
+#endif
+}
+
+sprec_server *sprec_server_new(const sprec_server_options *opts)
+{
+	struct sockaddr_un addr;
+	sprec_server *srv;
+	sprec_allocator alloc;
+	char buf[sizeof addr.sun_path];
+	const char *path;
+	int err;
+
+	sprec_get_allocator(&alloc);
+
+	srv = sprec_allocator_calloc(&alloc, 1, sizeof *srv);
+	if (srv == NULL) {
+		return NULL;
+	}
+
+	srv->alloc = alloc;
+	srv->listener = -1;
+	srv->wake[0] = srv->wake[1] = -1;
+
+	if (opts != NULL) {
+		srv->opts = *opts;
+	} else {
+		sprec_server_options_init(&srv->opts);
+	}
+
+	path = srv->opts.path;
+	if (path == NULL) {
+		if (sprec_ipc_socket_path(buf, sizeof buf, 1) != 0) {
+			goto err;
+		}
+		path = buf;
+	}
+
+	if (strlen(path) >= sizeof addr.sun_path) {
+		goto err;
+	}
+
+	srv->path = sprec_allocator_strdup(&alloc, path);
+	srv->pool = sprec_http_pool_new(&srv->opts.http);
+	srv->encoders = sprec_encoder_pool_new(srv->opts.encoders);
+	if (srv->path == NULL || srv->pool == NULL || srv->encoders == NULL) {
+		goto err;
+	}
+
+	srv->opts.path = srv->path;
+	srv->opts.send.pool = srv->pool;
+
+	if (srv->opts.cache_entries > 0) {
+		srv->cache = sprec_cache_new(srv->opts.cache_entries, srv->opts.cache_path, srv->opts.cache_slots);
+		if (srv->cache == NULL) {
+			goto err;
+		}
+	}
+
+	if (pipe(srv->wake) != 0) {
+		srv->wake[0] = srv->wake[1] = -1;
+		goto err;
+	}
+
+	fcntl(srv->wake[0], F_SETFD, FD_CLOEXEC);
+	fcntl(srv->wake[1], F_SETFD, FD_CLOEXEC);
+	fcntl(srv->wake[1], F_SETFL, O_NONBLOCK);
+
+	srv->listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (srv->listener < 0) {
+		goto err;
+	}
+
+	fcntl(srv->listener, F_SETFD, FD_CLOEXEC);
+
+	memset(&addr, 0, sizeof addr);
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	if (sprec_server_remove_stale(path, &addr) != 0) {
+		goto err;
+	}
+
+	/*
+	 * The socket is made with the umask; it is closed to others before
+	 * anyone may connect. The peers are checked as well, for systems
+	 * which don't apply the permissions of sockets.
+	 */
+	if (bind(srv->listener, (struct sockaddr *)&addr, sizeof addr) != 0) {
+		goto err;
+	}
+
+	if (chmod(path, 0600) != 0 || listen(srv->listener, 16) != 0) {
+		err = errno;
+		unlink(path);
+		errno = err;
+		goto err;
+	}
+
+	pthread_mutex_init(&srv->lock, NULL);
+
+	return srv;
+
+err:
+	err = errno;
+
+	if (srv->listener >= 0) {
+		close(srv->listener);
+	}
+	if (srv->wake[0] >= 0) {
+		close(srv->wake[0]);
+		close(srv->wake[1]);
+	}
+	sprec_cache_free(srv->cache);
+	sprec_encoder_pool_free(srv->encoders);
+	sprec_http_pool_free(srv->pool);
+	sprec_allocator_free(&alloc, srv->path);
+	sprec_allocator_free(&alloc, srv);
+	errno = err;
+
+	return NULL;
+}
+
+void sprec_server_free(sprec_server *srv)
+{
+	sprec_allocator alloc;
+
+	if (srv == NULL) {
+		return;
+	}
+
+	close(srv->listener);
+	unlink(srv->path);
+	close(srv->wake[0]);
+	close(srv->wake[1]);
+
+	sprec_cache_free(srv->cache);
+	sprec_encoder_pool_free(srv->encoders);
+	sprec_http_pool_free(srv->pool);
+	pthread_mutex_destroy(&srv->lock);
+
+	alloc = srv->alloc;
+	sprec_allocator_free(&alloc, srv->path);
+	sprec_allocator_free(&alloc, srv);
+}
+
+void sprec_server_stop(sprec_server *srv)
+{
+	char c = 0;
+
+	if (write(srv->wake[1], &c, 1) < 0) {
+		/* the pipe is full: a stop is pending already */
+	}
+}
+
+/*
+ * Joins the threads of the clients which have disconnected
+ * (or all of them if `all' is non-0)
+ */
+static void sprec_server_reap(sprec_server *srv, int all)
+{
+	sprec_connection **p, *conn;
+
+	pthread_mutex_lock(&srv->lock);
+
+	p = &srv->connections;
+	while ((conn = *p) != NULL) {
+		if (!all && !conn->finished) {
+			p = &conn->next;
+			continue;
+		}
+
+		*p = conn->next;
+		srv->nconnections--;
+
+		pthread_mutex_unlock(&srv->lock);
+		pthread_join(conn->thread, NULL);
+		sprec_allocator_free(&srv->alloc, conn);
+		pthread_mutex_lock(&srv->lock);
+	}
+
+	pthread_mutex_unlock(&srv->lock);
+}
+
+int sprec_server_run(sprec_server *srv)
+{
+	struct pollfd fds[2];
+	sprec_connection *conn;
+	char buf[16];
+	int sock;
+
+	for (;;) {
+		fds[0].fd = srv->wake[0];
+		fds[0].events = POLLIN;
+		fds[1].fd = srv->listener;
+		fds[1].events = POLLIN;
+
+		if (poll(fds, 2, -1) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+
+		if (fds[0].revents != 0) {
+			break;
+		}
+
+		sprec_server_reap(srv, 0);
+
+		if ((fds[1].revents & POLLIN) == 0) {
+			continue;
+		}
+
+		sock = accept(srv->listener, NULL, NULL);
+		if (sock < 0) {
+			continue;
+		}
+
+		fcntl(sock, F_SETFD, FD_CLOEXEC);
+
+		if (!sprec_server_peer_allowed(sock)) {
+			close(sock);
+			continue;
+		}
+
+#ifdef SO_NOSIGPIPE
+		{
+			int one = 1;
+			setsockopt(sock, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof one);
+		}
+#endif
+
+		if (srv->nconnections >= srv->opts.max_clients) {
+			close(sock);
+			continue;
+		}
+
+		conn = sprec_allocator_calloc(&srv->alloc, 1, sizeof *conn);
+		if (conn == NULL) {
+			close(sock);
+			continue;
+		}
+
+		conn->srv = srv;
+		conn->sock = sock;
+
+		pthread_mutex_lock(&srv->lock);
+
+		if (pthread_create(&conn->thread, NULL, sprec_connection_thread, conn) != 0) {
+			pthread_mutex_unlock(&srv->lock);
+			close(sock);
+			sprec_allocator_free(&srv->alloc, conn);
+			continue;
+		}
+
+		conn->next = srv->connections;
+		srv->connections = conn;
+		srv->nconnections++;
+
+		pthread_mutex_unlock(&srv->lock);
+	}
+
+	/*
+	 * Disconnect everybody; the requests in progress are finished first
+	 */
+	pthread_mutex_lock(&srv->lock);
+	for (conn = srv->connections; conn != NULL; conn = conn->next) {
+		if (conn->sock >= 0) {
+			shutdown(conn->sock, SHUT_RDWR);
+		}
+	}
+	pthread_mutex_unlock(&srv->lock);
+
+	sprec_server_reap(srv, 1);
+
+	/* consume the stop, so that the server can be run again */
+	fcntl(srv->wake[0], F_SETFL, O_NONBLOCK);
+	while (read(srv->wake[0], buf, sizeof buf) > 0) {
+	}
+	fcntl(srv->wake[0], F_SETFL, 0);
+
+	return 0;
+}
+
+static sprec_server_response *sprec_server_send(
+	sprec_server *srv,
+	const void *data,
+	size_t length,
+	const char *apikey,
+	const char *language,
+	uint32_t sample_rate
+)
+{
+	sprec_server_response *resp;
+
+	if (srv->cache != NULL) {
+		resp = sprec_cache_lookup(srv->cache, data, length, language);
+		if (resp != NULL) {
+			return resp;
+		}
+	}
+
+	resp = sprec_send_audio_data_ex(data, length, apikey, language, sample_rate, &srv->opts.send);
+
+	if (srv->cache != NULL && resp != NULL && resp->status == 200 && resp->result.count > 0) {
+		sprec_cache_store(srv->cache, data, length, language, resp);
+	}
+
+	return resp;
+}
+
+/*
+ * Encodes the WAV file mapped at `map' and sends it
+ */
+static sprec_server_response *sprec_server_send_wav(
+	sprec_server *srv,
+	const unsigned char *map,
+	size_t size,
+	const sprec_ipc_request *req,
+	sprec_client_error *error
+)
+{
+	sprec_server_response *resp;
+	sprec_wav_header *hdr;
+	sprec_pcm_format fmt;
+	sprec_encoder *enc;
+	const void *flac;
+	size_t flac_size, frames;
+	uint32_t length;
+	long start;
+	FILE *f;
+
+	/*
+	 * The header is parsed from memory, so that the file offset
+	 * (shared with the client) isn't touched
+	 */
+	f = fmemopen((void *)map, size, "rb");
+	if (f == NULL) {
+		*error = SPREC_CLIENT_ERR_REQUEST;
+		return NULL;
+	}
+
+	if (sprec_wav_read_header(f, &hdr, &length) != 0) {
+		fclose(f);
+		*error = SPREC_CLIENT_ERR_REQUEST;
+		return NULL;
+	}
+
+	start = ftell(f);
+	fclose(f);
+
+	if (start < 0 || hdr->bytes_per_frame == 0 || sprec_pcm_format_from_wav(hdr, &fmt) != 0) {
+		sprec_free(hdr);
+		*error = SPREC_CLIENT_ERR_REQUEST;
+		return NULL;
+	}
+
+	if (length > size - start) {
+		length = size - start;
+	}
+
+	frames = length / hdr->bytes_per_frame;
+
+	enc = sprec_encoder_pool_acquire(srv->encoders);
+	if (enc == NULL || sprec_encoder_encode_pcm_ex(enc, map + start, frames, hdr->sample_rate, hdr->number_of_channels, fmt, &flac, &flac_size) != 0) {
+		if (enc != NULL) {
+			sprec_encoder_pool_release(srv->encoders, enc);
+		}
+		sprec_free(hdr);
+		*error = SPREC_CLIENT_ERR_ENCODE;
+		return NULL;
+	}
+
+	resp = sprec_server_send(srv, flac, flac_size, req->apikey, req->language, hdr->sample_rate);
+
+	sprec_encoder_pool_release(srv->encoders, enc);
+	sprec_free(hdr);
+
+	if (resp == NULL) {
+		*error = SPREC_CLIENT_ERR_TRANSPORT;
+	}
+
+	return resp;
+}
+
+/*
+ * Reads a file of up to `size' bytes into memory, with pread() so that
+ * the file offset (shared with the client) isn't touched. `*length'
+ * receives the size read, which is less if the file has shrunk since.
+ */
+static unsigned char *sprec_server_read_file(int fd, size_t size, size_t *length)
+{
+	unsigned char *buf;
+	size_t done = 0;
+	ssize_t n;
+
+	buf = sprec_malloc(size);
+	if (buf == NULL) {
+		return NULL;
+	}
+
+	while (done < size) {
+		n = pread(fd, buf + done, size - done, done);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n < 0) {
+			sprec_free(buf);
+			return NULL;
+		}
+		if (n == 0) {
+			break;
+		}
+		done += n;
+	}
+
+	*length = done;
+
+	return buf;
+}
+
+static sprec_server_response *sprec_server_handle(
+	sprec_server *srv,
+	const sprec_ipc_request *req,
+	int fd,
+	sprec_client_error *error
+)
+{
+	sprec_server_response *resp = NULL;
+	sprec_reservation res;
+	unsigned char *map;
+	struct stat st;
+	size_t size, bytes;
+	int mapped;
+
+	*error = SPREC_CLIENT_ERR_REQUEST;
+
+	if (fd < 0
+	 || memchr(req->apikey, '\0', sizeof req->apikey) == NULL
+	 || memchr(req->language, '\0', sizeof req->language) == NULL
+	 || fstat(fd, &st) != 0
+	 || st.st_size <= 0) {
+		return NULL;
+	}
+
+	if ((uint64_t)st.st_size > SIZE_MAX) {
+		return NULL;
+	}
+
+	/*
+	 * The audio is used where the client put it if the file is sealed.
+	 * Any other file could be truncated by someone while it is mapped,
+	 * which would kill the daemon with SIGBUS, so it is copied.
+	 */
+	mapped = sprec_ipc_is_sealed(fd);
+
+	/*
+	 * The copy of the file, the encoded audio and the response
+	 */
+	bytes = SPREC_BUDGET_RESPONSE;
+	if (!mapped) {
+		bytes += st.st_size;
+	}
+	if (req->type == SPREC_IPC_WAV) {
+		bytes += st.st_size;
+	}
+
+	if (sprec_budget_reserve(&res, bytes, 0) != 0) {
+		*error = SPREC_CLIENT_ERR_NOMEM;
+		return NULL;
+	}
+
+	if (mapped) {
+		size = st.st_size;
+		map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+		if (map == MAP_FAILED) {
+			sprec_budget_release(&res);
+			return NULL;
+		}
+	} else {
+		map = sprec_server_read_file(fd, st.st_size, &size);
+		if (map == NULL) {
+			sprec_budget_release(&res);
+			return NULL;
+		}
+	}
+
+	switch (req->type) {
+	case SPREC_IPC_FLAC:
+		if (req->length == 0 || req->offset > size || req->length > size - req->offset) {
+			break;
+		}
+		resp = sprec_server_send(srv, map + req->offset, req->length, req->apikey, req->language, req->sample_rate);
+		*error = resp != NULL ? SPREC_CLIENT_OK : SPREC_CLIENT_ERR_TRANSPORT;
+		break;
+	case SPREC_IPC_WAV:
+		*error = SPREC_CLIENT_OK;
+		resp = sprec_server_send_wav(srv, map, size, req, error);
+		break;
+	default:
+		break;
+	}
+
+	if (mapped) {
+		munmap(map, size);
+	} else {
+		sprec_free(map);
+	}
+
+	sprec_budget_release(&res);
+
+	return resp;
+}
+
+static void *sprec_connection_thread(void *arg)
+{
+	sprec_connection *conn = arg;
+	sprec_server *srv = conn->srv;
+	sprec_server_response *resp;
+	sprec_ipc_response hdr;
+	sprec_ipc_request req;
+	sprec_client_error error;
+	int fd, err;
+
+	sprec_set_thread_allocator(&srv->alloc);
+
+	while (sprec_ipc_read_fd(conn->sock, &req, sizeof req, &fd) == 0) {
+		if (req.magic != SPREC_IPC_MAGIC || req.version != SPREC_IPC_VERSION) {
+			if (fd >= 0) {
+				close(fd);
+			}
+			break;
+		}
+
+		resp = sprec_server_handle(srv, &req, fd, &error);
+
+		if (fd >= 0) {
+			close(fd);
+		}
+
+		memset(&hdr, 0, sizeof hdr);
+		hdr.magic = SPREC_IPC_MAGIC;
+		hdr.error = resp != NULL ? SPREC_CLIENT_OK : error;
+		hdr.status = resp != NULL ? resp->status : 0;
+		hdr.length = resp != NULL ? resp->length : 0;
+
+		err = sprec_ipc_write(conn->sock, &hdr, sizeof hdr);
+		if (err == 0 && hdr.length > 0) {
+			err = sprec_ipc_write(conn->sock, resp->data, hdr.length);
+		}
+
+		sprec_free_response(resp);
+
+		if (err != 0) {
+			break;
+		}
+	}
+
+	/* under the lock, so that sprec_server_run() doesn't shut down a reused descriptor */
+	pthread_mutex_lock(&srv->lock);
+	close(conn->sock);
+	conn->sock = -1;
+	conn->finished = 1;
+	pthread_mutex_unlock(&srv->lock);
+
+	return NULL;
+}
@@ -0,0 +1,834 @@
+/*
+ * spool.c
+ * libsprec
+ *
+ * Created on Mon 19/10/2026.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sprec/spool.h>
+#include <sprec/wav.h>
+#include <sprec/flac_encoder.h>
+#include <sprec/alloc.h>
+#include <sprec/budget.h>
+#include "clock.h"
+#include "request.h"
+
+#define SPREC_SPOOL_MAGIC "SPRSPL01"
+#define SPREC_RECORD_MAGIC 0x51525053	/* "SPRQ" */
+#define SPREC_LANGUAGE_MAX 64
+
+enum {
+	RECORD_REMOVED,
+	RECORD_PENDING
+};
+
+/*
+ * The file starts with this header, followed by the records
+ */
+typedef struct sprec_spool_header {
+	char magic[8];
+	uint64_t next_id;	/* as of the last truncation */
+} sprec_spool_header;
+
+/*
+ * A record is this header, the language (with its terminating NUL)
+ * and the audio, padded to a multiple of 8 bytes. The checksum covers
+ * everything from `length' on, so that `state' can be overwritten.
+ */
+typedef struct sprec_spool_record {
+	uint32_t magic;
+	uint32_t state;
+	uint32_t crc;
+	uint32_t length;
+	uint64_t id;
+	double created;
+	uint32_t sample_rate;
+	uint32_t language_length;
+} sprec_spool_record;
+
+#define SPREC_RECORD_CHECKED (sizeof(sprec_spool_record) - offsetof(sprec_spool_record, length))
+
+typedef struct sprec_spool_slot {
+	uint64_t id;
+	off_t offset;
+	uint32_t length;
+	uint32_t size;		/* of the whole record */
+} sprec_spool_slot;
+
+struct sprec_spool {
+	sprec_allocator alloc;
+	pthread_mutex_t lock;
+	pthread_cond_t changed;	/* an entry was appended or a drainer stopped */
+	int fd;
+	off_t end;
+	uint64_t next_id;
+	sprec_spool_slot *slots;	/* pending entries, by increasing id */
+	size_t count;
+	size_t size;
+	uint64_t bytes;
+	size_t mapped;		/* entries handed out, see sprec_spool_oldest() */
+};
+
+/*
+ * An entry handed out, mapped from the file
+ */
+typedef struct sprec_spool_mapping {
+	sprec_spool_entry entry;
+	sprec_spool *spool;
+	void *map;
+	size_t map_length;
+} sprec_spool_mapping;
+
+struct sprec_drainer {
+	sprec_allocator alloc;
+	sprec_spool *spool;
+	char *apikey;
+	sprec_drain_options opts;
+	sprec_drain_callback cb;
+	void *ctx;
+	int stop;		/* protected by the lock of the spool */
+	pthread_t thread;
+};
+
+static uint32_t sprec_crc32(uint32_t crc, const void *data, size_t length);
+static int sprec_spool_recover(sprec_spool *spool, off_t size);
+static int sprec_spool_add_slot(sprec_spool *spool, const sprec_spool_slot *slot);
+static void sprec_spool_truncate(sprec_spool *spool);
+static void *sprec_drainer_thread(void *arg);
+
+static uint32_t sprec_record_size(uint32_t language_length, uint32_t length)
+{
+	return (sizeof(sprec_spool_record) + language_length + length + 7) & ~(uint32_t)7;
+}
+
+static int sprec_write_all(int fd, const void *data, size_t length, off_t offset)
+{
+	const char *p = data;
+	ssize_t n;
+
+	while (length > 0) {
+		n = pwrite(fd, p, length, offset);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+
+		p += n;
+		length -= n;
+		offset += n;
+	}
+
+	return 0;
+}
+
+static int sprec_sync(int fd)
+{
+#ifdef __APPLE__
+	return fsync(fd);
+#else
+	return fdatasync(fd);
+#endif
+}
+
+sprec_spool *sprec_spool_open(const char *path)
+{
+	sprec_spool *spool;
+	sprec_allocator alloc;
+	struct stat st;
+
+	sprec_get_allocator(&alloc);
+
+	spool = sprec_allocator_calloc(&alloc, 1, sizeof *spool);
+	if (spool == NULL) {
+		return NULL;
+	}
+
+	spool->alloc = alloc;
+	spool->next_id = 1;
+
+	spool->fd = open(path, O_RDWR | O_CREAT, 0600);
+	if (spool->fd < 0) {
+		sprec_allocator_free(&alloc, spool);
+		return NULL;
+	}
+
+	if (fstat(spool->fd, &st) != 0 || sprec_spool_recover(spool, st.st_size) != 0) {
+		close(spool->fd);
+		sprec_allocator_free(&alloc, spool->slots);
+		sprec_allocator_free(&alloc, spool);
+		return NULL;
+	}
+
+	pthread_mutex_init(&spool->lock, NULL);
+	pthread_cond_init(&spool->changed, NULL);
+
+	return spool;
+}
+
+void sprec_spool_close(sprec_spool *spool)
+{
+	sprec_allocator alloc;
+
+	if (spool == NULL) {
+		return;
+	}
+
+	close(spool->fd);
+	pthread_cond_destroy(&spool->changed);
+	pthread_mutex_destroy(&spool->lock);
+
+	alloc = spool->alloc;
+	sprec_allocator_free(&alloc, spool->slots);
+	sprec_allocator_free(&alloc, spool);
+}
+
+/*
+ * Indexes the pending records and cuts off whatever follows
+ * the last complete one (the remains of an interrupted append)
+ */
+static int sprec_spool_recover(sprec_spool *spool, off_t size)
+{
+	sprec_spool_header hdr;
+	const unsigned char *map, *p;
+	sprec_spool_record rec;
+	sprec_spool_slot slot;
+	off_t offset;
+	uint32_t crc, rsize;
+
+	if (size < (off_t)sizeof hdr) {
+		memset(&hdr, 0, sizeof hdr);
+		memcpy(hdr.magic, SPREC_SPOOL_MAGIC, sizeof hdr.magic);
+		hdr.next_id = spool->next_id;
+
+		if (ftruncate(spool->fd, 0) != 0
+		 || sprec_write_all(spool->fd, &hdr, sizeof hdr, 0) != 0
+		 || sprec_sync(spool->fd) != 0) {
+			return -1;
+		}
+
+		spool->end = sizeof hdr;
+		return 0;
+	}
+
+	if (pread(spool->fd, &hdr, sizeof hdr, 0) != (ssize_t)sizeof hdr
+	 || memcmp(hdr.magic, SPREC_SPOOL_MAGIC, sizeof hdr.magic) != 0) {
+		return -1;
+	}
+
+	spool->next_id = hdr.next_id;
+	offset = sizeof hdr;
+
+	if (size > offset) {
+		map = mmap(NULL, size, PROT_READ, MAP_SHARED, spool->fd, 0);
+		if (map == MAP_FAILED) {
+			return -1;
+		}
+
+		while (size - offset >= (off_t)sizeof rec) {
+			p = map + offset;
+			memcpy(&rec, p, sizeof rec);
+
+			if (rec.magic != SPREC_RECORD_MAGIC || rec.language_length == 0 || rec.language_length > SPREC_LANGUAGE_MAX) {
+				break;
+			}
+
+			rsize = sprec_record_size(rec.language_length, rec.length);
+			if (size - offset < (off_t)rsize || p[sizeof rec + rec.language_length - 1] != '\0') {
+				break;
+			}
+
+			crc = sprec_crc32(0, p + offsetof(sprec_spool_record, length), SPREC_RECORD_CHECKED);
+			crc = sprec_crc32(crc, p + sizeof rec, rec.language_length + rec.length);
+			if (crc != rec.crc) {
+				break;
+			}
+
+			if (rec.state == RECORD_PENDING) {
+				slot.id = rec.id;
+				slot.offset = offset;
+				slot.length = rec.length;
+				slot.size = rsize;
+
+				if (sprec_spool_add_slot(spool, &slot) != 0) {
+					munmap((void *)map, size);
+					return -1;
+				}
+			}
+
+			if (rec.id >= spool->next_id) {
+				spool->next_id = rec.id + 1;
+			}
+
+			offset += rsize;
+		}
+
+		munmap((void *)map, size);
+	}
+
+	if (offset < size && ftruncate(spool->fd, offset) != 0) {
+		return -1;
+	}
+
+	spool->end = offset;
+
+	if (spool->count == 0) {
+		sprec_spool_truncate(spool);
+	}
+
+	return 0;
+}
+
+static int sprec_spool_add_slot(sprec_spool *spool, const sprec_spool_slot *slot)
+{
+	sprec_spool_slot *tmp;
+	size_t size;
+
+	if (spool->count == spool->size) {
+		size = spool->size ? spool->size * 2 : 16;
+		tmp = sprec_allocator_realloc(&spool->alloc, spool->slots, size * sizeof *tmp);
+		if (tmp == NULL) {
+			return -1;
+		}
+
+		spool->slots = tmp;
+		spool->size = size;
+	}
+
+	spool->slots[spool->count++] = *slot;
+	spool->bytes += slot->length;
+
+	return 0;
+}
+
+/*
+ * Empties the file once nothing in it is needed anymore,
+ * keeping the identifiers increasing across truncations
+ */
+static void sprec_spool_truncate(sprec_spool *spool)
+{
+	sprec_spool_header hdr;
+
+	if (spool->end <= (off_t)sizeof hdr) {
+		return;
+	}
+
+	memset(&hdr, 0, sizeof hdr);
+	memcpy(hdr.magic, SPREC_SPOOL_MAGIC, sizeof hdr.magic);
+	hdr.next_id = spool->next_id;
+
+	if (sprec_write_all(spool->fd, &hdr, sizeof hdr, 0) != 0
+	 || sprec_sync(spool->fd) != 0
+	 || ftruncate(spool->fd, sizeof hdr) != 0) {
+		return;
+	}
+
+	spool->end = sizeof hdr;
+}
+
+int sprec_spool_append(
+	sprec_spool *spool,
+	const void *data,
+	size_t length,
+	const char *language,
+	uint32_t sample_rate,
+	uint64_t *id
+)
+{
+	static const char padding[8];
+	sprec_spool_record rec;
+	sprec_spool_slot slot;
+	size_t language_length;
+	off_t offset;
+	int err = -1;
+
+	if (data == NULL || language == NULL || length > UINT32_MAX - 256) {
+		return -1;
+	}
+
+	language_length = strlen(language) + 1;
+	if (language_length > SPREC_LANGUAGE_MAX) {
+		return -1;
+	}
+
+	memset(&rec, 0, sizeof rec);
+	rec.magic = SPREC_RECORD_MAGIC;
+	rec.state = RECORD_PENDING;
+	rec.length = length;
+	rec.created = sprec_clock_now();
+	rec.sample_rate = sample_rate;
+	rec.language_length = language_length;
+
+	pthread_mutex_lock(&spool->lock);
+
+	rec.id = spool->next_id;
+	rec.crc = sprec_crc32(0, (const char *)&rec + offsetof(sprec_spool_record, length), SPREC_RECORD_CHECKED);
+	rec.crc = sprec_crc32(rec.crc, language, language_length);
+	rec.crc = sprec_crc32(rec.crc, data, length);
+
+	slot.id = rec.id;
+	slot.offset = spool->end;
+	slot.length = length;
+	slot.size = sprec_record_size(language_length, length);
+
+	offset = spool->end;
+	if (sprec_write_all(spool->fd, &rec, sizeof rec, offset) != 0
+	 || sprec_write_all(spool->fd, language, language_length, offset + sizeof rec) != 0
+	 || sprec_write_all(spool->fd, data, length, offset + sizeof rec + language_length) != 0
+	 || sprec_write_all(spool->fd, padding, slot.size - sizeof rec - language_length - length, offset + sizeof rec + language_length + length) != 0
+	 || sprec_sync(spool->fd) != 0
+	 || sprec_spool_add_slot(spool, &slot) != 0) {
+		/* leave nothing half-written behind */
+		if (ftruncate(spool->fd, spool->end) != 0) {
+			/* the torn record is dropped when the spool is reopened */
+		}
+		goto out;
+	}
+
+	spool->next_id++;
+	spool->end += slot.size;
+	pthread_cond_broadcast(&spool->changed);
+
+	if (id != NULL) {
+		*id = rec.id;
+	}
+
+	err = 0;
+
+out:
+	pthread_mutex_unlock(&spool->lock);
+	return err;
+}
+
+int sprec_spool_append_file(sprec_spool *spool, const char *wavfile, const char *language, uint64_t *id)
+{
+	sprec_wav_header *hdr;
+	uint32_t length;
+	void *flac;
+	size_t size;
+	FILE *f;
+	int err;
+
+	f = fopen(wavfile, "rb");
+	if (f == NULL) {
+		return -1;
+	}
+
+	if (sprec_wav_read_header(f, &hdr, &length) != 0) {
+		fclose(f);
+		return -1;
+	}
+
+	fclose(f);
+
+	flac = sprec_flac_encode(wavfile, &size);
+	if (flac == NULL) {
+		sprec_free(hdr);
+		return -1;
+	}
+
+	err = sprec_spool_append(spool, flac, size, language, hdr->sample_rate, id);
+
+	sprec_free(flac);
+	sprec_free(hdr);
+
+	return err;
+}
+
+sprec_spool_entry *sprec_spool_oldest(sprec_spool *spool)
+{
+	sprec_spool_mapping *m;
+	sprec_spool_record rec;
+	sprec_spool_slot slot;
+	const unsigned char *p;
+	long page;
+	off_t base;
+
+	page = sysconf(_SC_PAGESIZE);
+
+	m = sprec_allocator_calloc(&spool->alloc, 1, sizeof *m);
+	if (m == NULL) {
+		return NULL;
+	}
+
+	pthread_mutex_lock(&spool->lock);
+
+	if (spool->count == 0) {
+		pthread_mutex_unlock(&spool->lock);
+		sprec_allocator_free(&spool->alloc, m);
+		return NULL;
+	}
+
+	slot = spool->slots[0];
+
+	/*
+	 * mmap() wants a page-aligned offset
+	 */
+	base = slot.offset - slot.offset % page;
+	m->map_length = slot.offset - base + slot.size;
+	m->map = mmap(NULL, m->map_length, PROT_READ, MAP_SHARED, spool->fd, base);
+	if (m->map == MAP_FAILED) {
+		pthread_mutex_unlock(&spool->lock);
+		sprec_allocator_free(&spool->alloc, m);
+		return NULL;
+	}
+
+	/* the file isn't truncated while this is mapped */
+	spool->mapped++;
+
+	pthread_mutex_unlock(&spool->lock);
+
+	p = (const unsigned char *)m->map + (slot.offset - base);
+	memcpy(&rec, p, sizeof rec);
+
+	m->spool = spool;
+	m->entry.id = rec.id;
+	m->entry.language = (const char *)p + sizeof rec;
+	m->entry.data = p + sizeof rec + rec.language_length;
+	m->entry.length = rec.length;
+	m->entry.sample_rate = rec.sample_rate;
+	m->entry.created = rec.created;
+
+	return &m->entry;
+}
+
+void sprec_spool_entry_free(sprec_spool_entry *entry)
+{
+	sprec_spool_mapping *m = (sprec_spool_mapping *)entry;
+	sprec_spool *spool;
+
+	if (m == NULL) {
+		return;
+	}
+
+	spool = m->spool;
+	munmap(m->map, m->map_length);
+
+	pthread_mutex_lock(&spool->lock);
+	if (--spool->mapped == 0 && spool->count == 0) {
+		sprec_spool_truncate(spool);
+	}
+	pthread_mutex_unlock(&spool->lock);
+
+	sprec_allocator_free(&spool->alloc, m);
+}
+
+int sprec_spool_remove(sprec_spool *spool, uint64_t id)
+{
+	static const uint32_t removed = RECORD_REMOVED;
+	size_t lo, hi, mid;
+	int err = -1;
+
+	pthread_mutex_lock(&spool->lock);
+
+	lo = 0;
+	hi = spool->count;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (spool->slots[mid].id < id) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	if (lo < spool->count && spool->slots[lo].id == id) {
+		/*
+		 * Not synced: at worst, the entry is sent again after a crash
+		 */
+		if (sprec_write_all(spool->fd, &removed, sizeof removed, spool->slots[lo].offset + offsetof(sprec_spool_record, state)) == 0) {
+			spool->bytes -= spool->slots[lo].length;
+			spool->count--;
+			memmove(&spool->slots[lo], &spool->slots[lo + 1], (spool->count - lo) * sizeof spool->slots[0]);
+
+			if (spool->count == 0 && spool->mapped == 0) {
+				sprec_spool_truncate(spool);
+			}
+
+			err = 0;
+		}
+	}
+
+	pthread_mutex_unlock(&spool->lock);
+
+	return err;
+}
+
+size_t sprec_spool_count(sprec_spool *spool)
+{
+	size_t count;
+
+	pthread_mutex_lock(&spool->lock);
+	count = spool->count;
+	pthread_mutex_unlock(&spool->lock);
+
+	return count;
+}
+
+uint64_t sprec_spool_size(sprec_spool *spool)
+{
+	uint64_t bytes;
+
+	pthread_mutex_lock(&spool->lock);
+	bytes = spool->bytes;
+	pthread_mutex_unlock(&spool->lock);
+
+	return bytes;
+}
+
+void sprec_drain_options_init(sprec_drain_options *opts)
+{
+	opts->rate = 2.0;
+	opts->burst = 1;
+	opts->retry_delay = 1.0;
+	opts->max_retry_delay = 60.0;
+	sprec_send_options_init(&opts->send);
+}
+
+sprec_drainer *sprec_spool_drain(
+	sprec_spool *spool,
+	const char *apikey,
+	const sprec_drain_options *opts,
+	sprec_drain_callback cb,
+	void *ctx
+)
+{
+	sprec_drainer *drainer;
+	sprec_allocator alloc;
+
+	sprec_get_allocator(&alloc);
+
+	drainer = sprec_allocator_calloc(&alloc, 1, sizeof *drainer);
+	if (drainer == NULL) {
+		return NULL;
+	}
+
+	drainer->alloc = alloc;
+	drainer->spool = spool;
+	drainer->cb = cb;
+	drainer->ctx = ctx;
+
+	if (opts != NULL) {
+		drainer->opts = *opts;
+	} else {
+		sprec_drain_options_init(&drainer->opts);
+	}
+
+	if (drainer->opts.burst == 0) {
+		drainer->opts.burst = 1;
+	}
+
+	drainer->apikey = sprec_allocator_strdup(&alloc, apikey);
+	if (drainer->apikey == NULL) {
+		sprec_allocator_free(&alloc, drainer);
+		return NULL;
+	}
+
+	if (pthread_create(&drainer->thread, NULL, sprec_drainer_thread, drainer) != 0) {
+		sprec_allocator_free(&alloc, drainer->apikey);
+		sprec_allocator_free(&alloc, drainer);
+		return NULL;
+	}
+
+	return drainer;
+}
+
+void sprec_drainer_stop(sprec_drainer *drainer)
+{
+	sprec_allocator alloc;
+
+	if (drainer == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&drainer->spool->lock);
+	drainer->stop = 1;
+	pthread_cond_broadcast(&drainer->spool->changed);
+	pthread_mutex_unlock(&drainer->spool->lock);
+
+	pthread_join(drainer->thread, NULL);
+
+	alloc = drainer->alloc;
+	sprec_allocator_free(&alloc, drainer->apikey);
+	sprec_allocator_free(&alloc, drainer);
+}
+
+/*
+ * Whether a response means the entry should be sent again later.
+ * A 403 is how the API reports an exhausted quota, which (like a 429)
+ * passes, as the scheduler assumes too.
+ */
+static int sprec_drainer_should_retry(const sprec_server_response *resp)
+{
+	return resp == NULL || resp->status == 403 || sprec_status_is_retryable(resp->status);
+}
+
+/*
+ * Sends the oldest entry. Returns 0 if it has been answered
+ * for good, non-0 if it should be tried again later.
+ */
+static int sprec_drainer_send(sprec_drainer *drainer)
+{
+	sprec_spool_entry *entry;
+	sprec_server_response *resp;
+	sprec_reservation res;
+	int keep = 0;
+
+	/*
+	 * The entry is mapped from the spool, only the response is
+	 * allocated. Without room for it, the entry waits like after
+	 * a transport error.
+	 */
+	if (sprec_budget_reserve(&res, SPREC_BUDGET_RESPONSE, 0) != 0) {
+		return 1;
+	}
+
+	entry = sprec_spool_oldest(drainer->spool);
+	if (entry == NULL) {
+		sprec_budget_release(&res);
+		return 0;
+	}
+
+	resp = sprec_send_audio_data_ex(
+		entry->data,
+		entry->length,
+		drainer->apikey,
+		entry->language,
+		entry->sample_rate,
+		&drainer->opts.send
+	);
+
+	/*
+	 * Only a 2xx response removes the entry on its own; a client
+	 * error does if the callback says so, as the entry is lost then
+	 */
+	if (sprec_drainer_should_retry(resp)) {
+		keep = 1;
+	} else if (drainer->cb != NULL) {
+		keep = drainer->cb(entry, resp, drainer->ctx);
+	} else {
+		keep = resp->status < 200 || resp->status >= 300;
+	}
+
+	if (!keep) {
+		sprec_spool_remove(drainer->spool, entry->id);
+	}
+
+	sprec_free_response(resp);
+	sprec_spool_entry_free(entry);
+	sprec_budget_release(&res);
+
+	return keep;
+}
+
+static void *sprec_drainer_thread(void *arg)
+{
+	sprec_drainer *drainer = arg;
+	sprec_spool *spool = drainer->spool;
+	const sprec_drain_options *opts = &drainer->opts;
+	double tokens = opts->burst, refilled, now, not_before = 0, delay = 0;
+	struct timespec ts;
+
+	sprec_set_thread_allocator(&drainer->alloc);
+
+	refilled = sprec_clock_now();
+
+	pthread_mutex_lock(&spool->lock);
+
+	while (!drainer->stop) {
+		if (spool->count == 0) {
+			pthread_cond_wait(&spool->changed, &spool->lock);
+			continue;
+		}
+
+		now = sprec_clock_now();
+
+		/*
+		 * Token bucket: `rate' requests per second on average,
+		 * at most `burst' at once
+		 */
+		if (opts->rate > 0) {
+			tokens += (now - refilled) * opts->rate;
+			if (tokens > opts->burst) {
+				tokens = opts->burst;
+			}
+			refilled = now;
+
+			if (tokens < 1 && now + (1 - tokens) / opts->rate > not_before) {
+				not_before = now + (1 - tokens) / opts->rate;
+			}
+		}
+
+		if (now < not_before) {
+			sprec_clock_abstime(not_before, &ts);
+			pthread_cond_timedwait(&spool->changed, &spool->lock, &ts);
+			continue;
+		}
+
+		tokens -= 1;
+
+		pthread_mutex_unlock(&spool->lock);
+
+		if (sprec_drainer_send(drainer) != 0) {
+			delay = delay > 0 ? delay * 2 : opts->retry_delay;
+			if (delay > opts->max_retry_delay) {
+				delay = opts->max_retry_delay;
+			}
+			not_before = sprec_clock_now() + delay;
+		} else {
+			delay = 0;
+		}
+
+		pthread_mutex_lock(&spool->lock);
+	}
+
+	pthread_mutex_unlock(&spool->lock);
+
+	return NULL;
+}
+
+/*
+ * CRC-32 (IEEE 802.3, as used by zlib and PNG)
+ */
+static uint32_t sprec_crc32_table[256];
+static pthread_once_t sprec_crc32_once = PTHREAD_ONCE_INIT;
+
+static void sprec_crc32_init(void)
+{
+	uint32_t c;
+	unsigned i, k;
+
+	for (i = 0; i < 256; i++) {
+		c = i;
+		for (k = 0; k < 8; k++) {
+			c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+		}
+		sprec_crc32_table[i] = c;
+	}
+}
+
+static uint32_t sprec_crc32(uint32_t crc, const void *data, size_t length)
+{
+	const unsigned char *p = data;
+
+	pthread_once(&sprec_crc32_once, sprec_crc32_init);
+
+	crc = ~crc;
+	while (length-- > 0) {
+		crc = sprec_crc32_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	}
+
+	return ~crc;
+}
@@ -8,6 +8,7 @@
 
 #include <unistd.h>
 #include <sprec/wav.h>
+#include <sprec/alloc.h>
 
 #if defined _WIN64 || defined _WIN32
 	#error "This has to be implemented yet!"
@@ -57,7 +58,7 @@ typedef struct sprec_record_state {
 sprec_wav_header *sprec_wav_header_from_data(const FLAC__byte *ptr)
 {
 	sprec_wav_header *hdr;
-	hdr = malloc(sizeof *hdr);
+	hdr = sprec_malloc(sizeof *hdr);
 	if (hdr == NULL) {
 		return NULL;
 	}
@@ -88,7 +89,7 @@ sprec_wav_header *sprec_wav_header_from_params(
 )
 {
 	sprec_wav_header *hdr;
-	hdr = malloc(sizeof *hdr);
+	hdr = sprec_malloc(sizeof *hdr);
 	if (hdr == NULL) {
 		return NULL;
 	}
@@ -97,7 +98,7 @@ sprec_wav_header *sprec_wav_header_from_params(
 	memcpy(&hdr->filetype_header, "WAVE", 4);
 	memcpy(&hdr->format_marker, "fmt ", 4);
 	hdr->data_header_length = 16;
-	hdr->format_type = 1;
+	hdr->format_type = WAVE_FORMAT_PCM;
 	hdr->number_of_channels = channels;
 	hdr->sample_rate = sample_rate;
 	hdr->bytes_per_second = sample_rate * channels * bit_depth / 8;
@@ -107,36 +108,173 @@ sprec_wav_header *sprec_wav_header_from_params(
 	return hdr;
 }
 
+void sprec_wav_header_pack(const sprec_wav_header *hdr, FLAC__byte *ptr)
+{
+	uint32_t data_size = hdr->file_size + 8 - SPREC_WAV_FILE_HEADER_SIZE;
+
+	/*
+	 * The reverse of sprec_wav_header_from_data(),
+	 * followed by the header of the data section
+	 */
+	memcpy(ptr + 0, &hdr->RIFF_marker, 4);
+	memcpy(ptr + 4, &hdr->file_size, 4);
+	memcpy(ptr + 8, &hdr->filetype_header, 4);
+	memcpy(ptr + 12, &hdr->format_marker, 4);
+	memcpy(ptr + 16, &hdr->data_header_length, 4);
+	memcpy(ptr + 20, &hdr->format_type, 2);
+	memcpy(ptr + 22, &hdr->number_of_channels, 2);
+	memcpy(ptr + 24, &hdr->sample_rate, 4);
+	memcpy(ptr + 28, &hdr->bytes_per_second, 4);
+	memcpy(ptr + 32, &hdr->bytes_per_frame, 2);
+	memcpy(ptr + 34, &hdr->bits_per_sample, 2);
+	memcpy(ptr + 36, "data", 4);
+	memcpy(ptr + 40, &data_size, 4);
+}
+
+#if !defined __APPLE__
+
+/*
+ * Overruns and short reads make a recording shorter than asked for;
+ * rewrites the header of the WAV file `f' with its real length
+ */
+static void sprec_wav_fix_length(FILE *f, sprec_wav_header *hdr, uint32_t length)
+{
+	hdr->file_size = length + SPREC_WAV_FILE_HEADER_SIZE - 8;
+
+	if (fseek(f, 0, SEEK_SET) == 0) {
+		sprec_wav_header_write(f, hdr);
+	}
+}
+
+#endif
+
 int sprec_wav_header_write(FILE *f, sprec_wav_header *hdr)
 {
+	FLAC__byte buf[SPREC_WAV_FILE_HEADER_SIZE];
+
 	if (hdr == NULL) {
 		return -1;
 	}
 
-#define CHECK(call) do { if ((call) != 1) { return -1; } } while (0)
+	sprec_wav_header_pack(hdr, buf);
 
-	CHECK(fwrite(&hdr->RIFF_marker, 4, 1, f));
-	CHECK(fwrite(&hdr->file_size, 4, 1, f));
-	CHECK(fwrite(&hdr->filetype_header, 4, 1, f));
-	CHECK(fwrite(&hdr->format_marker, 4, 1, f));
-	CHECK(fwrite(&hdr->data_header_length, 4, 1, f));
-	CHECK(fwrite(&hdr->format_type, 2, 1, f));
-	CHECK(fwrite(&hdr->number_of_channels, 2, 1, f));
-	CHECK(fwrite(&hdr->sample_rate, 4, 1, f));
-	CHECK(fwrite(&hdr->bytes_per_second, 4, 1, f));
-	CHECK(fwrite(&hdr->bytes_per_frame, 2, 1, f));
-	CHECK(fwrite(&hdr->bits_per_sample, 2, 1, f));
-	CHECK(fwrite("data", 4, 1, f));
+	return fwrite(buf, sizeof buf, 1, f) == 1 ? 0 : -1;
+}
+
+int sprec_wav_read_header(FILE *f, sprec_wav_header **hdr, uint32_t *length)
+{
+	FLAC__byte riff[SPREC_WAV_HEADER_SIZE];
+	FLAC__byte chunk[8];
+	int have_fmt = 0;
+	uint32_t chunk_size;
+	long start, end;
+
+	if (fread(riff, 12, 1, f) != 1) {
+		return -1;
+	}
+
+	if (memcmp(riff, "RIFF", 4) != 0 || memcmp(riff + 8, "WAVE", 4) != 0) {
+		return -1;
+	}
+
+	/*
+	 * Walk the chunks; the "fmt " chunk is not necessarily the first
+	 * one, and there may be others (e. g. Apple's FLLR) before "data"
+	 */
+	while (fread(chunk, 8, 1, f) == 1) {
+		memcpy(&chunk_size, chunk + 4, 4);
 
-	uint32_t data_size = hdr->file_size + 8 - 44;
-	CHECK(fwrite(&data_size, 4, 1, f));
+		if (memcmp(chunk, "fmt ", 4) == 0 && chunk_size >= 16) {
+			memcpy(riff + 12, chunk, 8);
+			if (fread(riff + 20, SPREC_WAV_HEADER_SIZE - 20, 1, f) != 1) {
+				return -1;
+			}
+
+			have_fmt = 1;
+			chunk_size -= SPREC_WAV_HEADER_SIZE - 20;
+
+			/*
+			 * WAVE_FORMAT_EXTENSIBLE: the actual format code
+			 * is at the beginning of the sub-format GUID
+			 */
+			if (riff[20] == 0xfe && riff[21] == 0xff && chunk_size >= 24) {
+				FLAC__byte ext[24];
 
-#undef CHECK
+				if (fread(ext, sizeof ext, 1, f) != 1) {
+					return -1;
+				}
 
+				memcpy(riff + 20, ext + 8, 2);
+				chunk_size -= sizeof ext;
+			}
+		} else if (memcmp(chunk, "data", 4) == 0 && have_fmt) {
+			/*
+			 * The size may be bogus if the file was
+			 * written as a stream, so trust the file size
+			 */
+			start = ftell(f);
+			if (start >= 0 && fseek(f, 0, SEEK_END) == 0) {
+				end = ftell(f);
+				if (end >= start && chunk_size > (unsigned long)(end - start)) {
+					chunk_size = end - start;
+				}
+
+				fseek(f, start, SEEK_SET);
+			}
+
+			*hdr = sprec_wav_header_from_data(riff);
+			if (*hdr == NULL) {
+				return -1;
+			}
+
+			*length = chunk_size;
+			return 0;
+		}
+
+		if (fseek(f, chunk_size + (chunk_size & 1), SEEK_CUR) != 0) {
+			return -1;
+		}
+	}
+
+	return -1;
+}
+
+int sprec_wav_read(const char *filename, sprec_wav_header **hdr, void **pcm, size_t *length)
+{
+	FILE *f;
+	void *buf;
+	uint32_t size;
+
+	f = fopen(filename, "rb");
+	if (f == NULL) {
+		return -1;
+	}
+
+	if (sprec_wav_read_header(f, hdr, &size) != 0) {
+		fclose(f);
+		return -1;
+	}
+
+	buf = sprec_malloc(size ? size : 1);
+	if (buf == NULL) {
+		sprec_free(*hdr);
+		fclose(f);
+		return -1;
+	}
+
+	*pcm = buf;
+	*length = fread(buf, 1, size, f);
+
+	fclose(f);
 	return 0;
 }
 
 int sprec_record_wav(const char *filename, sprec_wav_header *hdr, uint32_t duration_ms)
+{
+	return sprec_record_wav_ex(filename, hdr, duration_ms, NULL);
+}
+
+int sprec_record_wav_ex(const char *filename, sprec_wav_header *hdr, uint32_t duration_ms, const char *device)
 {
 #if defined _WIN64 || defined _WIN32
 	/*
@@ -256,14 +394,16 @@ int sprec_record_wav(const char *filename, sprec_wav_header *hdr, uint32_t durat
 	unsigned int val;
 	int dir;
 	snd_pcm_uframes_t frames;
+	snd_pcm_sframes_t n;
 	char *buffer;
+	uint32_t written;
 	FILE *f;
 	int err;
 
 	/*
 	 * Open PCM device for recording
 	 */
-	err = snd_pcm_open(&handle, "pulse", SND_PCM_STREAM_CAPTURE, 0);
+	err = snd_pcm_open(&handle, device ? device : "pulse", SND_PCM_STREAM_CAPTURE, 0);
 	if (err) {
 		return err;
 	}
@@ -336,7 +476,7 @@ int sprec_record_wav(const char *filename, sprec_wav_header *hdr, uint32_t durat
 	 * and number of channels
 	 */
 	size = frames * hdr->bits_per_sample / 8 * hdr->number_of_channels;
-	buffer = malloc(size);
+	buffer = sprec_malloc(size);
 	if (buffer == NULL) {
 		snd_pcm_close(handle);
 		return -1;
@@ -349,7 +489,7 @@ int sprec_record_wav(const char *filename, sprec_wav_header *hdr, uint32_t durat
 	err = snd_pcm_hw_params_get_period_time(params, &val, &dir);
 	if (err) {
 		snd_pcm_close(handle);
-		free(buffer);
+		sprec_free(buffer);
 		return err;
 	}
 
@@ -363,36 +503,52 @@ int sprec_record_wav(const char *filename, sprec_wav_header *hdr, uint32_t durat
 	f = fopen(filename, "wb");
 	if (f == NULL) {
 		snd_pcm_close(handle);
-		free(buffer);
+		sprec_free(buffer);
 		return -1;
 	}
 
-	err = sprec_wav_header_write(fd, hdr);
+	err = sprec_wav_header_write(f, hdr);
 	if (err) {
 		snd_pcm_close(handle);
-		free(buffer);
+		sprec_free(buffer);
 		fclose(f);
 		return err;
 	}
 
+	written = 0;
+
 	for (i = duration_ms * 1000 / val; i > 0; i--) {
-		err = snd_pcm_readi(handle, buffer, frames);
-		if (err == -EPIPE) {
+		/*
+		 * readi returns the number of frames read
+		 * (which may be less than a period),
+		 * or a negative error code
+		 */
+		n = snd_pcm_readi(handle, buffer, frames);
+		if (n < 0) {
 			/*
 			 * minus EPIPE means X-run
 			 */
-			err = snd_pcm_recover(handle, err, 0);
+			err = snd_pcm_recover(handle, n, 0);
+
+			/* still not good */
+			if (err < 0) {
+				sprec_wav_fix_length(f, hdr, written);
+				snd_pcm_close(handle);
+				sprec_free(buffer);
+				fclose(f);
+				return err;
+			}
+
+			continue;
 		}
 
-		/* still not good */
-		if (err) {
-			snd_pcm_close(handle);
-			free(buffer);
-			fclose(f);
-			return err;
+		if (fwrite(buffer, n * hdr->bytes_per_frame, 1, f) == 1) {
+			written += n * hdr->bytes_per_frame;
 		}
+	}
 
-		fwrite(buffer, size, 1, f);
+	if (written != pcm_data_size) {
+		sprec_wav_fix_length(f, hdr, written);
 	}
 
 	/*
@@ -401,7 +557,7 @@ int sprec_record_wav(const char *filename, sprec_wav_header *hdr, uint32_t durat
 	fclose(f);
 	snd_pcm_drain(handle);
 	snd_pcm_close(handle);
-	free(buffer);
+	sprec_free(buffer);
 
 	return 0;
 #endif
@@ -9,12 +9,57 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
 #include <curl/curl.h>
 #include <sprec/web_client.h>
+#include <sprec/pool.h>
+#include <sprec/alloc.h>
+#include "clock.h"
+#include "request.h"
 
 #define BUF_SIZE 0x1000
 
+/*
+ * Number of recent request latencies the hedging delay is computed from,
+ * and the minimum needed before the estimate is trusted
+ */
+#define LATENCY_WINDOW 128
+#define LATENCY_MIN_SAMPLES 16
+
+static struct {
+	pthread_mutex_t lock;
+	double samples[LATENCY_WINDOW];
+	size_t count;
+	size_t next;
+} sprec_latencies = { PTHREAD_MUTEX_INITIALIZER, { 0 }, 0, 0 };
+
 static size_t http_callback(char *ptr, size_t count, size_t blocksize, void *userdata);
+static void sprec_transfer_discard(sprec_transfer *transfer);
+#if LIBCURL_VERSION_NUM >= 0x072000
+static int sprec_progress_callback(void *userdata, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow);
+#endif
+static sprec_server_response *sprec_send_once(
+	const void *data,
+	size_t length,
+	const char *apikey,
+	const char *language,
+	uint32_t sample_rate,
+	const sprec_send_options *opts
+);
+static sprec_server_response *sprec_send_hedged(
+	const void *data,
+	size_t length,
+	const char *apikey,
+	const char *language,
+	uint32_t sample_rate,
+	double delay,
+	const sprec_send_options *opts
+);
+static double sprec_backoff_delay(const sprec_send_options *opts, unsigned attempt, unsigned *seed);
+static void sprec_latency_record(double latency);
+static void sprec_request_share(sprec_request *req);
 
 sprec_server_response *
 sprec_send_audio_data(
@@ -25,17 +70,151 @@ sprec_send_audio_data(
 	uint32_t sample_rate
 )
 {
-	CURL *conn_hndl;
-	struct curl_httppost *form, *lastptr;
-	struct curl_slist *headers;
+	return sprec_send_audio_data_ex(data, length, apikey, language, sample_rate, NULL);
+}
+
+void sprec_send_options_init(sprec_send_options *opts)
+{
+	opts->max_retries = 0;
+	opts->base_delay = 0.25;
+	opts->max_delay = 8.0;
+	opts->hedge = 0;
+	opts->hedge_delay = 0.0;
+	opts->pool = NULL;
+	opts->encoding = SPREC_ENCODING_FLAC;
+	opts->stats = NULL;
+}
+
+sprec_server_response *
+sprec_send_audio_data_ex(
+	const void *data,
+	size_t length,
+	const char *apikey,
+	const char *language,
+	uint32_t sample_rate,
+	const sprec_send_options *opts
+)
+{
+	sprec_send_options defaults;
 	sprec_server_response *resp;
-	char url[0x100];
-	char header[0x100];
+	unsigned attempt, seed;
+	double delay;
 
 	if (data == NULL) {
 		return NULL;
 	}
 
+	if (opts == NULL) {
+		sprec_send_options_init(&defaults);
+		opts = &defaults;
+	}
+
+	if (opts->stats != NULL) {
+		memset(opts->stats, 0, sizeof *opts->stats);
+	}
+
+	seed = (unsigned)(sprec_clock_now() * 1e6) ^ (unsigned)(uintptr_t)&seed;
+
+	/*
+	 * The encoded audio is kept by the caller, so a retry
+	 * only costs another upload, not another encoding pass.
+	 */
+	for (attempt = 0; ; attempt++) {
+		delay = opts->hedge ? opts->hedge_delay : 0.0;
+		if (opts->hedge && delay <= 0) {
+			delay = sprec_latency_p95();
+		}
+
+		if (opts->pool != NULL && delay <= 0) {
+			resp = sprec_http_pool_send_ex(opts->pool, data, length, apikey, language, sample_rate, opts->encoding, opts->stats);
+		} else if (delay > 0) {
+			resp = sprec_send_hedged(data, length, apikey, language, sample_rate, delay, opts);
+		} else {
+			resp = sprec_send_once(data, length, apikey, language, sample_rate, opts);
+		}
+
+		if (opts->stats != NULL) {
+			opts->stats->attempts = attempt + 1;
+		}
+
+		if (resp != NULL && !sprec_status_is_retryable(resp->status)) {
+			return resp;
+		}
+
+		if (attempt >= opts->max_retries) {
+			return resp;
+		}
+
+		sprec_free_response(resp);
+		sprec_clock_sleep(sprec_backoff_delay(opts, attempt, &seed));
+	}
+}
+
+double sprec_latency_p95(void)
+{
+	double sorted[LATENCY_WINDOW];
+	size_t n, i, j;
+
+	pthread_mutex_lock(&sprec_latencies.lock);
+	n = sprec_latencies.count;
+	memcpy(sorted, sprec_latencies.samples, n * sizeof sorted[0]);
+	pthread_mutex_unlock(&sprec_latencies.lock);
+
+	if (n < LATENCY_MIN_SAMPLES) {
+		return 0.0;
+	}
+
+	/*
+	 * Insertion sort; there are only LATENCY_WINDOW samples
+	 */
+	for (i = 1; i < n; i++) {
+		double x = sorted[i];
+		for (j = i; j > 0 && sorted[j - 1] > x; j--) {
+			sorted[j] = sorted[j - 1];
+		}
+		sorted[j] = x;
+	}
+
+	return sorted[(n * 95 + 99) / 100 - 1];
+}
+
+void sprec_free_response(sprec_server_response *resp)
+{
+	if (resp) {
+		sprec_free(resp->data);
+		sprec_free(resp);
+	}
+}
+
+int sprec_request_init(
+	sprec_request *req,
+	const void *data,
+	size_t length,
+	const char *apikey,
+	const char *language,
+	uint32_t sample_rate
+)
+{
+	return sprec_request_init_ex(req, data, length, apikey, language, sample_rate, SPREC_ENCODING_FLAC);
+}
+
+int sprec_request_init_ex(
+	sprec_request *req,
+	const void *data,
+	size_t length,
+	const char *apikey,
+	const char *language,
+	uint32_t sample_rate,
+	sprec_audio_encoding encoding
+)
+{
+	struct curl_httppost *lastptr;
+	sprec_server_response *resp;
+	char url[0x100];
+	char header[0x100];
+
+	memset(req, 0, sizeof *req);
+
 	/*
 	 * Initialize the variables
 	 * Put the language code to the URL query string
@@ -44,38 +223,47 @@ sprec_send_audio_data(
 	snprintf(
 		url,
 		sizeof url,
-		"https://www.google.com/speech-api/v2/recognize?output=json&key=%s&lang=%s",
+		SPREC_API_URL "?output=json&key=%s&lang=%s",
 		apikey,
 		language ? language : "en-US"
 	);
 
-	resp = malloc(sizeof *resp);
+	/*
+	 * The response belongs to the thread starting the request,
+	 * even if the transfer is driven by another one
+	 */
+	sprec_get_allocator(&req->transfer.alloc);
+
+	resp = sprec_allocator_malloc(&req->transfer.alloc, sizeof *resp);
 	if (resp == NULL) {
-		return NULL;
+		return -1;
 	}
 
 	resp->data = NULL;
 	resp->length = 0;
+	resp->status = 0;
 
-	conn_hndl = curl_easy_init();
-	if (conn_hndl == NULL) {
-		sprec_free_response(resp);
-		return NULL;
+	req->transfer.resp = resp;
+	sprec_parser_init(&req->transfer.parser, &resp->result);
+
+	req->conn_hndl = curl_easy_init();
+	if (req->conn_hndl == NULL) {
+		sprec_transfer_discard(&req->transfer);
+		return -1;
 	}
 
-	form = NULL;
 	lastptr = NULL;
-	headers = NULL;
 	snprintf(
 		header,
 		sizeof header,
-		"Content-Type: audio/x-flac; rate=%" PRIu32,
+		"Content-Type: %s; rate=%" PRIu32,
+		encoding == SPREC_ENCODING_L16 ? "audio/l16" : "audio/x-flac",
 		sample_rate
 	);
-	headers = curl_slist_append(headers, header);
+	req->headers = curl_slist_append(req->headers, header);
 
 	curl_formadd(
-		&form,
+		&req->form,
 		&lastptr,
 		CURLFORM_COPYNAME,
 		"myfile",
@@ -89,55 +277,405 @@ sprec_send_audio_data(
 	/*
 	 * Setup the cURL handle
 	 */
-	curl_easy_setopt(conn_hndl, CURLOPT_URL, url);
-	curl_easy_setopt(conn_hndl, CURLOPT_HTTPHEADER, headers);
-	curl_easy_setopt(conn_hndl, CURLOPT_HTTPPOST, form);
-	curl_easy_setopt(conn_hndl, CURLOPT_WRITEFUNCTION, http_callback);
-	curl_easy_setopt(conn_hndl, CURLOPT_WRITEDATA, resp);
+	curl_easy_setopt(req->conn_hndl, CURLOPT_URL, url);
+	curl_easy_setopt(req->conn_hndl, CURLOPT_HTTPHEADER, req->headers);
+	curl_easy_setopt(req->conn_hndl, CURLOPT_HTTPPOST, req->form);
+	curl_easy_setopt(req->conn_hndl, CURLOPT_WRITEFUNCTION, http_callback);
+	curl_easy_setopt(req->conn_hndl, CURLOPT_WRITEDATA, &req->transfer);
+
+	/*
+	 * Notes when the upload is over, which tells the
+	 * bandwidth apart from the processing time of the API
+	 */
+#if LIBCURL_VERSION_NUM >= 0x072000
+	curl_easy_setopt(req->conn_hndl, CURLOPT_XFERINFOFUNCTION, sprec_progress_callback);
+	curl_easy_setopt(req->conn_hndl, CURLOPT_XFERINFODATA, req);
+	curl_easy_setopt(req->conn_hndl, CURLOPT_NOPROGRESS, 0L);
+#endif
 
 	/*
 	 * SSL certificates are not available on iOS, so we have to trust Google
 	 * (0 means false)
 	 */
-	curl_easy_setopt(conn_hndl, CURLOPT_SSL_VERIFYPEER, 0);
+	curl_easy_setopt(req->conn_hndl, CURLOPT_SSL_VERIFYPEER, 0);
+
+	req->started = sprec_clock_now();
+
+	return 0;
+}
+
+sprec_server_response *sprec_request_finish(sprec_request *req)
+{
+	sprec_server_response *resp = req->transfer.resp;
+
+	req->finished = sprec_clock_now();
+
+	if (req->done && req->result == CURLE_OK) {
+		curl_easy_getinfo(req->conn_hndl, CURLINFO_RESPONSE_CODE, &resp->status);
+	}
 
 	/*
-	 * Initiate the HTTP(S) transfer
+	 * Clean up
 	 */
-	curl_easy_perform(conn_hndl);
+	curl_formfree(req->form);
+	curl_slist_free_all(req->headers);
+	curl_easy_cleanup(req->conn_hndl);
+
+	if (!req->done || req->result != CURLE_OK) {
+		sprec_transfer_discard(&req->transfer);
+		return NULL;
+	}
 
 	/*
-	 * Clean up
+	 * An empty body is still a valid (if useless) response
 	 */
-	curl_formfree(form);
-	curl_slist_free_all(headers);
-	curl_easy_cleanup(conn_hndl);
+	if (resp->data == NULL) {
+		resp->data = sprec_allocator_malloc(&req->transfer.alloc, 1);
+		if (resp->data == NULL) {
+			sprec_transfer_discard(&req->transfer);
+			return NULL;
+		}
+	}
 
 	/*
 	 * NULL-terminate the JSON response string
 	 */
 	resp->data[resp->length] = '\0';
+	sprec_parser_finish(&req->transfer.parser);
+
+	if (resp->status >= 200 && resp->status < 300) {
+		sprec_latency_record(sprec_clock_now() - req->started);
+	}
 
 	return resp;
 }
 
-void sprec_free_response(sprec_server_response *resp)
+static sprec_server_response *sprec_send_once(
+	const void *data,
+	size_t length,
+	const char *apikey,
+	const char *language,
+	uint32_t sample_rate,
+	const sprec_send_options *opts
+)
 {
-	if (resp) {
-		free(resp->data);
-		free(resp);
+	sprec_server_response *resp;
+	sprec_request req;
+
+	if (sprec_request_init_ex(&req, data, length, apikey, language, sample_rate, opts->encoding) != 0) {
+		return NULL;
+	}
+
+	sprec_request_share(&req);
+
+	/*
+	 * Initiate the HTTP(S) transfer
+	 */
+	req.result = curl_easy_perform(req.conn_hndl);
+	req.done = 1;
+
+	resp = sprec_request_finish(&req);
+	sprec_request_stats(&req, length, opts->stats);
+
+	if (resp != NULL) {
+		sprec_connection_used();
+	}
+
+	return resp;
+}
+
+/*
+ * Sends the request, then sends it again if no answer arrived within
+ * `delay' seconds, and takes whichever successful response comes first.
+ */
+static sprec_server_response *sprec_send_hedged(
+	const void *data,
+	size_t length,
+	const char *apikey,
+	const char *language,
+	uint32_t sample_rate,
+	double delay,
+	const sprec_send_options *opts
+)
+{
+	sprec_request reqs[2];
+	sprec_server_response *resp = NULL;
+	CURLM *multi;
+	CURLMsg *msg;
+	int running, left, i, n, winner = -1;
+	int timeout_ms;
+	double now, remaining;
+	long status;
+
+	multi = curl_multi_init();
+	if (multi == NULL) {
+		return NULL;
+	}
+
+	if (sprec_request_init_ex(&reqs[0], data, length, apikey, language, sample_rate, opts->encoding) != 0) {
+		curl_multi_cleanup(multi);
+		return NULL;
+	}
+
+	sprec_request_share(&reqs[0]);
+	curl_multi_add_handle(multi, reqs[0].conn_hndl);
+	n = 1;
+
+	for (;;) {
+		curl_multi_perform(multi, &running);
+
+		while ((msg = curl_multi_info_read(multi, &left)) != NULL) {
+			if (msg->msg != CURLMSG_DONE) {
+				continue;
+			}
+
+			for (i = 0; i < n; i++) {
+				if (reqs[i].conn_hndl != msg->easy_handle) {
+					continue;
+				}
+
+				reqs[i].done = 1;
+				reqs[i].result = msg->data.result;
+
+				status = 0;
+				curl_easy_getinfo(reqs[i].conn_hndl, CURLINFO_RESPONSE_CODE, &status);
+				if (winner < 0 && reqs[i].result == CURLE_OK && !sprec_status_is_retryable(status)) {
+					winner = i;
+				}
+			}
+		}
+
+		if (winner >= 0 || running == 0) {
+			/*
+			 * Either there is a good response, or every request
+			 * has failed -- unless the backup hasn't even started
+			 * yet, which isn't worth doing after a failure of the
+			 * first one anyway; that's what retries are for.
+			 */
+			break;
+		}
+
+		now = sprec_clock_now();
+		if (n == 1 && now - reqs[0].started >= delay) {
+			if (sprec_request_init_ex(&reqs[1], data, length, apikey, language, sample_rate, opts->encoding) == 0) {
+				sprec_request_share(&reqs[1]);
+				curl_multi_add_handle(multi, reqs[1].conn_hndl);
+				n = 2;
+			} else {
+				/* don't try again */
+				delay = HUGE_VAL;
+			}
+		}
+
+		/*
+		 * Wake up in time to start the backup request
+		 */
+		timeout_ms = 1000;
+		if (n == 1) {
+			remaining = delay - (now - reqs[0].started);
+			if (remaining < 1.0) {
+				timeout_ms = (int)(remaining * 1000) + 1;
+			}
+		}
+
+		curl_multi_wait(multi, NULL, 0, timeout_ms, NULL);
 	}
+
+	/*
+	 * Without a clear winner, fall back to any completed transfer,
+	 * so that the caller can see the (retryable) status code
+	 */
+	for (i = 0; winner < 0 && i < n; i++) {
+		if (reqs[i].done && reqs[i].result == CURLE_OK) {
+			winner = i;
+		}
+	}
+
+	for (i = 0; i < n; i++) {
+		curl_multi_remove_handle(multi, reqs[i].conn_hndl);
+
+		if (i == winner) {
+			resp = sprec_request_finish(&reqs[i]);
+			sprec_request_stats(&reqs[i], length, opts->stats);
+		} else {
+			/* abandon the loser */
+			reqs[i].done = 0;
+			sprec_request_finish(&reqs[i]);
+		}
+	}
+
+	curl_multi_cleanup(multi);
+
+	if (resp != NULL) {
+		sprec_connection_used();
+	}
+
+	return resp;
+}
+
+void sprec_request_stats(const sprec_request *req, size_t length, sprec_send_stats *stats)
+{
+	if (stats == NULL) {
+		return;
+	}
+
+	stats->bytes = length;
+	stats->upload_time = req->uploaded > 0 ? req->uploaded - req->started : 0;
+	stats->total_time = req->finished - req->started;
+}
+
+int sprec_http2_available(void)
+{
+#ifdef CURL_VERSION_HTTP2
+	curl_version_info_data *info = curl_version_info(CURLVERSION_NOW);
+
+	return (info->features & CURL_VERSION_HTTP2) != 0;
+#else
+	return 0;
+#endif
+}
+
+/*
+ * The options below appeared in libcurl 7.43.0 (multiplexing),
+ * 7.47.0 (HTTP/2 over TLS only) and 7.67.0 (streams per connection).
+ * With older versions, the requests simply use HTTP/1.1.
+ */
+void sprec_request_use_http2(sprec_request *req)
+{
+#if LIBCURL_VERSION_NUM >= 0x072f00
+	if (sprec_http2_available()) {
+		curl_easy_setopt(req->conn_hndl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+	}
+#endif
+#if LIBCURL_VERSION_NUM >= 0x072b00
+	curl_easy_setopt(req->conn_hndl, CURLOPT_PIPEWAIT, 1L);
+#endif
+}
+
+void sprec_multi_use_http2(CURLM *multi, long max_streams, long max_connections)
+{
+#if LIBCURL_VERSION_NUM >= 0x072b00
+	curl_multi_setopt(multi, CURLMOPT_PIPELINING, (long)CURLPIPE_MULTIPLEX);
+#endif
+#if LIBCURL_VERSION_NUM >= 0x074300
+	if (max_streams > 0) {
+		curl_multi_setopt(multi, CURLMOPT_MAX_CONCURRENT_STREAMS, max_streams);
+	}
+#endif
+	if (max_connections > 0) {
+		curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, max_connections);
+	}
+}
+
+/*
+ * Transport errors (reported as status 0), throttling
+ * and server-side errors are worth retrying
+ */
+int sprec_status_is_retryable(long status)
+{
+	return status == 0 || status == 408 || status == 429 || status >= 500;
+}
+
+/*
+ * Exponential back-off with "full jitter": a uniformly random
+ * delay between 0 and base * 2^attempt, capped at max_delay
+ */
+static double sprec_backoff_delay(const sprec_send_options *opts, unsigned attempt, unsigned *seed)
+{
+	double cap = opts->base_delay;
+	unsigned i;
+
+	for (i = 0; i < attempt && cap < opts->max_delay; i++) {
+		cap *= 2;
+	}
+
+	if (cap > opts->max_delay) {
+		cap = opts->max_delay;
+	}
+
+	/* xorshift32 */
+	*seed ^= *seed << 13;
+	*seed ^= *seed >> 17;
+	*seed ^= *seed << 5;
+
+	return cap * (*seed / 4294967296.0);
+}
+
+/*
+ * The blocking requests reuse the connections (and DNS lookups and TLS
+ * sessions) of each other and of sprec_warm_up(), if sprec_init() was
+ * called. The pool and the event-driven client have caches of their own.
+ */
+static void sprec_request_share(sprec_request *req)
+{
+	CURLSH *share = sprec_curl_share();
+
+	if (share != NULL) {
+		curl_easy_setopt(req->conn_hndl, CURLOPT_SHARE, share);
+	}
+}
+
+static void sprec_latency_record(double latency)
+{
+	pthread_mutex_lock(&sprec_latencies.lock);
+
+	sprec_latencies.samples[sprec_latencies.next] = latency;
+	sprec_latencies.next = (sprec_latencies.next + 1) % LATENCY_WINDOW;
+	if (sprec_latencies.count < LATENCY_WINDOW) {
+		sprec_latencies.count++;
+	}
+
+	pthread_mutex_unlock(&sprec_latencies.lock);
 }
 
 static size_t http_callback(char *ptr, size_t count, size_t blocksize, void *userdata)
 {
-	sprec_server_response *response = userdata;
+	sprec_transfer *transfer = userdata;
+	sprec_server_response *response = transfer->resp;
 	size_t size = count * blocksize;
+	char *tmp;
 
 	// +1 for terminating NUL byte
-	response->data = realloc(response->data, response->length + size + 1);
+	tmp = sprec_allocator_realloc(&transfer->alloc, response->data, response->length + size + 1);
+	if (tmp == NULL) {
+		/* makes libcurl abort the transfer */
+		return 0;
+	}
+
+	response->data = tmp;
 	memcpy(response->data + response->length, ptr, size);
 	response->length += size;
 
+	/*
+	 * Parse the JSON as it arrives so that callers
+	 * needn't re-scan the whole response afterwards.
+	 * A malformed response leaves the result partially
+	 * filled, but the raw data is still available.
+	 */
+	sprec_parser_feed(&transfer->parser, ptr, size);
+
 	return size;
 }
+
+/*
+ * Frees the response of a failed transfer
+ */
+static void sprec_transfer_discard(sprec_transfer *transfer)
+{
+	sprec_allocator_free(&transfer->alloc, transfer->resp->data);
+	sprec_allocator_free(&transfer->alloc, transfer->resp);
+	transfer->resp = NULL;
+}
+
+#if LIBCURL_VERSION_NUM >= 0x072000
+static int sprec_progress_callback(void *userdata, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow)
+{
+	sprec_request *req = userdata;
+
+	if (req->uploaded == 0 && ultotal > 0 && ulnow >= ultotal) {
+		req->uploaded = sprec_clock_now();
+	}
+
+	return 0;
+}
+#endif